@@ -0,0 +1,292 @@
+#ifndef ESEOPL3_H
+#define ESEOPL3_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * libeseopl3: YM2413 / YM3812 / YM3526 / Y8950 VGM -> YMF262 (OPL3) VGM converter.
+ *
+ *   ESEOPL3Options opts;
+ *   eseopl3_options_init(&opts);
+ *   ESEOPL3Context *p_ctx = eseopl3_create(&opts);
+ *   while (more input)  { eseopl3_push(p_ctx, chunk, len);  drain with eseopl3_pull(); }
+ *   eseopl3_finalize(p_ctx, &result);                      drain with eseopl3_pull();
+ *   file = result.p_header + pulled data + result.p_gd3
+ *
+ * push() は任意の長さのチャンクを受け付け、完結したコマンドから順に変換する。
+ * pull() は変換済みの音楽データ (ヘッダの後ろに置くバイト列) を取り出す。
+ * ヘッダは総サンプル数・ループ位置・GD3 位置が確定する finalize() で返るので、
+ * 逐次書き出す場合は eseopl3_header_size() 分を空けておき最後に書き戻す。
+ *
+ * 次のモードは曲全体が揃ってから変換するため、pull() は finalize() まで 0 を返す:
+ * 2xYM2413 / --fm-mix (複数ソースの合成)、チェックポイント (入力全体のハッシュ)。
+ *
+ * コンテキストは互いに独立しており、別スレッドで並行に使える
+ * (1 コンテキストを複数スレッドから同時に触るのは不可)。
+ */
+
+typedef struct ESEOPL3Context ESEOPL3Context;
+
+/** Source chip selection (ESEOPL3Options.convert_mask); 0 = OPL-family auto-detection. */
+enum {
+    ESEOPL3_CONVERT_YM2413 = 1 << 0,
+    ESEOPL3_CONVERT_YM3812 = 1 << 1,
+    ESEOPL3_CONVERT_YM3526 = 1 << 2,
+    ESEOPL3_CONVERT_Y8950  = 1 << 3
+};
+
+/**
+ * Memory for everything a context allocates (ESEOPL3Options.p_allocator).
+ * fn is one realloc-like entry point: p_ptr NULL allocates, new_size 0 frees, otherwise
+ * resize. old_size is the size p_ptr was obtained with. It is only called from the thread
+ * that drives the context, and must stay valid until eseopl3_destroy().
+ */
+typedef struct ESEOPL3Allocator {
+    void *(*fn)(void *p_user, void *p_ptr, size_t old_size, size_t new_size);
+    void  *p_user;
+} ESEOPL3Allocator;
+
+/**
+ * Conversion options (the CLI flags). Start from eseopl3_options_init().
+ * String fields are borrowed and must stay valid until eseopl3_destroy().
+ */
+typedef struct ESEOPL3Options {
+    double      detune;                     /* port1 chorus detune (%) */
+    double      detune_limit;
+    int         keyon_wait;
+    int         ch_panning;
+    double      v_ratio0;
+    double      v_ratio1;
+    bool        carrier_tl_clamp_enabled;
+    uint8_t     carrier_tl_clamp;
+    int         emergency_boost_steps;
+    bool        force_retrigger_each_note;
+    bool        keep_source_vgm;
+    bool        msx_audio;
+    bool        moon;
+    const char *preset;                     /* "YM2413", "VRC7", "YMF281B", "YM2423" */
+    const char *preset_source;              /* "YMVOICE", "YMFM", "EXPERIMENT" */
+    uint16_t    min_gate_samples;           /* key timing limits: 0 = off, non-zero implies keyon_coalesce */
+    uint16_t    pre_keyon_wait_samples;
+    uint16_t    min_off_on_wait_samples;
+    uint16_t    keyon_coalesce_samples;
+    bool        keyon_coalesce;             /* hold partial 1n/2n/3n writes (off = direct) */
+    bool        strip_unused_chip_clocks;
+    uint32_t    opl3_clock;                 /* 0 = keep */
+    unsigned    convert_mask;               /* ESEOPL3_CONVERT_* */
+    bool        strip_non_opl;
+    bool        test_tone;
+    bool        fast_attack;
+    bool        no_post_keyon_tl;
+    bool        single_port;
+    bool        audible_sanity;
+    bool        verbose;
+    uint64_t    range_start;                /* samples; 0/0 = whole song */
+    uint64_t    range_end;
+    uint64_t    checkpoint_every;           /* samples; 0 = off */
+    const char *checkpoint_path;            /* explicit sidecar path (NULL = "<output_path>.ckpt") */
+    const char *output_path;                /* only used to name the default sidecar */
+    bool        resume;
+    bool        dual_opl3;
+    bool        fm_mix;
+    const char *override_path;              /* voice override INI (NULL = none) */
+    const char *voice_bank_path;            /* mapped (created on first use) preset voice bank (NULL = in memory) */
+    const char *creator;                    /* appended to the GD3 creator field */
+    const char *metrics_path;               /* counters and note timing written at finalize (NULL = off) */
+    bool        profile;                    /* stage timers and allocation counts (eseopl3_profile) */
+    const char *trace_path;                 /* binary debug trace (NULL = off; eseopl3_trace_decode) */
+    uint32_t    trace_ring;                 /* 0 = every record to trace_path; n = keep only the last n */
+    const ESEOPL3Allocator *p_allocator;    /* NULL = malloc (see eseopl3_arena_allocator) */
+} ESEOPL3Options;
+
+/** Header and GD3 fix-ups returned by eseopl3_finalize(); owned by the context. */
+typedef struct ESEOPL3Result {
+    const uint8_t *p_header;        /* write at file offset 0 */
+    uint32_t       header_size;
+    const uint8_t *p_gd3;           /* append after the music data */
+    uint32_t       gd3_size;
+    uint32_t       data_size;       /* total bytes delivered by eseopl3_pull() */
+    uint32_t       total_samples;
+    const char    *p_source_chip;   /* "YM2413", "YM3812", ... */
+    const char    *p_preset;        /* decoded preset names (YM2413 sources) */
+    const char    *p_preset_source;
+    bool           is_ym2413;
+    int            voice_count;     /* distinct OPL3 voices seen */
+} ESEOPL3Result;
+
+/** Fill p_opts with the CLI defaults. */
+void eseopl3_options_init(ESEOPL3Options *p_opts);
+
+/** Returns NULL on failure (e.g. a malformed override file; the reason is printed to stderr). */
+ESEOPL3Context *eseopl3_create(const ESEOPL3Options *p_opts);
+
+/** Consume the next len bytes of the input VGM. Returns 0, or -1 once the input is rejected. */
+int    eseopl3_push(ESEOPL3Context *p_ctx, const void *p_data, size_t len);
+
+/** Copy up to cap converted bytes into p_out; returns the byte count (0 = nothing pending). */
+size_t eseopl3_pull(ESEOPL3Context *p_ctx, void *p_out, size_t cap);
+
+/** Bytes pull() would return right now. */
+size_t eseopl3_pending(const ESEOPL3Context *p_ctx);
+
+/** Output header size, known once the input header has been pushed (0 before). */
+uint32_t eseopl3_header_size(const ESEOPL3Context *p_ctx);
+
+/**
+ * End of input: convert what is left, build the header and GD3 chunk.
+ * Drain pull() afterwards for the rest of the music data. Returns 0, or -1 on error.
+ */
+int    eseopl3_finalize(ESEOPL3Context *p_ctx, ESEOPL3Result *p_res);
+
+void   eseopl3_destroy(ESEOPL3Context *p_ctx);
+
+/**
+ * Variant matrix: convert one whole input with several option sets in a single pass.
+ * The input is parsed once into the command IR (one event per VGM command), and the
+ * converters of all contexts advance over the shared IR in lockstep. pp_ctxs are fresh contexts from
+ * eseopl3_create() (nothing pushed); each ends up finalized as by push + finalize,
+ * with its result in p_results[i] (p_header NULL if that variant failed) and the music
+ * data ready for pull(). p_input is only read during the call.
+ * Returns the number of contexts that failed.
+ */
+int    eseopl3_convert_variants(ESEOPL3Context *const *pp_ctxs, int count, const void *p_input, size_t size,
+                                ESEOPL3Result *p_results);
+
+/** Conversion stages timed with ESEOPL3Options.profile. */
+enum {
+    ESEOPL3_STAGE_PARSE = 0,        /* header, IR lowering */
+    ESEOPL3_STAGE_CONVERT,          /* command dispatch, waits, other chips, checkpoints */
+    ESEOPL3_STAGE_YM2413,           /* YM2413 handler and scheduler */
+    ESEOPL3_STAGE_OPL3_WRITE,       /* duplicate_write_opl3 (OPL3 register writes, chorus, mirroring) */
+    ESEOPL3_STAGE_MERGE,            /* 2xYM2413 / --fm-mix */
+    ESEOPL3_STAGE_GD3,
+    ESEOPL3_STAGE_HEADER,
+    ESEOPL3_NUM_STAGES
+};
+
+/**
+ * Where a conversion spent its time. Stage times are exclusive (the OPL3 writes made
+ * by the YM2413 handler count only as opl3_write), so they add up to the time spent
+ * inside push / finalize. Allocations are those of the context after its creation.
+ */
+typedef struct ESEOPL3Profile {
+    uint64_t stage_ns[ESEOPL3_NUM_STAGES];
+    uint64_t stage_calls[ESEOPL3_NUM_STAGES];
+    uint64_t input_bytes;
+    uint64_t output_bytes;          /* header + music data + GD3 */
+    uint64_t commands;              /* input commands converted */
+    uint64_t total_samples;
+    uint64_t allocs;
+    uint64_t reallocs;
+    uint64_t frees;
+    uint64_t alloc_bytes;           /* requested by allocations and growth */
+    uint64_t peak_bytes;            /* most bytes held at once */
+} ESEOPL3Profile;
+
+/** After finalize(). Returns 0, or -1 if the context was not created with opts.profile. */
+int    eseopl3_profile(const ESEOPL3Context *p_ctx, ESEOPL3Profile *p_prof);
+
+/** "parse", "convert", ... for an ESEOPL3_STAGE_* value. */
+const char *eseopl3_stage_name(int stage);
+
+/**
+ * Render a trace file (ESEOPL3Options.trace_path) as the -verbose text to p_out_path
+ * (NULL = stdout). Returns 0, or -1 if it cannot be read or written.
+ */
+int    eseopl3_trace_decode(const char *p_path, const char *p_out_path);
+
+/*
+ * Job arena: a bump allocator for ESEOPL3Options.p_allocator.
+ *
+ * 1 ジョブ分 (create から destroy まで) の確保をすべてアリーナから切り出し、
+ * ジョブが終わったら eseopl3_arena_reset() で一度に捨てる。reset はメモリを
+ * 1 ブロックにまとめて持ち続けるので、同じ程度の大きさのジョブを繰り返す
+ * バッチやサーバーのワーカーでは、2 ジョブ目以降ヒープを呼ばず断片化もしない。
+ * スレッドセーフではない: ワーカーごとに 1 つ持つ。
+ */
+typedef struct ESEOPL3Arena ESEOPL3Arena;
+
+ESEOPL3Arena *eseopl3_arena_create(void);
+
+/** Allocator to put in ESEOPL3Options.p_allocator; valid until eseopl3_arena_destroy(). */
+const ESEOPL3Allocator *eseopl3_arena_allocator(ESEOPL3Arena *p_arena);
+
+/** End of a job: every context using the arena must have been destroyed. Keeps the memory. */
+void   eseopl3_arena_reset(ESEOPL3Arena *p_arena);
+
+/** Bytes held by the arena, and how many times it has gone to the heap since creation. */
+size_t eseopl3_arena_reserved(const ESEOPL3Arena *p_arena);
+size_t eseopl3_arena_heap_calls(const ESEOPL3Arena *p_arena);
+
+void   eseopl3_arena_destroy(ESEOPL3Arena *p_arena);
+
+/** Length of a cache key (hex digits, without the terminating NUL). */
+#define ESEOPL3_CACHE_KEY_CHARS 40
+
+/**
+ * Content address of one conversion: the input bytes, every option that changes the output
+ * (override file by content, not by path) and the converter version. Equal keys mean
+ * byte-identical output, so a stored result can be reused without converting.
+ * p_key receives ESEOPL3_CACHE_KEY_CHARS + 1 bytes. Returns 0, or -1 if the override file cannot be loaded.
+ */
+int    eseopl3_cache_key(const ESEOPL3Options *p_opts, const void *p_input, size_t input_size, char *p_key);
+
+/*
+ * Real-time bridge: YM2413 register writes in, OPL3 register writes out.
+ *
+ * 変換スレッド (producer) が eseopl3_bridge_write() でタイムスタンプ付きの
+ * YM2413 書き込みを渡し、再生スレッド (consumer) が eseopl3_bridge_pop() で
+ * OPL3 書き込みを受け取る。間は lock-free の SPSC リングで、write() の経路は
+ * メモリ確保をしない。リングが満杯なら OPL3 書き込みは捨てて overflows に数える
+ * (producer は待たない)。
+ * sample は 44.1 kHz の絶対位置。write/advance/finish は producer、pop は consumer、
+ * stats は producer と consumer の両方が止まってから呼ぶ。
+ * 保持中のバースト (keyon_coalesce) は時間が進むと出てくるので、リアルタイムの
+ * producer は書き込みが途切れている間も advance() を周期的 (1 ms 程度) に呼ぶ。
+ */
+
+typedef struct ESEOPL3Bridge ESEOPL3Bridge;
+
+typedef struct ESEOPL3Write {
+    uint32_t sample;                /* output timeline position */
+    uint8_t  port;                  /* 0 / 1 */
+    uint8_t  reg;
+    uint8_t  val;
+} ESEOPL3Write;
+
+typedef struct ESEOPL3BridgeStats {
+    uint64_t writes;                /* YM2413 writes handled */
+    uint64_t opl3_writes;           /* OPL3 writes queued */
+    uint64_t overflows;             /* OPL3 writes dropped on a full ring */
+    uint64_t late;                  /* timestamps that went backwards (taken as "now") */
+    uint64_t popped;                /* OPL3 writes taken by the consumer */
+    uint64_t total_ns;              /* queueing latency per OPL3 write: pushed -> popped */
+    uint32_t max_ns;
+    uint32_t hist[32];              /* bucket k = [2^k, 2^(k+1)) ns */
+} ESEOPL3BridgeStats;
+
+/** ring_capacity OPL3 writes (rounded up to a power of two; 0 = 4096). NULL on failure. */
+ESEOPL3Bridge *eseopl3_bridge_create(const ESEOPL3Options *p_opts, uint32_t ring_capacity);
+void   eseopl3_bridge_write(ESEOPL3Bridge *p_br, uint32_t sample, uint8_t reg, uint8_t val);
+/** No write until `sample`: release held notes that are due (call periodically while the input is quiet). */
+void   eseopl3_bridge_advance(ESEOPL3Bridge *p_br, uint32_t sample);
+/** End of the YM2413 stream. */
+void   eseopl3_bridge_finish(ESEOPL3Bridge *p_br);
+/** Producer: free slots in the ring (a file-fed producer can wait on this; a real-time one should not). */
+size_t eseopl3_bridge_space(const ESEOPL3Bridge *p_br);
+/** Consumer: take up to max queued writes, oldest first. */
+size_t eseopl3_bridge_pop(ESEOPL3Bridge *p_br, ESEOPL3Write *p_out, size_t max);
+void   eseopl3_bridge_stats(const ESEOPL3Bridge *p_br, ESEOPL3BridgeStats *p_stats);
+void   eseopl3_bridge_destroy(ESEOPL3Bridge *p_br);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESEOPL3_H */
@@ -2,7 +2,7 @@ import os
 import glob
 import sys
 
-def main(input_dir):
+def main(input_dir, cache_dir=None, use_variants=False):
     # Find all files matching *OPLL.vgm in input_dir
     input_files = sorted(glob.glob(os.path.join(input_dir, "*OPLL.vgm")))
     if not input_files:
@@ -49,19 +49,42 @@ def main(input_dir):
             else:
                 base_no_ext = os.path.splitext(basename)[0]
 
+            cache_opt = f' --cache "{cache_dir}"' if cache_dir else ''
+            if use_variants:
+                # 1 曲 1 コマンド: 入力を 1 回だけ解析して全パターンを出力する
+                cmd = f'./build/eseopl3patcher "{input_path}" 100 -ch_panning 1 -detune_limit 4{cache_opt}'
             for out_subdir, out_suffix, preset_opt in outputs:
                 out_dir = os.path.join(dirpath, out_subdir)
                 os.makedirs(out_dir, exist_ok=True)
                 out_filename = base_no_ext + out_suffix
                 out_path = os.path.join(out_dir, out_filename)
+                if use_variants:
+                    cmd += f' --variant -o "{out_path}" {preset_opt}'
+                    continue
                 cmd = f'./build/eseopl3patcher "{input_path}" 100 -o "{out_path}" -ch_panning 1 -detune_limit 4 {preset_opt}'
+                # 入力とオプションが前回と同じなら変換せずにキャッシュからコピーされる
+                f.write(cmd + cache_opt + "\n")
+            if use_variants:
                 f.write(cmd + "\n")
 
-    print(f"Batch file '{batch_filename}' created with {len(input_files)*len(outputs)} commands.")
+    commands = len(input_files) if use_variants else len(input_files) * len(outputs)
+    print(f"Batch file '{batch_filename}' created with {commands} commands.")
 
 if __name__ == "__main__":
-    if len(sys.argv) < 2:
-        print("Usage: python make_batch_from_vgm.py <input_dir>")
+    args = sys.argv[1:]
+    cache_dir = None
+    use_variants = "--variants" in args
+    if use_variants:
+        args.remove("--variants")
+    if "--cache" in args:
+        i = args.index("--cache")
+        if i + 1 >= len(args):
+            print("Usage: python make_batch_from_vgm.py <input_dir> [--cache <dir>] [--variants]")
+            sys.exit(1)
+        cache_dir = args[i + 1]
+        del args[i:i + 2]
+    if len(args) < 1:
+        print("Usage: python make_batch_from_vgm.py <input_dir> [--cache <dir>] [--variants]")
         sys.exit(1)
-    input_dir = sys.argv[1]
-    main(input_dir)
+    input_dir = args[0]
+    main(input_dir, cache_dir, use_variants)
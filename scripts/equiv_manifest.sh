@@ -0,0 +1,39 @@
+# tests/equiv/manifest.txt の読み込み (test_vgm_equiv.sh / test_keyon_edges.sh / test_seek_resume.sh から source)
+#
+# 1 行 1 エントリ: "<input.vgm> [converter options...]"  ('#' 以降の行と空行は無視)
+# ベースライン/キーオン基準のファイル名 (stem) は入力の stem にオプションを連結したもの:
+#   ym2413_retrigger.vgm                      -> ym2413_retrigger
+#   ym2413_retrigger.vgm --keyon-coalesce 32  -> ym2413_retrigger_keyon-coalesce32
+
+# ENTRIES に manifest のエントリを読み込む
+load_manifest () {
+  mapfile -t ENTRIES < <(grep -v '^[[:space:]]*#' "$1" | sed '/^[[:space:]]*$/d')
+}
+
+# <entry> -> 入力ファイル名
+entry_input () {
+  set -- $1
+  echo "$1"
+}
+
+# <entry> -> コンバータに渡すオプション
+entry_opts () {
+  set -- $1
+  shift
+  echo "$*"
+}
+
+# <entry> -> 出力ファイル名の stem
+entry_stem () {
+  set -- $1
+  local stem="${1%.vgm}"
+  shift
+  for w in "$@"; do
+    case "$w" in
+      --*) stem="${stem}_${w#--}" ;;
+      -*)  stem="${stem}_${w#-}" ;;
+      *)   stem="${stem}${w}" ;;
+    esac
+  done
+  echo "$stem"
+}
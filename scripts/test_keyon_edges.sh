@@ -0,0 +1,86 @@
+#!/usr/bin/env bash
+# Key-on timing test: the key-on edges (sample, chip, port, ch) of every manifest entry
+# must match tests/equiv/keyon/<stem>.txt both with --convert-ym2413 and with autodetect
+# (entry options are passed in both modes; stem: scripts/equiv_manifest.sh).
+#
+# Usage:
+#   scripts/test_keyon_edges.sh <converter_binary> [--update-baseline]
+#
+# 環境変数:
+#   DETUNE=0
+#
+# Exit codes:
+#   0: 正常 (差分なし)
+#   1: 差分あり
+#   2: セットアップ/引数エラー
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+REPO_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
+cd "$REPO_ROOT"
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 <converter_binary> [--update-baseline]" >&2
+  exit 2
+fi
+
+CONV="$1"; shift || true
+MODE="normal"
+[ "${1:-}" = "--update-baseline" ] && MODE="update"
+
+if [ ! -x "$CONV" ]; then
+  echo "[ERROR] Converter not found or not executable: $CONV" >&2
+  exit 2
+fi
+
+DETUNE="${DETUNE:-0}"
+EQUIV_DIR="tests/equiv"
+MANIFEST="$EQUIV_DIR/manifest.txt"
+INPUT_DIR="$EQUIV_DIR/inputs"
+KEYON_DIR="$EQUIV_DIR/keyon"
+WORK_DIR="$EQUIV_DIR/out_new"
+EDGES="python3 $SCRIPT_DIR/vgm_keyon_edges.py"
+mkdir -p "$KEYON_DIR" "$WORK_DIR"
+
+source "$SCRIPT_DIR/equiv_manifest.sh"
+load_manifest "$MANIFEST"
+
+diff_found=0
+for e in "${ENTRIES[@]}"; do
+  f="$(entry_input "$e")"
+  stem="$(entry_stem "$e")"
+  ref="$KEYON_DIR/${stem}.txt"
+  for mode in autodetect convert; do
+    args="$(entry_opts "$e")"
+    [ "$mode" = "convert" ] && args="--convert-ym2413 $args"
+    out="$WORK_DIR/${stem}_keyon_${mode}.vgm"
+    if ! "$CONV" "$INPUT_DIR/$f" "$DETUNE" $args -o "$out" >/dev/null 2>&1; then
+      echo "[ERROR] Converter failed for $e ($mode)" >&2
+      exit 2
+    fi
+    if [ "$MODE" = "update" ] && [ "$mode" = "autodetect" ]; then
+      $EDGES "$out" > "$ref"
+      echo "[OK] Generated baseline: ${stem}.txt ($(wc -l < "$ref") key-ons)"
+    fi
+    if [ ! -f "$ref" ]; then
+      echo "[WARN] Missing baseline for $e"
+      diff_found=1
+      continue
+    fi
+    if ! $EDGES "$out" | diff -u "$ref" - > "$WORK_DIR/${stem}_keyon_${mode}.diff"; then
+      echo "[DIFF] $e ($mode)"
+      head -n 20 "$WORK_DIR/${stem}_keyon_${mode}.diff"
+      diff_found=1
+    else
+      echo "[OK]  $e ($mode)"
+    fi
+  done
+done
+
+if [ $diff_found -eq 0 ]; then
+  echo "[RESULT] ✅ Key-on edges identical."
+  exit 0
+else
+  echo "[RESULT] ❌ Key-on edges differ."
+  exit 1
+fi
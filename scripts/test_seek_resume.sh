@@ -0,0 +1,172 @@
+#!/usr/bin/env bash
+# Seek / checkpoint test for every manifest entry (with its options):
+#   - a run with --checkpoint-every matches a plain run
+#   - --resume from a sidecar cut in the middle of a record matches a plain run
+#   - --start/--end with --checkpoint-file matches the same plain seek
+# plus the time spec check: a bare fractional number ("1.5") is rejected, "1.5s" is not,
+# and a 0x67 data block before --start reaches the output (also when seeking from a checkpoint).
+#
+# Usage:
+#   scripts/test_seek_resume.sh <converter_binary>
+#
+# 環境変数:
+#   DETUNE=0
+#   CKPT_EVERY=22050   (checkpoint interval, samples)
+#
+# Exit codes:
+#   0: 正常 (差分なし)
+#   1: 差分あり
+#   2: セットアップ/引数エラー
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+REPO_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
+cd "$REPO_ROOT"
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 <converter_binary>" >&2
+  exit 2
+fi
+
+CONV="$1"
+if [ ! -x "$CONV" ]; then
+  echo "[ERROR] Converter not found or not executable: $CONV" >&2
+  exit 2
+fi
+
+DETUNE="${DETUNE:-0}"
+CKPT_EVERY="${CKPT_EVERY:-22050}"
+EQUIV_DIR="tests/equiv"
+MANIFEST="$EQUIV_DIR/manifest.txt"
+INPUT_DIR="$EQUIV_DIR/inputs"
+WORK_DIR="$EQUIV_DIR/out_new/seek"
+rm -rf "$WORK_DIR"
+mkdir -p "$WORK_DIR"
+
+source "$SCRIPT_DIR/equiv_manifest.sh"
+load_manifest "$MANIFEST"
+
+diff_found=0
+check_same() {   # <label> <expected> <actual>
+  if cmp -s "$2" "$3"; then
+    echo "[OK]  $1"
+  else
+    echo "[DIFF] $1"
+    diff_found=1
+  fi
+}
+
+run() {   # <input> <output> [options...]   (stderr goes to <output>.log; entry options come first)
+  local in="$1" out="$2"; shift 2
+  if ! "$CONV" "$in" "$DETUNE" -o "$out" $opts "$@" >/dev/null 2>"$out.log"; then
+    echo "[ERROR] Converter failed: $in $*" >&2
+    exit 2
+  fi
+}
+
+used_ckpt() {   # <label> <log> <pattern>: long inputs must really start from a checkpoint
+  if [ "$total" -ge $(( CKPT_EVERY * 4 )) ] && ! grep -q "$3" "$2"; then
+    echo "[DIFF] $1 did not use a checkpoint"
+    diff_found=1
+  fi
+}
+
+for e in "${ENTRIES[@]}"; do
+  f="$(entry_input "$e")"
+  opts="$(entry_opts "$e")"
+  stem="$(entry_stem "$e")"
+  in="$INPUT_DIR/$f"
+  w="$WORK_DIR/$stem"
+  read -r total ym2413_clock < <(python3 -c "import struct,sys; d = open(sys.argv[1],'rb').read(); print(*struct.unpack_from('<I', d, 0x18), *struct.unpack_from('<I', d, 0x10))" "$in")
+  if [ $(( ym2413_clock & 0x40000000 )) -ne 0 ]; then
+    echo "[SKIP] $e (checkpoints do not cover a second YM2413)"
+    continue
+  fi
+
+  run "$in" "$w.plain.vgm"
+  run "$in" "$w.ckpt.vgm" --checkpoint-every "$CKPT_EVERY" --checkpoint-file "$w.ckpt"
+  check_same "$e checkpointed run" "$w.plain.vgm" "$w.ckpt.vgm"
+
+  # Interrupted run: the sidecar ends in the middle of a record
+  cp "$w.ckpt" "$w.cut.ckpt"
+  truncate -s $(( $(stat -c %s "$w.ckpt") / 2 + 7 )) "$w.cut.ckpt"
+  run "$in" "$w.resume.vgm" --checkpoint-every "$CKPT_EVERY" --checkpoint-file "$w.cut.ckpt" --resume
+  check_same "$e resume from a cut sidecar" "$w.plain.vgm" "$w.resume.vgm"
+  used_ckpt "$e resume" "$w.resume.vgm.log" "resumed at"
+
+  start=$(( total / 2 )); end=$(( total * 3 / 4 ))
+  run "$in" "$w.seek.vgm" --start "$start" --end "$end"
+  run "$in" "$w.seek_ckpt.vgm" --start "$start" --end "$end" --checkpoint-file "$w.ckpt" -verbose
+  check_same "$e --start/--end with a checkpoint file" "$w.seek.vgm" "$w.seek_ckpt.vgm"
+  used_ckpt "$e seek" "$w.seek_ckpt.vgm.log" "seek from checkpoint"
+done
+
+# Samples are whole numbers; seconds need the "s"
+opts=""
+in="$INPUT_DIR/$(entry_input "${ENTRIES[0]}")"
+if "$CONV" "$in" "$DETUNE" -o "$WORK_DIR/frac.vgm" --start 1.5 >/dev/null 2>&1; then
+  echo "[DIFF] --start 1.5 was accepted"
+  diff_found=1
+else
+  echo "[OK]  --start 1.5 rejected"
+fi
+run "$in" "$WORK_DIR/frac_s.vgm" --start 1.5s
+run "$in" "$WORK_DIR/frac_samples.vgm" --start 66150
+check_same "--start 1.5s == --start 66150" "$WORK_DIR/frac_samples.vgm" "$WORK_DIR/frac_s.vgm"
+
+# A data block at the top of the data is state, not timing: --start must keep it.
+# The converted data with the block taken out again must equal the same run without it.
+python3 - "$in" "$WORK_DIR/datablock.vgm" <<'PY'
+import struct, sys
+d = bytearray(open(sys.argv[1], 'rb').read())
+ver = struct.unpack_from('<I', d, 0x08)[0]
+rel = struct.unpack_from('<I', d, 0x34)[0] if ver >= 0x150 else 0
+ds = 0x34 + rel if rel else 0x40
+block = bytes([0x67, 0x66, 0x00]) + struct.pack('<I', 16) + bytes(range(0x80, 0x90))
+for off in (0x04, 0x14, 0x1C):
+    v = struct.unpack_from('<I', d, off)[0]
+    if v:
+        struct.pack_into('<I', d, off, v + len(block))
+open(sys.argv[2], 'wb').write(d[:ds] + block + d[ds:])
+PY
+check_block() {   # <label> <with block> <without block>
+  if python3 - "$2" "$3" <<'PY'
+import struct, sys
+def body(path):
+    d = open(path, 'rb').read()
+    rel = struct.unpack_from('<I', d, 0x34)[0]
+    gd3 = struct.unpack_from('<I', d, 0x14)[0]
+    return d[0x34 + rel:(0x14 + gd3) if gd3 else len(d)]
+block = bytes([0x67, 0x66, 0x00]) + struct.pack('<I', 16) + bytes(range(0x80, 0x90))
+a, b = body(sys.argv[1]), body(sys.argv[2])
+sys.exit(0 if a.count(block) == 1 and a.replace(block, b'') == b else 1)
+PY
+  then
+    echo "[OK]  $1"
+  else
+    echo "[DIFF] $1"
+    diff_found=1
+  fi
+}
+opts=""
+read -r total < <(python3 -c "import struct,sys; print(struct.unpack_from('<I', open(sys.argv[1],'rb').read(), 0x18)[0])" "$in")
+start=$(( total / 2 ))
+w="$WORK_DIR/datablock"
+run "$in" "$w.orig_plain.vgm"
+run "$w.vgm" "$w.plain.vgm"
+check_block "data block: plain run" "$w.plain.vgm" "$w.orig_plain.vgm"
+run "$in" "$w.orig_seek.vgm" --start "$start"
+run "$w.vgm" "$w.seek.vgm" --start "$start"
+check_block "data block before --start" "$w.seek.vgm" "$w.orig_seek.vgm"
+run "$w.vgm" "$w.ckpt_run.vgm" --checkpoint-every "$CKPT_EVERY" --checkpoint-file "$w.ckpt"
+run "$w.vgm" "$w.seek_ckpt.vgm" --start "$start" --checkpoint-file "$w.ckpt" -verbose
+check_same "data block before --start, seek from a checkpoint" "$w.seek.vgm" "$w.seek_ckpt.vgm"
+used_ckpt "data block seek" "$w.seek_ckpt.vgm.log" "seek from checkpoint"
+
+if [ $diff_found -eq 0 ]; then
+  echo "[RESULT] ✅ Seek and checkpoint outputs identical."
+  exit 0
+else
+  echo "[RESULT] ❌ Seek and checkpoint outputs differ."
+  exit 1
+fi
@@ -4,6 +4,9 @@
 # Usage:
 #   scripts/test_vgm_equiv.sh <converter_binary> [--init-baseline|--update-baseline]
 #
+# tests/equiv/manifest.txt の各エントリ ("<input.vgm> [options...]") を変換し、
+# tests/equiv/baseline/<stem>OPL3.vgm と比較する (stem は scripts/equiv_manifest.sh)。
+#
 # 環境変数:
 #   DETUNE=0                  # ← デフォルト 0 に変更 (以前 1.0)
 #   EXTRA_ARGS="--convert-ym2413 --strip-non-opl"
@@ -57,14 +60,16 @@ if [ ! -f "$MANIFEST" ]; then
   exit 2
 fi
 
-mapfile -t FILES < <(grep -v '^[[:space:]]*#' "$MANIFEST" | sed '/^[[:space:]]*$/d')
-if [ ${#FILES[@]} -eq 0 ]; then
+source "$SCRIPT_DIR/equiv_manifest.sh"
+load_manifest "$MANIFEST"
+if [ ${#ENTRIES[@]} -eq 0 ]; then
   echo "[ERROR] manifest has no entries" >&2
   exit 2
 fi
 
 missing=0
-for f in "${FILES[@]}"; do
+for e in "${ENTRIES[@]}"; do
+  f="$(entry_input "$e")"
   if [ ! -f "$INPUT_DIR/$f" ]; then
     echo "[ERROR] Missing input: $INPUT_DIR/$f" >&2
     missing=1
@@ -80,8 +85,8 @@ elif [ "$MODE" = "init" ]; then
 fi
 
 need_baseline_gen=0
-for f in "${FILES[@]}"; do
-  base="${f%.vgm}OPL3.vgm"
+for e in "${ENTRIES[@]}"; do
+  base="$(entry_stem "$e")OPL3.vgm"
   if [ ! -f "$BASELINE_DIR/$base" ]; then
     need_baseline_gen=1
     break
@@ -89,11 +94,13 @@ for f in "${FILES[@]}"; do
 done
 
 run_convert () {
-  local in_rel="$1"
+  local entry="$1"
   local out_dir="$2"
   local mode_label="$3"
+  local in_rel="$(entry_input "$entry")"
+  local opts="$(entry_opts "$entry")"
   local in_path="$INPUT_DIR/$in_rel"
-  local stem="${in_rel%.vgm}"
+  local stem="$(entry_stem "$entry")"
   local out_file="${stem}OPL3.vgm"
   local tmp_out="${out_dir}/${stem}.tmp.vgm"
   local final_out="${out_dir}/${out_file}"
@@ -106,8 +113,8 @@ run_convert () {
 
   rm -f "$tmp_out" "$final_out"
 
-  if ! "$CONV" "$in_path" "$DETUNE" $EXTRA_ARGS -o "$tmp_out" >"$log" 2>&1; then
-    echo "[ERROR] Converter failed for $in_rel (see $log)" >&2
+  if ! "$CONV" "$in_path" "$DETUNE" $EXTRA_ARGS $opts -o "$tmp_out" >"$log" 2>&1; then
+    echo "[ERROR] Converter failed for $entry (see $log)" >&2
     tail -n 40 "$log" || true
     return 2
   fi
@@ -130,8 +137,8 @@ generate_set () {
   else
     target_dir="$NEW_DIR"
   fi
-  for f in "${FILES[@]}"; do
-    run_convert "$f" "$target_dir" "$label" || exit $?
+  for e in "${ENTRIES[@]}"; do
+    run_convert "$e" "$target_dir" "$label" || exit $?
   done
 }
 
@@ -155,8 +162,9 @@ fi
 
 normalize_txt () { sed -E 's/File Version:.*//g'; }
 
-for f in "${FILES[@]}"; do
-  base="${f%.vgm}OPL3.vgm"
+for e in "${ENTRIES[@]}"; do
+  stem="$(entry_stem "$e")"
+  base="${stem}OPL3.vgm"
   ref="$BASELINE_DIR/$base"
   new="$NEW_DIR/$base"
   if [ ! -f "$ref" ]; then
@@ -165,21 +173,21 @@ for f in "${FILES[@]}"; do
     continue
   fi
   if ! cmp -s "$ref" "$new"; then
-    echo "[DIFF] $f"
+    echo "[DIFF] $e"
     diff_found=1
     if [ $have_vgm2txt -eq 1 ]; then
-      ref_txt="$TXT_DIR/${f%.vgm}_ref.txt"
-      new_txt="$TXT_DIR/${f%.vgm}_new.txt"
+      ref_txt="$TXT_DIR/${stem}_ref.txt"
+      new_txt="$TXT_DIR/${stem}_new.txt"
       vgm2txt "$ref" > "$ref_txt" 2>/dev/null || true
       vgm2txt "$new" > "$new_txt" 2>/dev/null || true
       normalize_txt < "$ref_txt" > "$ref_txt.norm"
       normalize_txt < "$new_txt" > "$new_txt.norm"
-      echo "----- textual diff (normalized) for $f -----"
+      echo "----- textual diff (normalized) for $e -----"
       diff -u "$ref_txt.norm" "$new_txt.norm" || true
       echo "-------------------------------------------"
     fi
   else
-    echo "[OK]  $f"
+    echo "[OK]  $e"
   fi
 done
 
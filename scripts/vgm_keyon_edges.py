@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+List the key-on edges of a VGM: one line "sample chip port ch" per KEY 0->1.
+
+  YM2413 (0x51 / 0xA1): reg 0x20-0x28 bit 4        -> chip 0 / 1, port 0
+  YMF262 (0x5E/0x5F, 0xAE/0xAF): reg 0xB0-0xB8 bit 5 -> chip 0 / 1, port 0 / 1
+
+--summary prints "chip N: keyons=<n> first=<sample> last=<sample>" per chip instead.
+Used by scripts/test_keyon_edges.sh.
+"""
+import argparse
+import struct
+import sys
+
+# Operand bytes of the fixed-length commands (VGM 1.71)
+def cmd_len(cmd):
+    if 0x30 <= cmd <= 0x3F or cmd in (0x4F, 0x50):
+        return 1
+    if 0x40 <= cmd <= 0x4E or 0x51 <= cmd <= 0x5F or 0xA0 <= cmd <= 0xBF:
+        return 2
+    if 0xC0 <= cmd <= 0xDF:
+        return 3
+    if 0xE0 <= cmd <= 0xFF:
+        return 4
+    return {0x90: 4, 0x91: 4, 0x92: 5, 0x93: 10, 0x94: 1, 0x95: 4}.get(cmd)
+
+
+def keyon_edges(data):
+    if data[:4] != b"Vgm ":
+        raise ValueError("not a VGM file")
+    data_offset = struct.unpack_from("<I", data, 0x34)[0] if len(data) >= 0x38 else 0
+    pos = 0x34 + data_offset if data_offset else 0x40
+    sample = 0
+    keys = {}
+    edges = []
+    while pos < len(data):
+        cmd = data[pos]
+        if cmd == 0x66:
+            break
+        if cmd == 0x61:
+            sample += struct.unpack_from("<H", data, pos + 1)[0]
+            pos += 3
+        elif cmd == 0x62:
+            sample += 735
+            pos += 1
+        elif cmd == 0x63:
+            sample += 882
+            pos += 1
+        elif 0x70 <= cmd <= 0x7F:
+            sample += (cmd & 0x0F) + 1
+            pos += 1
+        elif 0x80 <= cmd <= 0x8F:
+            sample += cmd & 0x0F
+            pos += 1
+        elif cmd == 0x67:
+            size = struct.unpack_from("<I", data, pos + 3)[0] & 0x7FFFFFFF
+            pos += 7 + size
+        elif cmd in (0x51, 0xA1):
+            reg, val = data[pos + 1], data[pos + 2]
+            if 0x20 <= reg <= 0x28:
+                key = (1 if cmd == 0xA1 else 0, 0, reg - 0x20)
+                on = (val & 0x10) != 0
+                if on and not keys.get(key):
+                    edges.append((sample,) + key)
+                keys[key] = on
+            pos += 3
+        elif cmd in (0x5E, 0x5F, 0xAE, 0xAF):
+            reg, val = data[pos + 1], data[pos + 2]
+            if 0xB0 <= reg <= 0xB8:
+                key = (1 if cmd >= 0xAE else 0, cmd & 1, reg - 0xB0)
+                on = (val & 0x20) != 0
+                if on and not keys.get(key):
+                    edges.append((sample,) + key)
+                keys[key] = on
+            pos += 3
+        else:
+            n = cmd_len(cmd)
+            if n is None:
+                raise ValueError("unknown command 0x%02X at 0x%X" % (cmd, pos))
+            pos += 1 + n
+    return edges
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    ap.add_argument("vgm")
+    ap.add_argument("--summary", action="store_true")
+    args = ap.parse_args()
+    with open(args.vgm, "rb") as f:
+        edges = keyon_edges(f.read())
+    if args.summary:
+        for chip in sorted({e[1] for e in edges}):
+            times = [e[0] for e in edges if e[1] == chip]
+            print("chip %d: keyons=%d first=%d last=%d" % (chip, len(times), times[0], times[-1]))
+    else:
+        for e in edges:
+            print("%d %d %d %d" % e)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
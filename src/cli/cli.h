@@ -0,0 +1,92 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "eseopl3.h"
+#include "../vgm/vgm_helpers.h"   /* DebugOpts */
+
+/*
+ * Command-line front end over libeseopl3 (include/eseopl3.h).
+ * main.c は引数を CliJob に読み込んでモードごとの関数へ渡すだけ。
+ */
+
+// Input is pushed to the converter in chunks of this size
+#define CLI_IO_CHUNK_BYTES (64 * 1024)
+
+// --bridge: one input record = LE32 sample (44.1 kHz, absolute) + reg + val
+#define CLI_BRIDGE_RECORD_BYTES 6
+#define CLI_BRIDGE_RING_DEFAULT 4096
+
+// --cache-max default (MiB)
+#define CLI_CACHE_MAX_MB_DEFAULT 1024
+
+// Buffer for cli_cache_tmp_path (target path + suffix)
+#define CLI_TMP_PATH_MAX (1024 + 64)
+
+// --variant: outputs per input pass, arguments per variant group
+#define CLI_VARIANT_MAX       64
+#define CLI_VARIANT_MAX_ARGS  128
+
+#define CLI_PARSE_OK     0
+#define CLI_PARSE_ERROR  1
+#define CLI_PARSE_HELP   2      /* -h / --help: the caller prints the usage (main) or reports an error */
+
+/** One conversion as given on the command line. */
+typedef struct {
+    const char     *p_input;
+    const char     *p_output;           /* NULL = <input>OPL3.vgm */
+    ESEOPL3Options  opts;
+    bool            is_bridge;
+    uint32_t        bridge_ring;
+    const char     *p_cache_dir;        /* --cache (NULL = off) */
+    uint64_t        cache_max_bytes;
+    bool            is_cache_link;      /* hardlink hits instead of copying */
+    int             variant_at;         /* argv index of the first --variant (0 = none) */
+    int             argc;               /* the command line; variant groups are parsed from it */
+    char          **pp_argv;
+    char            default_out[256];
+} CliJob;
+
+/* cli_args.c */
+int  cli_parse_job(int argc, char *argv[], CliJob *p_job);
+void cli_print_usage(const char *progname, const DebugOpts *debug);
+bool cli_has_vgm_extension_or_none(const char *p_filename);
+void cli_make_default_output_name(const char *p_input, char *p_output, size_t outlen);
+
+/* cli_convert.c */
+uint8_t *cli_read_file(const char *p_path, size_t *p_len);
+int  cli_write_file(const char *p_path, const uint8_t *p_data, size_t size);
+int  cli_convert_file(CliJob *p_job);
+int  cli_convert_memory(const ESEOPL3Options *p_opts, const uint8_t *p_in, size_t in_len,
+                        uint8_t **pp_out, size_t *p_out_len);
+int  cli_convert_variants(const CliJob *p_job, const uint8_t *p_in, size_t in_len);
+
+/* cli_cache.c: 0 on success / hit, -1 otherwise */
+int  cli_cache_key(const CliJob *p_job, const uint8_t *p_in, size_t in_len, char *p_key);
+int  cli_cache_fetch(const CliJob *p_job, const char *p_key, const char *p_output);
+uint8_t *cli_cache_load(const CliJob *p_job, const char *p_key, size_t *p_len);
+int  cli_cache_store(const CliJob *p_job, const char *p_key, const uint8_t *p_data, size_t size);
+int  cli_cache_store_file(const CliJob *p_job, const char *p_key, const char *p_path);
+int  cli_cache_write_atomic(const char *p_path, const uint8_t *p_data, size_t size);
+void cli_cache_tmp_path(const char *p_target, char *p_path, size_t size);
+int  cli_cache_replace(const char *p_tmp, const char *p_path);
+
+/* cli_bridge.c */
+int  cli_run_bridge(const CliJob *p_job);
+
+/* cli_batch.c */
+/** One command line of a --batch source; is_file = a file found in a directory (nargs < 0: overlong line). */
+typedef void (*CliBatchFn)(void *p_user, char **pp_args, int nargs, bool is_file);
+/** Walk a directory (*.vgm, except p_skip_dir) or read a list file. Returns 0, or -1 if it cannot be read. */
+int  cli_batch_scan(const char *p_source, const char *p_skip_dir, CliBatchFn fn, void *p_user);
+int  cli_batch(int argc, char *argv[]);
+
+/* cli_queue.c */
+int  cli_queue(int argc, char *argv[]);
+
+/* cli_serve.c */
+int  cli_serve(int argc, char *argv[]);
+
+#endif /* CLI_H */
@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "cli.h"
+#include "../vgm/vgm_seek.h"
+
+/** Parse command line for OPL chip conversion flags and debug options */
+static void parse_chip_conversion_flags(int argc, char *argv[], unsigned *p_convert_mask, DebugOpts *debug) {
+    *p_convert_mask = 0;   // 0 = OPL group auto-detection
+
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--convert-ym2413") == 0) {
+            *p_convert_mask |= ESEOPL3_CONVERT_YM2413;
+        } else if (strcmp(argv[i], "--convert-ym3812") == 0) {
+            *p_convert_mask |= ESEOPL3_CONVERT_YM3812;
+        } else if (strcmp(argv[i], "--convert-ym3526") == 0) {
+            *p_convert_mask |= ESEOPL3_CONVERT_YM3526;
+        } else if (strcmp(argv[i], "--convert-y8950") == 0) {
+            *p_convert_mask |= ESEOPL3_CONVERT_Y8950;
+        }
+        // Debug/diagnostic options
+        else if (strcmp(argv[i], "--strip-non-opl") == 0) debug->strip_non_opl = true;
+        else if (strcmp(argv[i], "--test-tone") == 0) debug->test_tone = true;
+        else if (strcmp(argv[i], "--fast-attack") == 0) debug->fast_attack = true;
+        else if (strcmp(argv[i], "--no-post-keyon-tl") == 0) debug->no_post_keyon_tl = true;
+        else if (strcmp(argv[i], "--single-port") == 0) debug->single_port = true;
+        else if (strcmp(argv[i], "--audible-sanity") == 0) debug->audible_sanity = true;
+        else if (strcmp(argv[i], "--debug-verbose") == 0) debug->verbose = true;
+        else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "-verbose") == 0) debug->verbose = true;
+    }
+}
+
+/** Check file extension for .vgm or none (for vgz-uncompressed) */
+bool cli_has_vgm_extension_or_none(const char *p_filename) {
+    size_t len = strlen(p_filename);
+    if (len > 4 && strcasecmp(p_filename + len - 4, ".vgm") == 0) return true;
+    const char *p_basename = strrchr(p_filename, '/');
+    p_basename = p_basename ? p_basename + 1 : p_filename;
+    if (strchr(p_basename, '.') == NULL) return true;
+    return false;
+}
+
+/** Generate output file name based on input name */
+void cli_make_default_output_name(const char *p_input, char *p_output, size_t outlen) {
+    size_t len = strlen(p_input);
+    if (len > 4 && strcmp(&p_input[len - 4], ".vgm") == 0) len -= 4;
+    snprintf(p_output, outlen, "%.*sOPL3.vgm", (int)len, p_input);
+}
+
+/** Print usage and help message (fully English) */
+void cli_print_usage(const char *progname, const DebugOpts *debug) {
+    if (debug->verbose){
+        printf(
+            "Usage: %s <input.vgm> <detune> [wait] [creator]\n"
+            "          [-o <output.vgm>] [--ch_panning <val>] [--vr0 <val>] [--vr1 <val>] [--detune <val>] [--detune_limit <val>] [--wait <val>]\n"
+            "          [--convert-ymXXXX ...] [--preset <YM2413|VRC7|YMF281B>] [--keep_source_vgm] [--override <overrides.ini>]\n"
+            "          [--msx_audio] [--moon]"
+            "          [--strip-non-opl] [--test-tone] [--fast-attack]\n"
+            "          [--no-post-keyon-tl] [--single-port]\n"
+            "          [--carrier-tl-clamp <val>] [--emergency-boost <val>] [--force-retrigger-each-note]\n"
+            "          [--audible-sanity] [--debug-verbose]\n"
+            "          [--min-gate-samples <val>] [--pre-keyon-wait <val>] [--min-off-on-wait <val>] [--keyon-coalesce <val>]\n"
+            "          [--strip-unused-chips] [--opl3-clock <val>] [--start <time>] [--end <time>]\n"
+            "          [--checkpoint-every <time>] [--checkpoint-file <path>] [--resume] [--dual-opl3] [--fm-mix]\n"
+            "          [--cache <dir>] [--cache-max <MiB>] [--cache-link]\n"
+            "\n"
+            "Options:\n"
+            "  --detune <val>             Detune percentage (can also specify as 2nd arg for backward compatibility).\n"
+            "  --detune_limit <val>       Maximum detune absolute value (default: 4.0).\n"
+            "  --wait <val>               KeyOn/Off wait samples.\n"
+            "  --ch_panning <val>         Channel panning mode (0=mono, 1=alternate L/R, ...).\n"
+            "  --vr0 <val>                Port0 volume ratio (default: 1.0).\n"
+            "  --vr1 <val>                Port1 volume ratio (default: 0.8).\n"
+            "  --preset <YM2413|VRC7|YMF281B>   Voice preset table for YM2413 conversion (YM2413, VRC7, YMF281B). Default: YM2413\n"
+            "  --keep_source_vgm          Output original vgm command \n"
+            "  -o, --output <file>        Output file name (otherwise auto-generated).\n"
+            "  --convert-ymXXXX           Explicit chip selection (YM2413, YM3812, YM3526, Y8950).\n"
+            "                             (Default: OPL group auto-detection; first OPL chip is converted unless specified)\n"
+            "  --strip-non-opl            Remove AY8910/K051649 (and similar) commands from output.\n"
+            "  --test-tone                Inject a simple OPL3 test tone at start for audibility check.\n"
+            "  --fast-attack              Force fast envelope (AR=15, DR>=4, Carrier TL=0).\n"
+            "  --no-post-keyon-tl         Suppress TL changes immediately after KeyOn.\n"
+            "  --single-port              Emit only port0 writes (suppress port1 duplicates).\n"
+            "  --carrier-tl-clamp <val>   Clamp final Carrier TL value (range: 0..63 or 0x00..0x3F).\n"
+            "  --emergency-boost <val>    Force Carrier TL even lower (increase volume for test/audibility).\n"
+            "  --force-retrigger-each-note  Retrigger attack for every note (forces key-on for each note event).\n"
+            "  --audible-sanity           Force fast envelope & audible TL for debug purposes.\n"
+            "  --debug-verbose            Print verbose information for detailed debug.\n"
+            "  --override <overrides.ini>   Per-instrument / per-channel voice overrides ([default], [inst N], [ch N] sections;\n"
+            "                             see README). Applied after the preset; an error reports file:line.\n"
+            "  --voice-bank <file>        Map the converted preset voices from <file> (written on first use) instead of\n"
+            "                             deriving them from the ROM tables in every process. Off by default.\n"
+            "  --metrics <file>           Write converter metrics: writes per register class and port, bytes, waits,\n"
+            "                             key-ons, deduplicated writes and one CSV row per note (emitted sample times).\n"
+            "  --profile                  Time each conversion stage, count allocations and print a one-line JSON\n"
+            "                             summary ([PROFILE]) with the throughput after the [OPL3] lines.\n"
+            "  --trace <file>             Record the --debug-verbose events as 16-byte binary records (no text formatting);\n"
+            "                             --trace-decode <file> prints them as the --debug-verbose text.\n"
+            "  --trace-ring <n>           With --trace, keep only the last <n> records (flight recorder; written at the end).\n"
+            "  --min-gate-samples <val>   Minimum gate duration in samples per note event (e.g. OPLL_MIN_GATE_SAMPLES = 88).\n"
+            "                             This ensures the key-on (gate) signal is held for at least <val> samples, guaranteeing proper note triggering in OPLL emulation.\n"
+            "  --pre-keyon-wait <val>     Number of samples to wait before key-on event (e.g. OPLL_PRE_KEYON_WAIT_SAMPLES = 16).\n"
+            "                             Allows internal chip state stabilization before key-on (applied when the instrument changes).\n"
+            "  --min-off-on-wait <val>    Minimum samples to wait between key-off and key-on (e.g. OPLL_MIN_OFF_TO_ON_WAIT_SAMPLES = 16).\n"
+            "                             Ensures reliable note retriggering in emulation.\n"
+            "                             These delays are taken out of the existing waits; the total length is unchanged.\n"
+            "                             All default to 0 (off); a non-zero value also enables --keyon-coalesce.\n"
+            "  --keyon-coalesce <val>     Hold partial OPLL 1n/2n/3n writes for up to <val> samples so a note is emitted as one\n"
+            "                             A0/B0/voice burst (capped at OPLL_MAX_PENDING_SAMPLES, 0 = same timestamp only).\n"
+            "                             Off by default: each write is converted as it arrives.\n"
+            "  --strip-unused-chips       Set unused chip clocks (YM2413/AY/etc.) to zero in output.\n"
+            "  --opl3-clock <val>         Override YMF262 (OPL3) clock value (e.g., 14318180).\n"
+            "  --start <time>             Convert from <time>: earlier commands only update the register state, and the\n"
+            "                             registers written so far are emitted at the start. <time> is samples, <sec>s or <min>:<sec>.\n"
+            "  --end <time>               Stop at <time> (same format). A range excerpt is written without a loop.\n"
+            "  --checkpoint-every <time>  Append a checkpoint of the whole conversion state every <time> to the sidecar.\n"
+            "  --checkpoint-file <path>   Sidecar path (default: <output>.ckpt). With --start, conversion jumps from the\n"
+            "                             nearest earlier checkpoint instead of scanning from the top.\n"
+            "  --resume                   Continue from the last complete checkpoint (same input and options required).\n"
+            "  --dual-opl3                For 2xYM2413 sources (0xA1, clock bit 30): put chip 2 on a second OPL3\n"
+            "                             instead of the port1 channels (keeps the port1 chorus for both chips).\n"
+            "  --fm-mix                   Convert every OPL-family source (YM2413, 2nd YM2413, YM3812, YM3526, Y8950)\n"
+            "                             onto one YMF262: voices get OPL3 channels on KeyOn, earlier chips in this\n"
+            "                             list win when all 18 channels are busy. Port1 chorus is off.\n"
+            "  --cache <dir>              Reuse earlier results: the output is stored under <dir> keyed by the input bytes,\n"
+            "                             the options and the converter version; a match is copied instead of converted.\n"
+            "  --cache-max <MiB>          Cache size budget, least recently used entries go first (default: 1024).\n"
+            "  --cache-link               Hardlink cache hits instead of copying (do not edit such outputs in place).\n"
+            "  --variant [options]        Start another output of the same input (repeatable). Options before the first\n"
+            "                             --variant are shared; the input is parsed once and all variants are converted\n"
+            "                             in one pass. Outputs default to <input>OPL3_<n>.vgm.\n"
+            "  --bridge                   Real-time bridge mode: <input> is a stream of 6-byte YM2413 writes\n"
+            "                             (LE32 sample at 44.1 kHz, reg, val; '-' = stdin). The OPL3 writes go through a\n"
+            "                             lock-free queue to a player thread, which writes them to -o as a VGM.\n"
+            "  --bridge-ring <n>          Queue size in OPL3 writes (default: 4096). Writes are dropped when it is full.\n"
+            "  --serve <socket>           (instead of <input> <detune>) Run as a conversion server on a Unix socket.\n"
+            "                             Jobs are command lines as above (README). --workers <n> sets the pool size (default: CPUs).\n"
+            "  --batch <dir|list>         (instead of <input> <detune>) Convert many files in one process: every *.vgm under\n"
+            "                             <dir> with the options that follow, or one command line per line of <list>\n"
+            "                             (e.g. eseopl3patcher_batch.bat). --jobs <n> (default: CPUs), --out-dir <dir>.\n"
+            "  --queue <spool>            (instead of <input> <detune>) Work through a job queue in a shared directory;\n"
+            "                             --enqueue <dir|list> [options] adds jobs, --status shows progress. Several\n"
+            "                             processes / machines can work on one spool; jobs of dead workers are redone.\n"
+            "  --trace-decode <file>      (instead of <input> <detune>) Print a --trace file as text on stdout.\n"
+            "  -h, --help                 Show this help message.\n"
+            "\n"
+            "Examples:\n"
+            "  %s music.vgm --detune 1.0 --convert-ym2413 --strip-non-opl --fast-attack --carrier-tl-clamp 58 --audible-sanity --debug-verbose -o out.vgm\n"
+            "  %s music.vgm 1.0 --ch_panning 1 --vr0 1.0 --vr1 0.8 --detune_limit 2.5\n"
+            ,
+            progname, progname, progname
+        );
+    } else {
+        printf(
+            "Usage: %s <input.vgm> <detune> [wait] [creator]\n"
+            "          [-o <output.vgm>] [--ch_panning <val>] [--vr0 <val>] [--vr1 <val>] [--detune <val>] [--detune_limit <val>] [--preset <YM2413|VRC7|YMF281B>] [--preset <YMVOICE|YMFM>]  [--keep_source_vgm]  [--wait <val>]\n"
+            "          [other options, see --help]\n"
+            "\n"
+            "Most commonly-used options:\n"
+            "  --detune <val>                   Detune percentage.\n"
+            "  --detune_limit <val>             Maximum detune value.\n"
+            "  --ch_panning <val>               Channel panning mode.\n"
+            "  --vr0 <val>, --vr1 <val>         Port0/Port1 volume ratios.\n"
+            "  --preset <YM2413|VRC7|YMF281B>   Voice preset table for YM2413 conversion (YM2413, VRC7, YMF281B). Default: YM2413\n"
+            "  --preset_source <YMVOICE|YMFM>   Voice preset reference (YMVOICE, YMFM). Default: YMVOICE\n"
+            "  --keep_source_vgm                Output original vgm command \n"
+            "  -o <output.vgm>                  Output file name.\n"
+            "  -h, --help                       Show this help message.\n"
+            "\n"
+            "Example:\n"
+            "  %s music.vgm --detune 1.0 -o out.vgm --ch_panning 1\n",
+            progname,progname
+        );
+    }
+}
+
+/**
+ * Parse a command line (argv[1] = input, argv[2] = detune, then options) into a job.
+ * Strings in the job point into argv.
+ */
+int cli_parse_job(int argc, char *argv[], CliJob *p_job) {
+    // Parse main arguments
+    memset(p_job, 0, sizeof(*p_job));
+    p_job->p_input = argv[1];
+    p_job->bridge_ring = CLI_BRIDGE_RING_DEFAULT;
+    p_job->cache_max_bytes = (uint64_t)CLI_CACHE_MAX_MB_DEFAULT << 20;
+    ESEOPL3Options *p_opts = &p_job->opts;
+    eseopl3_options_init(p_opts);
+    p_opts->detune = atof(argv[2]);
+    DebugOpts debug_opts = {0};
+    p_job->argc = argc;
+    p_job->pp_argv = argv;
+
+    // --variant: the options before the first one are shared, every group after one is an output
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--variant") == 0) {
+            p_job->variant_at = i;
+            argc = i;
+            break;
+        }
+    }
+
+    // Parse optional args
+    for (int i = 3; i < argc; ++i) {
+        // Helper for strtoul
+        char *endptr;
+
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            p_job->p_output = argv[++i];
+        } else if ((strcmp(argv[i], "-detune") == 0 || strcmp(argv[i], "--detune") == 0) && i + 1 < argc) {
+            p_opts->detune = atof(argv[++i]);
+        } else if ((strcmp(argv[i], "-detune_limit") == 0 || strcmp(argv[i], "--detune_limit") == 0) && i + 1 < argc) {
+            p_opts->detune_limit = atof(argv[++i]);
+        } else if ((strcmp(argv[i], "-ch_panning") == 0 || strcmp(argv[i], "--ch_panning") == 0) && i + 1 < argc) {
+            p_opts->ch_panning = (int)strtoul(argv[++i], &endptr, 10);
+        } else if ((strcmp(argv[i], "-vr0") == 0 || strcmp(argv[i], "--vr0") == 0) && i + 1 < argc) {
+            p_opts->v_ratio0 = atof(argv[++i]);
+        } else if ((strcmp(argv[i], "-vr1") == 0 || strcmp(argv[i], "--vr1") == 0) && i + 1 < argc) {
+            p_opts->v_ratio1 = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "--keep_source_vgm") == 0) {
+            p_opts->keep_source_vgm = true;
+        } else if (strcmp(argv[i], "-msx_audio") == 0 || strcmp(argv[i], "--msx_audio") == 0) {
+            p_opts->msx_audio = true;
+        } else if (strcmp(argv[i], "-moon") == 0 || strcmp(argv[i], "--moon") == 0) {
+            p_opts->moon = true;
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "-verbose") == 0) {
+            debug_opts.verbose = true;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            p_opts->verbose = debug_opts.verbose;   // the caller prints the usage (long form with -v)
+            return CLI_PARSE_HELP;
+        } else if (strcmp(argv[i], "-debug") == 0 || strcmp(argv[i], "--debug") == 0) {
+            debug_opts.verbose = true;
+        } else if (strcmp(argv[i], "--carrier-tl-clamp") == 0 && i + 1 < argc) {
+            p_opts->carrier_tl_clamp_enabled = true;
+            p_opts->carrier_tl_clamp = (uint8_t)strtoul(argv[++i], &endptr, 10);
+        } else if (strcmp(argv[i], "--emergency-boost") == 0 && i + 1 < argc) {
+            p_opts->emergency_boost_steps = (int)strtoul(argv[++i], &endptr, 10);
+        } else if (strcmp(argv[i], "--force-retrigger-each-note") == 0) {
+            p_opts->force_retrigger_each_note = true;
+        } else if (strcmp(argv[i], "--audible-sanity") == 0) {
+            debug_opts.audible_sanity = true;
+        } else if (strcmp(argv[i], "--strip-non-opl") == 0) {
+            debug_opts.strip_non_opl = true;
+        } else if (strcmp(argv[i], "--test-tone") == 0) {
+            debug_opts.test_tone = true;
+        } else if (strcmp(argv[i], "--fast-attack") == 0) {
+            debug_opts.fast_attack = true;
+        } else if (strcmp(argv[i], "--no-post-keyon-tl") == 0) {
+            debug_opts.no_post_keyon_tl = true;
+        } else if (strcmp(argv[i], "--single-port") == 0) {
+            debug_opts.single_port = true;
+        } else if (strcmp(argv[i], "--min-gate-samples") == 0 && i + 1 < argc) {
+            p_opts->min_gate_samples = (uint16_t)strtoul(argv[++i], &endptr, 10);
+        } else if (strcmp(argv[i], "--pre-keyon-wait") == 0 && i + 1 < argc) {
+            p_opts->pre_keyon_wait_samples = (uint16_t)strtoul(argv[++i], &endptr, 10);
+        } else if (strcmp(argv[i], "--min-off-on-wait") == 0 && i + 1 < argc) {
+            p_opts->min_off_on_wait_samples = (uint16_t)strtoul(argv[++i], &endptr, 10);
+        } else if (strcmp(argv[i], "--keyon-coalesce") == 0 && i + 1 < argc) {
+            p_opts->keyon_coalesce_samples = (uint16_t)strtoul(argv[++i], &endptr, 10);
+            p_opts->keyon_coalesce = true;
+        } else if (strcmp(argv[i], "--strip-unused-chips") == 0) {
+            p_opts->strip_unused_chip_clocks = true;
+        } else if (strcmp(argv[i], "--opl3-clock") == 0 && i + 1 < argc) {
+            p_opts->opl3_clock = (uint32_t)strtoul(argv[++i], &endptr, 10);
+        } else if ((strcmp(argv[i], "--start") == 0 || strcmp(argv[i], "--end") == 0) && i + 1 < argc) {
+            uint64_t *p_t = (argv[i][2] == 's') ? &p_opts->range_start : &p_opts->range_end;
+            if (vgm_parse_time_spec(argv[i + 1], p_t) != 0) {
+                fprintf(stderr, "Invalid time for %s: %s (use samples, <sec>s or <min>:<sec>)\n", argv[i], argv[i + 1]);
+                return CLI_PARSE_ERROR;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            if (vgm_parse_time_spec(argv[++i], &p_opts->checkpoint_every) != 0 || p_opts->checkpoint_every == 0) {
+                fprintf(stderr, "Invalid time for --checkpoint-every: %s\n", argv[i]);
+                return CLI_PARSE_ERROR;
+            }
+        } else if (strcmp(argv[i], "--checkpoint-file") == 0 && i + 1 < argc) {
+            p_opts->checkpoint_path = argv[++i];
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            p_opts->resume = true;
+        } else if (strcmp(argv[i], "--dual-opl3") == 0) {
+            p_opts->dual_opl3 = true;
+        } else if (strcmp(argv[i], "--fm-mix") == 0) {
+            p_opts->fm_mix = true;
+        } else if (strcmp(argv[i], "--override") == 0 && i + 1 < argc) {
+            p_opts->override_path = argv[++i];
+        } else if (strcmp(argv[i], "--voice-bank") == 0 && i + 1 < argc) {
+            p_opts->voice_bank_path = argv[++i];
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            p_opts->metrics_path = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            p_opts->profile = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            p_opts->trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--trace-ring") == 0 && i + 1 < argc) {
+            p_opts->trace_ring = (uint32_t)strtoul(argv[++i], &endptr, 10);
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            p_job->p_cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-max") == 0 && i + 1 < argc) {
+            p_job->cache_max_bytes = (uint64_t)strtoull(argv[++i], NULL, 10) << 20;
+        } else if (strcmp(argv[i], "--cache-link") == 0) {
+            p_job->is_cache_link = true;
+        } else if (strcmp(argv[i], "--bridge") == 0) {
+            p_job->is_bridge = true;
+        } else if (strcmp(argv[i], "--bridge-ring") == 0 && i + 1 < argc) {
+            p_job->bridge_ring = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-') {
+            int val = (int)strtoul(argv[i], &endptr, 10);
+            if (*endptr == '\0' && p_opts->keyon_wait == 0) {
+                p_opts->keyon_wait = val;
+            } else if (p_opts->creator == NULL || strcmp(p_opts->creator, "eseopl3patcher") == 0) {
+                p_opts->creator = argv[i];
+            }
+        } else if ((strcmp(argv[i], "-preset") == 0 || strcmp(argv[i], "--preset") == 0) && i + 1 < argc) {
+            p_opts->preset = argv[++i];
+            continue;
+        } else if ((strcmp(argv[i], "-preset_source") == 0 || strcmp(argv[i], "--preset_source") == 0) && i + 1 < argc) {
+            p_opts->preset_source = argv[++i];
+            continue;
+        }
+    }
+
+    if (p_opts->range_end && p_opts->range_end <= p_opts->range_start) {
+        fprintf(stderr, "--end must be after --start.\n");
+        return CLI_PARSE_ERROR;
+    }
+
+    // Chip flags and debug options
+    parse_chip_conversion_flags(argc, argv, &p_opts->convert_mask, &debug_opts);
+    p_opts->strip_non_opl = debug_opts.strip_non_opl;
+    p_opts->test_tone = debug_opts.test_tone;
+    p_opts->fast_attack = debug_opts.fast_attack;
+    p_opts->no_post_keyon_tl = debug_opts.no_post_keyon_tl;
+    p_opts->single_port = debug_opts.single_port;
+    p_opts->audible_sanity = debug_opts.audible_sanity;
+    p_opts->verbose = debug_opts.verbose;
+    return CLI_PARSE_OK;
+}
@@ -0,0 +1,674 @@
+#include <stdio.h>
+#include "cli.h"
+
+#ifdef _WIN32
+int cli_batch(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "--batch is not available on Windows; run the generated .bat instead.\n");
+    return 1;
+}
+#else
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "../opl3/opl3_clock.h"
+
+/*
+ * --batch <dir|list>: many conversions in one process.
+ *
+ *  - dir  : 配下の *.vgm を再帰的に集める (出力名 *OPL3.vgm は除く)。残りの引数
+ *           (<detune> [options...]) を各ファイルに付ける。--out-dir で出力先をまとめられる。
+ *  - list : 1 行 1 変換のコマンドライン (<input> <detune> [options...])。先頭のプログラム名は
+ *           無視するので make_batch_from_vgm.py の .bat をそのまま渡せる。残りの引数は各行の末尾に付く。
+ *
+ * 入力サイズの大きい順に並べてワーカーごとの deque へ配り、各ワーカーは自分の deque を
+ * 先頭 (大きい方) から、空になったら他のワーカーの末尾 (小さい方) から取る (work stealing)。
+ * 入力は reader スレッドが同じ順で先読みし (CLI_BATCH_PREFETCH_BYTES まで)、出力は
+ * writer スレッドがまとめて書き出すので、ワーカーは変換だけを行う。
+ */
+
+#define CLI_BATCH_MAX_WORKERS    256
+#define CLI_BATCH_MAX_ARGS       512    /* a --variant line has ~6 per variant */
+#define CLI_BATCH_LINE_MAX       8192
+#define CLI_BATCH_PREFETCH_BYTES (64u * 1024 * 1024)    /* read ahead, not yet converted */
+#define CLI_BATCH_WRITE_BYTES    (64u * 1024 * 1024)    /* converted, not yet written */
+#define CLI_BATCH_PATH_MAX       1024
+
+enum {
+    BATCH_INPUT_PENDING = 0,
+    BATCH_INPUT_LOADING,
+    BATCH_INPUT_READY,
+};
+
+typedef struct BatchTask {
+    int               argc;
+    char            **argv;
+    char             *p_strings;            /* argv, then the strings behind it (one block) */
+    char              out_path[CLI_BATCH_PATH_MAX];
+    CliJob            job;
+    uint64_t          in_size;              /* stat size */
+    int               variants;             /* outputs of the task (--variant groups, or 1) */
+    _Atomic int       input_state;
+    uint8_t          *p_in;
+    size_t            in_len;
+    /* result */
+    const char       *p_error;              /* NULL = converted */
+    bool              is_cache_hit;
+    size_t            out_len;
+    /* writer queue */
+    uint8_t          *p_out;
+    char              cache_key[ESEOPL3_CACHE_KEY_CHARS + 1];
+    struct BatchTask *p_next;
+} BatchTask;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int            *p_items;                /* task indices, largest first */
+    int             head;
+    int             tail;
+} BatchDeque;
+
+typedef struct {
+    BatchTask     **pp_tasks;               /* one allocation per task: job.p_output may point into it */
+    int             count;
+    int            *p_order;                /* task indices sorted by size (descending) */
+    int             workers;
+    BatchDeque      deques[CLI_BATCH_MAX_WORKERS];
+    /* prefetch */
+    pthread_mutex_t io_lock;
+    pthread_cond_t  io_cond;
+    uint64_t        prefetched;             /* bytes read and not yet converted */
+    bool            is_stopping;
+    /* writer */
+    BatchTask      *p_write_head;
+    BatchTask      *p_write_tail;
+    uint64_t        write_pending;
+    bool            is_converted;           /* all workers finished */
+    /* stats */
+    _Atomic uint64_t steals;
+} BatchState;
+
+typedef struct {
+    BatchState   *p_st;
+    int           id;
+    ESEOPL3Arena *p_arena;                  /* job memory, reset after every task (NULL = malloc) */
+} BatchWorker;
+
+/** Split a command line; "..." groups (no escapes, Windows paths keep their backslashes). */
+static int batch_tokenize(char *p_line, char **pp_tok, int max) {
+    int n = 0;
+    char *p = p_line;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        if (!*p) break;
+        if (n == max) return -1;
+        char *p_dst = p;
+        pp_tok[n++] = p_dst;
+        bool is_quoted = false;
+        while (*p && (is_quoted || (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'))) {
+            if (*p == '"') {
+                is_quoted = !is_quoted;
+                p++;
+                continue;
+            }
+            *p_dst++ = *p++;
+        }
+        if (*p) p++;
+        *p_dst = '\0';
+    }
+    return n;
+}
+
+static bool batch_is_program(const char *p_tok) {
+    const char *p_base = strrchr(p_tok, '/');
+    const char *p_base_w = strrchr(p_tok, '\\');
+    if (p_base_w > p_base) p_base = p_base_w;
+    p_base = p_base ? p_base + 1 : p_tok;
+    return strncmp(p_base, "eseopl3patcher", 14) == 0;
+}
+
+/**
+ * Set up one task from its argument list (input first) plus the shared trailing arguments.
+ * Parse errors become task failures; the batch goes on.
+ */
+static void batch_task_init(BatchTask *p_t, char **pp_args, int nargs, char **pp_extra, int nextra,
+                            const char *p_out_dir) {
+    memset(p_t, 0, sizeof(*p_t));
+    size_t vec = (size_t)(nargs + nextra + 2) * sizeof(char *);
+    size_t bytes = vec;
+    for (int i = 0; i < nargs; ++i) bytes += strlen(pp_args[i]) + 1;
+    for (int i = 0; i < nextra; ++i) bytes += strlen(pp_extra[i]) + 1;
+    p_t->p_strings = (char *)malloc(bytes);
+    if (!p_t->p_strings) {
+        p_t->p_error = "out of memory";
+        return;
+    }
+    p_t->argv = (char **)p_t->p_strings;
+    char *p = p_t->p_strings + vec;
+    p_t->argv[p_t->argc++] = "eseopl3patcher";
+    for (int i = 0; i < nargs + nextra; ++i) {
+        const char *p_src = (i < nargs) ? pp_args[i] : pp_extra[i - nargs];
+        size_t len = strlen(p_src) + 1;
+        memcpy(p, p_src, len);
+        p_t->argv[p_t->argc++] = p;
+        p += len;
+    }
+    p_t->argv[p_t->argc] = NULL;
+
+    if (p_t->argc < 3) {
+        p_t->p_error = "need <input> <detune>";
+        return;
+    }
+    if (cli_parse_job(p_t->argc, p_t->argv, &p_t->job) != CLI_PARSE_OK) {
+        p_t->p_error = "invalid options";
+        return;
+    }
+    CliJob *p_job = &p_t->job;
+    if (p_job->is_bridge || p_job->opts.resume || p_job->opts.checkpoint_every) {
+        p_t->p_error = "--bridge and checkpoints are not available in --batch";
+        return;
+    }
+    if (!cli_has_vgm_extension_or_none(p_job->p_input)) {
+        p_t->p_error = "input file must have .vgm extension or no extension";
+        return;
+    }
+    if (!p_job->p_output) {
+        if (p_out_dir) {
+            const char *p_base = strrchr(p_job->p_input, '/');
+            p_base = p_base ? p_base + 1 : p_job->p_input;
+            char name[256];
+            cli_make_default_output_name(p_base, name, sizeof(name));
+            snprintf(p_t->out_path, sizeof(p_t->out_path), "%s/%s", p_out_dir, name);
+        } else {
+            cli_make_default_output_name(p_job->p_input, p_t->out_path, sizeof(p_t->out_path));
+        }
+        p_job->p_output = p_t->out_path;
+    }
+    p_job->opts.output_path = p_job->p_output;
+
+    struct stat st;
+    if (stat(p_job->p_input, &st) != 0) {
+        p_t->p_error = "cannot open input file";
+        return;
+    }
+    p_t->in_size = (uint64_t)st.st_size;
+    p_t->variants = p_job->variant_at ? 0 : 1;
+    for (int i = p_job->variant_at; p_job->variant_at && i < p_t->argc; ++i) {
+        if (strcmp(p_t->argv[i], "--variant") == 0) p_t->variants++;
+    }
+}
+
+/** Append a task. Tasks never move once added (only the pointer array is reallocated). */
+static BatchTask *batch_grow(BatchTask ***ppp_tasks, int *p_count, int *p_cap) {
+    if (*p_count == *p_cap) {
+        int cap = *p_cap ? *p_cap * 2 : 256;
+        BatchTask **pp_new = (BatchTask **)realloc(*ppp_tasks, (size_t)cap * sizeof(BatchTask *));
+        if (!pp_new) return NULL;
+        *ppp_tasks = pp_new;
+        *p_cap = cap;
+    }
+    BatchTask *p_t = (BatchTask *)malloc(sizeof(BatchTask));
+    if (!p_t) return NULL;
+    (*ppp_tasks)[(*p_count)++] = p_t;
+    return p_t;
+}
+
+static void batch_free_tasks(BatchTask **pp_tasks, int count) {
+    for (int i = 0; i < count; ++i) {
+        free(pp_tasks[i]->p_strings);
+        free(pp_tasks[i]);
+    }
+    free(pp_tasks);
+}
+
+static bool batch_is_source_vgm(const char *p_name) {
+    size_t len = strlen(p_name);
+    if (len < 4 || strcasecmp(p_name + len - 4, ".vgm") != 0) return false;
+    return !(len >= 8 && strcmp(p_name + len - 8, "OPL3.vgm") == 0);   // our own outputs
+}
+
+/** Every *.vgm below p_dir (recursive), except p_skip_dir. */
+static void batch_walk(const char *p_dir, const char *p_skip_dir, CliBatchFn fn, void *p_user) {
+    DIR *p_d = opendir(p_dir);
+    if (!p_d) return;
+    struct dirent *p_de;
+    while ((p_de = readdir(p_d)) != NULL) {
+        if (p_de->d_name[0] == '.') continue;
+        char path[CLI_BATCH_PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", p_dir, p_de->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (p_skip_dir && strcmp(path, p_skip_dir) == 0) continue;
+            batch_walk(path, p_skip_dir, fn, p_user);
+        } else if (S_ISREG(st.st_mode) && batch_is_source_vgm(p_de->d_name)) {
+            char *p_arg = path;
+            fn(p_user, &p_arg, 1, true);
+        }
+    }
+    closedir(p_d);
+}
+
+/** One command line per line; blank lines, '#' / REM comments and @echo are skipped. */
+static int batch_read_list(const char *p_path, CliBatchFn fn, void *p_user) {
+    FILE *p_fp = fopen(p_path, "r");
+    if (!p_fp) return -1;
+    char line[CLI_BATCH_LINE_MAX];
+    while (fgets(line, sizeof(line), p_fp)) {
+        char *p_tok[CLI_BATCH_MAX_ARGS + 1];
+        int n = batch_tokenize(line, p_tok, CLI_BATCH_MAX_ARGS + 1);
+        if (n < 0) {
+            fn(p_user, NULL, -1, false);
+            continue;
+        }
+        if (n == 0 || p_tok[0][0] == '#' || strcasecmp(p_tok[0], "rem") == 0 || p_tok[0][0] == '@') continue;
+        int first = batch_is_program(p_tok[0]) ? 1 : 0;
+        fn(p_user, p_tok + first, n - first, false);
+    }
+    fclose(p_fp);
+    return 0;
+}
+
+int cli_batch_scan(const char *p_source, const char *p_skip_dir, CliBatchFn fn, void *p_user) {
+    struct stat st;
+    if (stat(p_source, &st) != 0) return -1;
+    if (S_ISDIR(st.st_mode)) {
+        batch_walk(p_source, p_skip_dir, fn, p_user);
+        return 0;
+    }
+    return batch_read_list(p_source, fn, p_user);
+}
+
+typedef struct {
+    BatchTask **pp_tasks;
+    int         count;
+    int         cap;
+    char      **pp_extra;
+    int         nextra;
+    const char *p_out_dir;
+} BatchCollect;
+
+static void batch_collect(void *p_user, char **pp_args, int nargs, bool is_file) {
+    BatchCollect *p_c = (BatchCollect *)p_user;
+    BatchTask *p_t = batch_grow(&p_c->pp_tasks, &p_c->count, &p_c->cap);
+    if (!p_t) return;
+    if (nargs < 0) {
+        memset(p_t, 0, sizeof(*p_t));
+        p_t->p_error = "too many arguments";
+        return;
+    }
+    batch_task_init(p_t, pp_args, nargs, p_c->pp_extra, p_c->nextra, is_file ? p_c->p_out_dir : NULL);
+}
+
+/* ---- work-stealing deques ---- */
+
+static int batch_take_own(BatchDeque *p_dq) {
+    int idx = -1;
+    pthread_mutex_lock(&p_dq->lock);
+    if (p_dq->head < p_dq->tail) idx = p_dq->p_items[p_dq->head++];
+    pthread_mutex_unlock(&p_dq->lock);
+    return idx;
+}
+
+static int batch_steal(BatchState *p_st, int self) {
+    for (int k = 1; k < p_st->workers; ++k) {
+        BatchDeque *p_dq = &p_st->deques[(self + k) % p_st->workers];
+        int idx = -1;
+        pthread_mutex_lock(&p_dq->lock);
+        if (p_dq->head < p_dq->tail) idx = p_dq->p_items[--p_dq->tail];
+        pthread_mutex_unlock(&p_dq->lock);
+        if (idx >= 0) {
+            atomic_fetch_add(&p_st->steals, 1);
+            return idx;
+        }
+    }
+    return -1;
+}
+
+/* ---- prefetch ---- */
+
+static void batch_load(BatchState *p_st, BatchTask *p_t) {
+    p_t->p_in = cli_read_file(p_t->job.p_input, &p_t->in_len);
+    pthread_mutex_lock(&p_st->io_lock);
+    if (p_t->p_in) p_st->prefetched += p_t->in_len;
+    atomic_store(&p_t->input_state, BATCH_INPUT_READY);
+    pthread_cond_broadcast(&p_st->io_cond);
+    pthread_mutex_unlock(&p_st->io_lock);
+}
+
+/** Reads the inputs in the order the workers will mostly take them, within the prefetch budget. */
+static void *batch_reader_main(void *p_arg) {
+    BatchState *p_st = (BatchState *)p_arg;
+    for (int i = 0; i < p_st->count; ++i) {
+        BatchTask *p_t = p_st->pp_tasks[p_st->p_order[i]];
+        pthread_mutex_lock(&p_st->io_lock);
+        while (p_st->prefetched >= CLI_BATCH_PREFETCH_BYTES && !p_st->is_stopping) {
+            pthread_cond_wait(&p_st->io_cond, &p_st->io_lock);
+        }
+        bool is_stopping = p_st->is_stopping;
+        pthread_mutex_unlock(&p_st->io_lock);
+        if (is_stopping) break;
+        int expected = BATCH_INPUT_PENDING;
+        if (atomic_compare_exchange_strong(&p_t->input_state, &expected, BATCH_INPUT_LOADING)) {
+            batch_load(p_st, p_t);
+        }
+    }
+    return NULL;
+}
+
+/** Input of p_t: already prefetched, being read by the reader, or read here. */
+static void batch_wait_input(BatchState *p_st, BatchTask *p_t) {
+    int expected = BATCH_INPUT_PENDING;
+    if (atomic_compare_exchange_strong(&p_t->input_state, &expected, BATCH_INPUT_LOADING)) {
+        batch_load(p_st, p_t);
+        return;
+    }
+    pthread_mutex_lock(&p_st->io_lock);
+    while (atomic_load(&p_t->input_state) != BATCH_INPUT_READY) {
+        pthread_cond_wait(&p_st->io_cond, &p_st->io_lock);
+    }
+    pthread_mutex_unlock(&p_st->io_lock);
+}
+
+static void batch_release_input(BatchState *p_st, BatchTask *p_t) {
+    pthread_mutex_lock(&p_st->io_lock);
+    if (p_t->p_in) p_st->prefetched -= p_t->in_len;
+    pthread_cond_broadcast(&p_st->io_cond);
+    pthread_mutex_unlock(&p_st->io_lock);
+    free(p_t->p_in);
+    p_t->p_in = NULL;
+}
+
+/* ---- writer ---- */
+
+static void batch_queue_write(BatchState *p_st, BatchTask *p_t) {
+    pthread_mutex_lock(&p_st->io_lock);
+    while (p_st->write_pending >= CLI_BATCH_WRITE_BYTES) {
+        pthread_cond_wait(&p_st->io_cond, &p_st->io_lock);
+    }
+    p_t->p_next = NULL;
+    if (p_st->p_write_tail) p_st->p_write_tail->p_next = p_t;
+    else p_st->p_write_head = p_t;
+    p_st->p_write_tail = p_t;
+    p_st->write_pending += p_t->out_len;
+    pthread_cond_broadcast(&p_st->io_cond);
+    pthread_mutex_unlock(&p_st->io_lock);
+}
+
+static void *batch_writer_main(void *p_arg) {
+    BatchState *p_st = (BatchState *)p_arg;
+    for (;;) {
+        pthread_mutex_lock(&p_st->io_lock);
+        while (!p_st->p_write_head && !p_st->is_converted) {
+            pthread_cond_wait(&p_st->io_cond, &p_st->io_lock);
+        }
+        BatchTask *p_t = p_st->p_write_head;
+        if (!p_t) {
+            pthread_mutex_unlock(&p_st->io_lock);
+            return NULL;
+        }
+        p_st->p_write_head = p_t->p_next;
+        if (!p_st->p_write_head) p_st->p_write_tail = NULL;
+        pthread_mutex_unlock(&p_st->io_lock);
+
+        const CliJob *p_job = &p_t->job;
+        // Replaces the old output (possibly a hardlink into the cache) only once the new one is complete
+        if (cli_cache_write_atomic(p_job->p_output, p_t->p_out, p_t->out_len) != 0) {
+            p_t->p_error = "cannot write output file";
+        } else if (p_job->p_cache_dir) {
+            cli_cache_store(p_job, p_t->cache_key, p_t->p_out, p_t->out_len);
+        }
+        free(p_t->p_out);
+        p_t->p_out = NULL;
+
+        pthread_mutex_lock(&p_st->io_lock);
+        p_st->write_pending -= p_t->out_len;
+        pthread_cond_broadcast(&p_st->io_cond);
+        pthread_mutex_unlock(&p_st->io_lock);
+    }
+}
+
+/* ---- workers ---- */
+
+static void batch_run_task(BatchState *p_st, BatchTask *p_t, ESEOPL3Arena *p_arena) {
+    CliJob *p_job = &p_t->job;
+    if (p_arena) p_job->opts.p_allocator = eseopl3_arena_allocator(p_arena);
+    batch_wait_input(p_st, p_t);
+    if (!p_t->p_in) {
+        p_t->p_error = "cannot read input file";
+        batch_release_input(p_st, p_t);
+        return;
+    }
+    if (p_job->variant_at) {
+        // One pass for all of the task's variants; they write their own outputs
+        if (cli_convert_variants(p_job, p_t->p_in, p_t->in_len) != 0) p_t->p_error = "variant conversion failed";
+        batch_release_input(p_st, p_t);
+        return;
+    }
+    if (p_job->p_cache_dir) {
+        if (cli_cache_key(p_job, p_t->p_in, p_t->in_len, p_t->cache_key) != 0) {
+            p_t->p_error = "cannot load the override file";
+            batch_release_input(p_st, p_t);
+            return;
+        }
+        if (cli_cache_fetch(p_job, p_t->cache_key, p_job->p_output) == 0) {
+            p_t->is_cache_hit = true;
+            batch_release_input(p_st, p_t);
+            return;
+        }
+    }
+    int rc = cli_convert_memory(&p_job->opts, p_t->p_in, p_t->in_len, &p_t->p_out, &p_t->out_len);
+    batch_release_input(p_st, p_t);
+    if (rc != 0) {
+        p_t->p_error = "conversion failed";
+        return;
+    }
+    batch_queue_write(p_st, p_t);
+}
+
+static void *batch_worker_main(void *p_arg) {
+    BatchWorker *p_w = (BatchWorker *)p_arg;
+    BatchState *p_st = p_w->p_st;
+    for (;;) {
+        int idx = batch_take_own(&p_st->deques[p_w->id]);
+        if (idx < 0) idx = batch_steal(p_st, p_w->id);
+        if (idx < 0) return NULL;           // nothing is ever added, so empty means done
+        batch_run_task(p_st, p_st->pp_tasks[idx], p_w->p_arena);
+        // The converter's buffers went with the task; the output was copied out (malloc)
+        if (p_w->p_arena) eseopl3_arena_reset(p_w->p_arena);
+    }
+}
+
+
+typedef struct {
+    uint64_t size;
+    int      idx;
+} BatchOrder;
+
+static int batch_order_larger(const void *p_a, const void *p_b) {
+    const BatchOrder *p_oa = (const BatchOrder *)p_a;
+    const BatchOrder *p_ob = (const BatchOrder *)p_b;
+    if (p_oa->size != p_ob->size) return (p_oa->size < p_ob->size) - (p_oa->size > p_ob->size);
+    return p_oa->idx - p_ob->idx;           // stable: list order among equal sizes
+}
+
+/** Sort the runnable tasks by input size and deal them round-robin to the worker deques. */
+static int batch_schedule(BatchState *p_st) {
+    BatchOrder *p_ord = (BatchOrder *)malloc((size_t)(p_st->count + 1) * sizeof(BatchOrder));
+    p_st->p_order = (int *)malloc((size_t)(p_st->count + 1) * sizeof(int));
+    if (!p_ord || !p_st->p_order) {
+        free(p_ord);
+        return -1;
+    }
+    int n = 0;
+    for (int i = 0; i < p_st->count; ++i) {
+        if (p_st->pp_tasks[i]->p_error) continue;
+        p_ord[n].size = p_st->pp_tasks[i]->in_size * (uint64_t)p_st->pp_tasks[i]->variants;   // work, roughly
+        p_ord[n].idx = i;
+        n++;
+    }
+    qsort(p_ord, (size_t)n, sizeof(BatchOrder), batch_order_larger);
+    for (int w = 0; w < p_st->workers; ++w) {
+        BatchDeque *p_dq = &p_st->deques[w];
+        pthread_mutex_init(&p_dq->lock, NULL);
+        p_dq->p_items = (int *)malloc((size_t)(n / p_st->workers + 1) * sizeof(int));
+        if (!p_dq->p_items) {
+            free(p_ord);
+            return -1;
+        }
+    }
+    for (int k = 0; k < n; ++k) {
+        BatchDeque *p_dq = &p_st->deques[k % p_st->workers];
+        p_dq->p_items[p_dq->tail++] = p_ord[k].idx;
+        p_st->p_order[k] = p_ord[k].idx;
+    }
+    p_st->count = n;                        // the reader walks p_order[0..n)
+    free(p_ord);
+    return 0;
+}
+
+/**
+ * eseopl3patcher --batch <dir|list> [--jobs <n>] [--out-dir <dir>] [<detune>] [options...]
+ */
+int cli_batch(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s --batch <dir|list> [--jobs <n>] [--out-dir <dir>] [<detune>] [options...]\n", argv[0]);
+        return 1;
+    }
+    const char *p_source = argv[2];
+    const char *p_out_dir = NULL;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    char *extra[CLI_BATCH_MAX_ARGS / 2];
+    int nextra = 0;
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            workers = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+            p_out_dir = argv[++i];
+        } else if (nextra < CLI_BATCH_MAX_ARGS / 2) {
+            extra[nextra++] = argv[i];
+        }
+    }
+    if (workers < 1) workers = 1;
+    if (workers > CLI_BATCH_MAX_WORKERS) workers = CLI_BATCH_MAX_WORKERS;
+
+    struct stat st_src;
+    if (stat(p_source, &st_src) != 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", p_source, strerror(errno));
+        return 1;
+    }
+    if (p_out_dir && mkdir(p_out_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s: %s\n", p_out_dir, strerror(errno));
+        return 1;
+    }
+
+    BatchState st;
+    memset(&st, 0, sizeof(st));
+    BatchCollect col = {NULL, 0, 0, extra, nextra, p_out_dir};
+    if (cli_batch_scan(p_source, p_out_dir, batch_collect, &col) != 0) {
+        fprintf(stderr, "Cannot read %s: %s\n", p_source, strerror(errno));
+        batch_free_tasks(col.pp_tasks, col.count);
+        return 1;
+    }
+    st.pp_tasks = col.pp_tasks;
+    int total = col.count;
+    if (total == 0) {
+        fprintf(stderr, "No input files in %s\n", p_source);
+        batch_free_tasks(st.pp_tasks, total);
+        return 1;
+    }
+    st.count = total;
+    st.workers = (int)workers;
+    if (st.workers > total) st.workers = total;
+    if (batch_schedule(&st) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    pthread_mutex_init(&st.io_lock, NULL);
+    pthread_cond_init(&st.io_cond, NULL);
+    atomic_init(&st.steals, 0);
+    for (int i = 0; i < total; ++i) atomic_init(&st.pp_tasks[i]->input_state, BATCH_INPUT_PENDING);
+
+    double t_start = opl3_now_sec();
+    pthread_t reader, writer;
+    pthread_t threads[CLI_BATCH_MAX_WORKERS];
+    BatchWorker ctx[CLI_BATCH_MAX_WORKERS];
+    if (pthread_create(&writer, NULL, batch_writer_main, &st) != 0) {
+        fprintf(stderr, "Failed to start the writer thread\n");
+        return 1;
+    }
+    bool is_reader = pthread_create(&reader, NULL, batch_reader_main, &st) == 0;   // optional: workers read themselves
+    bool is_verbose = false;
+    for (int i = 0; i < total; ++i) is_verbose |= st.pp_tasks[i]->job.opts.verbose;
+
+    int started = 0;
+    for (int w = 0; w < st.workers; ++w) {
+        ctx[w].p_st = &st;
+        ctx[w].id = w;
+        ctx[w].p_arena = eseopl3_arena_create();   // NULL: that worker converts with malloc
+        if (pthread_create(&threads[started], NULL, batch_worker_main, &ctx[w]) == 0) started++;
+    }
+    if (started == 0) {
+        batch_worker_main(&ctx[0]);         // steals everything from the other deques
+    }
+    for (int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+    for (int w = 0; w < st.workers; ++w) {
+        if (is_verbose && ctx[w].p_arena) {
+            fprintf(stderr, "[BATCH] worker %d: arena %zu KiB, %zu heap calls\n", w,
+                    eseopl3_arena_reserved(ctx[w].p_arena) / 1024, eseopl3_arena_heap_calls(ctx[w].p_arena));
+        }
+        eseopl3_arena_destroy(ctx[w].p_arena);
+    }
+
+    pthread_mutex_lock(&st.io_lock);
+    st.is_stopping = true;
+    st.is_converted = true;
+    pthread_cond_broadcast(&st.io_cond);
+    pthread_mutex_unlock(&st.io_lock);
+    if (is_reader) pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    double elapsed = opl3_now_sec() - t_start;
+
+    int converted = 0, hits = 0, failed = 0;
+    uint64_t in_bytes = 0, out_bytes = 0;
+    for (int i = 0; i < total; ++i) {
+        BatchTask *p_t = st.pp_tasks[i];
+        if (p_t->p_error) {
+            failed++;
+            fprintf(stderr, "[BATCH] FAILED %s: %s\n", p_t->argc > 1 ? p_t->argv[1] : "(line)", p_t->p_error);
+        } else {
+            in_bytes += p_t->in_size;
+            if (p_t->is_cache_hit) {
+                hits++;
+            } else {
+                converted++;
+                out_bytes += p_t->out_len;
+            }
+        }
+    }
+    if (elapsed <= 0) elapsed = 1e-9;
+    printf("[BATCH] %d files: %d converted, %d cached, %d failed in %.3f s "
+           "(%.1f files/s, %.2f MB/s in, %.2f MB out, %d workers, %llu steals)\n",
+           total, converted, hits, failed, elapsed,
+           (double)(converted + hits) / elapsed, (double)in_bytes / 1e6 / elapsed, (double)out_bytes / 1e6,
+           st.workers, (unsigned long long)atomic_load(&st.steals));
+
+    for (int w = 0; w < st.workers; ++w) {
+        free(st.deques[w].p_items);
+        pthread_mutex_destroy(&st.deques[w].lock);
+    }
+    pthread_mutex_destroy(&st.io_lock);
+    pthread_cond_destroy(&st.io_cond);
+    free(st.p_order);
+    batch_free_tasks(st.pp_tasks, total);
+    return failed ? 1 : 0;
+}
+#endif /* _WIN32 */
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
+#include "cli.h"
+#include "../vgm/vgm_header.h"
+#include "../opl3/opl3_clock.h"
+
+#define BRIDGE_VGM_HEADER   0x100
+#define BRIDGE_INPUT_BYTES  4096
+
+// A live producer (pipe, terminal) can go quiet while a note is held for coalescing:
+// each tick without input advances the bridge by the wall clock, so due notes still
+// reach the player instead of waiting for the next write. The clock trails by one tick
+// so that a record arriving with a little jitter is not taken as late.
+#define BRIDGE_TICK_MS      1
+#define BRIDGE_TICK_SAMPLES (44100 * BRIDGE_TICK_MS / 1000)
+
+typedef struct {
+    ESEOPL3Bridge  *p_br;
+    FILE           *p_wf;
+    bool            is_moon;
+    uint32_t        clock;          /* written to the header */
+    _Atomic bool    is_done;        /* producer finished: drain and stop */
+    uint32_t        end_sample;     /* valid once is_done is set */
+    uint32_t        sample;         /* player position */
+    uint32_t        data_bytes;
+} BridgePlayer;
+
+typedef struct {
+    FILE           *p_fp;
+    bool            is_live;        /* not a regular file: reads can stall, the tick runs */
+    uint32_t        last;           /* sample of the last record */
+    uint64_t        last_ns;        /* when it arrived (0 = no record yet) */
+    size_t          pos;
+    size_t          len;
+    unsigned char   buf[BRIDGE_INPUT_BYTES];
+} BridgeInput;
+
+static bool bridge_input_is_live(FILE *p_fp) {
+#ifdef _WIN32
+    (void)p_fp;
+    return false;
+#else
+    struct stat st;
+    return fstat(fileno(p_fp), &st) != 0 || !S_ISREG(st.st_mode);
+#endif
+}
+
+/**
+ * Refill the input buffer. A live input is polled, and while it stays quiet the bridge
+ * is advanced every BRIDGE_TICK_MS along the wall clock started by the last record.
+ * Returns the bytes read, 0 at EOF, -1 on a read error.
+ */
+static long bridge_input_fill(BridgeInput *p_in, ESEOPL3Bridge *p_br) {
+#ifndef _WIN32
+    if (p_in->is_live) {
+        int fd = fileno(p_in->p_fp);
+        struct pollfd pfd = {fd, POLLIN, 0};
+        for (;;) {
+            int r = poll(&pfd, 1, BRIDGE_TICK_MS);
+            if (r > 0) break;
+            if (r < 0 && errno != EINTR) return -1;
+            if (r == 0 && p_in->last_ns) {
+                uint64_t elapsed = (opl3_now_ns() - p_in->last_ns) * 44100u / 1000000000u;
+                if (elapsed > BRIDGE_TICK_SAMPLES) {
+                    eseopl3_bridge_advance(p_br, p_in->last + (uint32_t)(elapsed - BRIDGE_TICK_SAMPLES));
+                }
+            }
+        }
+        ssize_t n;
+        do {
+            n = read(fd, p_in->buf, sizeof(p_in->buf));
+        } while (n < 0 && errno == EINTR);
+        return (long)n;
+    }
+#else
+    (void)p_br;
+#endif
+    size_t n = fread(p_in->buf, 1, sizeof(p_in->buf), p_in->p_fp);
+    return (n == 0 && ferror(p_in->p_fp)) ? -1 : (long)n;
+}
+
+/** Next 6-byte record. Returns 1, 0 at the end of the input (a partial record is dropped), -1 on a read error. */
+static int bridge_input_next(BridgeInput *p_in, ESEOPL3Bridge *p_br, unsigned char *p_rec) {
+    size_t have = 0;
+    while (have < CLI_BRIDGE_RECORD_BYTES) {
+        if (p_in->pos == p_in->len) {
+            long n = bridge_input_fill(p_in, p_br);
+            if (n <= 0) return (int)n;
+            p_in->pos = 0;
+            p_in->len = (size_t)n;
+        }
+        size_t take = p_in->len - p_in->pos;
+        if (take > CLI_BRIDGE_RECORD_BYTES - have) take = CLI_BRIDGE_RECORD_BYTES - have;
+        memcpy(p_rec + have, p_in->buf + p_in->pos, take);
+        p_in->pos += take;
+        have += take;
+    }
+    p_in->last = (uint32_t)p_rec[0] | ((uint32_t)p_rec[1] << 8) | ((uint32_t)p_rec[2] << 16) | ((uint32_t)p_rec[3] << 24);
+    if (p_in->is_live) p_in->last_ns = opl3_now_ns();
+    return 1;
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static void bridge_put_wait(BridgePlayer *p_pl, uint32_t sample) {
+    while (p_pl->sample < sample) {
+        uint32_t step = sample - p_pl->sample;
+        if (step > 0xFFFF) step = 0xFFFF;
+        unsigned char cmd[3] = {0x61, (unsigned char)(step & 0xFF), (unsigned char)(step >> 8)};
+        fwrite(cmd, 1, sizeof(cmd), p_pl->p_wf);
+        p_pl->data_bytes += sizeof(cmd);
+        p_pl->sample += step;
+    }
+}
+
+/** Consumer side of the bridge: stands in for a player and logs what it would write to the chip. */
+static void *bridge_player_main(void *p_arg) {
+    BridgePlayer *p_pl = (BridgePlayer *)p_arg;
+    ESEOPL3Write batch[256];
+    for (;;) {
+        bool is_done = atomic_load_explicit(&p_pl->is_done, memory_order_acquire);
+        size_t n = eseopl3_bridge_pop(p_pl->p_br, batch, sizeof(batch) / sizeof(batch[0]));
+        for (size_t i = 0; i < n; ++i) {
+            bridge_put_wait(p_pl, batch[i].sample);
+            if (p_pl->is_moon) {
+                unsigned char cmd[4] = {0xD0, batch[i].port, batch[i].reg, batch[i].val};
+                fwrite(cmd, 1, sizeof(cmd), p_pl->p_wf);
+                p_pl->data_bytes += sizeof(cmd);
+            } else {
+                unsigned char cmd[3] = {(unsigned char)(batch[i].port ? 0x5F : 0x5E), batch[i].reg, batch[i].val};
+                fwrite(cmd, 1, sizeof(cmd), p_pl->p_wf);
+                p_pl->data_bytes += sizeof(cmd);
+            }
+        }
+        if (n == 0) {
+            // is_done was read before the pop, so an empty pop after it means everything is in
+            if (is_done) break;
+            sched_yield();
+        }
+    }
+    bridge_put_wait(p_pl, p_pl->end_sample);
+    fputc(0x66, p_pl->p_wf);
+    p_pl->data_bytes++;
+    return NULL;
+}
+
+static void bridge_write_header(BridgePlayer *p_pl) {
+    unsigned char h[BRIDGE_VGM_HEADER] = {0};
+    memcpy(h, "Vgm ", 4);
+    put_le32(h + 0x04, BRIDGE_VGM_HEADER + p_pl->data_bytes - 0x04);
+    put_le32(h + 0x08, 0x00000171);
+    put_le32(h + 0x18, p_pl->sample);
+    put_le32(h + 0x34, BRIDGE_VGM_HEADER - 0x34);
+    put_le32(h + (p_pl->is_moon ? 0x60 : 0x5C), p_pl->clock);
+    fseek(p_pl->p_wf, 0, SEEK_SET);
+    fwrite(h, 1, sizeof(h), p_pl->p_wf);
+}
+
+/** --bridge: feed timestamped YM2413 writes through the real-time bridge. */
+int cli_run_bridge(const CliJob *p_job) {
+    const ESEOPL3Options *p_opts = &p_job->opts;
+    const char *p_input = p_job->p_input;
+    const char *p_output = p_job->p_output;
+    if (!p_output) {
+        fprintf(stderr, "--bridge needs -o <output.vgm>.\n");
+        return 1;
+    }
+    FILE *p_fp = (strcmp(p_input, "-") == 0) ? stdin : fopen(p_input, "rb");
+    if (!p_fp) {
+        fprintf(stderr, "Cannot open input file: %s\n", p_input);
+        return 1;
+    }
+    BridgePlayer player = {0};
+    player.is_moon = p_opts->moon;
+    player.clock = p_opts->moon ? 33868800 : (p_opts->opl3_clock ? p_opts->opl3_clock : OPL3_CLOCK);
+    atomic_init(&player.is_done, false);
+    player.p_wf = fopen(p_output, "wb");
+    if (!player.p_wf) {
+        fprintf(stderr, "Failed to open output file: %s\n", p_output);
+        if (p_fp != stdin) fclose(p_fp);
+        return 1;
+    }
+    player.p_br = eseopl3_bridge_create(p_opts, p_job->bridge_ring);
+    if (!player.p_br) {
+        fclose(player.p_wf);
+        if (p_fp != stdin) fclose(p_fp);
+        return 1;
+    }
+    unsigned char pad[BRIDGE_VGM_HEADER] = {0};
+    fwrite(pad, 1, sizeof(pad), player.p_wf);
+
+    pthread_t th;
+    if (pthread_create(&th, NULL, bridge_player_main, &player) != 0) {
+        fprintf(stderr, "Failed to start the player thread\n");
+        eseopl3_bridge_destroy(player.p_br);
+        fclose(player.p_wf);
+        if (p_fp != stdin) fclose(p_fp);
+        return 1;
+    }
+
+    // Input is read faster than real time, so let the player catch up before each write
+    // (one YM2413 write expands to at most a few dozen OPL3 writes).
+    size_t headroom = eseopl3_bridge_space(player.p_br) / 2;
+    BridgeInput *p_in = (BridgeInput *)calloc(1, sizeof(BridgeInput));
+    int rc = 0, got = 0;
+    if (p_in) {
+        p_in->p_fp = p_fp;
+        p_in->is_live = bridge_input_is_live(p_fp);
+        unsigned char rec[CLI_BRIDGE_RECORD_BYTES];
+        while ((got = bridge_input_next(p_in, player.p_br, rec)) == 1) {
+            while (eseopl3_bridge_space(player.p_br) < headroom) sched_yield();
+            eseopl3_bridge_write(player.p_br, p_in->last, rec[4], rec[5]);
+        }
+        player.end_sample = p_in->last;
+        free(p_in);
+    }
+    if (!p_in || got < 0) {
+        fprintf(stderr, "Failed to read entire file!\n");
+        rc = 1;
+    }
+    if (p_fp != stdin) fclose(p_fp);
+    eseopl3_bridge_finish(player.p_br);
+
+    atomic_store_explicit(&player.is_done, true, memory_order_release);
+    pthread_join(th, NULL);
+    bridge_write_header(&player);
+    fclose(player.p_wf);
+
+    ESEOPL3BridgeStats st;
+    eseopl3_bridge_stats(player.p_br, &st);
+    printf("[BRIDGE] Converted VGM written to: %s\n", p_output);
+    printf("[BRIDGE] writes=%llu opl3=%llu overflow=%llu late=%llu\n",
+           (unsigned long long)st.writes, (unsigned long long)st.opl3_writes,
+           (unsigned long long)st.overflows, (unsigned long long)st.late);
+    if (st.popped) {
+        printf("[BRIDGE] queue latency avg=%llu ns max=%u ns\n",
+               (unsigned long long)(st.total_ns / st.popped), st.max_ns);
+    }
+    if (p_opts->verbose) {
+        for (int k = 0; k < 32; ++k) {
+            if (st.hist[k]) printf("[BRIDGE]   %10llu ns+ : %u\n", 1ULL << k, st.hist[k]);
+        }
+    }
+    eseopl3_bridge_destroy(player.p_br);
+    return rc;
+}
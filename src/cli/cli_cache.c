@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "cli.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define cache_mkdir(p) _mkdir(p)
+#define cache_getpid() _getpid()
+#else
+#include <unistd.h>
+#define cache_mkdir(p) mkdir((p), 0755)
+#define cache_getpid() getpid()
+#endif
+
+/*
+ * --cache <dir>: content-addressed store of converted VGMs.
+ *
+ * <dir>/<key の先頭2桁>/<key>.vgm に保存する (key = eseopl3_cache_key)。
+ * 入力もオプションも同じなら変換せずに保存済みの出力をコピー (--cache-link ならハードリンク) する。
+ * 書き込みは一時ファイル + rename なので、複数プロセス / スレッドで同じディレクトリを共有できる。
+ *
+ * 容量制限はキャッシュ全体の合計に対してかける。<dir>/size に合計バイト数を持ち、
+ * 保存のたびにロックして書いたサイズを足す。合計が cache_max を超えたとき (または
+ * size が無いとき) だけ全バケットを走査して正確な合計を取り直し、mtime の古い順に
+ * cache_max の 90% まで消す。ヒットで mtime を更新するので LRU になる。
+ * いま保存したエントリは消さない。
+ */
+
+#define CACHE_PATH_MAX      1024
+#define CACHE_EVICT_TO      90          /* % of cache_max left after eviction */
+#define CACHE_INDEX_NAME    "size"
+
+typedef struct {
+    char     name[ESEOPL3_CACHE_KEY_CHARS + 8];     /* "<bucket>/<key>.vgm" */
+    time_t   mtime;
+    uint64_t size;
+} CacheEntry;
+
+typedef struct {
+    CacheEntry *p_ents;
+    size_t      count;
+    size_t      cap;
+    uint64_t    total;
+} CacheScan;
+
+static void cache_entry_path(const CliJob *p_job, const char *p_key, char *p_path, size_t size) {
+    snprintf(p_path, size, "%s/%.2s/%s.vgm", p_job->p_cache_dir, p_key, p_key);
+}
+
+/** Unique temporary name next to p_target (processes and threads may share the directory). */
+/** Temporary name next to p_target, unique per process and thread. */
+void cli_cache_tmp_path(const char *p_target, char *p_path, size_t size) {
+    snprintf(p_path, size, "%s.tmp%d.%lx", p_target, (int)cache_getpid(), (unsigned long)(uintptr_t)pthread_self());
+}
+
+/** Move a completely written temporary file over p_path. On failure the temporary file is removed. */
+int cli_cache_replace(const char *p_tmp, const char *p_path) {
+#ifdef _WIN32
+    remove(p_path);   // rename does not replace on Windows
+#endif
+    if (rename(p_tmp, p_path) != 0) {
+        remove(p_tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/** Write p_data to p_path atomically (temporary file + rename): an existing file is only replaced by a complete one. */
+int cli_cache_write_atomic(const char *p_path, const uint8_t *p_data, size_t size) {
+    char tmp[CLI_TMP_PATH_MAX];
+    cli_cache_tmp_path(p_path, tmp, sizeof(tmp));
+    FILE *p_wf = fopen(tmp, "wb");
+    if (!p_wf) return -1;
+    bool is_ok = fwrite(p_data, 1, size, p_wf) == size;
+    if (fclose(p_wf) != 0) is_ok = false;
+    if (!is_ok) {
+        remove(tmp);
+        return -1;
+    }
+    return cli_cache_replace(tmp, p_path);
+}
+
+/** --metrics / --profile / --trace report on the conversion itself: always a miss (the result is still stored). */
+static bool cache_is_bypassed(const CliJob *p_job) {
+    return p_job->opts.metrics_path != NULL || p_job->opts.profile || p_job->opts.trace_path != NULL;
+}
+
+int cli_cache_key(const CliJob *p_job, const uint8_t *p_in, size_t in_len, char *p_key) {
+    return eseopl3_cache_key(&p_job->opts, p_in, in_len, p_key);
+}
+
+uint8_t *cli_cache_load(const CliJob *p_job, const char *p_key, size_t *p_len) {
+    if (cache_is_bypassed(p_job)) return NULL;
+    char path[CACHE_PATH_MAX];
+    cache_entry_path(p_job, p_key, path, sizeof(path));
+    uint8_t *p_data = cli_read_file(path, p_len);
+    if (p_data) utime(path, NULL);      // most recently used
+    return p_data;
+}
+
+int cli_cache_fetch(const CliJob *p_job, const char *p_key, const char *p_output) {
+    if (cache_is_bypassed(p_job)) return -1;
+    char path[CACHE_PATH_MAX];
+    cache_entry_path(p_job, p_key, path, sizeof(path));
+#ifndef _WIN32
+    if (p_job->is_cache_link) {
+        char tmp[CLI_TMP_PATH_MAX];
+        cli_cache_tmp_path(p_output, tmp, sizeof(tmp));
+        if (link(path, tmp) == 0) {
+            if (rename(tmp, p_output) == 0) {
+                utime(path, NULL);
+                return 0;
+            }
+            remove(tmp);
+        }
+        // different file system etc.: fall back to a copy
+    }
+#endif
+    size_t size;
+    uint8_t *p_data = cli_cache_load(p_job, p_key, &size);
+    if (!p_data) return -1;
+    int rc = cli_cache_write_atomic(p_output, p_data, size);
+    free(p_data);
+    return rc;
+}
+
+static int cache_entry_older(const void *p_a, const void *p_b) {
+    const CacheEntry *p_ea = (const CacheEntry *)p_a;
+    const CacheEntry *p_eb = (const CacheEntry *)p_b;
+    return (p_ea->mtime > p_eb->mtime) - (p_ea->mtime < p_eb->mtime);
+}
+
+/** Add the entries of one bucket directory to p_scan. */
+static void cache_scan_bucket(const char *p_cache_dir, const char *p_bucket, CacheScan *p_scan) {
+    char dir[CACHE_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/%s", p_cache_dir, p_bucket);
+    DIR *p_dir = opendir(dir);
+    if (!p_dir) return;
+    struct dirent *p_de;
+    while ((p_de = readdir(p_dir)) != NULL) {
+        size_t len = strlen(p_de->d_name);
+        if (len != ESEOPL3_CACHE_KEY_CHARS + 4 || strcmp(p_de->d_name + len - 4, ".vgm") != 0) continue;
+        char path[CACHE_PATH_MAX + 64];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, p_de->d_name);
+        if (stat(path, &st) != 0) continue;
+        if (p_scan->count == p_scan->cap) {
+            size_t cap = p_scan->cap ? p_scan->cap * 2 : 256;
+            CacheEntry *p_new = (CacheEntry *)realloc(p_scan->p_ents, cap * sizeof(CacheEntry));
+            if (!p_new) break;
+            p_scan->p_ents = p_new;
+            p_scan->cap = cap;
+        }
+        CacheEntry *p_ent = &p_scan->p_ents[p_scan->count++];
+        snprintf(p_ent->name, sizeof(p_ent->name), "%s/%s", p_bucket, p_de->d_name);
+        p_ent->mtime = st.st_mtime;
+        p_ent->size = (uint64_t)st.st_size;
+        p_scan->total += (uint64_t)st.st_size;
+    }
+    closedir(p_dir);
+}
+
+/**
+ * Full scan: bring the whole cache within cache_max (down to CACHE_EVICT_TO %), dropping
+ * the least recently used entries but never p_keep ("<bucket>/<key>.vgm"). Returns the new total.
+ */
+static uint64_t cache_evict(const char *p_cache_dir, uint64_t cache_max, const char *p_keep) {
+    CacheScan scan = {0};
+    DIR *p_dir = opendir(p_cache_dir);
+    if (!p_dir) return 0;
+    struct dirent *p_de;
+    while ((p_de = readdir(p_dir)) != NULL) {
+        if (strlen(p_de->d_name) == 2 && p_de->d_name[0] != '.') cache_scan_bucket(p_cache_dir, p_de->d_name, &scan);
+    }
+    closedir(p_dir);
+    if (scan.total > cache_max) {
+        uint64_t target = cache_max / 100 * CACHE_EVICT_TO;
+        qsort(scan.p_ents, scan.count, sizeof(CacheEntry), cache_entry_older);
+        for (size_t i = 0; i < scan.count && scan.total > target; ++i) {
+            if (strcmp(scan.p_ents[i].name, p_keep) == 0) continue;
+            char path[CACHE_PATH_MAX + 64];
+            snprintf(path, sizeof(path), "%s/%s", p_cache_dir, scan.p_ents[i].name);
+            if (remove(path) == 0) scan.total -= scan.p_ents[i].size;
+        }
+    }
+    free(scan.p_ents);
+    return scan.total;
+}
+
+/**
+ * Account `added` bytes in <dir>/size (locked: processes share the directory) and run a
+ * full eviction scan when the running total passes cache_max or the index is missing.
+ */
+static void cache_account(const CliJob *p_job, const char *p_keep, int64_t added) {
+    char path[CACHE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/" CACHE_INDEX_NAME, p_job->p_cache_dir);
+    FILE *fp = fopen(path, "r+");
+    if (!fp) fp = fopen(path, "w+");
+    if (!fp) {
+        cache_evict(p_job->p_cache_dir, p_job->cache_max_bytes, p_keep);
+        return;
+    }
+#ifndef _WIN32
+    // Serializes the read-modify-write (Windows: unlocked; a lost update only delays the next scan)
+    struct flock lk = {0};
+    lk.l_type = F_WRLCK;
+    lk.l_whence = SEEK_SET;
+    fcntl(fileno(fp), F_SETLKW, &lk);
+#endif
+    unsigned long long total = 0;
+    bool is_known = fscanf(fp, "%llu", &total) == 1;
+    if (is_known && added < 0 && (unsigned long long)-added > total) is_known = false;
+    if (is_known) total += (unsigned long long)added;
+    if (!is_known || total > p_job->cache_max_bytes) {
+        total = cache_evict(p_job->p_cache_dir, p_job->cache_max_bytes, p_keep);
+    }
+    rewind(fp);
+    fprintf(fp, "%020llu\n", total);
+    fflush(fp);
+#ifndef _WIN32
+    lk.l_type = F_UNLCK;
+    fcntl(fileno(fp), F_SETLK, &lk);
+#endif
+    fclose(fp);
+}
+
+int cli_cache_store(const CliJob *p_job, const char *p_key, const uint8_t *p_data, size_t size) {
+    char bucket[CACHE_PATH_MAX], path[CACHE_PATH_MAX], keep[ESEOPL3_CACHE_KEY_CHARS + 8];
+    snprintf(bucket, sizeof(bucket), "%s/%.2s", p_job->p_cache_dir, p_key);
+    if (cache_mkdir(p_job->p_cache_dir) != 0 && errno != EEXIST) return -1;
+    if (cache_mkdir(bucket) != 0 && errno != EEXIST) return -1;
+    cache_entry_path(p_job, p_key, path, sizeof(path));
+    struct stat st;
+    int64_t replaced = (stat(path, &st) == 0) ? (int64_t)st.st_size : 0;
+    if (cli_cache_write_atomic(path, p_data, size) != 0) return -1;
+    snprintf(keep, sizeof(keep), "%.2s/%s.vgm", p_key, p_key);
+    cache_account(p_job, keep, (int64_t)size - replaced);
+    return 0;
+}
+
+int cli_cache_store_file(const CliJob *p_job, const char *p_key, const char *p_path) {
+    size_t size;
+    uint8_t *p_data = cli_read_file(p_path, &size);
+    if (!p_data) return -1;
+    int rc = cli_cache_store(p_job, p_key, p_data, size);
+    free(p_data);
+    return rc;
+}
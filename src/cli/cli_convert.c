@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cli.h"
+#include "../opl3/opl3_clock.h"
+
+/** Whole file into memory (malloc'ed). NULL if it cannot be read. */
+uint8_t *cli_read_file(const char *p_path, size_t *p_len) {
+    FILE *p_fp = fopen(p_path, "rb");
+    if (!p_fp) return NULL;
+    uint8_t *p_data = NULL;
+    size_t len = 0, cap = 0;
+    for (;;) {
+        if (cap - len < CLI_IO_CHUNK_BYTES) {
+            cap = cap ? cap * 2 : CLI_IO_CHUNK_BYTES;
+            uint8_t *p_new = (uint8_t *)realloc(p_data, cap);
+            if (!p_new) {
+                free(p_data);
+                fclose(p_fp);
+                return NULL;
+            }
+            p_data = p_new;
+        }
+        size_t n = fread(p_data + len, 1, cap - len, p_fp);
+        len += n;
+        if (n == 0) break;
+    }
+    bool is_error = ferror(p_fp);
+    fclose(p_fp);
+    if (is_error) {
+        free(p_data);
+        return NULL;
+    }
+    *p_len = len;
+    return p_data;
+}
+
+/** Write a whole file. Returns 0, or -1 if it cannot be created or written. */
+int cli_write_file(const char *p_path, const uint8_t *p_data, size_t size) {
+    FILE *p_wf = fopen(p_path, "wb");
+    if (!p_wf) return -1;
+    bool is_written = fwrite(p_data, 1, size, p_wf) == size;
+    if (fclose(p_wf) != 0) is_written = false;
+    return is_written ? 0 : -1;
+}
+
+/**
+ * Open the streamed output (a temporary file next to it, renamed over it when complete) once there is something to write.
+ * The old output stays until then; a hardlink into the cache (--cache-link) is replaced, never written through.
+ */
+static FILE *open_output(const char *p_output_path, const char *p_tmp_path) {
+    FILE *p_wf = fopen(p_tmp_path, "wb");
+    if (!p_wf) fprintf(stderr, "Failed to open output file: %s\n", p_output_path);
+    return p_wf;
+}
+
+/** Hand the converted data pulled so far to the output file (opened with the header space reserved). */
+static int write_pending(ESEOPL3Context *p_cs, FILE **pp_wf, const char *p_output_path, const char *p_tmp_path) {
+    unsigned char out[CLI_IO_CHUNK_BYTES];
+    if (eseopl3_pending(p_cs) == 0) return 0;
+    if (!*pp_wf) {
+        *pp_wf = open_output(p_output_path, p_tmp_path);
+        if (!*pp_wf) return -1;
+        // The header is written last, once the sizes and the loop point are known
+        uint32_t header_size = eseopl3_header_size(p_cs);
+        memset(out, 0, sizeof(out));
+        if (fwrite(out, 1, header_size, *pp_wf) != header_size) goto write_error;
+    }
+    size_t n;
+    while ((n = eseopl3_pull(p_cs, out, sizeof(out))) > 0) {
+        if (fwrite(out, 1, n, *pp_wf) != n) goto write_error;
+    }
+    return 0;
+
+write_error:
+    fprintf(stderr, "Failed to write output file: %s\n", p_output_path);
+    return -1;
+}
+
+/** Header and GD3 into the streamed output, then move it over p_output_path. Closes p_wf; 0 or -1. */
+static int finish_output(FILE *p_wf, const ESEOPL3Result *p_res, const char *p_output_path, const char *p_tmp_path) {
+    bool is_ok = fwrite(p_res->p_gd3, 1, p_res->gd3_size, p_wf) == p_res->gd3_size &&
+                 fseek(p_wf, 0, SEEK_SET) == 0 &&
+                 fwrite(p_res->p_header, 1, p_res->header_size, p_wf) == p_res->header_size;
+    if (fclose(p_wf) != 0) is_ok = false;
+    if (!is_ok) {
+        remove(p_tmp_path);
+    } else if (cli_cache_replace(p_tmp_path, p_output_path) != 0) {
+        is_ok = false;
+    }
+    if (!is_ok) fprintf(stderr, "Failed to write output file: %s\n", p_output_path);
+    return is_ok ? 0 : -1;
+}
+
+static void print_json_string(const char *p_str) {
+    putchar('"');
+    for (const unsigned char *p = (const unsigned char *)p_str; *p; ++p) {
+        if (*p == '"' || *p == '\\') printf("\\%c", *p);
+        else if (*p < 0x20) printf("\\u%04x", *p);
+        else putchar(*p);
+    }
+    putchar('"');
+}
+
+/** --profile: one JSON line (times in microseconds; read/write = file I/O around the library). */
+static void print_profile(const char *p_input, const ESEOPL3Profile *p_prof, uint64_t read_ns, uint64_t write_ns,
+                          uint64_t wall_ns) {
+    double wall_s = wall_ns > 0 ? (double)wall_ns / 1e9 : 1e-9;
+    printf("[PROFILE] {\"input\":");
+    print_json_string(p_input);
+    printf(",\"input_bytes\":%llu,\"output_bytes\":%llu,\"commands\":%llu,\"samples\":%llu,\"wall_us\":%.1f,\"stages_us\":{\"read\":%.1f",
+           (unsigned long long)p_prof->input_bytes, (unsigned long long)p_prof->output_bytes,
+           (unsigned long long)p_prof->commands, (unsigned long long)p_prof->total_samples,
+           (double)wall_ns / 1e3, (double)read_ns / 1e3);
+    for (int s = 0; s < ESEOPL3_NUM_STAGES; ++s) {
+        printf(",\"%s\":%.1f", eseopl3_stage_name(s), (double)p_prof->stage_ns[s] / 1e3);
+    }
+    printf(",\"write\":%.1f},\"calls\":{", (double)write_ns / 1e3);
+    for (int s = 0; s < ESEOPL3_NUM_STAGES; ++s) {
+        printf("%s\"%s\":%llu", s ? "," : "", eseopl3_stage_name(s), (unsigned long long)p_prof->stage_calls[s]);
+    }
+    printf("},\"alloc\":{\"allocs\":%llu,\"reallocs\":%llu,\"frees\":%llu,\"bytes\":%llu,\"peak_bytes\":%llu}",
+           (unsigned long long)p_prof->allocs, (unsigned long long)p_prof->reallocs, (unsigned long long)p_prof->frees,
+           (unsigned long long)p_prof->alloc_bytes, (unsigned long long)p_prof->peak_bytes);
+    printf(",\"throughput\":{\"input_mb_s\":%.2f,\"commands_s\":%.0f,\"output_per_input\":%.3f}}\n",
+           (double)p_prof->input_bytes / 1e6 / wall_s, (double)p_prof->commands / wall_s,
+           p_prof->input_bytes ? (double)p_prof->output_bytes / (double)p_prof->input_bytes : 0.0);
+}
+
+/** Convert p_job->p_input to p_job->p_output (default <input>OPL3.vgm) and print the summary. */
+int cli_convert_file(CliJob *p_job) {
+    if (p_job->variant_at) {
+        size_t in_len;
+        uint8_t *p_in = cli_has_vgm_extension_or_none(p_job->p_input) ? cli_read_file(p_job->p_input, &in_len) : NULL;
+        if (!p_in) {
+            fprintf(stderr, "Cannot open input file: %s\n", p_job->p_input);
+            return 1;
+        }
+        int failed = cli_convert_variants(p_job, p_in, in_len);
+        free(p_in);
+        return failed ? 1 : 0;
+    }
+
+    // Output file name
+    if (!p_job->p_output) {
+        cli_make_default_output_name(p_job->p_input, p_job->default_out, sizeof(p_job->default_out));
+        p_job->p_output = p_job->default_out;
+    }
+    const char *p_input_vgm = p_job->p_input;
+    const char *p_output_path = p_job->p_output;
+    ESEOPL3Options *p_opts = &p_job->opts;
+    p_opts->output_path = p_output_path;
+    char tmp_path[CLI_TMP_PATH_MAX];
+    cli_cache_tmp_path(p_output_path, tmp_path, sizeof(tmp_path));
+
+    // File extension check
+    if (!cli_has_vgm_extension_or_none(p_input_vgm)) {
+        fprintf(stderr, "Input file must have .vgm extension or no extension.\n");
+        return 1;
+    }
+
+    // --cache: a stored result for the same input and options replaces the conversion
+    char cache_key[ESEOPL3_CACHE_KEY_CHARS + 1];
+    if (p_job->p_cache_dir) {
+        size_t in_len;
+        uint8_t *p_in = cli_read_file(p_input_vgm, &in_len);
+        if (!p_in) {
+            fprintf(stderr, "Cannot open input file: %s\n", p_input_vgm);
+            return 1;
+        }
+        int rc = cli_cache_key(p_job, p_in, in_len, cache_key);
+        free(p_in);
+        if (rc != 0) return 1;
+        if (cli_cache_fetch(p_job, cache_key, p_output_path) == 0) {
+            printf("[CACHE] Hit %s -> %s\n", cache_key, p_output_path);
+            return 0;
+        }
+    }
+
+    // Open input file
+    FILE *p_fp = fopen(p_input_vgm, "rb");
+    if (!p_fp) {
+        fprintf(stderr, "Cannot open input file: %s\n", p_input_vgm);
+        return 1;
+    }
+
+    uint64_t t_start = opl3_now_ns();
+    uint64_t read_ns = 0, write_ns = 0, t0;
+    ESEOPL3Context *p_cs = eseopl3_create(p_opts);
+    if (!p_cs) {
+        fclose(p_fp);
+        return 1;
+    }
+
+    // Convert while reading: every chunk is pushed, converted data goes straight to the output
+    FILE *p_wf = NULL;
+    unsigned char chunk[CLI_IO_CHUNK_BYTES];
+    size_t n;
+    int rc = 0;
+    while (rc == 0) {
+        t0 = opl3_now_ns();
+        n = fread(chunk, 1, sizeof(chunk), p_fp);
+        read_ns += opl3_now_ns() - t0;
+        if (n == 0) break;
+        if (eseopl3_push(p_cs, chunk, n) != 0) {
+            rc = 1;
+            break;
+        }
+        t0 = opl3_now_ns();
+        if (write_pending(p_cs, &p_wf, p_output_path, tmp_path) != 0) rc = 1;
+        write_ns += opl3_now_ns() - t0;
+    }
+    if (rc == 0 && ferror(p_fp)) {
+        fprintf(stderr, "Failed to read entire file!\n");
+        rc = 1;
+    }
+    fclose(p_fp);
+
+    ESEOPL3Result result;
+    if (rc == 0 && eseopl3_finalize(p_cs, &result) != 0) rc = 1;
+    t0 = opl3_now_ns();
+    if (rc == 0 && write_pending(p_cs, &p_wf, p_output_path, tmp_path) != 0) rc = 1;
+    if (rc == 0 && !p_wf) {
+        // No music data at all: header and GD3 only
+        p_wf = open_output(p_output_path, tmp_path);
+        if (!p_wf || fseek(p_wf, result.header_size, SEEK_SET) != 0) rc = 1;
+    }
+    if (rc == 0) {
+        rc = finish_output(p_wf, &result, p_output_path, tmp_path) != 0;
+    } else if (p_wf) {
+        fclose(p_wf);
+        remove(tmp_path);   // the previous output (if any) stays as it was
+    }
+    if (rc != 0) {
+        eseopl3_destroy(p_cs);
+        return 1;
+    }
+    write_ns += opl3_now_ns() - t0;
+    uint64_t wall_ns = opl3_now_ns() - t_start;
+
+    // Only a complete output (every write checked, renamed into place) reaches the cache
+    if (p_job->p_cache_dir) {
+        if (cli_cache_store_file(p_job, cache_key, p_output_path) == 0) {
+            printf("[CACHE] Stored %s\n", cache_key);
+        } else {
+            fprintf(stderr, "[CACHE] Cannot store %s under %s\n", cache_key, p_job->p_cache_dir);
+        }
+    }
+
+    printf("[GD3] Creator: %s\n", p_opts->creator);
+
+
+    if (p_opts->msx_audio) {
+        printf("[Y9050] MSX-AUDIO: ON\n");
+    }
+
+    if (p_opts->moon) {
+        printf("[OPL4] Converted VGM written to: %s\n", p_output_path);
+        printf("[OPL4] Detune percentage (-detune <val>): %g%%\n", p_opts->detune);
+        printf("[OPL4] Detune limit (-detune_limit <val>): max +-%g\n", p_opts->detune_limit);
+        printf("[OPL4] Channel Panning Mode (-ch_panning <val>): %d\n", p_opts->ch_panning);
+        printf("[OPL4] Port0 Volume (-vr0 <val>): %.2f%%\n", p_opts->v_ratio0 * 100);
+        printf("[OPL4] Port1 Volume (-vr1 <val>): %.2f%%\n", p_opts->v_ratio1 * 100);
+    } else {
+        printf("[OPL3] Converted VGM written to: %s\n", p_output_path);
+        printf("[OPL3] Detune percentage (-detune <val>): %g%%\n", p_opts->detune);
+        printf("[OPL3] Detune limit (-detune_limit <val>): max +-%g\n", p_opts->detune_limit);
+        printf("[OPL3] Channel Panning Mode (-ch_panning <val>): %d\n", p_opts->ch_panning);
+        printf("[OPL3] Port0 Volume (-vr0 <val>): %.2f%%\n", p_opts->v_ratio0 * 100);
+        printf("[OPL3] Port1 Volume (-vr1 <val>): %.2f%%\n", p_opts->v_ratio1 * 100);
+    }
+    if (result.is_ym2413) {
+        printf("[YM2413] Preset(-preset): %s\n", result.p_preset);
+        printf("[YM2413] Preset source(-preset_source): %s\n", result.p_preset_source);
+    }
+
+    if (p_opts->verbose) {
+        printf("[OPL3] Total voices in DB: %d\n", result.voice_count);
+    }
+
+    ESEOPL3Profile prof;
+    if (eseopl3_profile(p_cs, &prof) == 0) print_profile(p_input_vgm, &prof, read_ns, write_ns, wall_ns);
+
+    eseopl3_destroy(p_cs);
+    return 0;
+}
+
+/** Header + music data + GD3 of a finalized context as one malloc'ed image (NULL on allocation failure). */
+static uint8_t *take_output(ESEOPL3Context *p_cs, const ESEOPL3Result *p_res, size_t *p_len) {
+    size_t data_size = eseopl3_pending(p_cs);
+    size_t total = p_res->header_size + data_size + p_res->gd3_size;
+    uint8_t *p_out = (uint8_t *)malloc(total);
+    if (!p_out) {
+        fprintf(stderr, "Failed to allocate %zu bytes for the output\n", total);
+        return NULL;
+    }
+    memcpy(p_out, p_res->p_header, p_res->header_size);
+    eseopl3_pull(p_cs, p_out + p_res->header_size, data_size);
+    memcpy(p_out + p_res->header_size + data_size, p_res->p_gd3, p_res->gd3_size);
+    *p_len = total;
+    return p_out;
+}
+
+/**
+ * Convert a whole VGM image in memory. *pp_out (malloc'ed, header + data + GD3) is owned by the caller.
+ * Returns 0, or -1 after the library has reported the error.
+ */
+int cli_convert_memory(const ESEOPL3Options *p_opts, const uint8_t *p_in, size_t in_len,
+                       uint8_t **pp_out, size_t *p_out_len) {
+    *pp_out = NULL;
+    *p_out_len = 0;
+    ESEOPL3Context *p_cs = eseopl3_create(p_opts);
+    if (!p_cs) return -1;
+    ESEOPL3Result result;
+    if (eseopl3_push(p_cs, p_in, in_len) != 0 || eseopl3_finalize(p_cs, &result) != 0) {
+        eseopl3_destroy(p_cs);
+        return -1;
+    }
+    *pp_out = take_output(p_cs, &result, p_out_len);
+    eseopl3_destroy(p_cs);
+    return *pp_out ? 0 : -1;
+}
+
+/** Default name of variant n: <input>OPL3_<n>.vgm */
+static void make_variant_output_name(const char *p_input, int n, char *p_output, size_t outlen) {
+    size_t len = strlen(p_input);
+    if (len > 4 && strcmp(&p_input[len - 4], ".vgm") == 0) len -= 4;
+    snprintf(p_output, outlen, "%.*sOPL3_%d.vgm", (int)len, p_input, n);
+}
+
+/**
+ * --variant: one input, several outputs from one pass (eseopl3_convert_variants).
+ *
+ *   <input> <detune> [shared options] --variant [options] --variant [options] ...
+ *
+ * 各グループは共有オプションの後ろに付けて解析するので、同じオプションはグループ側が勝つ。
+ * -o の無いグループは <input>OPL3_<n>.vgm に出力する。--cache はバリエーションごとに引き、
+ * ヒットしなかったものだけを 1 パスで変換する。Returns the number of variants that failed.
+ */
+int cli_convert_variants(const CliJob *p_job, const uint8_t *p_in, size_t in_len) {
+    static const char *const k_not_here[] = {"--bridge", "--resume", "--checkpoint-every", "--checkpoint-file", "--variant"};
+    char **argv = p_job->pp_argv;
+    int shared = p_job->variant_at;
+    CliJob *p_jobs = (CliJob *)calloc(CLI_VARIANT_MAX, sizeof(CliJob));
+    char (*p_keys)[ESEOPL3_CACHE_KEY_CHARS + 1] = calloc(CLI_VARIANT_MAX, ESEOPL3_CACHE_KEY_CHARS + 1);
+    ESEOPL3Context *p_ctxs[CLI_VARIANT_MAX];
+    int ctx_variant[CLI_VARIANT_MAX];
+    ESEOPL3Result results[CLI_VARIANT_MAX];
+    char *vargv[CLI_VARIANT_MAX_ARGS + 1];
+    int count = 0, failed = 0, hits = 0, nctx = 0;
+    if (!p_jobs || !p_keys) {
+        free(p_jobs);
+        free(p_keys);
+        return 1;
+    }
+
+    // Parse every group on top of the shared options
+    for (int i = shared; i < p_job->argc; ) {
+        int end = i + 1;
+        while (end < p_job->argc && strcmp(argv[end], "--variant") != 0) end++;
+        if (count == CLI_VARIANT_MAX || shared + (end - i - 1) > CLI_VARIANT_MAX_ARGS) {
+            fprintf(stderr, "[VARIANT] too many variants or arguments (max %d / %d)\n", CLI_VARIANT_MAX, CLI_VARIANT_MAX_ARGS);
+            failed = 1;
+            goto done;
+        }
+        int vargc = 0;
+        for (int k = 0; k < shared; ++k) vargv[vargc++] = argv[k];
+        for (int k = i + 1; k < end; ++k) vargv[vargc++] = argv[k];
+        vargv[vargc] = NULL;
+        for (int k = 3; k < vargc; ++k) {
+            for (size_t x = 0; x < sizeof(k_not_here) / sizeof(k_not_here[0]); ++x) {
+                if (strcmp(vargv[k], k_not_here[x]) == 0) {
+                    fprintf(stderr, "[VARIANT] %s cannot be combined with --variant\n", k_not_here[x]);
+                    failed = 1;
+                    goto done;
+                }
+            }
+        }
+        CliJob *p_v = &p_jobs[count];
+        if (cli_parse_job(vargc, vargv, p_v) != CLI_PARSE_OK) {
+            failed = 1;
+            goto done;
+        }
+        if (!p_v->p_output) {
+            make_variant_output_name(p_v->p_input, count + 1, p_v->default_out, sizeof(p_v->default_out));
+            p_v->p_output = p_v->default_out;
+        }
+        p_v->opts.output_path = p_v->p_output;
+        p_v->opts.p_allocator = p_job->opts.p_allocator;
+        for (int k = 0; k < count; ++k) {
+            if (strcmp(p_jobs[k].p_output, p_v->p_output) == 0) {
+                fprintf(stderr, "[VARIANT] variants %d and %d both write %s\n", k + 1, count + 1, p_v->p_output);
+                failed = 1;
+                goto done;
+            }
+        }
+        count++;
+        i = end;
+    }
+
+    // Cache hits need no converter
+    for (int v = 0; v < count; ++v) {
+        CliJob *p_v = &p_jobs[v];
+        if (p_v->p_cache_dir) {
+            if (cli_cache_key(p_v, p_in, in_len, p_keys[v]) != 0) {
+                failed++;
+                continue;
+            }
+            if (cli_cache_fetch(p_v, p_keys[v], p_v->p_output) == 0) {
+                printf("[CACHE] Hit %s -> %s\n", p_keys[v], p_v->p_output);
+                hits++;
+                continue;
+            }
+        }
+        p_ctxs[nctx] = eseopl3_create(&p_v->opts);
+        if (!p_ctxs[nctx]) {
+            failed++;
+            continue;
+        }
+        ctx_variant[nctx++] = v;
+    }
+
+    if (nctx > 0) eseopl3_convert_variants(p_ctxs, nctx, p_in, in_len, results);
+    for (int c = 0; c < nctx; ++c) {
+        CliJob *p_v = &p_jobs[ctx_variant[c]];
+        size_t out_len = 0;
+        uint8_t *p_out = results[c].p_header ? take_output(p_ctxs[c], &results[c], &out_len) : NULL;
+        eseopl3_destroy(p_ctxs[c]);
+        if (!p_out || cli_cache_write_atomic(p_v->p_output, p_out, out_len) != 0) {
+            fprintf(stderr, "[VARIANT] %d: conversion to %s failed\n", ctx_variant[c] + 1, p_v->p_output);
+            free(p_out);
+            failed++;
+            continue;
+        }
+        if (p_v->p_cache_dir) cli_cache_store(p_v, p_keys[ctx_variant[c]], p_out, out_len);
+        free(p_out);
+        printf("[VARIANT] %d: %s", ctx_variant[c] + 1, p_v->p_output);
+        if (results[c].is_ym2413) printf(" (%s / %s)", results[c].p_preset, results[c].p_preset_source);
+        printf("\n");
+    }
+    printf("[VARIANT] %d variants of %s in one pass: %d converted, %d cached, %d failed\n",
+           count, p_job->p_input, count - hits - failed, hits, failed);
+
+done:
+    free(p_jobs);
+    free(p_keys);
+    return failed;
+}
@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include "cli.h"
+
+#ifdef _WIN32
+int cli_queue(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "--queue is not available on Windows.\n");
+    return 1;
+}
+#else
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "../opl3/opl3_clock.h"
+
+/*
+ * --queue <spool>: job queue in a shared directory (NFS など)。キューサーバは不要。
+ *
+ *   <spool>/todo/<name>.job            待ちジョブ。1 行 1 引数 (<input> <detune> [options...])
+ *   <spool>/claimed/<name>.job.<owner> 実行中。todo からの rename で取るので、1 つのジョブを
+ *                                      取れるのは 1 ワーカーだけ (owner = <host>.<pid>)
+ *   <spool>/done/, failed/             終わったジョブ
+ *   <spool>/workers/<owner>            ワーカーのハートビート (lease/4 ごとに mtime を更新)
+ *   <spool>/journal/<owner>.log        ワーカーごとの実行記録
+ *   <spool>/tmp/                       enqueue の書きかけ (完成してから rename で todo へ)
+ *
+ * ワーカーは起動時と todo が空になったときに claimed を見直し、持ち主が死んでいる
+ * (同じホストで pid が無い、またはハートビートが lease 秒より古い) ジョブを todo に戻す。
+ * 途中で落ちたワーカーのジョブは、どのノードで次に起動したワーカーでも拾い直せる。
+ * 同じジョブを 2 回実行しても出力は同じなので、戻しすぎても結果は壊れない。
+ * 時刻はノード間で比べるので、lease は時計のずれより十分長くする。
+ */
+
+#define QUEUE_LEASE_DEFAULT  600        /* s without a heartbeat before a worker counts as dead */
+#define QUEUE_MAX_WORKERS    256
+#define QUEUE_MAX_ARGS       512
+#define QUEUE_PATH_MAX       1024
+#define QUEUE_NAME_MAX       256
+
+static const char *const k_queue_dirs[] = {"todo", "claimed", "done", "failed", "workers", "journal", "tmp"};
+
+typedef struct {
+    const char       *p_spool;
+    char              owner[QUEUE_NAME_MAX];    /* <host>.<pid> */
+    char              heartbeat[QUEUE_PATH_MAX];
+    long              lease;
+    FILE             *p_journal;
+    pthread_mutex_t   lock;                     /* journal, stop flag */
+    pthread_cond_t    cond;
+    bool              is_stopping;
+    _Atomic int       jobs_ok;
+    _Atomic int       jobs_failed;
+    _Atomic int       requeued;
+} QueueState;
+
+static int queue_mkdirs(const char *p_spool) {
+    if (mkdir(p_spool, 0755) != 0 && errno != EEXIST) return -1;
+    for (size_t i = 0; i < sizeof(k_queue_dirs) / sizeof(k_queue_dirs[0]); ++i) {
+        char path[QUEUE_PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", p_spool, k_queue_dirs[i]);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+    }
+    return 0;
+}
+
+/** <host>.<pid>; '/' and '.' in the host name would confuse the claim names. */
+static void queue_owner_name(char *p_owner, size_t size) {
+    char host[128] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    for (char *p = host; *p; ++p) {
+        if (*p == '/' || *p == '.') *p = '_';
+    }
+    snprintf(p_owner, size, "%s.%d", host, (int)getpid());
+}
+
+static int queue_count(const char *p_spool, const char *p_sub) {
+    char path[QUEUE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", p_spool, p_sub);
+    DIR *p_d = opendir(path);
+    if (!p_d) return 0;
+    int n = 0;
+    struct dirent *p_de;
+    while ((p_de = readdir(p_d)) != NULL) {
+        if (p_de->d_name[0] != '.') n++;
+    }
+    closedir(p_d);
+    return n;
+}
+
+/* ---- enqueue ---- */
+
+typedef struct {
+    const char *p_spool;
+    char      **pp_extra;
+    int         nextra;
+    const char *p_out_dir;
+    char        prefix[QUEUE_NAME_MAX];
+    int         count;
+    int         failed;
+} QueueEnqueue;
+
+/** Write the job to tmp/ and publish it with a rename, so a worker never sees half a job. */
+static void queue_enqueue_one(void *p_user, char **pp_args, int nargs, bool is_file) {
+    QueueEnqueue *p_q = (QueueEnqueue *)p_user;
+    if (nargs < 1) {
+        fprintf(stderr, "[QUEUE] skipped a line with too many arguments\n");
+        p_q->failed++;
+        return;
+    }
+    char name[QUEUE_NAME_MAX + 16], tmp[QUEUE_PATH_MAX + QUEUE_NAME_MAX], todo[QUEUE_PATH_MAX + QUEUE_NAME_MAX];
+    snprintf(name, sizeof(name), "%s-%06d.job", p_q->prefix, p_q->count);
+    snprintf(tmp, sizeof(tmp), "%s/tmp/%s", p_q->p_spool, name);
+    snprintf(todo, sizeof(todo), "%s/todo/%s", p_q->p_spool, name);
+    FILE *p_fp = fopen(tmp, "w");
+    if (!p_fp) {
+        p_q->failed++;
+        return;
+    }
+    for (int i = 0; i < nargs; ++i) fprintf(p_fp, "%s\n", pp_args[i]);
+    for (int i = 0; i < p_q->nextra; ++i) fprintf(p_fp, "%s\n", p_q->pp_extra[i]);
+    if (is_file && p_q->p_out_dir) {
+        const char *p_base = strrchr(pp_args[0], '/');
+        char out[QUEUE_NAME_MAX];
+        cli_make_default_output_name(p_base ? p_base + 1 : pp_args[0], out, sizeof(out));
+        fprintf(p_fp, "-o\n%s/%s\n", p_q->p_out_dir, out);
+    }
+    bool is_ok = !ferror(p_fp);
+    if (fclose(p_fp) != 0) is_ok = false;
+    if (!is_ok || rename(tmp, todo) != 0) {
+        remove(tmp);
+        p_q->failed++;
+        return;
+    }
+    p_q->count++;
+}
+
+static int queue_enqueue(const char *p_spool, const char *p_source, int argc, char *argv[], int first) {
+    QueueEnqueue q;
+    memset(&q, 0, sizeof(q));
+    q.p_spool = p_spool;
+    char *extra[QUEUE_MAX_ARGS];
+    for (int i = first; i < argc; ++i) {
+        if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+            q.p_out_dir = argv[++i];
+        } else if (q.nextra < QUEUE_MAX_ARGS) {
+            extra[q.nextra++] = argv[i];
+        }
+    }
+    q.pp_extra = extra;
+    if (q.p_out_dir && mkdir(q.p_out_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s: %s\n", q.p_out_dir, strerror(errno));
+        return 1;
+    }
+    char owner[QUEUE_NAME_MAX];
+    queue_owner_name(owner, sizeof(owner));
+    int n = snprintf(q.prefix, sizeof(q.prefix), "%ld-%s", (long)time(NULL), owner);
+    if (n < 0 || (size_t)n >= sizeof(q.prefix)) {
+        fprintf(stderr, "[QUEUE] host name too long for a job name: %s\n", owner);
+        return 1;
+    }
+    if (cli_batch_scan(p_source, q.p_out_dir, queue_enqueue_one, &q) != 0) {
+        fprintf(stderr, "Cannot read %s: %s\n", p_source, strerror(errno));
+        return 1;
+    }
+    printf("[QUEUE] %d jobs added to %s/todo", q.count, p_spool);
+    if (q.failed) printf(" (%d failed)", q.failed);
+    printf("\n");
+    return q.failed ? 1 : 0;
+}
+
+/* ---- recovery ---- */
+
+/** Is the worker <host>.<pid> gone? Same host: by pid. Any host: by a stale or missing heartbeat. */
+static bool queue_owner_dead(const QueueState *p_st, const char *p_owner) {
+    const char *p_dot = strrchr(p_owner, '.');
+    const char *p_my_dot = strrchr(p_st->owner, '.');
+    if (p_dot && p_my_dot && (p_dot - p_owner) == (p_my_dot - p_st->owner) &&
+        strncmp(p_owner, p_st->owner, (size_t)(p_dot - p_owner)) == 0) {
+        pid_t pid = (pid_t)strtol(p_dot + 1, NULL, 10);
+        if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) return true;
+    }
+    char path[QUEUE_PATH_MAX + QUEUE_NAME_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/workers/%s", p_st->p_spool, p_owner);
+    if (stat(path, &st) != 0) return true;
+    return difftime(time(NULL), st.st_mtime) > (double)p_st->lease;
+}
+
+/** Put the claims of dead workers back into todo. Returns the number of live claims left. */
+static int queue_recover(QueueState *p_st) {
+    char dir[QUEUE_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/claimed", p_st->p_spool);
+    DIR *p_d = opendir(dir);
+    if (!p_d) return 0;
+    int live = 0;
+    struct dirent *p_de;
+    while ((p_de = readdir(p_d)) != NULL) {
+        char *p_mark = strstr(p_de->d_name, ".job.");
+        if (!p_mark) continue;
+        const char *p_owner = p_mark + 5;
+        if (strcmp(p_owner, p_st->owner) == 0 || !queue_owner_dead(p_st, p_owner)) {
+            live++;
+            continue;
+        }
+        char from[QUEUE_PATH_MAX + QUEUE_NAME_MAX], to[QUEUE_PATH_MAX + QUEUE_NAME_MAX];
+        snprintf(from, sizeof(from), "%s/%s", dir, p_de->d_name);
+        snprintf(to, sizeof(to), "%s/todo/%.*s", p_st->p_spool, (int)(p_mark + 4 - p_de->d_name), p_de->d_name);
+        if (rename(from, to) == 0) {        // another worker may have been faster
+            atomic_fetch_add(&p_st->requeued, 1);
+            printf("[QUEUE] requeued %s (worker %s is gone)\n", to + strlen(p_st->p_spool) + 6, p_owner);
+        }
+    }
+    closedir(p_d);
+    return live;
+}
+
+/* ---- workers ---- */
+
+static void *queue_heartbeat_main(void *p_arg) {
+    QueueState *p_st = (QueueState *)p_arg;
+    long period = p_st->lease / 4 > 0 ? p_st->lease / 4 : 1;
+    pthread_mutex_lock(&p_st->lock);
+    while (!p_st->is_stopping) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += period;
+        pthread_cond_timedwait(&p_st->cond, &p_st->lock, &ts);
+        if (!p_st->is_stopping) utime(p_st->heartbeat, NULL);
+    }
+    pthread_mutex_unlock(&p_st->lock);
+    return NULL;
+}
+
+/** Claim one job: rename todo/<name> to claimed/<name>.<owner>. Returns false when todo is empty. */
+static bool queue_claim(QueueState *p_st, char *p_name, size_t name_size) {
+    char dir[QUEUE_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/todo", p_st->p_spool);
+    DIR *p_d = opendir(dir);
+    if (!p_d) return false;
+    bool is_claimed = false;
+    struct dirent *p_de;
+    while (!is_claimed && (p_de = readdir(p_d)) != NULL) {
+        size_t len = strlen(p_de->d_name);
+        if (p_de->d_name[0] == '.' || len < 4 || strcmp(p_de->d_name + len - 4, ".job") != 0) continue;
+        char from[QUEUE_PATH_MAX + QUEUE_NAME_MAX], to[QUEUE_PATH_MAX + 2 * QUEUE_NAME_MAX];
+        snprintf(from, sizeof(from), "%s/%s", dir, p_de->d_name);
+        snprintf(to, sizeof(to), "%s/claimed/%s.%s", p_st->p_spool, p_de->d_name, p_st->owner);
+        if (rename(from, to) == 0) {        // ENOENT: someone else took it
+            snprintf(p_name, name_size, "%s", p_de->d_name);
+            is_claimed = true;
+        }
+    }
+    closedir(p_d);
+    return is_claimed;
+}
+
+/** Run the claimed job p_name. Returns 0 on success. */
+static int queue_run_job(QueueState *p_st, const char *p_name, ESEOPL3Arena *p_arena) {
+    char path[QUEUE_PATH_MAX + 2 * QUEUE_NAME_MAX];
+    snprintf(path, sizeof(path), "%s/claimed/%s.%s", p_st->p_spool, p_name, p_st->owner);
+    size_t len;
+    uint8_t *p_text = cli_read_file(path, &len);
+    if (!p_text) return -1;
+    char *p_buf = (char *)realloc(p_text, len + 1);
+    if (!p_buf) {
+        free(p_text);
+        return -1;
+    }
+    p_buf[len] = '\0';
+
+    char *argv[QUEUE_MAX_ARGS + 1];
+    int argc = 0;
+    argv[argc++] = "eseopl3patcher";
+    for (char *p = p_buf; *p && argc < QUEUE_MAX_ARGS; ) {
+        char *p_end = strchr(p, '\n');
+        if (p_end) *p_end = '\0';
+        argv[argc++] = p;
+        if (!p_end) break;
+        p = p_end + 1;
+    }
+    argv[argc] = NULL;
+
+    int rc = -1;
+    CliJob job;
+    if (argc < 3) {
+        fprintf(stderr, "[QUEUE] %s: need <input> <detune>\n", p_name);
+    } else if (cli_parse_job(argc, argv, &job) == CLI_PARSE_OK) {
+        if (job.is_bridge) {
+            fprintf(stderr, "[QUEUE] %s: --bridge is not available in --queue\n", p_name);
+        } else {
+            if (p_arena) job.opts.p_allocator = eseopl3_arena_allocator(p_arena);
+            rc = cli_convert_file(&job) == 0 ? 0 : -1;
+            if (p_arena) eseopl3_arena_reset(p_arena);
+        }
+    }
+    free(p_buf);
+    return rc;
+}
+
+static void queue_finish_job(QueueState *p_st, const char *p_name, int rc, double elapsed) {
+    char from[QUEUE_PATH_MAX + 2 * QUEUE_NAME_MAX], to[QUEUE_PATH_MAX + QUEUE_NAME_MAX];
+    snprintf(from, sizeof(from), "%s/claimed/%s.%s", p_st->p_spool, p_name, p_st->owner);
+    snprintf(to, sizeof(to), "%s/%s/%s", p_st->p_spool, rc == 0 ? "done" : "failed", p_name);
+    rename(from, to);
+    atomic_fetch_add(rc == 0 ? &p_st->jobs_ok : &p_st->jobs_failed, 1);
+
+    pthread_mutex_lock(&p_st->lock);
+    if (p_st->p_journal) {
+        fprintf(p_st->p_journal, "%ld\t%s\t%s\t%.3f\n", (long)time(NULL), p_name, rc == 0 ? "OK" : "FAILED", elapsed);
+        fflush(p_st->p_journal);
+    }
+    pthread_mutex_unlock(&p_st->lock);
+}
+
+static void *queue_worker_main(void *p_arg) {
+    QueueState *p_st = (QueueState *)p_arg;
+    char name[QUEUE_NAME_MAX];
+    ESEOPL3Arena *p_arena = eseopl3_arena_create();     // job memory of this worker (NULL = malloc)
+    while (queue_claim(p_st, name, sizeof(name))) {
+        double t0 = opl3_now_sec();
+        int rc = queue_run_job(p_st, name, p_arena);
+        queue_finish_job(p_st, name, rc, opl3_now_sec() - t0);
+    }
+    eseopl3_arena_destroy(p_arena);
+    return NULL;
+}
+
+static int queue_status(const char *p_spool) {
+    printf("[QUEUE] %s: %d todo, %d running, %d done, %d failed, %d workers seen\n", p_spool,
+           queue_count(p_spool, "todo"), queue_count(p_spool, "claimed"), queue_count(p_spool, "done"),
+           queue_count(p_spool, "failed"), queue_count(p_spool, "workers"));
+    return 0;
+}
+
+/**
+ * eseopl3patcher --queue <spool> --enqueue <dir|list> [--out-dir <dir>] [<detune>] [options...]
+ * eseopl3patcher --queue <spool> [--jobs <n>] [--lease <sec>]
+ * eseopl3patcher --queue <spool> --status
+ */
+int cli_queue(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s --queue <spool> --enqueue <dir|list> [--out-dir <dir>] [<detune>] [options...]\n"
+            "       %s --queue <spool> [--jobs <n>] [--lease <sec>]\n"
+            "       %s --queue <spool> --status\n", argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    const char *p_spool = argv[2];
+    if (argc >= 4 && strcmp(argv[3], "--status") == 0) return queue_status(p_spool);
+    if (queue_mkdirs(p_spool) != 0) {
+        fprintf(stderr, "Cannot create the spool %s: %s\n", p_spool, strerror(errno));
+        return 1;
+    }
+    if (argc >= 5 && strcmp(argv[3], "--enqueue") == 0) return queue_enqueue(p_spool, argv[4], argc, argv, 5);
+
+    QueueState st;
+    memset(&st, 0, sizeof(st));
+    st.p_spool = p_spool;
+    st.lease = QUEUE_LEASE_DEFAULT;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            workers = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--lease") == 0 && i + 1 < argc) {
+            st.lease = strtol(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown --queue option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (workers < 1) workers = 1;
+    if (workers > QUEUE_MAX_WORKERS) workers = QUEUE_MAX_WORKERS;
+    if (st.lease < 1) st.lease = 1;
+
+    // Announce ourselves before claiming anything, so our claims never look abandoned
+    queue_owner_name(st.owner, sizeof(st.owner));
+    snprintf(st.heartbeat, sizeof(st.heartbeat), "%s/workers/%s", p_spool, st.owner);
+    FILE *p_hb = fopen(st.heartbeat, "w");
+    if (!p_hb) {
+        fprintf(stderr, "Cannot write %s: %s\n", st.heartbeat, strerror(errno));
+        return 1;
+    }
+    fclose(p_hb);
+    char journal[QUEUE_PATH_MAX + QUEUE_NAME_MAX];
+    snprintf(journal, sizeof(journal), "%s/journal/%s.log", p_spool, st.owner);
+    st.p_journal = fopen(journal, "a");
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.cond, NULL);
+    atomic_init(&st.jobs_ok, 0);
+    atomic_init(&st.jobs_failed, 0);
+    atomic_init(&st.requeued, 0);
+
+    pthread_t heartbeat;
+    bool is_heartbeat = pthread_create(&heartbeat, NULL, queue_heartbeat_main, &st) == 0;
+    double t_start = opl3_now_sec();
+
+    // Work until todo stays empty after taking back what dead workers left behind
+    int live = 0;
+    do {
+        queue_recover(&st);
+        pthread_t threads[QUEUE_MAX_WORKERS];
+        int started = 0;
+        while (started < workers && pthread_create(&threads[started], NULL, queue_worker_main, &st) == 0) started++;
+        if (started == 0) queue_worker_main(&st);
+        for (int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+        live = queue_recover(&st);
+    } while (queue_count(p_spool, "todo") > 0);
+
+    pthread_mutex_lock(&st.lock);
+    st.is_stopping = true;
+    pthread_cond_broadcast(&st.cond);
+    pthread_mutex_unlock(&st.lock);
+    if (is_heartbeat) pthread_join(heartbeat, NULL);
+    remove(st.heartbeat);
+    if (st.p_journal) fclose(st.p_journal);
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.cond);
+
+    double elapsed = opl3_now_sec() - t_start;
+    int ok = atomic_load(&st.jobs_ok), failed = atomic_load(&st.jobs_failed);
+    printf("[QUEUE] %s: %d jobs (%d failed) in %.3f s (%.1f jobs/s), %d requeued, %d still running elsewhere\n",
+           st.owner, ok + failed, failed, elapsed, elapsed > 0 ? (double)(ok + failed) / elapsed : 0.0,
+           atomic_load(&st.requeued), live);
+    return failed ? 1 : 0;
+}
+#endif /* _WIN32 */
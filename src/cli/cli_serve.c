@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include "cli.h"
+
+#ifdef _WIN32
+int cli_serve(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "--serve needs Unix domain sockets and is not available on Windows.\n");
+    return 1;
+}
+#else
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../opl3/opl3_clock.h"
+
+/*
+ * --serve: conversion server on a Unix domain socket.
+ *
+ * 短いジングルを大量に変換する場合、1 ファイルごとのプロセス起動・音色バンクの
+ * 読み込み・出力ファイル作成が変換そのものより重い。サーバは音色バンクを起動時に
+ * 1 度だけ確保し、接続をワーカースレッドのプールで処理する。
+ *
+ * Request (1 接続で何件でも順に送れる):
+ *   JOB <argc> <data_len>\n
+ *   <arg>\n × argc        CLI と同じコマンドライン: <input> <detune> [options...]
+ *                         input が "-" なら後続の data_len バイトが入力 VGM
+ *   <data_len bytes>
+ *   SHUTDOWN\n            サーバを停止 (処理中のジョブは最後まで返す)
+ *
+ * Reply:
+ *   OK <out_len> <parse_us> <convert_us> <total_us>\n + out_len バイトの VGM
+ *   OK <out_len> <parse_us> <convert_us> <total_us> <path>\n   (-o 指定時、データは <path> に書き込み済み)
+ *   ERR <message>\n
+ */
+
+#define SERVE_BACKLOG       64
+#define SERVE_QUEUE_SIZE    256         /* accepted connections waiting for a worker */
+#define SERVE_MAX_WORKERS   256
+#define SERVE_MAX_ARGS      64
+#define SERVE_MAX_LINE      4096
+#define SERVE_MAX_DATA      (256u * 1024 * 1024)
+
+typedef struct {
+    int                 listen_fd;
+    const char         *p_path;
+    bool                is_verbose;
+    _Atomic bool        is_stopping;
+    _Atomic uint64_t    jobs;
+    /* accepted connections -> workers */
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    int                 fds[SERVE_QUEUE_SIZE];
+    int                 head;
+    int                 count;
+    int                 live_fds[SERVE_MAX_WORKERS];   /* connection of each worker (-1 = idle), under lock */
+} ServeState;
+
+typedef struct {
+    ServeState *p_st;
+    int         id;
+} ServeWorker;
+
+/** Buffered reader over a connection. */
+typedef struct {
+    int     fd;
+    size_t  pos;
+    size_t  len;
+    uint8_t buf[8192];
+} ServeConn;
+
+static int serve_fill(ServeConn *p_c) {
+    ssize_t n;
+    do {
+        n = read(p_c->fd, p_c->buf, sizeof(p_c->buf));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+    p_c->pos = 0;
+    p_c->len = (size_t)n;
+    return 0;
+}
+
+/** One '\n'-terminated line without the terminator. Returns its length, or -1 on EOF / overlong line. */
+static int serve_read_line(ServeConn *p_c, char *p_line, size_t cap) {
+    size_t n = 0;
+    for (;;) {
+        if (p_c->pos == p_c->len && serve_fill(p_c) != 0) return -1;
+        char ch = (char)p_c->buf[p_c->pos++];
+        if (ch == '\n') break;
+        if (n + 1 >= cap) return -1;
+        p_line[n++] = ch;
+    }
+    if (n > 0 && p_line[n - 1] == '\r') n--;
+    p_line[n] = '\0';
+    return (int)n;
+}
+
+static int serve_read_exact(ServeConn *p_c, uint8_t *p_dst, size_t len) {
+    while (len > 0) {
+        if (p_c->pos == p_c->len && serve_fill(p_c) != 0) return -1;
+        size_t n = p_c->len - p_c->pos;
+        if (n > len) n = len;
+        memcpy(p_dst, p_c->buf + p_c->pos, n);
+        p_c->pos += n;
+        p_dst += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int serve_write_all(int fd, const void *p_data, size_t len) {
+    const uint8_t *p = (const uint8_t *)p_data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int serve_reply_error(int fd, const char *p_msg) {
+    char line[SERVE_MAX_LINE];
+    int n = snprintf(line, sizeof(line), "ERR %s\n", p_msg);
+    return serve_write_all(fd, line, (size_t)n);
+}
+
+/**
+ * One job. p_args holds argc NUL-separated arguments, p_data the inline input (may be NULL).
+ * Returns -1 when the connection is unusable.
+ */
+static int serve_run_job(ServeState *p_st, ESEOPL3Arena *p_arena, int fd, int argc, char *p_args,
+                         uint8_t *p_data, size_t data_len, uint64_t t_start) {
+    char *argv[SERVE_MAX_ARGS + 1];
+    argv[0] = "eseopl3patcher";
+    for (int i = 0; i < argc; ++i) {
+        argv[i + 1] = p_args;
+        p_args += strlen(p_args) + 1;
+    }
+    if (argc < 2) return serve_reply_error(fd, "need <input> <detune>");
+
+    CliJob job;
+    int rc = cli_parse_job(argc + 1, argv, &job);
+    if (rc == CLI_PARSE_HELP) return serve_reply_error(fd, "--help is not available in --serve");
+    if (rc != CLI_PARSE_OK) return serve_reply_error(fd, "invalid options");
+    if (job.is_bridge) return serve_reply_error(fd, "--bridge is not available in --serve");
+    if (job.variant_at) return serve_reply_error(fd, "--variant is not available in --serve");
+    if (job.opts.resume || job.opts.checkpoint_every) {
+        return serve_reply_error(fd, "checkpoints are not available in --serve");
+    }
+    job.opts.output_path = job.p_output;
+    if (p_arena) job.opts.p_allocator = eseopl3_arena_allocator(p_arena);
+
+    uint8_t *p_file = NULL;
+    const uint8_t *p_in = p_data;
+    size_t in_len = data_len;
+    if (strcmp(job.p_input, "-") != 0) {
+        if (!cli_has_vgm_extension_or_none(job.p_input)) {
+            return serve_reply_error(fd, "input file must have .vgm extension or no extension");
+        }
+        p_file = cli_read_file(job.p_input, &in_len);
+        if (!p_file) return serve_reply_error(fd, "cannot read input file");
+        p_in = p_file;
+    }
+    char cache_key[ESEOPL3_CACHE_KEY_CHARS + 1];
+    if (job.p_cache_dir && cli_cache_key(&job, p_in, in_len, cache_key) != 0) {
+        free(p_file);
+        return serve_reply_error(fd, "cannot load the override file");
+    }
+    uint64_t t_parsed = opl3_now_ns() / 1000u;
+
+    uint8_t *p_out = NULL;
+    size_t out_len = 0;
+    if (job.p_cache_dir) p_out = cli_cache_load(&job, cache_key, &out_len);
+    if (!p_out) {
+        rc = cli_convert_memory(&job.opts, p_in, in_len, &p_out, &out_len);
+        if (p_arena) eseopl3_arena_reset(p_arena);
+        if (rc == 0 && job.p_cache_dir) cli_cache_store(&job, cache_key, p_out, out_len);
+    }
+    free(p_file);
+    if (!p_out) return serve_reply_error(fd, "conversion failed");
+    uint64_t t_converted = opl3_now_ns() / 1000u;
+
+    if (job.p_output) {
+        int wrc = cli_write_file(job.p_output, p_out, out_len);
+        free(p_out);
+        if (wrc != 0) return serve_reply_error(fd, "cannot write output file");
+        p_out = NULL;
+    }
+    uint64_t t_end = opl3_now_ns() / 1000u;
+    atomic_fetch_add(&p_st->jobs, 1);
+
+    char line[SERVE_MAX_LINE + 128];
+    int n = snprintf(line, sizeof(line), "OK %zu %llu %llu %llu%s%s\n", out_len,
+                     (unsigned long long)(t_parsed - t_start),
+                     (unsigned long long)(t_converted - t_parsed),
+                     (unsigned long long)(t_end - t_start),
+                     job.p_output ? " " : "", job.p_output ? job.p_output : "");
+    rc = serve_write_all(fd, line, (size_t)n);
+    if (rc == 0 && p_out) rc = serve_write_all(fd, p_out, out_len);
+    free(p_out);
+    return rc;
+}
+
+/**
+ * Stop accepting and end the reads of every connection: a worker waiting for the next
+ * request of an idle client gets EOF. Requests already received are still answered.
+ */
+static void serve_stop(ServeState *p_st) {
+    pthread_mutex_lock(&p_st->lock);
+    atomic_store(&p_st->is_stopping, true);
+    shutdown(p_st->listen_fd, SHUT_RDWR);       // wakes accept()
+    for (int i = 0; i < SERVE_MAX_WORKERS; ++i) {
+        if (p_st->live_fds[i] >= 0) shutdown(p_st->live_fds[i], SHUT_RD);
+    }
+    pthread_cond_broadcast(&p_st->cond);
+    pthread_mutex_unlock(&p_st->lock);
+}
+
+/** Serve every job on one connection until the client closes it. */
+static void serve_connection(ServeState *p_st, ESEOPL3Arena *p_arena, int fd) {
+    ServeConn *p_c = (ServeConn *)malloc(sizeof(ServeConn));
+    char *p_args = (char *)malloc(SERVE_MAX_ARGS * SERVE_MAX_LINE);
+    if (!p_c || !p_args) {
+        free(p_c);
+        free(p_args);
+        return;
+    }
+    p_c->fd = fd;
+    p_c->pos = p_c->len = 0;
+
+    char line[SERVE_MAX_LINE];
+    while (serve_read_line(p_c, line, sizeof(line)) >= 0) {
+        uint64_t t_start = opl3_now_ns() / 1000u;
+        if (strcmp(line, "SHUTDOWN") == 0) {
+            serve_stop(p_st);
+            break;
+        }
+        int argc = 0;
+        unsigned long data_len = 0;
+        if (sscanf(line, "JOB %d %lu", &argc, &data_len) != 2 ||
+            argc < 0 || argc > SERVE_MAX_ARGS || data_len > SERVE_MAX_DATA) {
+            serve_reply_error(fd, "bad request");
+            break;
+        }
+        size_t used = 0;
+        bool is_ok = true;
+        for (int i = 0; i < argc && is_ok; ++i) {
+            int n = serve_read_line(p_c, p_args + used, SERVE_MAX_LINE);
+            if (n < 0) is_ok = false;
+            used += (size_t)n + 1;
+        }
+        uint8_t *p_data = NULL;
+        if (is_ok && data_len > 0) {
+            p_data = (uint8_t *)malloc(data_len);
+            if (!p_data || serve_read_exact(p_c, p_data, data_len) != 0) is_ok = false;
+        }
+        if (!is_ok || serve_run_job(p_st, p_arena, fd, argc, p_args, p_data, data_len, t_start) != 0) {
+            free(p_data);
+            break;
+        }
+        free(p_data);
+    }
+    free(p_args);
+    free(p_c);
+}
+
+static void *serve_worker_main(void *p_arg) {
+    ServeWorker *p_w = (ServeWorker *)p_arg;
+    ServeState *p_st = p_w->p_st;
+    ESEOPL3Arena *p_arena = eseopl3_arena_create();     // job memory of this worker (NULL = malloc)
+    for (;;) {
+        pthread_mutex_lock(&p_st->lock);
+        while (p_st->count == 0 && !atomic_load(&p_st->is_stopping)) {
+            pthread_cond_wait(&p_st->cond, &p_st->lock);
+        }
+        if (p_st->count == 0) {
+            pthread_mutex_unlock(&p_st->lock);
+            eseopl3_arena_destroy(p_arena);
+            return NULL;
+        }
+        int fd = p_st->fds[p_st->head];
+        p_st->head = (p_st->head + 1) % SERVE_QUEUE_SIZE;
+        p_st->count--;
+        p_st->live_fds[p_w->id] = fd;
+        if (atomic_load(&p_st->is_stopping)) shutdown(fd, SHUT_RD);   // queued before the stop
+        pthread_cond_broadcast(&p_st->cond);
+        pthread_mutex_unlock(&p_st->lock);
+
+        serve_connection(p_st, p_arena, fd);
+        pthread_mutex_lock(&p_st->lock);
+        p_st->live_fds[p_w->id] = -1;
+        pthread_mutex_unlock(&p_st->lock);
+        close(fd);
+    }
+}
+
+static int serve_listen(const char *p_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(p_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", p_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, p_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(p_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SERVE_BACKLOG) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", p_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/** eseopl3patcher --serve <socket> [--workers <n>] [-v] */
+int cli_serve(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s --serve <socket> [--workers <n>] [-v]\n", argv[0]);
+        return 1;
+    }
+    ServeState st;
+    memset(&st, 0, sizeof(st));
+    st.p_path = argv[2];
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "-verbose") == 0) {
+            st.is_verbose = true;
+        }
+    }
+    if (workers < 1) workers = 1;
+    if (workers > SERVE_MAX_WORKERS) workers = SERVE_MAX_WORKERS;
+
+    st.listen_fd = serve_listen(st.p_path);
+    if (st.listen_fd < 0) return 1;
+    signal(SIGPIPE, SIG_IGN);      // a client going away must not end the server
+
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.cond, NULL);
+    atomic_init(&st.is_stopping, false);
+    atomic_init(&st.jobs, 0);
+    for (int i = 0; i < SERVE_MAX_WORKERS; ++i) st.live_fds[i] = -1;
+    pthread_t threads[SERVE_MAX_WORKERS];
+    ServeWorker ctx[SERVE_MAX_WORKERS];
+    int started = 0;
+    while (started < workers) {
+        ctx[started].p_st = &st;
+        ctx[started].id = started;
+        if (pthread_create(&threads[started], NULL, serve_worker_main, &ctx[started]) != 0) break;
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Failed to start the worker threads\n");
+        close(st.listen_fd);
+        unlink(st.p_path);
+        return 1;
+    }
+    printf("[SERVE] Listening on %s (%d workers)\n", st.p_path, started);
+    fflush(stdout);
+
+    while (!atomic_load(&st.is_stopping)) {
+        int fd = accept(st.listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (!atomic_load(&st.is_stopping)) perror("accept");
+            break;
+        }
+        pthread_mutex_lock(&st.lock);
+        while (st.count == SERVE_QUEUE_SIZE && !atomic_load(&st.is_stopping)) {
+            pthread_cond_wait(&st.cond, &st.lock);
+        }
+        if (st.count < SERVE_QUEUE_SIZE) {
+            st.fds[(st.head + st.count) % SERVE_QUEUE_SIZE] = fd;
+            st.count++;
+            fd = -1;
+        }
+        pthread_cond_broadcast(&st.cond);
+        pthread_mutex_unlock(&st.lock);
+        if (fd >= 0) close(fd);
+    }
+
+    // Requests already received on accepted connections are still answered
+    serve_stop(&st);
+    for (int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+    close(st.listen_fd);
+    unlink(st.p_path);
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.cond);
+    printf("[SERVE] Stopped after %llu jobs\n", (unsigned long long)atomic_load(&st.jobs));
+    return 0;
+}
+#endif /* _WIN32 */
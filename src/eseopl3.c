@@ -0,0 +1,1625 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "eseopl3.h"
+#include "vgm/vgm_helpers.h"
+#include "vgm/vgm_header.h"
+#include "opl3/opl3_convert.h"
+#include "opl3/opl3_debug_util.h"
+#include "opl3/opl3_event.h"
+#include "opl3/opl3_arena.h"
+#include "opl3/opl3_clock.h"
+#include "opl3/opl3_hash.h"
+#include "opl3/opl3_metrics.h"
+#include "opl3/opl3_profile.h"
+#include "opl3/opl3_trace.h"
+#include "opl3/opl3_voice.h"
+#include "opl3/opl3_alloc.h"
+#include "opll/opll_override.h"
+#include "opll/opll2opl3_conv.h"
+#include "opll/opll_voice_bank.h"
+#include "opll/opll_bridge.h"
+#include "vgm/vgm_seek.h"
+#include "vgm/vgm_checkpoint.h"
+#include "vgm/vgm_merge.h"
+#include "vgm/gd3_util.h"
+
+/*
+ * libeseopl3 back end: the conversion pass of the CLI, split at the points where
+ * input arrives (push), output leaves (pull) and the file is closed (finalize).
+ *
+ * push() は受け取ったバイト列を入力バッファに足し、完結したコマンドだけを
+ * opl3_event_lower_feed() でコマンド IR (1 コマンド = 1 イベント) に落として即座に OPL3 書き込みへ変換する。
+ * 変換器の状態 (VGMContext) は CLI の 1 パス変換と同じなので、どんな分割で
+ * push しても出力は一括変換とバイト単位で一致する。
+ *
+ * 入力のヘッダと GD3 (末尾) は再構築のため finalize まで保持する。ストリーミング中は
+ * 変換済みのコマンド列を、出力は pull 済みの分を捨てていく (ESEOPL3_COMPACT_BYTES)。
+ */
+
+// Default values for command options
+#define DEFAULT_DETUNE        1.0
+#define DEFAULT_WAIT          0
+#define DEFAULT_CH_PANNING    0
+#define DEFAULT_VOLUME_RATIO0 1.0
+#define DEFAULT_VOLUME_RATIO1 0.8
+#define DEFAULT_DETUNE_LIMIT 4
+#define DEFAULT_CARRIER_TL_CLAMP_ENABLED 0
+#define DEFAULT_CARRIER_TL_CLAMP 63
+
+// Default bridge ring size (OPL3 writes)
+#define ESEOPL3_BRIDGE_RING    4096
+
+// Bump when a converter change alters the output for the same input and options (cache keys)
+#define ESEOPL3_CONVERTER_VERSION 2
+
+// Pulled output / converted input is dropped once this much has accumulated (streaming mode only)
+#define ESEOPL3_COMPACT_BYTES  (64 * 1024)
+
+// Block size of an eseopl3_arena_create() arena (a job's buffers; reset coalesces them into one block)
+#define ESEOPL3_JOB_ARENA_BLOCK (256 * 1024)
+
+// eseopl3_convert_variants(): input lowered per step; every variant converts it while the IR chunk is hot
+#define ESEOPL3_VARIANT_STEP_BYTES (16 * 1024)
+
+/** Read a little-endian 32-bit integer from buffer */
+static uint32_t read_le_uint32(const unsigned char *p_ptr) {
+    return (uint32_t)p_ptr[0] |
+           ((uint32_t)p_ptr[1] << 8) |
+           ((uint32_t)p_ptr[2] << 16) |
+           ((uint32_t)p_ptr[3] << 24);
+}
+
+/** Safely copy multi-byte command to output buffer */
+static int copy_bytes_checked(VGMBuffer *dst, const unsigned char *src, long filesize,
+                              long current_offset, long length) {
+    if (current_offset < 0 || current_offset + length > filesize) {
+        fprintf(stderr, "[ERROR] Truncated command at EOF (need %ld bytes, remain %ld)\n",
+                length, filesize - current_offset);
+        return 0;
+    }
+    vgm_buffer_append(dst, src + current_offset, (size_t)length);
+    return 1;
+}
+
+/**
+ * Decode preset string to OPLL_PresetType enum.
+ * Supported values: "YM2413", "VRC7", "YMF281B"
+ * Returns OPLL_PresetType_YM2413 for unknown input.
+ */
+static OPLL_PresetType decode_preset_type(const char *str) {
+    if (!str) return OPLL_PresetType_YM2413;
+    if (strcasecmp(str, "YM2413") == 0 || strcasecmp(str, "OPLL") == 0) return OPLL_PresetType_YM2413;
+    if (strcasecmp(str, "VRC7") == 0 || strcasecmp(str, "DS1001") == 0)   return OPLL_PresetType_VRC7;
+    if (strcasecmp(str, "YMF281B") == 0 || strcasecmp(str, "OPLLP") == 0) return OPLL_PresetType_YMF281B;
+    if (strcasecmp(str, "YM2423") == 0 || strcasecmp(str, "OPLL-X") == 0) return OPLL_PresetType_YM2423;
+    return OPLL_PresetType_YM2413; // default fallback
+}
+
+/**
+ * Decode preset string to OPLL_PresetSource enum.
+ * Supported values: "YMVOICE", "YMFM"
+ * Returns OPLL_PresetType_YM2413 for unknown input.
+ */
+static OPLL_PresetSource decode_preset_source(const char *str) {
+    if (!str) return OPLL_PresetSource_YMVOICE;
+    if (strcasecmp(str, "YMVOICE") == 0 || strcasecmp(str, "YM-VOICE") == 0) return OPLL_PresetSource_YMVOICE;
+    if (strcasecmp(str, "YMFM") == 0)   return OPLL_PresetSource_YMFM;
+    if (strcasecmp(str, "EXPERIMENT") == 0)   return OPLL_PresetSource_EXPERIMENT;
+    return OPLL_PresetSource_YMVOICE; // default fallback
+}
+
+static int update_is_adding_bytes(VGMContext *vgmctx, uint32_t orig_loop_offset, uint32_t current_addr) {
+    if (orig_loop_offset != 0xFFFFFFFF && current_addr < orig_loop_offset) {
+        vgmctx->status.is_adding_port1_bytes = 1;
+        return 1;
+    } else {
+        vgmctx->status.is_adding_port1_bytes = 0;
+        return 0;
+    }
+}
+
+static void update_loop_start_in_buffer(long read_done_byte, uint32_t orig_loop_address, VGMContext *vgmctx, long *loop_start_in_buffer) {
+    if (orig_loop_address != 0xFFFFFFFF && read_done_byte == orig_loop_address) {
+        *loop_start_in_buffer = vgmctx->buffer.size;
+    }
+}
+
+/**
+ * A source chip converted in its own context next to the main one
+ * (the second YM2413 of a 2xYM2413 file, the other chips of --fm-mix).
+ * It receives its own writes and every wait / end of the stream; its
+ * output buffer is merged into the main stream after the pass.
+ */
+typedef struct {
+    uint8_t     cmd;                    // VGM write command of the chip (0x51, 0xA1, 0x5A, 0x5B, 0x5C)
+    VGMContext *p_ctx;
+    long        loop_start_in_buffer;
+} ExtraSource;
+
+#define MAX_EXTRA_SOURCES (VGM_MERGE_MAX_INPUTS - 1)
+
+static FMChipType source_chip_of_cmd(uint8_t cmd) {
+    switch (cmd) {
+        case 0x51: case 0xA1: return FMCHIP_YM2413;
+        case 0x5A: return FMCHIP_YM3812;
+        case 0x5B: return FMCHIP_YM3526;
+        case 0x5C: return FMCHIP_Y8950;
+        default:   return FMCHIP_NONE;
+    }
+}
+
+static uint32_t source_clock_of_cmd(const VGMChipClockFlags *p_flags, uint8_t cmd) {
+    switch (cmd) {
+        case 0x51: case 0xA1: return p_flags->ym2413_clock;
+        case 0x5A: return p_flags->ym3812_clock;
+        case 0x5B: return p_flags->ym3526_clock;
+        case 0x5C: return p_flags->y8950_clock;
+        default:   return 0;
+    }
+}
+
+static void count_source_write(VGMStats *p_stats, uint8_t cmd) {
+    switch (cmd) {
+        case 0x51: case 0xA1: p_stats->ym2413_write_count++; break;
+        case 0x5A: p_stats->ym3812_write_count++; break;
+        case 0x5B: p_stats->ym3526_write_count++; break;
+        case 0x5C: p_stats->y8950_write_count++; break;
+        default: break;
+    }
+}
+
+static const char *source_name_of_cmd(uint8_t cmd) {
+    switch (cmd) {
+        case 0x51: return "YM2413";
+        case 0xA1: return "YM2413#2";
+        case 0x5A: return "YM3812";
+        case 0x5B: return "YM3526";
+        case 0x5C: return "Y8950";
+        default:   return "?";
+    }
+}
+
+static int extra_source_find(const ExtraSource *p_extras, int count, uint8_t cmd) {
+    for (int i = 0; i < count; ++i) {
+        if (p_extras[i].cmd == cmd) return i;
+    }
+    return -1;
+}
+
+/** Create the converter for one extra source. It shares the options of the main context. */
+static VGMContext *extra_source_create(const VGMContext *p_main, const VGMChipClockFlags *p_flags, uint8_t cmd) {
+    const OPL3Allocator *p_alloc = p_main->buffer.p_alloc;
+    VGMContext *p_ctx = (VGMContext *)opl3_mem_calloc(p_alloc, sizeof(VGMContext));
+    if (!p_ctx) return NULL;
+    FMChipType chip = source_chip_of_cmd(cmd);
+    vgm_buffer_init(&p_ctx->buffer);
+    p_ctx->buffer.p_alloc = p_alloc;
+    p_ctx->timestamp.sample_rate = p_main->timestamp.sample_rate;
+    p_ctx->cmd_type = VGMCommandType_Unkown;
+    p_ctx->cmd_opts = p_main->cmd_opts;
+    p_ctx->source_fmchip = chip;
+    p_ctx->source_fm_clock = (double)source_clock_of_cmd(p_flags, cmd);
+    p_ctx->target_fmchip = p_main->target_fmchip;
+    p_ctx->target_fm_clock = p_main->target_fm_clock;
+    p_ctx->p_metrics = NULL;
+    p_ctx->p_trace = NULL;
+    p_ctx->p_profile = p_main->p_profile;
+    opl3_hooks_attach(&p_ctx->hooks, p_main->hooks.p_hooks, p_main->hooks.p_user);
+
+    opl3_init(p_ctx, chip, &p_ctx->cmd_opts);
+    p_ctx->opl3_state.voice_db.p_alloc = p_alloc;
+    p_ctx->opl3_state.opl3_mode_initialized = true;
+    if (chip == FMCHIP_YM2413) opll2opl3_init_scheduler(p_ctx, &p_ctx->cmd_opts);
+    return p_ctx;
+}
+
+/** Feed one event to an extra source: its own writes, and every wait / end of the stream. */
+static void extra_source_feed(ExtraSource *p_src, const OPL3EventCursor *p_ev) {
+    VGMContext *p_ctx = p_src->p_ctx;
+    bool is_opll = (p_ctx->source_fmchip == FMCHIP_YM2413);
+    if (p_ev->cmd == p_src->cmd) {
+        p_ctx->cmd_type = VGMCommandType_RegWrite;
+        if (is_opll) {
+            if (p_ctx->cmd_opts.is_keep_source_vgm) {
+                uint8_t bytes[3] = {p_src->cmd, p_ev->reg, p_ev->val};
+                vgm_buffer_append(&p_ctx->buffer, bytes, 3);
+            }
+            opll2opl3_command_handler(p_ctx, p_ev->reg, p_ev->val, 0, &p_ctx->cmd_opts);
+        } else {
+            duplicate_write_opl3(p_ctx, p_ev->reg, p_ev->val, &p_ctx->cmd_opts);
+        }
+    } else if (p_ev->type == OPL3_EVENT_WAIT) {
+        p_ctx->cmd_type = VGMCommandType_Wait;
+        if (is_opll) opll2opl3_command_handler(p_ctx, 0, 0, (uint16_t)p_ev->arg, &p_ctx->cmd_opts);
+        else         vgm_wait_samples(p_ctx, (uint16_t)p_ev->arg);
+    } else if (p_ev->cmd == 0x66) {
+        p_ctx->cmd_type = VGMCommandType_End;
+        if (is_opll) opll2opl3_flush_all(p_ctx, &p_ctx->cmd_opts);
+    }
+}
+
+/** Loop point of the source stream: close held bursts and remember the position. */
+static void extra_source_mark_loop(ExtraSource *p_src) {
+    if (p_src->p_ctx->source_fmchip == FMCHIP_YM2413) {
+        opll2opl3_flush_all(p_src->p_ctx, &p_src->p_ctx->cmd_opts);
+    }
+    p_src->loop_start_in_buffer = (long)p_src->p_ctx->buffer.size;
+}
+
+static void extra_source_free(ExtraSource *p_src) {
+    if (!p_src->p_ctx) return;
+    const OPL3Allocator *p_alloc = p_src->p_ctx->buffer.p_alloc;
+    opl3_voice_db_free(&p_src->p_ctx->opl3_state.voice_db);
+    opll_voice_bank_close(p_src->p_ctx->opll_state.p_voice_bank);
+    vgm_buffer_free(&p_src->p_ctx->buffer);
+    opl3_mem_free(p_alloc, p_src->p_ctx, sizeof(VGMContext));
+    p_src->p_ctx = NULL;
+}
+
+static void clear_source_clock(uint8_t *p_header, uint8_t cmd) {
+    switch (cmd) {
+        case 0x51: case 0xA1: set_ym2413_clock(p_header, 0); break;
+        case 0x5A: set_ym3812_clock(p_header, 0); break;
+        case 0x5B: set_ym3526_clock(p_header, 0); break;
+        case 0x5C: set_y8950_clock(p_header, 0); break;
+        default: break;
+    }
+}
+
+struct ESEOPL3Context {
+    ESEOPL3Options      opts;
+    OPLLOverrideTable  *p_overrides;
+    OPL3Allocator       alloc;
+    const OPL3Allocator *p_alloc;           // &alloc, or NULL (malloc): every buffer of the job comes from it
+
+    VGMBuffer           input;              // everything pushed so far
+    VGMContext          vgmctx;
+    VGMChipClockFlags   chip_flags;
+
+    // Extra sources (2xYM2413 chip 2, --fm-mix)
+    ExtraSource         extras[MAX_EXTRA_SOURCES];
+    int                 extra_count;
+    bool                is_fm_mix;
+    bool                is_mix_msx_audio;
+
+    // Input layout
+    uint32_t            orig_header_size;
+    long                data_start;
+    long                input_skip;         // converted command bytes dropped from input (after data_start)
+    uint32_t            orig_loop_offset;
+    uint32_t            orig_loop_address;
+    long                pre_loop_output_bytes;
+    long                loop_start_in_buffer;
+    VGMSeekRange        seek;
+
+    // Event IR, lowered as the input arrives
+    OPL3Arena           ir_arena;
+    OPL3EventStream     ir;
+    OPL3EventStream    *p_ir;               // &ir, or the stream shared by eseopl3_convert_variants()
+    OPL3EventLowerer    lowerer;
+    OPL3EventCursor     ev;
+
+    // Checkpoints (--checkpoint-every / --checkpoint-file / --resume)
+    uint64_t            ckpt_interval;
+    const char         *p_ckpt_path;
+    bool                is_resume;
+    char                ckpt_default[300];
+    const char         *p_ckpt_file;
+    VGMCheckpointWriter ckpt;
+    VGMCheckpointRecord ckpt_rec;
+    VGMSeekImage        src_images[VGM_SEEK_NUM_CHIPS];
+    uint32_t            ev_index;
+    uint64_t            src_sample;
+
+    bool                is_started;         // header parsed, converter set up
+    bool                is_deferred;        // conversion waits for the whole input
+    bool                is_ended;           // 0x66 (or a copy failure) reached
+    bool                is_finalized;
+    bool                is_failed;
+
+    // Output
+    size_t              out_read;           // pulled bytes still in vgmctx.buffer
+    uint32_t            out_base;           // pulled bytes already dropped from it
+    uint32_t            header_size;
+    uint8_t            *p_header_buf;
+    VGMBuffer           gd3;
+
+    // --profile (vgmctx.p_profile points here when enabled)
+    OPL3Profile         profile;
+    uint64_t            input_bytes;
+};
+
+void eseopl3_options_init(ESEOPL3Options *p_opts) {
+    memset(p_opts, 0, sizeof(*p_opts));
+    p_opts->detune = DEFAULT_DETUNE;
+    p_opts->detune_limit = DEFAULT_DETUNE_LIMIT;
+    p_opts->keyon_wait = DEFAULT_WAIT;
+    p_opts->ch_panning = DEFAULT_CH_PANNING;
+    p_opts->v_ratio0 = DEFAULT_VOLUME_RATIO0;
+    p_opts->v_ratio1 = DEFAULT_VOLUME_RATIO1;
+    p_opts->carrier_tl_clamp_enabled = DEFAULT_CARRIER_TL_CLAMP_ENABLED;
+    p_opts->carrier_tl_clamp = DEFAULT_CARRIER_TL_CLAMP;
+    p_opts->preset = "YM2413";
+    p_opts->preset_source = "YMVOICE";
+    p_opts->keyon_coalesce_samples = OPLL_KEYON_COALESCE_SAMPLES;
+    p_opts->creator = "eseopl3patcher";
+}
+
+/** Converter options (CommandOptions) for the library options. */
+static void eseopl3_command_options(const ESEOPL3Options *p_opts, CommandOptions *p_co) {
+    memset(p_co, 0, sizeof(*p_co));
+    p_co->detune = p_opts->detune;
+    p_co->opl3_keyon_wait = p_opts->keyon_wait;
+    p_co->ch_panning = p_opts->ch_panning;
+    p_co->v_ratio0 = p_opts->v_ratio0;
+    p_co->v_ratio1 = p_opts->v_ratio1;
+    p_co->carrier_tl_clamp_enabled = p_opts->carrier_tl_clamp_enabled;
+    p_co->carrier_tl_clamp = p_opts->carrier_tl_clamp;
+    p_co->emergency_boost_steps = p_opts->emergency_boost_steps;
+    p_co->force_retrigger_each_note = p_opts->force_retrigger_each_note;
+    p_co->min_gate_samples = p_opts->min_gate_samples;
+    p_co->pre_keyon_wait_samples = p_opts->pre_keyon_wait_samples;
+    p_co->min_off_on_wait_samples = p_opts->min_off_on_wait_samples;
+    p_co->keyon_coalesce_samples = p_opts->keyon_coalesce_samples;
+    // The key timing scheduler works on the coalesced bursts
+    p_co->is_keyon_coalesce = p_opts->keyon_coalesce || p_opts->min_gate_samples > 0 ||
+                              p_opts->pre_keyon_wait_samples > 0 || p_opts->min_off_on_wait_samples > 0;
+    p_co->strip_unused_chip_clocks = p_opts->strip_unused_chip_clocks;
+    p_co->override_opl3_clock = p_opts->opl3_clock;
+    p_co->detune_limit = p_opts->detune_limit;
+    p_co->fm_mapping_style = FM_MappingStyle_modern;
+    p_co->is_port1_enabled = true;
+    p_co->is_voice_zero_clear = false;
+    p_co->is_a0_b0_aligned = false;
+    p_co->is_keep_source_vgm = p_opts->keep_source_vgm;
+    p_co->is_msx_audio = p_opts->msx_audio;
+    p_co->is_moon = p_opts->moon;
+    p_co->preset = decode_preset_type(p_opts->preset);
+    p_co->preset_source = decode_preset_source(p_opts->preset_source);
+    p_co->debug.strip_non_opl = p_opts->strip_non_opl;
+    p_co->debug.test_tone = p_opts->test_tone;
+    p_co->debug.fast_attack = p_opts->fast_attack;
+    p_co->debug.no_post_keyon_tl = p_opts->no_post_keyon_tl;
+    p_co->debug.single_port = p_opts->single_port;
+    p_co->debug.audible_sanity = p_opts->audible_sanity;
+    p_co->debug.verbose = p_opts->verbose;
+    p_co->p_voice_bank_path = p_opts->voice_bank_path;
+}
+
+int eseopl3_cache_key(const ESEOPL3Options *p_opts, const void *p_input, size_t input_size, char *p_key) {
+    const uint64_t basis = OPL3_FNV1A64_BASIS;
+    uint32_t version[3] = {ESEOPL3_CONVERTER_VERSION, OPLL_VOICE_BANK_VERSION, opll_voice_bank_source_hash()};
+    uint64_t h = opl3_fnv1a64(basis, version, sizeof(version));
+
+    CommandOptions co;
+    eseopl3_command_options(p_opts, &co);     // zero-filled, so padding hashes the same
+    co.debug.verbose = false;                 // diagnostics do not change the output
+    co.p_voice_bank_path = NULL;              // the bank file only caches derived voices
+    h = opl3_fnv1a64(h, &co, sizeof(co));
+
+    // Options that stay outside CommandOptions
+    struct {
+        uint64_t range_start;
+        uint64_t range_end;
+        uint32_t convert_mask;
+        uint32_t override_hash;
+        uint8_t  dual_opl3;
+        uint8_t  fm_mix;
+    } extra;
+    memset(&extra, 0, sizeof(extra));
+    extra.range_start = p_opts->range_start;
+    extra.range_end = p_opts->range_end;
+    extra.convert_mask = p_opts->convert_mask;
+    extra.dual_opl3 = p_opts->dual_opl3;
+    extra.fm_mix = p_opts->fm_mix;
+    if (p_opts->override_path) {
+        OPLLOverrideTable *p_tbl = opll_override_load(p_opts->override_path);
+        if (!p_tbl) return -1;
+        extra.override_hash = p_tbl->hash;
+        opll_override_free(p_tbl);
+    }
+    h = opl3_fnv1a64(h, &extra, sizeof(extra));
+    if (p_opts->creator) h = opl3_fnv1a64(h, p_opts->creator, strlen(p_opts->creator) + 1);
+
+    snprintf(p_key, ESEOPL3_CACHE_KEY_CHARS + 1, "%016llx%016llx%08x",
+             (unsigned long long)opl3_fnv1a64(basis, p_input, input_size), (unsigned long long)h,
+             (unsigned)(uint32_t)input_size);
+    return 0;
+}
+
+ESEOPL3Context *eseopl3_create(const ESEOPL3Options *p_opts) {
+    OPL3Allocator alloc = {NULL, NULL};
+    if (p_opts->p_allocator) {
+        alloc.fn = p_opts->p_allocator->fn;
+        alloc.p_user = p_opts->p_allocator->p_user;
+    }
+    const OPL3Allocator *p_alloc = alloc.fn ? &alloc : NULL;
+    ESEOPL3Context *p_ctx = (ESEOPL3Context *)opl3_mem_calloc(p_alloc, sizeof(ESEOPL3Context));
+    if (!p_ctx) return NULL;
+    p_ctx->opts = *p_opts;
+    p_ctx->alloc = alloc;
+    p_ctx->p_alloc = p_alloc ? &p_ctx->alloc : NULL;
+    if (p_opts->profile) {
+        // Everything after the context itself is counted
+        opl3_profile_init(&p_ctx->profile);
+        p_ctx->p_alloc = opl3_profile_allocator(&p_ctx->profile, p_ctx->p_alloc);
+        p_ctx->vgmctx.p_profile = &p_ctx->profile;
+    }
+    p_alloc = p_ctx->p_alloc;
+    if (p_opts->override_path) {
+        p_ctx->p_overrides = opll_override_load(p_opts->override_path);
+        if (!p_ctx->p_overrides) {
+            opl3_mem_free(p_alloc, p_ctx, sizeof(ESEOPL3Context));
+            return NULL;
+        }
+    }
+    vgm_buffer_init(&p_ctx->input);
+    vgm_buffer_init(&p_ctx->gd3);
+    p_ctx->input.p_alloc = p_alloc;
+    p_ctx->gd3.p_alloc = p_alloc;
+    p_ctx->p_ir = &p_ctx->ir;
+    p_ctx->ckpt_interval = p_opts->checkpoint_every;
+    p_ctx->p_ckpt_path = p_opts->checkpoint_path;
+    p_ctx->is_resume = p_opts->resume;
+    p_ctx->is_fm_mix = p_opts->fm_mix;
+    p_ctx->loop_start_in_buffer = -1;
+
+    // VGMContext setup
+    VGMContext *p_vc = &p_ctx->vgmctx;
+    vgm_buffer_init(&p_vc->buffer);
+    p_vc->buffer.p_alloc = p_alloc;
+    p_vc->timestamp.sample_rate = 44100.0;
+    p_vc->cmd_type = VGMCommandType_Unkown;
+    p_vc->opl3_state.rhythm_mode = false;
+    p_vc->opl3_state.opl3_mode_initialized = false;
+    p_vc->opll_state.is_rhythm_mode = false;
+    p_vc->opll_state.is_initialized = false;
+    p_vc->p_metrics = NULL;
+    p_vc->p_trace = NULL;
+    opl3_hooks_attach(&p_vc->hooks, NULL, NULL);
+
+    // Source chip selection
+    VGMChipClockFlags *p_flags = &p_ctx->chip_flags;
+    p_flags->convert_ym2413 = (p_opts->convert_mask & ESEOPL3_CONVERT_YM2413) != 0;
+    p_flags->convert_ym3812 = (p_opts->convert_mask & ESEOPL3_CONVERT_YM3812) != 0;
+    p_flags->convert_ym3526 = (p_opts->convert_mask & ESEOPL3_CONVERT_YM3526) != 0;
+    p_flags->convert_y8950  = (p_opts->convert_mask & ESEOPL3_CONVERT_Y8950) != 0;
+    p_flags->opl_group_autodetect = (p_opts->convert_mask == 0);
+
+    eseopl3_command_options(p_opts, &p_vc->cmd_opts);
+    p_vc->cmd_opts.p_overrides = p_ctx->p_overrides;
+    return p_ctx;
+}
+
+/** Drop the context into the failed state (the reason has been printed). */
+static int eseopl3_fail(ESEOPL3Context *p_ctx) {
+    p_ctx->is_failed = true;
+    return -1;
+}
+
+/** --profile: charge the time from here to the matching eseopl3_stage_end() to `stage`. */
+static OPL3ProfileStage eseopl3_stage_begin(ESEOPL3Context *p_ctx, OPL3ProfileStage stage) {
+    if (!OPL3_PROFILE_ON(p_ctx->vgmctx.p_profile)) return OPL3_PROFILE_IDLE;
+    return opl3_profile_enter(p_ctx->vgmctx.p_profile, stage);
+}
+
+static void eseopl3_stage_end(ESEOPL3Context *p_ctx, OPL3ProfileStage prev) {
+    if (OPL3_PROFILE_ON(p_ctx->vgmctx.p_profile)) opl3_profile_leave(p_ctx->vgmctx.p_profile, prev);
+}
+
+/**
+ * Parse the input header and set up the converters (the first half of the CLI pass).
+ * Called once the header and the first data byte are available, or at finalize().
+ */
+static int eseopl3_start(ESEOPL3Context *p_ctx) {
+    const uint8_t *p_vgm_data = p_ctx->input.data;
+    long filesize = (long)p_ctx->input.size;
+    VGMContext *p_vc = &p_ctx->vgmctx;
+    VGMChipClockFlags *p_flags = &p_ctx->chip_flags;
+
+    if (filesize < 0x38 || memcmp(p_vgm_data, "Vgm ", 4) != 0) {
+        fprintf(stderr, "Not a valid VGM file.\n");
+        return eseopl3_fail(p_ctx);
+    }
+
+    // Header/data offsets
+    // Read DataOffset (0x34) from VGM header
+    uint32_t vgm_data_offset = read_le_uint32(p_vgm_data + 0x34);
+
+    // If DataOffset is 0, adjust to 0x0C (VGM 1.01/1.10 compatibility)
+    // This ensures that actual data starts at 0x40 (0x34 + 0x0C)
+    if (vgm_data_offset == 0) {
+        vgm_data_offset = 0x0C;
+    }
+
+    // Calculate original header size using DataOffset
+    p_ctx->orig_header_size = 0x34 + vgm_data_offset;
+
+    // Ensure header size is at least 0x40 bytes (VGM minimum header size)
+    if (p_ctx->orig_header_size < 0x40) p_ctx->orig_header_size = VGM_HEADER_SIZE;
+    p_ctx->header_size = (p_ctx->orig_header_size > VGM_HEADER_SIZE) ? p_ctx->orig_header_size : VGM_HEADER_SIZE;
+
+    // Calculate data start position (where music data begins)
+    p_ctx->data_start = 0x34 + vgm_data_offset;
+
+    // Header layout (stderr: stdout belongs to the embedder, and --serve / --batch run jobs in parallel)
+    if (p_vc->cmd_opts.debug.verbose) {
+        fprintf(stderr, "orig_data_offset:%u(0x%x)\n", read_le_uint32(p_vgm_data + 0x34), read_le_uint32(p_vgm_data + 0x34));
+        fprintf(stderr, "orig_header_size: 0x%0x(%d).\n", p_ctx->orig_header_size, p_ctx->orig_header_size);
+        fprintf(stderr, "data_start: 0x%0lx(%ld).\n", p_ctx->data_start, p_ctx->data_start);
+    }
+
+    // Validate that data start offset is within file size
+    if (p_ctx->data_start >= filesize) {
+        fprintf(stderr, "Invalid VGM data offset.\n");
+        return eseopl3_fail(p_ctx);
+    }
+    // Loop Offset ($1C): Offset from the start of the file to the loop point (relative to $00). The loop point in the data is at ($1C + $04).
+    p_ctx->orig_loop_offset = read_le_uint32(p_vgm_data + 0x1C);
+    p_ctx->orig_loop_address = (p_ctx->orig_loop_offset != 0xFFFFFFFF) ? (p_ctx->orig_loop_offset + 0x04) : 0;
+
+    // A time-range excerpt is written without a loop
+    vgm_seek_init(&p_ctx->seek, p_ctx->opts.range_start, p_ctx->opts.range_end);
+    if (p_ctx->seek.is_active) {
+        p_ctx->orig_loop_offset = 0xFFFFFFFF;
+        p_ctx->orig_loop_address = 0;
+    }
+
+    // Parse chip clocks (the source chip selection below needs has_* / *_clock)
+    if (!vgm_parse_chip_clocks(p_vgm_data, filesize, p_flags)) {
+        fprintf(stderr, "Failed to parse VGM header for chip clocks.\n");
+        return eseopl3_fail(p_ctx);
+    }
+
+    // FM clock setup (source chip selection)
+    if (p_flags->convert_ym2413 && p_flags->has_ym2413) {
+        p_vc->source_fmchip = FMCHIP_YM2413;
+        p_vc->source_fm_clock = (double)p_flags->ym2413_clock;
+    } else if (p_flags->convert_ym3812 && p_flags->has_ym3812) {
+        p_vc->source_fmchip = FMCHIP_YM3812;
+        p_vc->source_fm_clock = (double)p_flags->ym3812_clock;
+    } else if (p_flags->convert_ym3526 && p_flags->has_ym3526) {
+        p_vc->source_fmchip = FMCHIP_YM3526;
+        p_vc->source_fm_clock = (double)p_flags->ym3526_clock;
+    } else if (p_flags->convert_y8950 && p_flags->has_y8950) {
+        p_vc->source_fmchip = FMCHIP_Y8950;
+        p_vc->source_fm_clock = (double)p_flags->y8950_clock;
+    } else {
+        p_vc->source_fm_clock = -1.0;
+    }
+    p_vc->target_fm_clock = OPL3_CLOCK;
+    p_vc->target_fmchip = FMCHIP_YMF262;
+
+    if(p_vc->cmd_opts.is_moon) {
+        p_vc->target_fmchip = FMCHIP_YMF278B;
+    }
+
+    if (p_vc->cmd_opts.debug.verbose) {
+        fprintf(stderr, "[VGM] FM chip usage:\n");
+        fprintf(stderr, " YM2413:%s clock=%u\n", p_flags->has_ym2413?"Y":"N", p_flags->ym2413_clock);
+        fprintf(stderr, " YM3812:%s clock=%u\n", p_flags->has_ym3812?"Y":"N", p_flags->ym3812_clock);
+        fprintf(stderr, " YM3526:%s clock=%u\n", p_flags->has_ym3526?"Y":"N", p_flags->ym3526_clock);
+        fprintf(stderr, " Y8950 :%s clock=%u\n", p_flags->has_y8950 ?"Y":"N", p_flags->y8950_clock);
+    }
+
+    // Extra sources: chip 2 of a 2xYM2413 file (clock bit 30) and, with --fm-mix, every other
+    // OPL-family chip. Each gets its own converter; the outputs are merged after the pass.
+    ExtraSource *extras = p_ctx->extras;
+    p_ctx->is_mix_msx_audio = p_vc->cmd_opts.is_msx_audio;
+    if (p_ctx->is_fm_mix) {
+        // Source order = priority order (the first one also drives the chip-global registers)
+        const struct { uint8_t cmd; bool is_present; bool is_selected; } k_candidates[] = {
+            {0x51, p_flags->has_ym2413,     p_flags->convert_ym2413},
+            {0xA1, p_flags->has_2nd_ym2413, p_flags->convert_ym2413},
+            {0x5A, p_flags->has_ym3812,     p_flags->convert_ym3812},
+            {0x5B, p_flags->has_ym3526,     p_flags->convert_ym3526},
+            {0x5C, p_flags->has_y8950,      p_flags->convert_y8950},
+        };
+        uint8_t mix_cmds[VGM_MERGE_MAX_INPUTS];
+        int mix_count = 0;
+        for (size_t k = 0; k < sizeof(k_candidates) / sizeof(k_candidates[0]); ++k) {
+            if (k_candidates[k].is_present && (p_flags->opl_group_autodetect || k_candidates[k].is_selected)) {
+                mix_cmds[mix_count++] = k_candidates[k].cmd;
+            }
+        }
+        if (mix_count < 2) {
+            p_ctx->is_fm_mix = false;
+            if (p_vc->cmd_opts.debug.verbose) {
+                fprintf(stderr, "[MIX] fewer than two OPL-family sources; --fm-mix has nothing to do\n");
+            }
+        } else {
+            uint8_t primary = mix_cmds[0];
+            p_flags->convert_ym2413 = (primary == 0x51);
+            p_flags->convert_ym3812 = (primary == 0x5A);
+            p_flags->convert_ym3526 = (primary == 0x5B);
+            p_flags->convert_y8950  = (primary == 0x5C);
+            p_flags->opl_group_autodetect = false;
+            p_flags->opl_group_first_cmd = primary;
+            p_vc->source_fmchip = source_chip_of_cmd(primary);
+            p_vc->source_fm_clock = (double)source_clock_of_cmd(p_flags, primary);
+            // Every channel is a pool channel: no port1 chorus, the mixer writes the Y8950 mirror itself
+            p_vc->cmd_opts.is_port1_enabled = false;
+            p_vc->cmd_opts.is_msx_audio = false;
+            for (int k = 1; k < mix_count; ++k) {
+                extras[p_ctx->extra_count].cmd = mix_cmds[k];
+                extras[p_ctx->extra_count].loop_start_in_buffer = -1;
+                extras[p_ctx->extra_count].p_ctx = extra_source_create(p_vc, p_flags, mix_cmds[k]);
+                if (!extras[p_ctx->extra_count].p_ctx) {
+                    fprintf(stderr, "Failed to allocate the %s context.\n", source_name_of_cmd(mix_cmds[k]));
+                    return eseopl3_fail(p_ctx);
+                }
+                p_ctx->extra_count++;
+            }
+            if (p_vc->cmd_opts.debug.verbose) {
+                fprintf(stderr, "[MIX] %d sources -> one YMF262:", mix_count);
+                for (int k = 0; k < mix_count; ++k) fprintf(stderr, " %s", source_name_of_cmd(mix_cmds[k]));
+                fprintf(stderr, "\n");
+            }
+        }
+    }
+    if (!p_ctx->is_fm_mix && p_flags->has_2nd_ym2413 && (p_flags->opl_group_autodetect || p_flags->convert_ym2413)) {
+        p_vc->cmd_opts.dual_route = p_ctx->opts.dual_opl3 ? OPLL_DualRoute_SECOND_OPL3 : OPLL_DualRoute_PORT1;
+        if (p_vc->cmd_opts.dual_route == OPLL_DualRoute_PORT1) {
+            p_vc->cmd_opts.is_port1_enabled = false;   // port1 channels belong to chip 2: no chorus
+        }
+        extras[0].cmd = 0xA1;
+        extras[0].loop_start_in_buffer = -1;
+        extras[0].p_ctx = extra_source_create(p_vc, p_flags, 0xA1);
+        if (!extras[0].p_ctx) {
+            fprintf(stderr, "Failed to allocate the second YM2413 context.\n");
+            return eseopl3_fail(p_ctx);
+        }
+        p_ctx->extra_count = 1;
+        if (p_vc->cmd_opts.debug.verbose) {
+            fprintf(stderr, "[DUAL] 2xYM2413: chip 2 -> %s\n",
+                (p_vc->cmd_opts.dual_route == OPLL_DualRoute_PORT1) ? "OPL3 port1 channels (chorus off)" : "second OPL3");
+        }
+    }
+    if (p_ctx->extra_count > 0 && (p_ctx->ckpt_interval || p_ctx->is_resume || p_ctx->p_ckpt_path)) {
+        fprintf(stderr, "[CKPT] checkpoints do not cover additional source chips yet; ignored\n");
+        p_ctx->ckpt_interval = 0;
+        p_ctx->is_resume = false;
+        p_ctx->p_ckpt_path = NULL;
+    }
+    // Checkpoints are keyed by a hash of the whole input: convert once it has arrived
+    p_ctx->is_deferred = (p_ctx->ckpt_interval || p_ctx->is_resume || p_ctx->p_ckpt_path);
+
+    if (p_ctx->opts.trace_path) {
+        p_vc->p_trace = opl3_trace_open(p_ctx->opts.trace_path, p_ctx->opts.trace_ring, p_ctx->opts.trace_ring == 0, p_ctx->p_alloc);
+        if (!p_vc->p_trace) fprintf(stderr, "[TRACE] cannot create %s, tracing disabled\n", p_ctx->opts.trace_path);
+    }
+    if (p_ctx->opts.metrics_path) {
+        // Counters and the note log are reserved here; the file is written once at finalize
+        p_vc->p_metrics = opl3_metrics_open(0, p_ctx->p_alloc);
+        if (!p_vc->p_metrics) fprintf(stderr, "[METRICS] cannot allocate the note log, metrics disabled\n");
+    }
+    {
+        int written_bytes = opl3_init(p_vc, FMCHIP_YMF262, &p_vc->cmd_opts);
+        p_vc->opl3_state.voice_db.p_alloc = p_ctx->p_alloc;
+        p_ctx->pre_loop_output_bytes += written_bytes;
+        opll2opl3_init_scheduler(p_vc, &p_vc->cmd_opts);
+    }
+
+    // Front end: commands are lowered into the event IR as they arrive
+    opl3_arena_init(&p_ctx->ir_arena, 0);
+    p_ctx->ir_arena.p_alloc = p_ctx->p_alloc;
+    opl3_event_lower_begin(&p_ctx->ir, &p_ctx->lowerer, &p_ctx->ir_arena, p_ctx->data_start);
+    p_ctx->is_started = true;
+    return 0;
+}
+
+/** Index of file offset `offset` in p_ctx->input, or -1 when the bytes were dropped. */
+static long eseopl3_input_index(const ESEOPL3Context *p_ctx, long offset) {
+    if (offset < p_ctx->data_start) return offset;
+    if (offset < p_ctx->data_start + p_ctx->input_skip) return -1;
+    return offset - p_ctx->input_skip;
+}
+
+/** Lower the commands received so far (input from data_start on, minus the dropped prefix). */
+static int eseopl3_lower(ESEOPL3Context *p_ctx, bool is_final) {
+    p_ctx->lowerer.base = p_ctx->data_start + p_ctx->input_skip;
+    return opl3_event_lower_feed(&p_ctx->ir, &p_ctx->lowerer, p_ctx->input.data + p_ctx->data_start,
+                                 (long)p_ctx->input.size - p_ctx->data_start, is_final);
+}
+
+/**
+ * Back end: lower one event to OPL3 writes.
+ * Returns 1 when the conversion has ended (0x66, or a truncated passthrough command).
+ */
+static int eseopl3_convert_event(ESEOPL3Context *p_ctx, const OPL3EventCursor *p_ev) {
+    VGMContext *p_vc = &p_ctx->vgmctx;
+    VGMChipClockFlags *p_flags = &p_ctx->chip_flags;
+    long read_done_byte = (long)p_ev->offset;
+    uint32_t current_addr = read_done_byte; // read_done_byteはdata_startから始まっていればファイル先頭からの位置
+    uint32_t orig_loop_address = p_ctx->orig_loop_address;
+
+    if (p_vc->source_fmchip == FMCHIP_YM2413 && orig_loop_address != 0xFFFFFFFF && read_done_byte == orig_loop_address) {
+        // Held OPLL bursts belong to the intro; never let them leak across the loop point
+        p_ctx->pre_loop_output_bytes += opll2opl3_flush_all(p_vc, &p_vc->cmd_opts);
+    }
+    for (int x = 0; x < p_ctx->extra_count; ++x) {
+        if (orig_loop_address != 0xFFFFFFFF && read_done_byte == orig_loop_address) {
+            extra_source_mark_loop(&p_ctx->extras[x]);
+        }
+        extra_source_feed(&p_ctx->extras[x], p_ev);
+    }
+    update_is_adding_bytes(p_vc, p_ctx->orig_loop_offset, current_addr);
+    update_loop_start_in_buffer(read_done_byte, orig_loop_address, p_vc, &p_ctx->loop_start_in_buffer);
+
+    p_vc->cmd_type = VGMCommandType_Unkown;
+    uint8_t cmd = p_ev->cmd;
+    int written_bytes = 0;
+
+    /* OPL-family autodetect */
+    if (p_flags->opl_group_autodetect && !p_flags->convert_ym2413 && !p_flags->convert_ym3812 &&
+        !p_flags->convert_ym3526 && !p_flags->convert_y8950) {
+        if (cmd == 0x51) {
+            p_flags->convert_ym2413 = true;
+            p_flags->opl_group_autodetect = false;
+            p_flags->opl_group_first_cmd = 0x51;
+            p_vc->source_fmchip = FMCHIP_YM2413;
+            p_vc->source_fm_clock = (double)p_flags->ym2413_clock;
+        } else if (cmd == 0x5A) {
+            p_flags->convert_ym3812 = true;
+            p_flags->opl_group_autodetect = false;
+            p_flags->opl_group_first_cmd = 0x5A;
+            p_vc->source_fmchip = FMCHIP_YM3812;
+            p_vc->source_fm_clock = (double)p_flags->ym3812_clock;
+        } else if (cmd == 0x5B) {
+            p_flags->convert_ym3526 = true;
+            p_flags->opl_group_autodetect = false;
+            p_flags->opl_group_first_cmd = 0x5B;
+            p_vc->source_fmchip = FMCHIP_YM3526;
+            p_vc->source_fm_clock = (double)p_flags->ym3526_clock;
+        } else if (cmd == 0x5C) {
+            p_flags->convert_y8950 = true;
+            p_flags->opl_group_autodetect = false;
+            p_flags->opl_group_first_cmd = 0x5C;
+            p_vc->source_fmchip = FMCHIP_Y8950;
+            p_vc->source_fm_clock = (double)p_flags->y8950_clock;
+        }
+    }
+
+    /* YM2413 */
+    if (cmd == 0x51) {
+        // Updates the stats
+        p_vc->status.stats.ym2413_write_count++;
+        p_vc->cmd_type = VGMCommandType_RegWrite;
+
+        if (p_vc->cmd_opts.is_keep_source_vgm) {
+            // Inject Original Command
+            written_bytes += vgm_append_byte(&p_vc->buffer, cmd);
+            written_bytes += vgm_append_byte(&p_vc->buffer, p_ev->reg);
+            written_bytes += vgm_append_byte(&p_vc->buffer, p_ev->val);
+        }
+        if (p_flags->convert_ym2413) {
+            if (!p_vc->opl3_state.opl3_mode_initialized) {
+                if (p_vc->cmd_opts.debug.verbose) fprintf(stderr, "Initializing OPL3 mode for YM2413...\n");
+                // Converting YM2413 writes means the waits go through the OPLL scheduler too,
+                // also when the header did not announce the chip
+                if (p_vc->source_fmchip != FMCHIP_YM2413) {
+                    p_vc->source_fmchip = FMCHIP_YM2413;
+                    if (p_vc->source_fm_clock <= 0) p_vc->source_fm_clock = (double)get_vgm_default_chip_clock(FMCHIP_YM2413);
+                }
+                written_bytes += opl3_init(p_vc, FMCHIP_YM2413, &p_vc->cmd_opts);
+                p_vc->opl3_state.opl3_mode_initialized = true;
+            }
+            written_bytes += opll2opl3_command_handler(p_vc, p_ev->reg, p_ev->val, 0, &p_vc->cmd_opts);
+        }
+        if (p_vc->status.is_adding_port1_bytes) {
+            p_ctx->pre_loop_output_bytes += written_bytes;
+        }
+        return 0;
+    }
+
+    /* Extra sources are converted by their own contexts (0xA1 is dropped when the header does not announce it) */
+    if (cmd == 0xA1 || extra_source_find(p_ctx->extras, p_ctx->extra_count, cmd) >= 0) {
+        count_source_write(&p_vc->status.stats, cmd);
+        return 0;
+    }
+
+    /* YM3812 / YM3526 / Y8950 */
+    if (cmd == 0x5A || cmd == 0x5B || cmd == 0x5C) {
+        bool is_selected;
+        FMChipType chip;
+        // Updates the stats
+        count_source_write(&p_vc->status.stats, cmd);
+        p_vc->cmd_type = VGMCommandType_RegWrite;
+        if (cmd == 0x5A)      { is_selected = p_flags->convert_ym3812; chip = FMCHIP_YM3812; }
+        else if (cmd == 0x5B) { is_selected = p_flags->convert_ym3526; chip = FMCHIP_YM3526; }
+        else                  { is_selected = p_flags->convert_y8950;  chip = FMCHIP_Y8950;  }
+
+        if (is_selected) {
+            if (!p_vc->opl3_state.opl3_mode_initialized) {
+                written_bytes += opl3_init(p_vc, chip, &p_vc->cmd_opts);
+                p_vc->opl3_state.opl3_mode_initialized = true;
+            }
+            written_bytes += duplicate_write_opl3(p_vc, p_ev->reg, p_ev->val, &p_vc->cmd_opts);
+        } else {
+            written_bytes += write_reg(p_vc, 0, p_ev->reg, p_ev->val);
+        }
+
+        if (p_vc->status.is_adding_port1_bytes) {
+            p_ctx->pre_loop_output_bytes += written_bytes;
+        }
+        return 0;
+    }
+
+    /* Other OPN-family passthrough */
+    if (cmd == 0x52 || cmd == 0x54 || cmd == 0x55 || cmd == 0x56 || cmd == 0x57) {
+        p_vc->cmd_type = VGMCommandType_Wait;
+        write_reg(p_vc, 0, p_ev->reg, p_ev->val);
+        return 0;
+    }
+
+    /* Wait process */
+    if ((cmd >= 0x70 && cmd <= 0x7F) || cmd == 0x61 || cmd == 0x62 || cmd == 0x63) {
+        p_vc->cmd_type = VGMCommandType_Wait;
+        if (p_vc->source_fmchip == FMCHIP_YM2413) {
+            int wait_samples = (int)p_ev->arg;
+            if (OPL3_TRACE_WANTED(p_vc->p_trace, p_vc->cmd_opts.debug.verbose)) {
+                OPL3TraceRecord rec = {0};
+                rec.time = (uint32_t)p_vc->opll_state.sch.virtual_time;
+                rec.emit = (uint32_t)p_vc->opll_state.sch.emit_time;
+                rec.code = OPL3_TRACE_MAIN_WAIT;
+                rec.reg = cmd;
+                rec.val = (uint8_t)p_vc->cmd_type;
+                rec.arg = (uint16_t)wait_samples;
+                opl3_trace_emit(p_vc->p_trace, p_vc->cmd_opts.debug.verbose, &rec);
+            }
+            written_bytes += opll2opl3_command_handler(p_vc, 0, 0, wait_samples, &p_vc->cmd_opts);
+        } else if (cmd == 0x61) {
+            vgm_wait_samples(p_vc, (uint16_t)p_ev->arg);
+        } else if (cmd == 0x62) {
+            written_bytes += vgm_wait_60hz(p_vc);
+        } else if (cmd == 0x63) {
+            written_bytes += vgm_wait_50hz(p_vc);
+        } else {
+            vgm_wait_short(p_vc, cmd);
+        }
+
+        if (p_vc->status.is_adding_port1_bytes) {
+            p_ctx->pre_loop_output_bytes += written_bytes;
+        }
+        return 0;
+    }
+
+    /* End */
+    if (cmd == 0x66) {
+        p_vc->cmd_type = VGMCommandType_End;
+        if (p_vc->source_fmchip == FMCHIP_YM2413) {
+            written_bytes += opll2opl3_flush_all(p_vc, &p_vc->cmd_opts);
+        }
+        written_bytes += vgm_append_byte(&p_vc->buffer, 0x66);
+
+        if (p_vc->status.is_adding_port1_bytes) {
+            p_ctx->pre_loop_output_bytes += written_bytes;
+        }
+        return 1; /* End reached */
+    }
+
+    /* --- New: Safe copy of other chips (AY8910 / K051649) --- */
+    const VGMFixedCmdLen *spec = vgm_find_fixed_cmd(cmd);
+    if (spec && p_vc->cmd_opts.debug.strip_non_opl) {
+        // Skip this command entirely
+        return 0;
+    }
+    if (!spec && p_ev->arg == 1 && p_vc->cmd_opts.debug.verbose) {
+        // Not in the VGM command table: for easier analysis, copy only 1 byte and emit warning
+        fprintf(stderr, "[WARN] Unknown VGM command 0x%02X at offset 0x%lX (forward as raw)\n",
+                cmd, read_done_byte);
+    }
+
+    /* Everything else (data blocks, PCM RAM writes, DAC streams, other chips) is copied whole (length from the IR) */
+    if (!copy_bytes_checked(&p_vc->buffer, p_ctx->input.data, (long)p_ctx->input.size,
+                            eseopl3_input_index(p_ctx, read_done_byte), (long)p_ev->arg)) {
+        return 1;
+    }
+    return 0;
+}
+
+/** Convert every event lowered so far (periodic checkpoints are written on the way). */
+static void eseopl3_drain(ESEOPL3Context *p_ctx) {
+    if (!p_ctx->ev.p_chunk) {
+        if (!p_ctx->p_ir->p_head) return;
+        opl3_event_cursor_init(&p_ctx->ev, p_ctx->p_ir);
+    }
+    OPL3ProfileStage prev_stage = eseopl3_stage_begin(p_ctx, OPL3_PROFILE_CONVERT);
+    while (!p_ctx->is_ended && vgm_seek_next(&p_ctx->seek, &p_ctx->ev)) {
+        if (p_ctx->ckpt.fp) {
+            if (vgm_checkpoint_due(&p_ctx->ckpt, p_ctx->src_sample)) {
+                VGMCheckpointRecord *p_rec = &p_ctx->ckpt_rec;
+                p_rec->event_index = p_ctx->ev_index;
+                p_rec->src_offset = p_ctx->ev.offset;
+                p_rec->src_sample = p_ctx->src_sample;
+                p_rec->pre_loop_output_bytes = p_ctx->pre_loop_output_bytes;
+                p_rec->loop_start_in_buffer = p_ctx->loop_start_in_buffer;
+                p_rec->reserved = 0;
+                p_rec->chip_flags = p_ctx->chip_flags;
+                memcpy(p_rec->image, p_ctx->src_images, sizeof(p_ctx->src_images));
+                vgm_checkpoint_write(&p_ctx->ckpt, p_rec, &p_ctx->vgmctx);
+            }
+            vgm_seek_capture(p_ctx->src_images, &p_ctx->ev);
+            p_ctx->ev_index++;
+            if (p_ctx->ev.type == OPL3_EVENT_WAIT) p_ctx->src_sample += p_ctx->ev.arg;
+        }
+        if (OPL3_PROFILE_ON(p_ctx->vgmctx.p_profile)) p_ctx->profile.commands++;
+        if (eseopl3_convert_event(p_ctx, &p_ctx->ev)) p_ctx->is_ended = true;
+    }
+    eseopl3_stage_end(p_ctx, prev_stage);
+}
+
+/** Whole input available: hash it, then resume / seek from a checkpoint or open the sidecar. */
+static void eseopl3_checkpoint_begin(ESEOPL3Context *p_ctx) {
+    VGMContext *p_vc = &p_ctx->vgmctx;
+    uint32_t input_hash, opts_hash;
+    long ckpt_resume_end = 0;
+
+    if (!p_ctx->p_ckpt_path) {
+        snprintf(p_ctx->ckpt_default, sizeof(p_ctx->ckpt_default), "%s.ckpt",
+                 p_ctx->opts.output_path ? p_ctx->opts.output_path : "eseopl3");
+    }
+    p_ctx->p_ckpt_file = p_ctx->p_ckpt_path ? p_ctx->p_ckpt_path : p_ctx->ckpt_default;
+    {
+        CommandOptions opts_key = p_vc->cmd_opts;
+        opts_key.debug.verbose = false;   // diagnostics do not change the output
+        opts_key.p_overrides = NULL;      // keyed by content, not by address
+        opts_key.p_voice_bank_path = NULL;
+        input_hash = opl3_fnv1a(OPL3_FNV1A_BASIS, p_ctx->input.data, p_ctx->input.size);
+        opts_hash = opl3_fnv1a(OPL3_FNV1A_BASIS, &opts_key, sizeof(opts_key)) ^
+                    (opl3_fnv1a(OPL3_FNV1A_BASIS, &p_ctx->chip_flags, sizeof(p_ctx->chip_flags)) * OPL3_FNV1A_PRIME);
+        if (p_ctx->p_overrides) opts_hash ^= p_ctx->p_overrides->hash * 2654435761u;
+        if (opts_hash == 0) opts_hash = 1;
+    }
+
+    opl3_event_cursor_init(&p_ctx->ev, p_ctx->p_ir);
+    if (p_ctx->seek.is_active && p_ctx->p_ckpt_path) {
+        // Random access: continue the state-only fast-forward from the nearest checkpoint
+        if (vgm_checkpoint_load(p_ctx->p_ckpt_file, input_hash, 0, p_ctx->opts.range_start, &p_ctx->ckpt_rec, NULL, NULL, NULL) == 0) {
+            vgm_seek_resume_at(&p_ctx->seek, p_ctx->ckpt_rec.src_sample, p_ctx->ckpt_rec.image,
+                               p_ctx->ckpt_rec.event_index);
+            if (p_vc->cmd_opts.debug.verbose) {
+                fprintf(stderr, "[CKPT] seek from checkpoint at sample %llu (event %u)\n",
+                    (unsigned long long)p_ctx->ckpt_rec.src_sample, p_ctx->ckpt_rec.event_index);
+            }
+        }
+    } else if (p_ctx->is_resume && !p_ctx->seek.is_active) {
+        VGMBuffer prefix;
+        if (vgm_checkpoint_load(p_ctx->p_ckpt_file, input_hash, opts_hash, UINT64_MAX, &p_ctx->ckpt_rec, &prefix,
+                                &p_vc->opl3_state.voice_db, &ckpt_resume_end) == 0) {
+            vgm_buffer_free(&p_vc->buffer);
+            p_vc->buffer = prefix;
+            vgm_checkpoint_restore_ctx(p_vc, &p_ctx->ckpt_rec);
+            p_ctx->chip_flags = p_ctx->ckpt_rec.chip_flags;
+            p_ctx->pre_loop_output_bytes = (long)p_ctx->ckpt_rec.pre_loop_output_bytes;
+            p_ctx->loop_start_in_buffer = (long)p_ctx->ckpt_rec.loop_start_in_buffer;
+            memcpy(p_ctx->src_images, p_ctx->ckpt_rec.image, sizeof(p_ctx->src_images));
+            p_ctx->ev_index = p_ctx->ckpt_rec.event_index;
+            p_ctx->src_sample = p_ctx->ckpt_rec.src_sample;
+            opl3_event_cursor_seek(&p_ctx->ev, p_ctx->p_ir, p_ctx->ev_index);
+            fprintf(stderr, "[CKPT] resumed at sample %llu (event %u, %zu output bytes)\n",
+                (unsigned long long)p_ctx->src_sample, p_ctx->ev_index, p_vc->buffer.size);
+        } else {
+            fprintf(stderr, "[CKPT] no usable checkpoint in %s, converting from the start\n", p_ctx->p_ckpt_file);
+        }
+    }
+    if (p_ctx->ckpt_interval && !p_ctx->seek.is_active) {
+        if (vgm_checkpoint_open(&p_ctx->ckpt, p_ctx->p_ckpt_file, p_ctx->ckpt_interval, input_hash, opts_hash, ckpt_resume_end) != 0) {
+            fprintf(stderr, "[CKPT] cannot write %s, checkpoints disabled\n", p_ctx->p_ckpt_file);
+        } else if (ckpt_resume_end > 0) {
+            p_ctx->ckpt.out_done = p_vc->buffer.size;
+            p_ctx->ckpt.voices_done = p_vc->opl3_state.voice_db.count;
+            p_ctx->ckpt.next_at = p_ctx->src_sample + p_ctx->ckpt_interval;
+        }
+    }
+}
+
+/** Output is delivered as it is produced (no merge pass, no checkpoint pass). */
+static bool eseopl3_is_streaming(const ESEOPL3Context *p_ctx) {
+    return p_ctx->is_started && !p_ctx->is_deferred && p_ctx->extra_count == 0;
+}
+
+/**
+ * Streaming: drop what is converted, so memory stays bounded however long the input is.
+ * Once the cursor has caught up with the lowerer, the IR events and the lowered command
+ * bytes are not read again; the header and the GD3 chunk stay for finalize.
+ */
+static void eseopl3_compact_input(ESEOPL3Context *p_ctx) {
+    const OPL3EventChunk *p_tail = p_ctx->ir.p_tail;
+    bool is_caught_up = p_tail && p_ctx->ev.p_chunk == p_tail && p_ctx->ev.index >= p_tail->count;
+    if (p_ctx->p_ir != &p_ctx->ir || !(is_caught_up || p_ctx->is_ended)) return;
+    if (p_tail) {
+        opl3_arena_reset(&p_ctx->ir_arena);
+        p_ctx->ir.p_head = p_ctx->ir.p_tail = NULL;
+        memset(&p_ctx->ev, 0, sizeof(p_ctx->ev));
+    }
+
+    long keep_from = p_ctx->lowerer.pos;
+    uint32_t gd3_offset = read_le_uint32(p_ctx->input.data + 0x14);
+    if (gd3_offset && 0x14 + (long)gd3_offset < keep_from) keep_from = 0x14 + (long)gd3_offset;
+    long drop = keep_from - (p_ctx->data_start + p_ctx->input_skip);
+    if (drop < ESEOPL3_COMPACT_BYTES) return;
+    long from = p_ctx->data_start + drop;
+    memmove(p_ctx->input.data + p_ctx->data_start, p_ctx->input.data + from, p_ctx->input.size - (size_t)from);
+    p_ctx->input.size -= (size_t)drop;
+    p_ctx->input_skip += drop;
+}
+
+int eseopl3_push(ESEOPL3Context *p_ctx, const void *p_data, size_t len) {
+    if (p_ctx->is_failed || p_ctx->is_finalized) return -1;
+    if (len && vgm_buffer_try_append(&p_ctx->input, p_data, len) != 0) return eseopl3_fail(p_ctx);
+    long size = (long)p_ctx->input.size;
+    if (!p_ctx->is_started) {
+        if (size >= 4 && memcmp(p_ctx->input.data, "Vgm ", 4) != 0) {
+            fprintf(stderr, "Not a valid VGM file.\n");
+            return eseopl3_fail(p_ctx);
+        }
+        // The header, and at least the first command, before anything is converted
+        if (size < 0x70) return 0;
+        uint32_t data_offset = read_le_uint32(p_ctx->input.data + 0x34);
+        long data_start = 0x34 + (long)(data_offset ? data_offset : 0x0C);
+        if (size <= data_start) return 0;
+        OPL3ProfileStage prev_stage = eseopl3_stage_begin(p_ctx, OPL3_PROFILE_PARSE);
+        int rc = eseopl3_start(p_ctx);
+        eseopl3_stage_end(p_ctx, prev_stage);
+        if (rc != 0) return -1;
+    }
+    if (p_ctx->is_deferred) return 0;
+    OPL3ProfileStage prev_stage = eseopl3_stage_begin(p_ctx, OPL3_PROFILE_PARSE);
+    int rc = eseopl3_lower(p_ctx, false);
+    eseopl3_stage_end(p_ctx, prev_stage);
+    if (rc != 0) {
+        fprintf(stderr, "Failed to allocate event IR.\n");
+        return eseopl3_fail(p_ctx);
+    }
+    eseopl3_drain(p_ctx);
+    if (eseopl3_is_streaming(p_ctx)) eseopl3_compact_input(p_ctx);
+    return 0;
+}
+
+size_t eseopl3_pending(const ESEOPL3Context *p_ctx) {
+    if (p_ctx->is_failed) return 0;
+    if (!p_ctx->is_finalized && !eseopl3_is_streaming(p_ctx)) return 0;
+    return p_ctx->vgmctx.buffer.size - p_ctx->out_read;
+}
+
+size_t eseopl3_pull(ESEOPL3Context *p_ctx, void *p_out, size_t cap) {
+    size_t n = eseopl3_pending(p_ctx);
+    if (n > cap) n = cap;
+    if (n == 0) return 0;
+    VGMBuffer *p_buf = &p_ctx->vgmctx.buffer;
+    memcpy(p_out, p_buf->data + p_ctx->out_read, n);
+    p_ctx->out_read += n;
+    if (eseopl3_is_streaming(p_ctx) && !p_ctx->is_finalized && p_ctx->out_read >= ESEOPL3_COMPACT_BYTES) {
+        // Nothing reads the stream behind the converter in streaming mode
+        memmove(p_buf->data, p_buf->data + p_ctx->out_read, p_buf->size - p_ctx->out_read);
+        p_buf->size -= p_ctx->out_read;
+        p_ctx->out_base += (uint32_t)p_ctx->out_read;
+        p_ctx->out_read = 0;
+    }
+    return n;
+}
+
+uint32_t eseopl3_header_size(const ESEOPL3Context *p_ctx) {
+    return p_ctx->is_started ? p_ctx->header_size : 0;
+}
+
+/** Interleave the extra sources into the main stream on the shared timeline. */
+static int eseopl3_merge(ESEOPL3Context *p_ctx) {
+    VGMContext *p_vc = &p_ctx->vgmctx;
+    ExtraSource *extras = p_ctx->extras;
+    int extra_count = p_ctx->extra_count;
+    VGMBuffer merged;
+    long merged_loop = -1;
+    uint32_t merged_samples = 0;
+    vgm_buffer_init(&merged);
+    merged.p_alloc = p_ctx->p_alloc;
+    if (p_ctx->is_fm_mix) {
+        VGMMergeInput inputs[VGM_MERGE_MAX_INPUTS];
+        int priority[VGM_MERGE_MAX_INPUTS];
+        OPL3Mixer *p_mix = (OPL3Mixer *)opl3_mem_calloc(p_ctx->p_alloc, sizeof(OPL3Mixer));
+        if (!p_mix) {
+            fprintf(stderr, "Failed to allocate the FM mixer.\n");
+            return -1;
+        }
+        inputs[0].p_buf = &p_vc->buffer;
+        inputs[0].loop = p_ctx->loop_start_in_buffer;
+        for (int x = 0; x < extra_count; ++x) {
+            inputs[x + 1].p_buf = &extras[x].p_ctx->buffer;
+            inputs[x + 1].loop = extras[x].loop_start_in_buffer;
+        }
+        for (int x = 0; x <= extra_count; ++x) priority[x] = extra_count + 1 - x;
+        opl3_mixer_init(p_mix, extra_count + 1, priority, p_vc->cmd_opts.is_moon ? 0xD0 : 0x5E, p_ctx->is_mix_msx_audio);
+        vgm_merge_streams(&merged, inputs, extra_count + 1, opl3_mixer_sink, p_mix, &merged_loop, &merged_samples);
+        if (p_vc->cmd_opts.debug.verbose) {
+            for (int x = 0; x <= extra_count; ++x) {
+                const OPL3MixSource *p_src = &p_mix->src[x];
+                fprintf(stderr, "[MIX] %-8s notes=%u stolen=%u dropped=%u\n",
+                    source_name_of_cmd(x ? extras[x - 1].cmd : p_ctx->chip_flags.opl_group_first_cmd),
+                    p_src->note_count, p_src->stolen_notes, p_src->dropped_notes);
+            }
+            fprintf(stderr, "[MIX] steals=%u rhythm owner=%d dropped rhythm writes=%u, %zu bytes, %u samples\n",
+                p_mix->alloc.steal_count, p_mix->rhythm_owner, p_mix->rhythm_conflicts, merged.size, merged_samples);
+        }
+        opl3_mem_free(p_ctx->p_alloc, p_mix, sizeof(OPL3Mixer));
+        p_vc->cmd_opts.is_msx_audio = p_ctx->is_mix_msx_audio;
+    } else {
+        vgm_merge_dual_streams(&merged, &p_vc->buffer, p_ctx->loop_start_in_buffer,
+                               &extras[0].p_ctx->buffer, extras[0].loop_start_in_buffer,
+                               p_vc->cmd_opts.dual_route, &merged_loop, &merged_samples);
+        if (p_vc->cmd_opts.debug.verbose) {
+            fprintf(stderr, "[DUAL] merged %zu + %zu bytes -> %zu bytes, %u samples\n",
+                p_vc->buffer.size, extras[0].p_ctx->buffer.size, merged.size, merged_samples);
+        }
+    }
+    vgm_buffer_free(&p_vc->buffer);
+    p_vc->buffer = merged;
+    p_ctx->loop_start_in_buffer = merged_loop;
+    p_vc->status.total_samples = merged_samples;
+    return 0;
+}
+
+/** GD3 rebuild: original fields, creator and a note describing the conversion. */
+static void eseopl3_build_gd3(ESEOPL3Context *p_ctx) {
+    const ESEOPL3Options *p_opts = &p_ctx->opts;
+    VGMContext *p_vc = &p_ctx->vgmctx;
+    char *p_gd3_fields[GD3_FIELDS] = {0};
+    uint32_t orig_gd3_ver = 0, orig_gd3_len = 0;
+    uint32_t gd3_offset = (p_ctx->input.size >= 0x18) ? read_le_uint32(p_ctx->input.data + 0x14) : 0;
+    long gd3_index = gd3_offset ? eseopl3_input_index(p_ctx, 0x14 + (long)gd3_offset) : -1;
+    if (gd3_index < 0 || gd3_index > (long)p_ctx->input.size ||
+        extract_gd3_chunk(p_ctx->input.data + gd3_index, (long)p_ctx->input.size - gd3_index, p_gd3_fields,
+                          &orig_gd3_ver, &orig_gd3_len, p_ctx->p_alloc) != 0) {
+        for (int i = 0; i < GD3_FIELDS; ++i) p_gd3_fields[i] = opl3_mem_strdup(p_ctx->p_alloc, "");
+        orig_gd3_ver = 0x00000100;
+    }
+    char creator_append[128];
+    snprintf(creator_append, sizeof(creator_append), ",%s", p_opts->creator);
+    char note_append[512];
+
+    if (p_vc->source_fmchip == FMCHIP_YM2413) {
+        snprintf(note_append, sizeof(note_append),
+            ", Conversion from %s to OPL3 with Preset:%s/%s Detune:%.2f%%(max:+-%.2f) KEY ON/OFF wait:%d "
+            "Ch Panning mode:%d port0 volume:%.2f%% port1 volume:%.2f%% Keep source VGM:%s msx_audio:%s moonsound:%s",
+            get_converted_opl_chip_name(&p_ctx->chip_flags),
+            get_opll_preset_type(p_vc->cmd_opts.preset), get_opll_preset_source(p_vc->cmd_opts.preset_source),
+            p_opts->detune,
+            (double)p_opts->detune_limit,
+            (int)p_opts->keyon_wait,
+            (int)p_opts->ch_panning,
+            p_opts->v_ratio0 * 100,
+            p_opts->v_ratio1 * 100,
+            p_vc->cmd_opts.is_keep_source_vgm ? "ON" : "OFF",
+            p_vc->cmd_opts.is_msx_audio ? "ON" : "OFF",
+            p_vc->cmd_opts.is_moon ? "ON" : "OFF"
+        );
+        if (p_vc->cmd_opts.dual_route != OPLL_DualRoute_NONE) {
+            size_t len = strlen(note_append);
+            snprintf(note_append + len, sizeof(note_append) - len, " 2xYM2413:%s",
+                (p_vc->cmd_opts.dual_route == OPLL_DualRoute_PORT1) ? "port1" : "2xOPL3");
+        }
+    } else {
+        snprintf(note_append, sizeof(note_append),
+            ", Conversion from %s to OPL3. Detune:%.2f%%(max:+-%.2f) KEY ON/OFF wait:%d "
+            "Ch Panning mode:%d port0 volume:%.2f%% port1 volume:%.2f%% msx_audio:%s moonsound:%s",
+            get_converted_opl_chip_name(&p_ctx->chip_flags),
+            p_opts->detune,
+            (double)p_opts->detune_limit,
+            (int)p_opts->keyon_wait,
+            (int)p_opts->ch_panning,
+            p_opts->v_ratio0 * 100,
+            p_opts->v_ratio1 * 100,
+            p_vc->cmd_opts.is_msx_audio ? "ON" : "OFF",
+            p_vc->cmd_opts.is_moon ? "ON" : "OFF"
+        );
+    }
+    if (p_ctx->is_fm_mix) {
+        size_t len = strlen(note_append);
+        len += snprintf(note_append + len, sizeof(note_append) - len, " FM mix:%s", source_name_of_cmd(p_ctx->chip_flags.opl_group_first_cmd));
+        for (int x = 0; x < p_ctx->extra_count && len < sizeof(note_append); ++x) {
+            len += snprintf(note_append + len, sizeof(note_append) - len, "+%s", source_name_of_cmd(p_ctx->extras[x].cmd));
+        }
+    }
+
+    build_new_gd3_chunk(&p_ctx->gd3, p_gd3_fields, orig_gd3_ver, creator_append, note_append);
+    gd3_fields_free(p_gd3_fields, GD3_FIELDS, p_ctx->p_alloc);
+}
+
+/** Build the output header now that sizes, loop and sample count are final. */
+static int eseopl3_build_header(ESEOPL3Context *p_ctx) {
+    VGMContext *p_vc = &p_ctx->vgmctx;
+    VGMChipClockFlags *p_flags = &p_ctx->chip_flags;
+    bool is_merged = (p_ctx->extra_count > 0);
+
+    // Compute header and buffer sizes
+    uint32_t music_data_size = p_ctx->out_base + (uint32_t)p_vc->buffer.size;
+    uint32_t gd3_size = (uint32_t)p_ctx->gd3.size;
+    uint32_t header_size = p_ctx->header_size;
+    uint32_t new_eof_offset = music_data_size + header_size + gd3_size - 1;
+    uint32_t vgm_eof_offset_field = new_eof_offset - 0x04;
+    uint32_t gd3_offset_field_value = header_size + music_data_size - 0x14;
+    uint32_t data_offset = header_size - 0x34;
+
+    p_ctx->p_header_buf = (uint8_t*)opl3_mem_calloc(p_ctx->p_alloc, header_size);
+    if (!p_ctx->p_header_buf) {
+        fprintf(stderr, "Failed to allocate the output header.\n");
+        return -1;
+    }
+    uint8_t *p_header_buf = p_ctx->p_header_buf;
+
+    if (is_merged && p_ctx->loop_start_in_buffer >= 0) {
+        // Merged stream: the loop position is known exactly (relative to 0x1C)
+        p_ctx->pre_loop_output_bytes = (long)header_size + p_ctx->loop_start_in_buffer - 0x1C;
+    }
+
+    build_vgm_header(
+        p_header_buf,
+        p_ctx->input.data,
+        p_vc->status.total_samples,
+        vgm_eof_offset_field,
+        gd3_offset_field_value,
+        data_offset,
+        0x00000171,             // VGM version
+        p_ctx->pre_loop_output_bytes  // additional_data_bytes
+    );
+
+    if (p_vc->cmd_opts.is_keep_source_vgm) {
+        p_vc->cmd_opts.strip_unused_chip_clocks = false;
+    }
+
+    if (p_ctx->seek.is_active) {
+        clear_vgm_loop(p_header_buf);
+        if (p_vc->cmd_opts.debug.verbose) {
+            fprintf(stderr, "[SEEK] range=%llu-%llu samples, output=%u samples\n",
+                (unsigned long long)p_ctx->opts.range_start,
+                (unsigned long long)(p_ctx->opts.range_end ? p_ctx->opts.range_end : p_ctx->seek.pos),
+                p_vc->status.total_samples);
+        }
+    }
+
+    /** Update the clock information in new header */
+    vgm_header_postprocess(p_header_buf, p_vc, &p_vc->cmd_opts);
+
+    if (p_vc->cmd_opts.dual_route == OPLL_DualRoute_SECOND_OPL3) {
+        set_vgm_dual_chip(p_header_buf, p_vc->cmd_opts.is_moon ? 0x60 : 0x5C);
+        if (p_vc->cmd_opts.is_msx_audio) set_vgm_dual_chip(p_header_buf, 0x58);
+    }
+
+    // The extra source chips are converted too
+    for (int x = 0; x < p_ctx->extra_count; ++x) {
+        if (!p_vc->cmd_opts.is_keep_source_vgm) clear_source_clock(p_header_buf, p_ctx->extras[x].cmd);
+    }
+
+    if (p_vc->cmd_opts.is_keep_source_vgm && p_vc->source_fmchip == FMCHIP_YM2413) {
+        if (p_vc->cmd_opts.debug.verbose) {
+            fprintf(stderr, " YM2413:%s clock=%u (0x%0x)\n", p_flags->has_ym2413?"Y":"N", p_flags->ym2413_clock, p_flags->ym2413_clock);
+        }
+        set_ym2413_clock(p_header_buf, p_flags->ym2413_clock | (p_flags->has_2nd_ym2413 ? VGM_CLOCK_DUAL_BIT : 0));
+    }
+    return 0;
+}
+
+int eseopl3_finalize(ESEOPL3Context *p_ctx, ESEOPL3Result *p_res) {
+    if (p_ctx->is_failed) return -1;
+    if (p_ctx->is_finalized) return -1;
+
+    VGMContext *p_vc = &p_ctx->vgmctx;
+    OPL3ProfileStage prev_stage = eseopl3_stage_begin(p_ctx, OPL3_PROFILE_PARSE);
+    int rc = 0;
+    if (!p_ctx->is_started) rc = eseopl3_start(p_ctx);
+    if (rc == 0 && p_ctx->p_ir == &p_ctx->ir &&
+        eseopl3_lower(p_ctx, true) != 0) {
+        fprintf(stderr, "Failed to allocate event IR.\n");
+        rc = eseopl3_fail(p_ctx);
+    }
+    eseopl3_stage_end(p_ctx, prev_stage);
+    if (rc != 0) return -1;
+    p_ctx->input_bytes = p_ctx->input.size + (uint64_t)p_ctx->input_skip;
+    if (p_vc->cmd_opts.debug.verbose) {
+        const OPL3EventStream *p_ir = p_ctx->p_ir;
+        fprintf(stderr, "[IR] events=%u keyon=%u keyoff=%u pitch=%u voice=%u wait=%u samples=%llu arena=%zu bytes\n",
+            p_ir->count, p_ir->type_count[OPL3_EVENT_KEYON], p_ir->type_count[OPL3_EVENT_KEYOFF],
+            p_ir->type_count[OPL3_EVENT_PITCH], p_ir->type_count[OPL3_EVENT_VOICECHANGE],
+            p_ir->type_count[OPL3_EVENT_WAIT], (unsigned long long)p_ir->total_samples, p_ir->p_arena->total_bytes);
+    }
+    if (p_ctx->is_deferred) eseopl3_checkpoint_begin(p_ctx);
+    eseopl3_drain(p_ctx);
+
+    opl3_arena_free(&p_ctx->ir_arena);
+    memset(&p_ctx->ir, 0, sizeof(p_ctx->ir));
+    memset(&p_ctx->ev, 0, sizeof(p_ctx->ev));
+    p_ctx->p_ir = &p_ctx->ir;
+    if (p_ctx->ckpt.fp && p_vc->cmd_opts.debug.verbose) {
+        fprintf(stderr, "[CKPT] %u checkpoints written to %s\n", p_ctx->ckpt.count, p_ctx->p_ckpt_file);
+    }
+    vgm_checkpoint_close(&p_ctx->ckpt);
+    if (p_vc->p_metrics) {
+        if (opl3_metrics_flush(p_vc->p_metrics, p_ctx->opts.metrics_path, p_vc->timestamp.current_sample) != 0) {
+            fprintf(stderr, "[METRICS] cannot write %s\n", p_ctx->opts.metrics_path);
+        }
+        if (p_vc->cmd_opts.debug.verbose) opl3_metrics_print_summary(p_vc->p_metrics, stderr);
+        opl3_metrics_close(p_vc->p_metrics);
+        p_vc->p_metrics = NULL;
+    }
+    if (p_vc->p_trace) {
+        if (p_vc->cmd_opts.debug.verbose) {
+            fprintf(stderr, "[TRACE] %llu records (%s)\n", (unsigned long long)p_vc->p_trace->head,
+                    p_vc->p_trace->is_stream ? "all kept" : "ring");
+        }
+        if (opl3_trace_close(p_vc->p_trace) != 0) fprintf(stderr, "[TRACE] cannot write %s\n", p_ctx->opts.trace_path);
+        p_vc->p_trace = NULL;
+    }
+
+    if (p_ctx->extra_count > 0) {
+        prev_stage = eseopl3_stage_begin(p_ctx, OPL3_PROFILE_MERGE);
+        rc = eseopl3_merge(p_ctx);
+        eseopl3_stage_end(p_ctx, prev_stage);
+        if (rc != 0) return eseopl3_fail(p_ctx);
+        p_ctx->out_read = 0;
+    }
+    prev_stage = eseopl3_stage_begin(p_ctx, OPL3_PROFILE_GD3);
+    eseopl3_build_gd3(p_ctx);
+    eseopl3_stage_end(p_ctx, prev_stage);
+    prev_stage = eseopl3_stage_begin(p_ctx, OPL3_PROFILE_HEADER);
+    rc = eseopl3_build_header(p_ctx);
+    eseopl3_stage_end(p_ctx, prev_stage);
+    if (rc != 0) return eseopl3_fail(p_ctx);
+    for (int x = 0; x < p_ctx->extra_count; ++x) extra_source_free(&p_ctx->extras[x]);
+    p_ctx->is_finalized = true;
+
+    memset(p_res, 0, sizeof(*p_res));
+    p_res->p_header = p_ctx->p_header_buf;
+    p_res->header_size = p_ctx->header_size;
+    p_res->p_gd3 = p_ctx->gd3.data;
+    p_res->gd3_size = (uint32_t)p_ctx->gd3.size;
+    p_res->data_size = p_ctx->out_base + (uint32_t)p_vc->buffer.size;
+    p_res->total_samples = p_vc->status.total_samples;
+    p_res->p_source_chip = get_converted_opl_chip_name(&p_ctx->chip_flags);
+    p_res->p_preset = get_opll_preset_type(p_vc->cmd_opts.preset);
+    p_res->p_preset_source = get_opll_preset_source(p_vc->cmd_opts.preset_source);
+    p_res->is_ym2413 = (p_vc->source_fmchip == FMCHIP_YM2413);
+    p_res->voice_count = p_vc->opl3_state.voice_db.count;
+    return 0;
+}
+
+int eseopl3_convert_variants(ESEOPL3Context *const *pp_ctxs, int count, const void *p_input, size_t size,
+                             ESEOPL3Result *p_results) {
+    const uint8_t *p_data = (const uint8_t *)p_input;
+    OPL3Arena arena;
+    OPL3EventStream ir;
+    OPL3EventLowerer low;
+    long data_start = -1;
+    int failed = 0;
+
+    // Every variant parses the header itself (options differ), but borrows the input instead of copying it
+    for (int i = 0; i < count; ++i) {
+        ESEOPL3Context *p_ctx = pp_ctxs[i];
+        memset(&p_results[i], 0, sizeof(p_results[i]));
+        if (p_ctx->is_failed || p_ctx->is_started || p_ctx->input.size) {
+            p_ctx->is_failed = true;        // only fresh contexts can share the pass
+            continue;
+        }
+        p_ctx->input.data = (uint8_t *)p_data;
+        p_ctx->input.size = size;
+        OPL3ProfileStage prev_stage = eseopl3_stage_begin(p_ctx, OPL3_PROFILE_PARSE);
+        int rc = eseopl3_start(p_ctx);
+        eseopl3_stage_end(p_ctx, prev_stage);
+        if (rc != 0) continue;
+        p_ctx->p_ir = &ir;
+        data_start = p_ctx->data_start;     // same input, same layout
+    }
+
+    // Front end once; the back ends follow step by step
+    if (data_start >= 0) {
+        opl3_arena_init(&arena, 0);
+        arena.p_alloc = pp_ctxs[0]->p_alloc;
+        opl3_event_lower_begin(&ir, &low, &arena, data_start);
+        long end = 0;
+        while (end < (long)size) {
+            end = ((long)size - end > ESEOPL3_VARIANT_STEP_BYTES) ? end + ESEOPL3_VARIANT_STEP_BYTES : (long)size;
+            // The shared lowering is charged to the first variant
+            OPL3ProfileStage prev_stage = eseopl3_stage_begin(pp_ctxs[0], OPL3_PROFILE_PARSE);
+            int rc = opl3_event_lower_feed(&ir, &low, p_data, end, end == (long)size);
+            eseopl3_stage_end(pp_ctxs[0], prev_stage);
+            if (rc != 0) {
+                fprintf(stderr, "Failed to allocate event IR.\n");
+                for (int i = 0; i < count; ++i) {
+                    if (pp_ctxs[i]->p_ir == &ir) eseopl3_fail(pp_ctxs[i]);
+                }
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                ESEOPL3Context *p_ctx = pp_ctxs[i];
+                if (p_ctx->p_ir == &ir && !p_ctx->is_failed && !p_ctx->is_deferred) eseopl3_drain(p_ctx);
+            }
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        ESEOPL3Context *p_ctx = pp_ctxs[i];
+        if (p_ctx->is_failed || eseopl3_finalize(p_ctx, &p_results[i]) != 0) {
+            memset(&p_results[i], 0, sizeof(p_results[i]));
+            failed++;
+        }
+        p_ctx->p_ir = &p_ctx->ir;
+        vgm_buffer_init(&p_ctx->input);     // borrowed: only needed up to finalize
+        p_ctx->input.p_alloc = p_ctx->p_alloc;
+    }
+    if (data_start >= 0) opl3_arena_free(&arena);
+    return failed;
+}
+
+int eseopl3_trace_decode(const char *p_path, const char *p_out_path) {
+    FILE *fp = p_out_path ? fopen(p_out_path, "w") : stdout;
+    if (!fp) return -1;
+    int rc = opl3_trace_decode(p_path, fp);
+    if (p_out_path && fclose(fp) != 0) rc = -1;
+    return rc;
+}
+
+int eseopl3_profile(const ESEOPL3Context *p_ctx, ESEOPL3Profile *p_prof) {
+    if (!p_ctx->vgmctx.p_profile || !p_ctx->is_finalized) return -1;
+    const OPL3Profile *p_src = &p_ctx->profile;
+    memset(p_prof, 0, sizeof(*p_prof));
+    for (int i = 0; i < ESEOPL3_NUM_STAGES; ++i) {
+        p_prof->stage_ns[i] = p_src->ns[OPL3_PROFILE_PARSE + i];
+        p_prof->stage_calls[i] = p_src->calls[OPL3_PROFILE_PARSE + i];
+    }
+    p_prof->input_bytes = p_ctx->input_bytes;
+    p_prof->output_bytes = (uint64_t)p_ctx->header_size + p_ctx->out_base + p_ctx->vgmctx.buffer.size + p_ctx->gd3.size;
+    p_prof->commands = p_src->commands;
+    p_prof->total_samples = p_ctx->vgmctx.status.total_samples;
+    p_prof->allocs = p_src->allocs;
+    p_prof->reallocs = p_src->reallocs;
+    p_prof->frees = p_src->frees;
+    p_prof->alloc_bytes = p_src->alloc_bytes;
+    p_prof->peak_bytes = p_src->peak_bytes;
+    return 0;
+}
+
+const char *eseopl3_stage_name(int stage) {
+    static const char *const k_names[ESEOPL3_NUM_STAGES] = {
+        "parse", "convert", "ym2413", "opl3_write", "merge", "gd3", "header"
+    };
+    return (stage >= 0 && stage < ESEOPL3_NUM_STAGES) ? k_names[stage] : "?";
+}
+
+void eseopl3_destroy(ESEOPL3Context *p_ctx) {
+    if (!p_ctx) return;
+    for (int x = 0; x < p_ctx->extra_count; ++x) extra_source_free(&p_ctx->extras[x]);
+    if (p_ctx->is_started) opl3_arena_free(&p_ctx->ir_arena);
+    vgm_checkpoint_close(&p_ctx->ckpt);
+    opl3_voice_db_free(&p_ctx->vgmctx.opl3_state.voice_db);
+    opll_voice_bank_close(p_ctx->vgmctx.opll_state.p_voice_bank);
+    opl3_metrics_close(p_ctx->vgmctx.p_metrics);
+    opl3_trace_close(p_ctx->vgmctx.p_trace);
+    vgm_buffer_free(&p_ctx->vgmctx.buffer);
+    vgm_buffer_free(&p_ctx->input);
+    vgm_buffer_free(&p_ctx->gd3);
+    opl3_mem_free(p_ctx->p_alloc, p_ctx->p_header_buf, p_ctx->header_size);
+    opll_override_free(p_ctx->p_overrides);
+    OPL3Allocator alloc = p_ctx->alloc;
+    opl3_mem_free(alloc.fn ? &alloc : NULL, p_ctx, sizeof(ESEOPL3Context));
+}
+
+struct ESEOPL3Arena {
+    OPL3Arena        arena;
+    ESEOPL3Allocator alloc;
+};
+
+ESEOPL3Arena *eseopl3_arena_create(void) {
+    ESEOPL3Arena *p_arena = (ESEOPL3Arena *)calloc(1, sizeof(ESEOPL3Arena));
+    if (!p_arena) return NULL;
+    opl3_arena_init(&p_arena->arena, ESEOPL3_JOB_ARENA_BLOCK);
+    OPL3Allocator alloc = opl3_arena_allocator(&p_arena->arena);
+    p_arena->alloc.fn = alloc.fn;
+    p_arena->alloc.p_user = alloc.p_user;
+    return p_arena;
+}
+
+const ESEOPL3Allocator *eseopl3_arena_allocator(ESEOPL3Arena *p_arena) {
+    return &p_arena->alloc;
+}
+
+void eseopl3_arena_reset(ESEOPL3Arena *p_arena) {
+    opl3_arena_reset(&p_arena->arena);
+}
+
+size_t eseopl3_arena_reserved(const ESEOPL3Arena *p_arena) {
+    return p_arena->arena.total_bytes;
+}
+
+size_t eseopl3_arena_heap_calls(const ESEOPL3Arena *p_arena) {
+    return p_arena->arena.block_allocs;
+}
+
+void eseopl3_arena_destroy(ESEOPL3Arena *p_arena) {
+    if (!p_arena) return;
+    opl3_arena_free(&p_arena->arena);
+    free(p_arena);
+}
+
+struct ESEOPL3Bridge {
+    OPLLBridge          br;
+    OPL3Ring            ring;
+    OPLLOverrideTable  *p_overrides;
+};
+
+ESEOPL3Bridge *eseopl3_bridge_create(const ESEOPL3Options *p_opts, uint32_t ring_capacity) {
+    ESEOPL3Bridge *p_b = (ESEOPL3Bridge *)calloc(1, sizeof(ESEOPL3Bridge));
+    if (!p_b) return NULL;
+    CommandOptions opts;
+    eseopl3_command_options(p_opts, &opts);
+    if (p_opts->override_path) {
+        p_b->p_overrides = opll_override_load(p_opts->override_path);
+        if (!p_b->p_overrides) {
+            free(p_b);
+            return NULL;
+        }
+        opts.p_overrides = p_b->p_overrides;
+    }
+    if (opl3_ring_init(&p_b->ring, ring_capacity ? ring_capacity : ESEOPL3_BRIDGE_RING) != 0) {
+        opll_override_free(p_b->p_overrides);
+        free(p_b);
+        return NULL;
+    }
+    if (opll_bridge_init(&p_b->br, &opts, 0, &p_b->ring) != 0) {
+        opl3_ring_free(&p_b->ring);
+        opll_override_free(p_b->p_overrides);
+        free(p_b);
+        return NULL;
+    }
+    return p_b;
+}
+
+void eseopl3_bridge_write(ESEOPL3Bridge *p_b, uint32_t sample, uint8_t reg, uint8_t val) {
+    opll_bridge_write(&p_b->br, sample, reg, val);
+}
+
+void eseopl3_bridge_advance(ESEOPL3Bridge *p_b, uint32_t sample) {
+    opll_bridge_advance(&p_b->br, sample);
+}
+
+void eseopl3_bridge_finish(ESEOPL3Bridge *p_b) {
+    opll_bridge_finish(&p_b->br);
+}
+
+size_t eseopl3_bridge_space(const ESEOPL3Bridge *p_b) {
+    return (size_t)p_b->ring.mask + 1 - opl3_ring_count((OPL3Ring *)&p_b->ring);
+}
+
+size_t eseopl3_bridge_pop(ESEOPL3Bridge *p_b, ESEOPL3Write *p_out, size_t max) {
+    size_t n = 0;
+    OPL3RingWrite w;
+    uint64_t now_ns = opl3_now_ns();
+    while (n < max && opll_bridge_pop(&p_b->br, &w, now_ns)) {
+        p_out[n].sample = w.sample;
+        p_out[n].port = w.port;
+        p_out[n].reg = w.reg;
+        p_out[n].val = w.val;
+        n++;
+    }
+    return n;
+}
+
+void eseopl3_bridge_stats(const ESEOPL3Bridge *p_b, ESEOPL3BridgeStats *p_stats) {
+    const OPLLBridgeStats *p_st = &p_b->br.stats;
+    const OPLLBridgeLatency *p_lat = &p_b->br.latency;
+    p_stats->writes = p_st->writes;
+    p_stats->opl3_writes = p_st->opl3_writes;
+    p_stats->overflows = p_st->overflows;
+    p_stats->late = p_st->late;
+    p_stats->popped = p_lat->popped;
+    p_stats->total_ns = p_lat->total_ns;
+    p_stats->max_ns = p_lat->max_ns;
+    memcpy(p_stats->hist, p_lat->hist, sizeof(p_stats->hist));
+}
+
+void eseopl3_bridge_destroy(ESEOPL3Bridge *p_b) {
+    if (!p_b) return;
+    opll_bridge_free(&p_b->br);
+    opl3_ring_free(&p_b->ring);
+    opll_override_free(p_b->p_overrides);
+    free(p_b);
+}
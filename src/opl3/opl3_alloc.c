@@ -0,0 +1,366 @@
+#include "opl3_alloc.h"
+#include <string.h>
+
+/* 4-op capable pairs (first half, second half) as physical channels */
+static const int8_t k_4op_pairs[6][2] = {
+    {0, 3}, {1, 4}, {2, 5}, {9, 12}, {10, 13}, {11, 14}
+};
+
+/* Operator slot offsets (mod, car) of a channel within one port */
+static const uint8_t k_op_slot[9][2] = {
+    {0, 3}, {1, 4}, {2, 5}, {8, 11}, {9, 12}, {10, 13}, {16, 19}, {17, 20}, {18, 21}
+};
+
+static const uint8_t k_op_bases[5] = {0x20, 0x40, 0x60, 0x80, 0xE0};
+
+static int alloc_4op_partner(int phys) {
+    for (int i = 0; i < 6; ++i) {
+        if (k_4op_pairs[i][0] == phys) return k_4op_pairs[i][1];
+        if (k_4op_pairs[i][1] == phys) return k_4op_pairs[i][0];
+    }
+    return -1;
+}
+
+void opl3_alloc_init(OPL3ChannelAllocator *p_alloc) {
+    memset(p_alloc, 0, sizeof(*p_alloc));
+    for (int i = 0; i < OPL3_NUM_CHANNELS; ++i) p_alloc->ch[i].owner = OPL3_ALLOC_NO_OWNER;
+}
+
+/**
+ * Cost of taking one channel: tier 0 free, 1 released, 2 keyed (steal), -1 unusable.
+ * Within a tier a smaller rank is taken first.
+ */
+static int alloc_cost(const OPL3AllocChannel *c, int priority, uint64_t *p_rank) {
+    if (c->is_pinned) return -1;
+    if (c->owner == OPL3_ALLOC_NO_OWNER) { *p_rank = 0; return 0; }
+    if (!c->is_keyed) { *p_rank = c->stamp; return 1; }
+    if (c->priority > priority) return -1;
+    *p_rank = ((uint64_t)(uint32_t)c->priority << 32) | c->stamp;
+    return 2;
+}
+
+/** Drop the current owner of phys (and of its 4-op partner), recording the victim. */
+static void alloc_evict(OPL3ChannelAllocator *p_alloc, int phys, OPL3AllocVictim *p_victims, int *p_victim_count) {
+    OPL3AllocChannel *c = &p_alloc->ch[phys];
+    if (c->owner == OPL3_ALLOC_NO_OWNER) return;
+    int head = phys;
+    if (c->is_4op) {
+        int partner = alloc_4op_partner(phys);
+        if (partner >= 0 && partner < phys) head = partner;   // 4-op KeyOn lives on the first half
+    }
+    OPL3AllocVictim *v = &p_victims[(*p_victim_count)++];
+    v->phys = head;
+    v->owner = c->owner;
+    v->was_keyed = c->is_keyed;
+    if (c->is_keyed) p_alloc->steal_count++;
+    opl3_alloc_release(p_alloc, phys);
+}
+
+static void alloc_take(OPL3ChannelAllocator *p_alloc, int phys, int owner, int priority, bool is_4op) {
+    OPL3AllocChannel *c = &p_alloc->ch[phys];
+    c->owner = owner;
+    c->priority = priority;
+    c->stamp = ++p_alloc->clock;
+    c->is_keyed = 0;
+    c->is_pinned = 0;
+    c->is_4op = is_4op;
+}
+
+int opl3_alloc_voice(OPL3ChannelAllocator *p_alloc, int owner, int priority, bool is_4op, int home,
+                     OPL3AllocVictim *p_victims, int *p_victim_count) {
+    *p_victim_count = 0;
+    int best = -1, best_tier = 3;
+    uint64_t best_rank = 0;
+
+    if (!is_4op) {
+        if (home >= 0 && home < OPL3_NUM_CHANNELS && p_alloc->ch[home].owner == OPL3_ALLOC_NO_OWNER &&
+            !p_alloc->ch[home].is_pinned) {
+            best = home;
+            best_tier = 0;
+        }
+        for (int i = 0; i < OPL3_NUM_CHANNELS && best_tier > 0; ++i) {
+            uint64_t rank;
+            int tier = alloc_cost(&p_alloc->ch[i], priority, &rank);
+            if (tier < 0) continue;
+            if (tier < best_tier || (tier == best_tier && rank < best_rank)) {
+                best = i; best_tier = tier; best_rank = rank;
+            }
+        }
+        if (best < 0) return -1;
+        alloc_evict(p_alloc, best, p_victims, p_victim_count);
+        alloc_take(p_alloc, best, owner, priority, false);
+        return best;
+    }
+
+    // 4-op: both halves must be usable; the pair costs as much as its worse half
+    for (int i = 0; i < 6; ++i) {
+        uint64_t rank0, rank1;
+        int t0 = alloc_cost(&p_alloc->ch[k_4op_pairs[i][0]], priority, &rank0);
+        int t1 = alloc_cost(&p_alloc->ch[k_4op_pairs[i][1]], priority, &rank1);
+        if (t0 < 0 || t1 < 0) continue;
+        int tier = (t0 > t1) ? t0 : t1;
+        uint64_t rank = (rank0 > rank1) ? rank0 : rank1;
+        if (tier < best_tier || (tier == best_tier && rank < best_rank)) {
+            best = i; best_tier = tier; best_rank = rank;
+        }
+    }
+    if (best < 0) return -1;
+    int first = k_4op_pairs[best][0], second = k_4op_pairs[best][1];
+    alloc_evict(p_alloc, first, p_victims, p_victim_count);
+    alloc_evict(p_alloc, second, p_victims, p_victim_count);
+    alloc_take(p_alloc, first, owner, priority, true);
+    alloc_take(p_alloc, second, owner, priority, true);
+    return first;
+}
+
+void opl3_alloc_keyon(OPL3ChannelAllocator *p_alloc, int phys) {
+    p_alloc->ch[phys].is_keyed = 1;
+    p_alloc->ch[phys].stamp = ++p_alloc->clock;
+}
+
+void opl3_alloc_keyoff(OPL3ChannelAllocator *p_alloc, int phys) {
+    p_alloc->ch[phys].is_keyed = 0;
+    p_alloc->ch[phys].stamp = ++p_alloc->clock;
+}
+
+void opl3_alloc_release(OPL3ChannelAllocator *p_alloc, int phys) {
+    OPL3AllocChannel *c = &p_alloc->ch[phys];
+    if (c->is_pinned) return;
+    if (c->is_4op) {
+        int partner = alloc_4op_partner(phys);
+        if (partner >= 0) {
+            memset(&p_alloc->ch[partner], 0, sizeof(OPL3AllocChannel));
+            p_alloc->ch[partner].owner = OPL3_ALLOC_NO_OWNER;
+        }
+    }
+    memset(c, 0, sizeof(*c));
+    c->owner = OPL3_ALLOC_NO_OWNER;
+}
+
+void opl3_alloc_pin(OPL3ChannelAllocator *p_alloc, int phys, int owner, int priority) {
+    alloc_take(p_alloc, phys, owner, priority, false);
+    p_alloc->ch[phys].is_pinned = 1;
+}
+
+uint8_t opl3_alloc_4op_mask(const OPL3ChannelAllocator *p_alloc) {
+    uint8_t mask = 0;
+    for (int i = 0; i < 6; ++i) {
+        const OPL3AllocChannel *c = &p_alloc->ch[k_4op_pairs[i][0]];
+        if (c->owner != OPL3_ALLOC_NO_OWNER && c->is_4op) mask |= (uint8_t)(1u << i);
+    }
+    return mask;
+}
+
+/* ---- Mixer ---- */
+
+void opl3_mixer_init(OPL3Mixer *p_mix, int source_count, const int *p_priority,
+                     uint8_t cmd_style, bool is_msx_audio) {
+    memset(p_mix, 0, sizeof(*p_mix));
+    opl3_alloc_init(&p_mix->alloc);
+    if (source_count > OPL3_MIX_MAX_SOURCES) source_count = OPL3_MIX_MAX_SOURCES;
+    p_mix->source_count = source_count;
+    for (int s = 0; s < source_count; ++s) {
+        memset(p_mix->src[s].map, -1, sizeof(p_mix->src[s].map));
+        p_mix->src[s].priority = p_priority ? p_priority[s] : 0;
+    }
+    p_mix->rhythm_owner = -1;
+    p_mix->cmd_style = cmd_style;
+    p_mix->is_msx_audio = is_msx_audio;
+}
+
+static int mixer_emit(OPL3Mixer *p_mix, int port, uint8_t reg, uint8_t val, VGMBuffer *p_out) {
+    int bytes = 0;
+    opl3_reg_set(&p_mix->phys, (port << 8) | reg, val);
+    if (p_mix->cmd_style == 0xD0) {
+        uint8_t cmd[4] = {0xD0, (uint8_t)port, reg, val};
+        vgm_buffer_append(p_out, cmd, 4);
+        bytes += 4;
+    } else {
+        uint8_t cmd[3] = {(uint8_t)(p_mix->cmd_style + port), reg, val};
+        vgm_buffer_append(p_out, cmd, 3);
+        bytes += 3;
+    }
+    if (p_mix->is_msx_audio && port == 0 && reg != 0x05) {
+        uint8_t cmd[3] = {0x5C, reg, val};
+        vgm_buffer_append(p_out, cmd, 3);
+        bytes += 3;
+    }
+    return bytes;
+}
+
+/** Key off a physical channel that is being taken away from its voice. */
+static int mixer_cut(OPL3Mixer *p_mix, int phys, VGMBuffer *p_out) {
+    int port = phys / 9, ch = phys % 9;
+    uint8_t b0 = opl3_reg_get(&p_mix->phys, (port << 8) | (0xB0 + ch));
+    if (!(b0 & 0x20)) return 0;
+    return mixer_emit(p_mix, port, (uint8_t)(0xB0 + ch), (uint8_t)(b0 & ~0x20), p_out);
+}
+
+/** Copy a virtual channel's voice (operators, A0, C0; B0 too if with_b0) onto a physical channel. */
+static int mixer_replay(OPL3Mixer *p_mix, const OPL3State *p_src_state, int vch, int phys, bool with_b0, VGMBuffer *p_out) {
+    int vport = vch / 9, vc = vch % 9;
+    int pport = phys / 9, pc = phys % 9;
+    int bytes = 0;
+    for (int op = 0; op < 2; ++op) {
+        for (int i = 0; i < 5; ++i) {
+            uint8_t val = opl3_reg_get(p_src_state, (vport << 8) | (k_op_bases[i] + k_op_slot[vc][op]));
+            bytes += mixer_emit(p_mix, pport, (uint8_t)(k_op_bases[i] + k_op_slot[pc][op]), val, p_out);
+        }
+    }
+    bytes += mixer_emit(p_mix, pport, (uint8_t)(0xA0 + pc), opl3_reg_get(p_src_state, (vport << 8) | (0xA0 + vc)), p_out);
+    bytes += mixer_emit(p_mix, pport, (uint8_t)(0xC0 + pc), opl3_reg_get(p_src_state, (vport << 8) | (0xC0 + vc)), p_out);
+    if (with_b0) {
+        bytes += mixer_emit(p_mix, pport, (uint8_t)(0xB0 + pc), opl3_reg_get(p_src_state, (vport << 8) | (0xB0 + vc)), p_out);
+    }
+    return bytes;
+}
+
+/** Unmap the voices reported by the allocator and silence the ones still sounding. */
+static int mixer_drop_victims(OPL3Mixer *p_mix, const OPL3AllocVictim *p_victims, int count, VGMBuffer *p_out) {
+    int bytes = 0;
+    for (int i = 0; i < count; ++i) {
+        int vs = p_victims[i].owner / OPL3_NUM_CHANNELS;
+        int vv = p_victims[i].owner % OPL3_NUM_CHANNELS;
+        if (vs < p_mix->source_count) {
+            p_mix->src[vs].map[vv] = -1;
+            if (p_victims[i].was_keyed) p_mix->src[vs].stolen_notes++;
+        }
+        if (p_victims[i].was_keyed) bytes += mixer_cut(p_mix, p_victims[i].phys, p_out);
+    }
+    return bytes;
+}
+
+/** The first source to enable rhythm mode gets physical ch 6-8 of port0 for its ch 6-8 until it turns it off. */
+static int mixer_take_rhythm(OPL3Mixer *p_mix, int source, VGMBuffer *p_out) {
+    OPL3MixSource *p_src = &p_mix->src[source];
+    int bytes = 0;
+    p_mix->rhythm_owner = source;
+    for (int i = 6; i <= 8; ++i) {
+        int owner = OPL3_ALLOC_OWNER(source, i);
+        // Move out of the way: whatever sits on the rhythm channel, and this voice's old channel
+        if (p_src->map[i] >= 0 && p_src->map[i] != i) {
+            bytes += mixer_cut(p_mix, p_src->map[i], p_out);
+            opl3_alloc_release(&p_mix->alloc, p_src->map[i]);
+            p_src->map[i] = -1;
+        }
+        if (p_mix->alloc.ch[i].owner != OPL3_ALLOC_NO_OWNER && p_mix->alloc.ch[i].owner != owner) {
+            OPL3AllocVictim victim;
+            int count = 0;
+            alloc_evict(&p_mix->alloc, i, &victim, &count);
+            bytes += mixer_drop_victims(p_mix, &victim, count, p_out);
+        }
+        opl3_alloc_pin(&p_mix->alloc, i, owner, p_src->priority);
+        p_src->map[i] = (int8_t)i;
+        bytes += mixer_replay(p_mix, &p_src->state, i, i, true, p_out);
+    }
+    return bytes;
+}
+
+/** Rhythm mode turned off by its owner: ch 6-8 go back to the pool (still mapped to the owner). */
+static void mixer_release_rhythm(OPL3Mixer *p_mix) {
+    const OPL3MixSource *p_src = &p_mix->src[p_mix->rhythm_owner];
+    for (int i = 6; i <= 8; ++i) {
+        OPL3AllocChannel *c = &p_mix->alloc.ch[i];
+        c->is_pinned = 0;
+        c->is_keyed = (opl3_reg_get(&p_src->state, 0xB0 + i) & 0x20) ? 1 : 0;
+        c->stamp = ++p_mix->alloc.clock;
+    }
+    p_mix->rhythm_owner = -1;
+}
+
+int opl3_mixer_write(OPL3Mixer *p_mix, int source, int port, uint8_t reg, uint8_t val, VGMBuffer *p_out) {
+    if (source < 0 || source >= p_mix->source_count) return 0;
+    OPL3MixSource *p_src = &p_mix->src[source];
+    int bytes = 0;
+    port &= 1;
+
+    opl3_reg_set(&p_src->state, (port << 8) | reg, val);
+
+    if (!p_mix->is_started) {
+        // Port1 channels are part of the pool: OPL3 mode is always on
+        p_mix->is_started = true;
+        bytes += mixer_emit(p_mix, 1, 0x05, 0x01, p_out);
+        bytes += mixer_emit(p_mix, 1, 0x04, 0x00, p_out);
+    }
+
+    // Chip-global registers: the first source drives them, port1 04h/05h belong to the mixer
+    if (reg < 0x20) {
+        if (port == 0 && source == 0) bytes += mixer_emit(p_mix, 0, reg, val, p_out);
+        return bytes;
+    }
+
+    if (reg == 0xBD) {
+        if (port != 0) return bytes;
+        if ((val & 0x20) && p_mix->rhythm_owner < 0) bytes += mixer_take_rhythm(p_mix, source, p_out);
+        if (source == p_mix->rhythm_owner || (p_mix->rhythm_owner < 0 && source == 0)) {
+            bytes += mixer_emit(p_mix, 0, 0xBD, val, p_out);
+            if (!(val & 0x20) && source == p_mix->rhythm_owner) mixer_release_rhythm(p_mix);
+        } else if (val & 0x20) {
+            p_mix->rhythm_conflicts++;
+        }
+        return bytes;
+    }
+
+    // Channel registers: locate the virtual channel (and operator) written
+    int ch, op = -1;
+    if ((reg >= 0x20 && reg <= 0x95) || reg >= 0xE0) {
+        int slot = reg & 0x1F;
+        if (slot > 0x15 || (slot & 7) >= 6) return bytes;
+        ch = (slot >> 3) * 3 + (slot & 7) % 3;
+        op = (slot & 7) / 3;
+    } else if ((reg >= 0xA0 && reg <= 0xA8) || (reg >= 0xB0 && reg <= 0xB8) || (reg >= 0xC0 && reg <= 0xC8)) {
+        ch = reg & 0x0F;
+    } else {
+        return bytes;
+    }
+    int vch = port * 9 + ch;
+    int phys = p_src->map[vch];
+
+    if (reg >= 0xB0 && reg <= 0xB8) {
+        bool was_on = (p_src->state.b0_stamp[port][ch] & 0x20) != 0;
+        bool is_on = (val & 0x20) != 0;
+        if (is_on && !was_on) {
+            p_src->note_count++;
+            if (phys < 0) {
+                OPL3AllocVictim victims[2];
+                int victim_count = 0;
+                int home = (source * 9 + vch) % OPL3_NUM_CHANNELS;
+                phys = opl3_alloc_voice(&p_mix->alloc, OPL3_ALLOC_OWNER(source, vch), p_src->priority,
+                                        false, home, victims, &victim_count);
+                if (phys < 0) {
+                    p_src->dropped_notes++;
+                    return bytes;
+                }
+                bytes += mixer_drop_victims(p_mix, victims, victim_count, p_out);
+                p_src->map[vch] = (int8_t)phys;
+                bytes += mixer_replay(p_mix, &p_src->state, vch, phys, false, p_out);
+            }
+            opl3_alloc_keyon(&p_mix->alloc, phys);
+        } else if (!is_on && was_on && phys >= 0) {
+            // Keep the mapping: the next note of this channel reuses it unless it gets stolen
+            opl3_alloc_keyoff(&p_mix->alloc, phys);
+        }
+    }
+    if (phys < 0) return bytes;   // not sounding anywhere: the mirror is enough
+
+    int pport = phys / 9, pc = phys % 9;
+    uint8_t preg;
+    if (op >= 0) preg = (uint8_t)((reg & 0xE0) + k_op_slot[pc][op]);
+    else         preg = (uint8_t)((reg & 0xF0) + pc);
+    bytes += mixer_emit(p_mix, pport, preg, val, p_out);
+    return bytes;
+}
+
+void opl3_mixer_sink(void *p_user, int source, const uint8_t *p_cmd, uint32_t len, VGMBuffer *p_out) {
+    OPL3Mixer *p_mix = (OPL3Mixer *)p_user;
+    uint8_t cmd = p_cmd[0];
+    if ((cmd == 0x5E || cmd == 0x5F) && len == 3) {
+        opl3_mixer_write(p_mix, source, cmd - 0x5E, p_cmd[1], p_cmd[2], p_out);
+    } else if (cmd == 0xD0 && len == 4 && p_cmd[1] <= 1) {
+        opl3_mixer_write(p_mix, source, p_cmd[1], p_cmd[2], p_cmd[3], p_out);
+    } else if (cmd == 0x5C && len == 3 && p_mix->is_msx_audio) {
+        // Y8950 mirror of the source's own channels: regenerated from the physical writes
+    } else {
+        vgm_buffer_append(p_out, p_cmd, len);
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef OPL3_ALLOC_H
+#define OPL3_ALLOC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "opl3_state.h"
+#include "../vgm/vgm_helpers.h" // For VGMBuffer
+
+/*
+ * OPL3 channel allocator / multi-source mixer.
+ *
+ * 複数のソースチップ (YM2413, YM3812, Y8950, 2個目の YM2413 ...) をそれぞれ
+ * 単独で変換した OPL3 ストリームを、1個の YMF262 の 18ch に載せ替える。
+ * 各ソースの書き込みはまず仮想チャンネル (ソースが書いたつもりの ch) の
+ * OPL3State ミラーに入り、KeyOn の立ち上がりで物理チャンネルを割り当てて
+ * オペレータ/周波数/C0 をミラーから再生する。足りないときは優先度の低い
+ * (同じなら古い) 発音中のチャンネルを奪う。
+ */
+
+#define OPL3_ALLOC_NO_OWNER   (-1)
+#define OPL3_MIX_MAX_SOURCES  8
+
+/** Owner id of virtual channel vch (0..17) of a source */
+#define OPL3_ALLOC_OWNER(source, vch) ((source) * OPL3_NUM_CHANNELS + (vch))
+
+typedef struct {
+    int      owner;       // OPL3_ALLOC_OWNER() or OPL3_ALLOC_NO_OWNER
+    int      priority;    // owner's priority (higher wins)
+    uint32_t stamp;       // last KeyOn / KeyOff order (older = better steal candidate)
+    uint8_t  is_keyed;
+    uint8_t  is_pinned;   // rhythm channels: never reassigned
+    uint8_t  is_4op;      // half of a 4-op pair (both halves carry the owner)
+} OPL3AllocChannel;
+
+/** A voice evicted by opl3_alloc_voice(); phys is the channel to key off when was_keyed. */
+typedef struct {
+    int  phys;
+    int  owner;
+    bool was_keyed;
+} OPL3AllocVictim;
+
+typedef struct {
+    OPL3AllocChannel ch[OPL3_NUM_CHANNELS];   // physical channel = port * 9 + ch
+    uint32_t clock;
+    uint32_t steal_count;
+} OPL3ChannelAllocator;
+
+void opl3_alloc_init(OPL3ChannelAllocator *p_alloc);
+
+/**
+ * Pick a physical channel (or the first half of a 4-op pair) for owner.
+ * Order: home channel if free, any free channel, the oldest released channel,
+ * then the keyed channel with the lowest priority (oldest first) whose priority
+ * does not exceed `priority`. home < 0 = no preference.
+ * Evicted voices are reported in p_victims[0..*p_victim_count-1] (at most 2).
+ * Returns the physical channel, or -1 when everything is pinned or outranks the request.
+ */
+int  opl3_alloc_voice(OPL3ChannelAllocator *p_alloc, int owner, int priority, bool is_4op, int home,
+                      OPL3AllocVictim *p_victims, int *p_victim_count);
+
+void opl3_alloc_keyon(OPL3ChannelAllocator *p_alloc, int phys);
+void opl3_alloc_keyoff(OPL3ChannelAllocator *p_alloc, int phys);
+
+/** Free phys (and its 4-op partner); no-op for pinned channels. */
+void opl3_alloc_release(OPL3ChannelAllocator *p_alloc, int phys);
+
+/** Bind phys to owner permanently (rhythm section). */
+void opl3_alloc_pin(OPL3ChannelAllocator *p_alloc, int phys, int owner, int priority);
+
+/** Connection-select bits (port1 reg 04h) for the pairs currently allocated as 4-op. */
+uint8_t opl3_alloc_4op_mask(const OPL3ChannelAllocator *p_alloc);
+
+/* ---- Mixer ---- */
+
+typedef struct {
+    OPL3State state;                      // register image as written by the source (virtual channels)
+    int8_t    map[OPL3_NUM_CHANNELS];     // virtual -> physical channel (-1 = not placed)
+    int       priority;
+    uint32_t  note_count;
+    uint32_t  dropped_notes;              // KeyOn that found no channel
+    uint32_t  stolen_notes;               // own notes cut by a higher-priority source
+} OPL3MixSource;
+
+typedef struct {
+    OPL3ChannelAllocator alloc;
+    OPL3State     phys;                   // register image of the output YMF262
+    OPL3MixSource src[OPL3_MIX_MAX_SOURCES];
+    int           source_count;
+    int           rhythm_owner;           // source owning physical ch 6-8 while its rhythm mode is on (-1 = none)
+    uint32_t      rhythm_conflicts;       // rhythm writes dropped from other sources
+    uint8_t       cmd_style;              // 0x5E (YMF262) or 0xD0 (YMF278B)
+    bool          is_msx_audio;           // mirror port0 writes to Y8950 (0x5C)
+    bool          is_started;             // OPL3 mode enabled in the output
+} OPL3Mixer;
+
+/**
+ * Initialize for source_count sources. p_priority[i] is source i's priority (higher wins);
+ * cmd_style selects the output command form (0x5E or 0xD0).
+ */
+void opl3_mixer_init(OPL3Mixer *p_mix, int source_count, const int *p_priority,
+                     uint8_t cmd_style, bool is_msx_audio);
+
+/** Route one register write of a source (port 0/1) to the output. Returns bytes written. */
+int  opl3_mixer_write(OPL3Mixer *p_mix, int source, int port, uint8_t reg, uint8_t val, VGMBuffer *p_out);
+
+/**
+ * VGMMergeSink adapter: OPL3 writes (0x5E/0x5F, 0xD0 port 0/1) go through the mixer,
+ * Y8950 mirrors (0x5C) are regenerated by the mixer, everything else is copied.
+ */
+void opl3_mixer_sink(void *p_user, int source, const uint8_t *p_cmd, uint32_t len, VGMBuffer *p_out);
+
+#endif /* OPL3_ALLOC_H */
@@ -0,0 +1,121 @@
+#include "opl3_arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_HDR   ((sizeof(OPL3ArenaBlock) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+static inline size_t arena_round_up(size_t n) {
+    return (n + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static inline uint8_t *arena_payload(OPL3ArenaBlock *p_blk) {
+    return (uint8_t *)p_blk + ARENA_HDR;
+}
+
+static OPL3ArenaBlock *arena_block_new(OPL3Arena *p_arena, size_t payload) {
+    OPL3ArenaBlock *p_blk = (OPL3ArenaBlock *)opl3_mem_alloc(p_arena->p_alloc, ARENA_HDR + payload);
+    if (!p_blk) return NULL;
+    p_blk->used = 0;
+    p_blk->size = payload;
+    p_arena->total_bytes += payload;
+    p_arena->block_allocs++;
+    return p_blk;
+}
+
+void opl3_arena_init(OPL3Arena *p_arena, size_t block_size) {
+    p_arena->p_head = NULL;
+    p_arena->block_size = block_size ? block_size : OPL3_ARENA_DEFAULT_BLOCK;
+    p_arena->total_bytes = 0;
+    p_arena->block_allocs = 0;
+    p_arena->p_alloc = NULL;
+}
+
+/** Bump size (already rounded) bytes off the current block, or start a new one. */
+static void *arena_bump(OPL3Arena *p_arena, size_t size) {
+    OPL3ArenaBlock *p_blk = p_arena->p_head;
+
+    if (!p_blk || p_blk->size - p_blk->used < size) {
+        if (size > p_arena->block_size && p_blk) {
+            // Oversized requests get a dedicated block behind the current one,
+            // which keeps serving (and growing in place) the small allocations
+            OPL3ArenaBlock *p_big = arena_block_new(p_arena, size);
+            if (!p_big) return NULL;
+            p_big->used = size;
+            p_big->p_next = p_blk->p_next;
+            p_blk->p_next = p_big;
+            return arena_payload(p_big);
+        }
+        size_t payload = (size > p_arena->block_size) ? size : p_arena->block_size;
+        p_blk = arena_block_new(p_arena, payload);
+        if (!p_blk) return NULL;
+        p_blk->p_next = p_arena->p_head;
+        p_arena->p_head = p_blk;
+    }
+
+    void *p = arena_payload(p_blk) + p_blk->used;
+    p_blk->used += size;
+    return p;
+}
+
+void *opl3_arena_alloc(OPL3Arena *p_arena, size_t size) {
+    size = arena_round_up(size ? size : 1);
+    void *p = arena_bump(p_arena, size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+void *opl3_arena_realloc(OPL3Arena *p_arena, void *p_ptr, size_t old_size, size_t new_size) {
+    OPL3ArenaBlock *p_blk = p_arena->p_head;
+    size_t old_r = arena_round_up(old_size);
+    bool is_last = p_ptr && p_blk && (uint8_t *)p_ptr + old_r == arena_payload(p_blk) + p_blk->used;
+
+    if (new_size == 0) {
+        if (is_last) p_blk->used -= old_r;     // rewind; anything older waits for reset/free
+        return NULL;
+    }
+    size_t new_r = arena_round_up(new_size);
+    if (is_last && p_blk->used - old_r + new_r <= p_blk->size) {
+        p_blk->used = p_blk->used - old_r + new_r;
+        return p_ptr;
+    }
+    void *p_new = arena_bump(p_arena, new_r);
+    if (p_new && p_ptr) memcpy(p_new, p_ptr, old_size < new_size ? old_size : new_size);
+    return p_new;
+}
+
+static void *arena_alloc_fn(void *p_user, void *p_ptr, size_t old_size, size_t new_size) {
+    return opl3_arena_realloc((OPL3Arena *)p_user, p_ptr, old_size, new_size);
+}
+
+OPL3Allocator opl3_arena_allocator(OPL3Arena *p_arena) {
+    OPL3Allocator alloc = {arena_alloc_fn, p_arena};
+    return alloc;
+}
+
+void opl3_arena_reset(OPL3Arena *p_arena) {
+    OPL3ArenaBlock *p_blk = p_arena->p_head;
+    if (p_blk && p_blk->p_next) {
+        // The last job needed all of it: next time it fits in one block
+        size_t total = p_arena->total_bytes;
+        opl3_arena_free(p_arena);
+        p_blk = arena_block_new(p_arena, total);
+        if (!p_blk) return;
+        p_blk->p_next = NULL;
+        p_arena->p_head = p_blk;
+    }
+    if (p_blk) p_blk->used = 0;
+}
+
+void opl3_arena_free(OPL3Arena *p_arena) {
+    OPL3ArenaBlock *p_blk = p_arena->p_head;
+    while (p_blk) {
+        OPL3ArenaBlock *p_next = p_blk->p_next;
+        opl3_mem_free(p_arena->p_alloc, p_blk, ARENA_HDR + p_blk->size);
+        p_blk = p_next;
+    }
+    p_arena->p_head = NULL;
+    p_arena->total_bytes = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef OPL3_ARENA_H
+#define OPL3_ARENA_H
+
+#include <stddef.h>
+#include "opl3_mem.h"
+
+/*
+ * Simple bump arena.
+ * 変換1回分の寿命を持つデータ (イベント IR など) をまとめて確保し、
+ * opl3_arena_free() で一括解放する。個別 free はできない。
+ *
+ * opl3_arena_allocator() で OPL3Allocator としても使える (ジョブ単位アロケータ)。
+ * realloc は末尾の確保なら同じ場所で伸縮し、それ以外は新しく取ってコピーする。
+ * opl3_arena_reset() はブロックを 1 つにまとめて残すので、同じ程度のジョブを
+ * 繰り返すと 2 回目以降はヒープを呼ばない。
+ */
+typedef struct OPL3ArenaBlock {
+    struct OPL3ArenaBlock *p_next;
+    size_t used;
+    size_t size;
+    /* payload follows */
+} OPL3ArenaBlock;
+
+typedef struct OPL3Arena {
+    OPL3ArenaBlock *p_head;     /* current block (newest first) */
+    size_t block_size;          /* default payload size of new blocks */
+    size_t total_bytes;         /* payload bytes reserved across all blocks */
+    size_t block_allocs;        /* blocks taken from p_alloc since init (heap calls) */
+    const OPL3Allocator *p_alloc;   /* where blocks come from (NULL = malloc) */
+} OPL3Arena;
+
+#define OPL3_ARENA_DEFAULT_BLOCK (64 * 1024)
+
+/** Initialize an empty arena (block_size 0 = OPL3_ARENA_DEFAULT_BLOCK). Blocks come from malloc. */
+void  opl3_arena_init(OPL3Arena *p_arena, size_t block_size);
+
+/** Allocate size bytes aligned to 16; memory is zero-filled. Returns NULL on OOM. */
+void *opl3_arena_alloc(OPL3Arena *p_arena, size_t size);
+
+/**
+ * Resize an allocation of old_size bytes (p_ptr NULL = allocate, new_size 0 = release).
+ * The newest allocation grows and shrinks in place; anything else is copied. Not zero-filled.
+ */
+void *opl3_arena_realloc(OPL3Arena *p_arena, void *p_ptr, size_t old_size, size_t new_size);
+
+/** OPL3Allocator backed by p_arena (not thread-safe: one job at a time). */
+OPL3Allocator opl3_arena_allocator(OPL3Arena *p_arena);
+
+/** Forget every allocation but keep the memory, coalesced into one block for the next job. */
+void  opl3_arena_reset(OPL3Arena *p_arena);
+
+/** Release every block. The arena can be reused afterwards. */
+void  opl3_arena_free(OPL3Arena *p_arena);
+
+#endif /* OPL3_ARENA_H */
@@ -0,0 +1,24 @@
+#ifndef OPL3_CLOCK_H
+#define OPL3_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Monotonic clock shared by --profile, the bridge latency counters and the CLI
+ * timings (batch / queue / serve / --profile). 壁時計ではないので差分にだけ使う。
+ */
+
+/** CLOCK_MONOTONIC in nanoseconds. */
+static inline uint64_t opl3_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/** opl3_now_ns() in seconds. */
+static inline double opl3_now_sec(void) {
+    return (double)opl3_now_ns() / 1e9;
+}
+
+#endif /* OPL3_CLOCK_H */
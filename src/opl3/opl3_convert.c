@@ -1,6 +1,9 @@
 #include "opl3_convert.h"
 #include "opl3_voice.h"
+#include "opl3_profile.h"
+#include "opl3_trace.h"
 #include "../opll/opll_state.h"
+#include "../opll/opll_override.h"
 #include "../vgm/vgm_helpers.h"
 #include "../vgm/vgm_header.h"       /* OPL3_CLOCK */
 #include <math.h>
@@ -8,22 +11,38 @@
 #include <stdio.h>
 #include <float.h>
 #include <stdlib.h>  // getenv
-#include <stdarg.h>
-
-
-typedef enum {
-    FREQSEQ_BAB = 0, // B(OFF) -> A -> B(POST)
-    FREQSEQ_AB  = 1  // A -> B(POST), for hardware experiment use
-} FreqSeqMode;
-
-static FreqSeqMode g_freqseq_mode = FREQSEQ_AB;
-static int g_micro_wait_ab   = 0;  // Interval between B(pre)->A and A->B(post)
-static void opl3_debug_log(const CommandOptions *opts, const char *fmt, ...) {
-    if (!opts || !opts->debug.verbose) return;
-    va_list args;
-    va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
-    va_end(args);
+
+
+/** [OPL3] operator write (trace record and -verbose text). */
+static inline void opl3_trace_op_write(VGMContext *p_vpmctx, const CommandOptions *p_opts, OPL3TraceWriteBlock block,
+                                       uint8_t reg, uint8_t val, int ch) {
+    if (!OPL3_TRACE_WANTED(p_vpmctx->p_trace, p_opts->debug.verbose)) return;
+    OPL3TraceRecord rec = {0};
+    rec.time = (uint32_t)p_vpmctx->timestamp.current_sample;
+    rec.emit = (uint32_t)p_vpmctx->opll_state.sch.emit_time;
+    rec.code = OPL3_TRACE_OPL3_WRITE;
+    rec.ch = (uint8_t)ch;
+    rec.reg = reg;
+    rec.val = val;
+    rec.x = (uint8_t)block;
+    opl3_trace_emit(p_vpmctx->p_trace, p_opts->debug.verbose, &rec);
+}
+
+/** [SEQ0] / [SEQ1]: the A/B order chosen for an FNUM/KEY update. */
+static inline void opl3_trace_seq(VGMContext *p_vpmctx, const CommandOptions *p_opts, int port, OPL3TraceSeqKind kind,
+                                  int ch, uint8_t a, uint8_t b, bool is_keyed) {
+    if (!OPL3_TRACE_WANTED(p_vpmctx->p_trace, p_opts->debug.verbose)) return;
+    OPL3TraceRecord rec = {0};
+    rec.time = (uint32_t)p_vpmctx->timestamp.current_sample;
+    rec.emit = (uint32_t)p_vpmctx->opll_state.sch.emit_time;
+    rec.code = OPL3_TRACE_SEQ;
+    rec.ch = (uint8_t)ch;
+    rec.reg = a;
+    rec.val = b;
+    rec.x = (uint8_t)kind;
+    rec.y = (port ? OPL3_TRACE_SEQ_PORT1 : 0) | (p_vpmctx->opl3_state.rhythm_mode ? OPL3_TRACE_SEQ_RHYTHM : 0) |
+            (is_keyed ? OPL3_TRACE_SEQ_KEYED : 0);
+    opl3_trace_emit(p_vpmctx->p_trace, p_opts->debug.verbose, &rec);
 }
 
 struct OPL3State;
@@ -36,7 +55,7 @@ static inline int reg_to_ch(uint8_t r){ return r & 0x0F; }
 
 /** Stage the F-Number LSB for a given channel */
 static inline void stage_fnum_lsb(OPL3State *st, int ch9){
-    st->staged_fnum_lsb[ch9] = st->reg[0xA0 + ch9];
+    st->staged_fnum_lsb[ch9] = opl3_reg_get(st, 0xA0 + ch9);
     st->staged_fnum_valid[ch9] = true;
 }
 
@@ -265,8 +284,7 @@ static uint8_t apply_tl_with_ratio(uint8_t orig_val, double v_ratio) {
 int opl3_write_reg(VGMContext *p_vpmctx, int port, uint8_t reg, uint8_t value) {
     int reg_addr = reg + (port ? 0x100 : 0x000);
     int add_bytes = 0;
-    p_vpmctx->opl3_state.reg_stamp[reg_addr] = p_vpmctx->opl3_state.reg[reg_addr];
-    p_vpmctx->opl3_state.reg[reg_addr] = value;
+    opl3_reg_set(&p_vpmctx->opl3_state, reg_addr, value);
     // Write to VGM stream
     add_bytes = write_reg(p_vpmctx, port, reg, value);
     return add_bytes;
@@ -397,11 +415,7 @@ int opl3_write_block_fnum_key (
     return bytes_written;
 }
 
-/**
- * Main OPL3/OPL2 register write handler (supports OPL3 chorus and register mirroring).
- * Returns the number of additional bytes written (beyond the initial 3-byte write).
- */
-int duplicate_write_opl3(
+static int opl3_write_duplicated(
     VGMContext *p_vpmctx,
     uint8_t reg, uint8_t val, const CommandOptions *p_opts
     // double detune, int opl3_keyon_wait, int ch_panning, double v_ratio0, double v_ratio1
@@ -420,8 +434,7 @@ int duplicate_write_opl3(
 
         // Update port 1 reg
         int port_1_reg_addr = reg + 0x100;
-        p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-        p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+        opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
     } else if (reg >= 0x40 && reg <= 0x55) {
         int ch = reg - 0x40;
 
@@ -435,9 +448,8 @@ int duplicate_write_opl3(
             
             // Update port 1 reg
             int port_1_reg_addr = reg + 0x100;
-            p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-            p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
-            opl3_debug_log(p_opts, "[OPL3] Write reg=%02X val=%02X ch=%d (port0/port1)\n", reg, val, ch);
+            opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
+            opl3_trace_op_write(p_vpmctx, p_opts, OPL3_TRACE_BLOCK_40, reg, val, ch);
         }
     } else if (reg >= 0x60 && reg <= 0x75) {
         int ch = reg - 0x60;
@@ -450,10 +462,9 @@ int duplicate_write_opl3(
 
             // Update port 1 reg
             int port_1_reg_addr = reg + 0x100;
-            p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-            p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+            opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
         }
-        opl3_debug_log(p_opts, "[OPL3] Write reg=%02X val=%02X ch=%d (60h block)\n", reg, val, ch);
+        opl3_trace_op_write(p_vpmctx, p_opts, OPL3_TRACE_BLOCK_60, reg, val, ch);
     } else if (reg >= 0x80 && reg <= 0x95) {
         int ch = reg - 0x80;
 
@@ -465,17 +476,16 @@ int duplicate_write_opl3(
 
             // Update port 1 reg
             int port_1_reg_addr = reg + 0x100;
-            p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-            p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+            opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
         }
-        opl3_debug_log(p_opts, "[OPL3] Write reg=%02X val=%02X ch=%d (80h block)\n", reg, val, ch);
+        opl3_trace_op_write(p_vpmctx, p_opts, OPL3_TRACE_BLOCK_80, reg, val, ch);
     } else if (reg >= 0xA0 && reg <= 0xA8) {
         // Only write port0 for A0..A8
         int ch = reg - 0xA0;
 
         if(p_opts->is_a0_b0_aligned) {
             // KeyOn判定
-            uint8_t keyon = (p_vpmctx->opl3_state.reg[0xB0 + ch]) & 0x20;
+            uint8_t keyon = opl3_reg_get(&p_vpmctx->opl3_state, 0xB0 + ch) & 0x20;
             if (keyon) {
                 addtional_bytes += write_reg(p_vpmctx, 0, 0xA0 + ch, val);
                 if (p_opts->is_port1_enabled) {
@@ -484,14 +494,11 @@ int duplicate_write_opl3(
 
                 // Update port 1 reg
                 int port_1_reg_addr = reg + 0x100;
-                p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-                p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
-                opl3_debug_log(p_opts, "[SEQ0] ch=%d %s A=%02X (rhythm=%d) port0: A(%02X)\n",
-                    ch, (keyon) ? "KeyOn" : "KeyOff", val, p_vpmctx->opl3_state.rhythm_mode, val);
+                opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
+                opl3_trace_seq(p_vpmctx, p_opts, 0, OPL3_TRACE_SEQ_A_ONLY, ch, val, 0, keyon != 0);
             } else {
                 // Only update the register buffer (No dump to vgm)
-                p_vpmctx->opl3_state.reg_stamp[reg] = p_vpmctx->opl3_state.reg[reg];
-                p_vpmctx->opl3_state.reg[reg] = val;
+                opl3_reg_set(&p_vpmctx->opl3_state, reg, val);
             }
         } else {
             addtional_bytes += write_reg(p_vpmctx, 0, 0xA0 + ch, val);
@@ -503,45 +510,41 @@ int duplicate_write_opl3(
         // Write B0 (KeyOn/Block/FnumMSB) and handle detune
         // write_reg(ctx->p_music_data, 0, 0xB0 + ch, ctx->val);
         int ch = reg - 0xB0;
-        uint8_t A_lsb = p_vpmctx->opl3_state.reg[0xA0 + ch];
+        uint8_t A_lsb = opl3_reg_get(&p_vpmctx->opl3_state, 0xA0 + ch);
 
         // KeyOn判定
-        uint8_t prev_val = p_vpmctx->opl3_state.reg_stamp[reg];
+        uint8_t prev_val = p_vpmctx->opl3_state.b0_stamp[0][ch];
         uint8_t keyon_prev = prev_val & 0x20;
         uint8_t keyon_new  = val & 0x20;
 
         if (!keyon_prev && keyon_new) {
             if(p_opts->is_a0_b0_aligned) {
                 // KeyOff -> KeyOn（posedge）：A>B
-                opl3_debug_log(p_opts, "[SEQ0] ch=%d KeyOff -> KeyOn A=%02X B=%02X (rhythm=%d) port0: A(%02X)->B(%02X)\n",
-                    ch, A_lsb, val, p_vpmctx->opl3_state.rhythm_mode, A_lsb, val);
+                opl3_trace_seq(p_vpmctx, p_opts, 0, OPL3_TRACE_SEQ_KEYON, ch, A_lsb, val, false);
                 addtional_bytes += write_reg(p_vpmctx, 0, 0xA0 + ch, A_lsb);
             }
             addtional_bytes += write_reg(p_vpmctx, 0, 0xB0 + ch, val);
         } else if (keyon_prev && !keyon_new) {
             if(p_opts->is_a0_b0_aligned) {
                 // KeyOn -> KeyOff（negedge）：B>A
-                opl3_debug_log(p_opts, "[SEQ0] ch=%d KeyOn -> KeyOff A=%02X B=%02X (rhythm=%d) port0: B(%02X)->A(%02X)\n",
-                ch, A_lsb, val, p_vpmctx->opl3_state.rhythm_mode, val, A_lsb);
+                opl3_trace_seq(p_vpmctx, p_opts, 0, OPL3_TRACE_SEQ_KEYOFF, ch, A_lsb, val, true);
             }
             addtional_bytes += write_reg(p_vpmctx, 0, 0xB0 + ch, val);
             if(p_opts->is_a0_b0_aligned) {
                 addtional_bytes += write_reg(p_vpmctx, 0, 0xA0 + ch, A_lsb);
             }
         } else {
-            opl3_debug_log(p_opts, "[SEQ0] ch=%d %s mode=%s A=%02X B=%02X (rhythm=%d) ",
-                ch, (keyon_prev) ? "KeyOn" : "KeyOff", 
-                g_freqseq_mode == FREQSEQ_BAB ? "BAB" : "AB", A_lsb, val, p_vpmctx->opl3_state.rhythm_mode);
-            if (g_freqseq_mode == FREQSEQ_BAB) {
-                opl3_debug_log(p_opts, "port0: B(%02X)->A(%02X)->B(%02X)\n", val, A_lsb, val);
+            if (p_vpmctx->opl3_state.freqseq_mode == FREQSEQ_BAB) {
+                opl3_trace_seq(p_vpmctx, p_opts, 0, OPL3_TRACE_SEQ_BAB, ch, A_lsb, val, keyon_prev != 0);
                 addtional_bytes += write_reg(p_vpmctx, 0, 0xB0 + ch, val);
                 if(p_opts->is_a0_b0_aligned) {
                     addtional_bytes += write_reg(p_vpmctx, 0, 0xA0 + ch, A_lsb);
                     addtional_bytes += write_reg(p_vpmctx, 0, 0xB0 + ch, val);
                 }
             } else {
+                opl3_trace_seq(p_vpmctx, p_opts, 0, p_opts->is_a0_b0_aligned ? OPL3_TRACE_SEQ_AB : OPL3_TRACE_SEQ_B_ONLY,
+                               ch, A_lsb, val, keyon_prev != 0);
                 if(p_opts->is_a0_b0_aligned) {
-                    opl3_debug_log(p_opts, "port0: A(%02X)->B(%02X)\n", A_lsb, val);
                     addtional_bytes += write_reg(p_vpmctx, 0, 0xA0 + ch, A_lsb);
                 }
                 addtional_bytes += write_reg(p_vpmctx, 0, 0xB0 + ch, val);
@@ -553,11 +556,12 @@ int duplicate_write_opl3(
 
         // Detune 計算
         uint8_t detunedA, detunedB;
-        detune_if_fm(p_vpmctx, ch, A_lsb, val, p_opts->detune, &detunedA, &detunedB,p_opts);
+        double detune = p_opts->detune;
+        if (p_opts->p_overrides) detune = opll_override_detune(p_opts->p_overrides, p_vpmctx, ch, detune);
+        detune_if_fm(p_vpmctx, ch, A_lsb, val, detune, &detunedA, &detunedB,p_opts);
         if (!keyon_prev && keyon_new) {
             // KeyOff -> KeyOn（posedge）：A>B
-            opl3_debug_log(p_opts, "[SEQ1] ch=%d KeyOff -> KeyOn A=%02X B=%02X (rhythm=%d) port1: A(%02X)->B(%02X)\n",
-                ch, detunedA, detunedB, p_vpmctx->opl3_state.rhythm_mode, detunedA, detunedB);
+            opl3_trace_seq(p_vpmctx, p_opts, 1, OPL3_TRACE_SEQ_KEYON, ch, detunedA, detunedB, false);
             if (p_opts->is_port1_enabled) {
                 if(p_opts->is_a0_b0_aligned) {
                     addtional_bytes += write_reg(p_vpmctx, 1, 0xA0 + ch, detunedA);
@@ -567,37 +571,29 @@ int duplicate_write_opl3(
             // Update port 1 reg
             int port_1_reg_addr = 0xA0 + ch + 0x100;
             if(p_opts->is_a0_b0_aligned) {
-                p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-                p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+                opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
             }
 
             port_1_reg_addr = 0xB0 + ch + 0x100;
-            p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-            p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+            opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
         } else if (keyon_prev && !keyon_new) {
             // KeyOn -> KeyOff（negedge）：B>A
-            opl3_debug_log(p_opts, "[SEQ1] ch=%d KeyOn -> KeyOff A=%02X B=%02X (rhythm=%d) port1: B(%02X)->A(%02X)\n",
-                ch, detunedA, detunedB, p_vpmctx->opl3_state.rhythm_mode, detunedB, detunedA);
+            opl3_trace_seq(p_vpmctx, p_opts, 1, OPL3_TRACE_SEQ_KEYOFF, ch, detunedA, detunedB, true);
             if (p_opts->is_port1_enabled) {
                 addtional_bytes += write_reg(p_vpmctx, 1, 0xB0 + ch, detunedB);
                 addtional_bytes += write_reg(p_vpmctx, 1, 0xA0 + ch, detunedA);
             }
             // Update port 1 reg
             int port_1_reg_addr = 0xA0 + ch + 0x100;
-            p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-            p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+            opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
 
             port_1_reg_addr = 0xB0 + ch + 0x100;
-            p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-            p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+            opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
         } else {
             // Supposing OPL3 Extend mode
             if (!(p_vpmctx->opl3_state.rhythm_mode && ch >= 6 && ch <= 8)) {
-                opl3_debug_log(p_opts, "[SEQ1] ch=%d %s mode=%s A=%02X B=%02X (rhythm=%d) ",
-                    ch, (keyon_prev) ? "KeyOn" : "KeyOff", 
-                    g_freqseq_mode == FREQSEQ_BAB ? "BAB" : "AB", detunedA, detunedB, p_vpmctx->opl3_state.rhythm_mode);
-                if (g_freqseq_mode == FREQSEQ_BAB) {
-                    opl3_debug_log(p_opts, "port1: B(%02X)->A(%02X)->B(%02X)\n", detunedB, detunedA, detunedB);
+                if (p_vpmctx->opl3_state.freqseq_mode == FREQSEQ_BAB) {
+                    opl3_trace_seq(p_vpmctx, p_opts, 1, OPL3_TRACE_SEQ_BAB, ch, detunedA, detunedB, keyon_prev != 0);
                     if (p_opts->is_port1_enabled) {
                         addtional_bytes += write_reg(p_vpmctx, 1, 0xB0 + ch, detunedB);
                         if(p_opts->is_a0_b0_aligned) {
@@ -608,14 +604,12 @@ int duplicate_write_opl3(
 
                     // Update port 1 reg
                     int port_1_reg_addr = 0xA0 + ch + 0x100;
-                    p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-                    p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+                    opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
 
                     port_1_reg_addr = 0xB0 + ch + 0x100;
-                    p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-                    p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+                    opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
                 } else {
-                    opl3_debug_log(p_opts, "port1: A(%02X)->B(%02X)\n", detunedA, detunedB);
+                    opl3_trace_seq(p_vpmctx, p_opts, 1, OPL3_TRACE_SEQ_AB, ch, detunedA, detunedB, keyon_prev != 0);
                     if (p_opts->is_port1_enabled) {
                         if(p_opts->is_a0_b0_aligned) {
                         addtional_bytes += write_reg(p_vpmctx, 1, 0xA0 + ch, detunedA);
@@ -624,20 +618,18 @@ int duplicate_write_opl3(
                     }
                     // Update port 1 reg
                     int port_1_reg_addr = 0xA0 + ch + 0x100;
-                    p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-                    p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+                    opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
 
                     port_1_reg_addr = 0xB0 + ch + 0x100;
-                    p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-                    p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+                    opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
                 }
             }
         }
         if ( p_opts->opl3_keyon_wait > 0)
             addtional_bytes += vgm_wait_samples(p_vpmctx, p_opts->opl3_keyon_wait);
         
-        // p_vpmctx->opl3_state.reg_stamp[reg]更新
-        p_vpmctx->opl3_state.reg_stamp[reg] = val;
+        // b0_stamp 更新
+        p_vpmctx->opl3_state.b0_stamp[0][ch] = val;
     } else if (reg >= 0xC0 && reg <= 0xC8) {
         int ch = reg - 0xC0;
         // Stereo panning implementation based on channel number
@@ -660,6 +652,10 @@ int duplicate_write_opl3(
             port0_panning = 0xA0;  // Left channel (bit 5 and bit 7)
             port1_panning = 0x50;  // Right channel (bit 4 and bit 6)
         }
+        if (!p_opts->is_port1_enabled) {
+            // No chorus partner on port1: keep the channel centred
+            port0_panning = 0xF0;
+        }
 
         addtional_bytes += write_reg(p_vpmctx, 0, 0xC0 + ch, (0xF & val) | port0_panning);
         // C0 is always copy to port 1 because DAM and DVB should be applied to port 1 even if it is in Rhythm mode
@@ -670,8 +666,7 @@ int duplicate_write_opl3(
         //}
         // Update port 1 reg
         int port_1_reg_addr = reg + 0x100;
-        p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-        p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+        opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
     } else if (reg == 0xBD) {
         p_vpmctx->opl3_state.rhythm_mode = (val & 0x20) != 0;
         addtional_bytes += write_reg(p_vpmctx, 0, reg, val);
@@ -680,8 +675,7 @@ int duplicate_write_opl3(
         }
             // Update port 1 reg
             int port_1_reg_addr = reg + 0x100;
-            p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-            p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+            opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
     } else if (reg >= 0xE0 && reg <= 0xF5) {
         int ch = reg - 0xE0;
         addtional_bytes += write_reg(p_vpmctx, 0, reg, val);
@@ -691,8 +685,7 @@ int duplicate_write_opl3(
             }
             // Update port 1 reg
             int port_1_reg_addr = reg + 0x100;
-            p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-            p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+            opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
         }
     } else {
         // Write to both ports
@@ -702,12 +695,25 @@ int duplicate_write_opl3(
         }
         // Update port 1 reg
         int port_1_reg_addr = reg + 0x100;
-        p_vpmctx->opl3_state.reg_stamp[port_1_reg_addr] = p_vpmctx->opl3_state.reg[port_1_reg_addr];
-        p_vpmctx->opl3_state.reg[port_1_reg_addr] = val;
+        opl3_reg_set(&p_vpmctx->opl3_state, port_1_reg_addr, val);
     }
     return addtional_bytes;
 }
 
+/**
+ * Main OPL3/OPL2 register write handler (supports OPL3 chorus and register mirroring).
+ * Returns the number of additional bytes written (beyond the initial 3-byte write).
+ */
+int duplicate_write_opl3(VGMContext *p_vpmctx, uint8_t reg, uint8_t val, const CommandOptions *p_opts) {
+    if (OPL3_PROFILE_ON(p_vpmctx->p_profile)) {
+        OPL3ProfileStage prev_stage = opl3_profile_enter(p_vpmctx->p_profile, OPL3_PROFILE_OPL3_WRITE);
+        int bytes = opl3_write_duplicated(p_vpmctx, reg, val, p_opts);
+        opl3_profile_leave(p_vpmctx->p_profile, prev_stage);
+        return bytes;
+    }
+    return opl3_write_duplicated(p_vpmctx, reg, val, p_opts);
+}
+
 /**
  * OPL3 initialization sequence for both ports.
  * Sets FM chip type in OPL3State and initializes register mirror.
@@ -716,17 +722,18 @@ int opl3_init(VGMContext *p_vpmctx, FMChipType source_fmchip, const CommandOptio
     if (!p_vpmctx) return 0;
 
     memset(p_vpmctx->opl3_state.reg, 0, sizeof(p_vpmctx->opl3_state.reg));
-    memset(p_vpmctx->opl3_state.reg_stamp, 0, sizeof(p_vpmctx->opl3_state.reg_stamp));
+    memset(p_vpmctx->opl3_state.b0_stamp, 0, sizeof(p_vpmctx->opl3_state.b0_stamp));
     p_vpmctx->opl3_state.rhythm_mode = false;
     p_vpmctx->opl3_state.opl3_mode_initialized = false;
     p_vpmctx->opl3_state.source_fmchip = source_fmchip;
+    p_vpmctx->opl3_state.freqseq_mode = FREQSEQ_AB;
 
     // Get 'ESEOPL3_FREQSEQ' enviornement variable
     const char *seq = getenv("ESEOPL3_FREQSEQ");
     if (p_opts->debug.verbose) {
-        if (seq && (seq[0]=='a' || seq[0]=='A')) g_freqseq_mode = FREQSEQ_AB;
+        if (seq && (seq[0]=='a' || seq[0]=='A')) p_vpmctx->opl3_state.freqseq_mode = FREQSEQ_AB;
         fprintf(stderr, "[FREQSEQ] selected=%s (ESEOPL3_FREQSEQ=%s)\n",
-                g_freqseq_mode==FREQSEQ_BAB ? "BAB" : "AB",
+                p_vpmctx->opl3_state.freqseq_mode==FREQSEQ_BAB ? "BAB" : "AB",
                 seq ? seq : "(unset)");
     }
 
@@ -735,7 +742,8 @@ int opl3_init(VGMContext *p_vpmctx, FMChipType source_fmchip, const CommandOptio
     // Initialize OPL3VoiceDB
     opl3_voice_db_init(&p_vpmctx->opl3_state.voice_db);
 
-    if (p_opts->is_port1_enabled) {
+    // Port1 is also in use when it carries the second YM2413
+    if (p_opts->is_port1_enabled || p_opts->dual_route == OPLL_DualRoute_PORT1) {
     // OPL3 global registers (Port 1 only)
         addtional_bytes += write_reg(p_vpmctx, 1, 0x05, 0x01);  // OPL3 enable
         addtional_bytes += write_reg(p_vpmctx, 1, 0x04, 0x00);  // Waveform select
@@ -768,6 +776,10 @@ int opl3_init(VGMContext *p_vpmctx, FMChipType source_fmchip, const CommandOptio
             port0_panning = 0xA0;  // Left channel (bit 5 and bit 7)
             port1_panning = 0x50;  // Right channel (bit 4 and bit 6)
         }
+        if (!p_opts->is_port1_enabled) {
+            // No chorus partner on port1: keep the channel centred
+            port0_panning = 0xF0;
+        }
 
         addtional_bytes += write_reg(p_vpmctx, 0, 0xC0 + ch, port0_panning);
         // C0 is always copy to port 1 because DAM and DVB should be applied to port 1 even if it is in Rhythm mode
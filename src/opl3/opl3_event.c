@@ -1,16 +1,20 @@
 #include "opl3_event.h"
 #include "opl3_voice.h"
+#include "opl3_arena.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /**
  * Initialize an OPL3EventList structure.
  * @param p_list Pointer to OPL3EventList to initialize.
+ * @param p_alloc Allocator for the event array (NULL = malloc).
  */
-void opl3_event_list_init(OPL3EventList *p_list) {
+void opl3_event_list_init(OPL3EventList *p_list, const OPL3Allocator *p_alloc) {
     p_list->count = 0;
     p_list->capacity = 64;
-    p_list->p_events = (OPL3Event*)calloc(p_list->capacity, sizeof(OPL3Event));
+    p_list->p_alloc = p_alloc;
+    p_list->p_events = (OPL3Event*)opl3_mem_calloc(p_alloc, p_list->capacity * sizeof(OPL3Event));
 }
 
 /**
@@ -18,7 +22,7 @@ void opl3_event_list_init(OPL3EventList *p_list) {
  * @param p_list Pointer to OPL3EventList to free.
  */
 void opl3_event_list_free(OPL3EventList *p_list) {
-    if (p_list->p_events) free(p_list->p_events);
+    opl3_mem_free(p_list->p_alloc, p_list->p_events, (size_t)p_list->capacity * sizeof(OPL3Event));
     p_list->p_events = NULL;
     p_list->count = 0;
     p_list->capacity = 0;
@@ -31,8 +35,160 @@ void opl3_event_list_free(OPL3EventList *p_list) {
  */
 void opl3_event_list_add(OPL3EventList *p_list, const OPL3Event *p_event) {
     if (p_list->count >= p_list->capacity) {
+        size_t old_size = (size_t)p_list->capacity * sizeof(OPL3Event);
         p_list->capacity *= 2;
-        p_list->p_events = (OPL3Event*)realloc(p_list->p_events, p_list->capacity * sizeof(OPL3Event));
+        p_list->p_events = (OPL3Event*)opl3_mem_realloc(p_list->p_alloc, p_list->p_events, old_size,
+                                                        (size_t)p_list->capacity * sizeof(OPL3Event));
     }
     p_list->p_events[p_list->count++] = *p_event;
-}
\ No newline at end of file
+}
+
+/* ---------------------------------------------------------------------------
+ * Event IR front end
+ * ------------------------------------------------------------------------- */
+
+static int event_stream_push(OPL3EventStream *p_stream, uint8_t type, uint8_t cmd,
+                             uint8_t reg, uint8_t val, uint32_t arg, uint32_t offset) {
+    OPL3EventChunk *c = p_stream->p_tail;
+    if (!c || c->count == OPL3_EVENT_CHUNK_SIZE) {
+        OPL3EventChunk *p_new = (OPL3EventChunk *)opl3_arena_alloc(p_stream->p_arena, sizeof(OPL3EventChunk));
+        if (!p_new) return -1;
+        if (c) c->p_next = p_new; else p_stream->p_head = p_new;
+        p_stream->p_tail = c = p_new;
+    }
+    uint32_t i = c->count++;
+    c->type[i] = type;
+    c->cmd[i] = cmd;
+    c->reg[i] = reg;
+    c->val[i] = val;
+    c->arg[i] = arg;
+    c->offset[i] = offset;
+    p_stream->count++;
+    p_stream->type_count[type]++;
+    if (type == OPL3_EVENT_WAIT) p_stream->total_samples += arg;
+    return 0;
+}
+
+/** YM2413 register write -> event class (key edge tracked per channel). */
+static uint8_t classify_opll_write(uint8_t reg, uint8_t val, uint8_t *p_keys) {
+    if (reg >= 0x20 && reg <= 0x28) {
+        int ch = reg - 0x20;
+        uint8_t key = (val >> 4) & 1;
+        uint8_t prev = p_keys[ch];
+        p_keys[ch] = key;
+        if (key && !prev) return OPL3_EVENT_KEYON;
+        if (!key && prev) return OPL3_EVENT_KEYOFF;
+        return OPL3_EVENT_PITCH;
+    }
+    if (reg >= 0x10 && reg <= 0x18) return OPL3_EVENT_PITCH;
+    if ((reg >= 0x30 && reg <= 0x38) || reg <= 0x07) return OPL3_EVENT_VOICECHANGE;
+    return OPL3_EVENT_CONTROL;
+}
+
+/** OPL/OPL2/Y8950 register write -> event class. */
+static uint8_t classify_opl_write(uint8_t reg, uint8_t val, uint8_t *p_keys) {
+    if (reg >= 0xB0 && reg <= 0xB8) {
+        int ch = reg - 0xB0;
+        uint8_t key = (val >> 5) & 1;
+        uint8_t prev = p_keys[ch];
+        p_keys[ch] = key;
+        if (key && !prev) return OPL3_EVENT_KEYON;
+        if (!key && prev) return OPL3_EVENT_KEYOFF;
+        return OPL3_EVENT_PITCH;
+    }
+    if (reg >= 0xA0 && reg <= 0xA8) return OPL3_EVENT_PITCH;
+    if ((reg >= 0x20 && reg <= 0x95) || (reg >= 0xC0 && reg <= 0xC8) || (reg >= 0xE0 && reg <= 0xF5)) {
+        return OPL3_EVENT_VOICECHANGE;
+    }
+    return OPL3_EVENT_CONTROL;
+}
+
+void opl3_event_lower_begin(OPL3EventStream *p_stream, OPL3EventLowerer *p_low,
+                            struct OPL3Arena *p_arena, long data_start) {
+    memset(p_stream, 0, sizeof(*p_stream));
+    memset(p_low, 0, sizeof(*p_low));
+    p_stream->p_arena = p_arena;
+    p_low->pos = data_start;
+}
+
+int opl3_event_lower_feed(OPL3EventStream *p_stream, OPL3EventLowerer *p_low,
+                          const uint8_t *p_data, long size, bool is_final) {
+    p_stream->p_src = p_data;
+    p_stream->src_size = size;
+    if (p_low->is_done) return 0;
+
+    long pos = p_low->pos;
+    long end = p_low->base + size;
+    while (pos < end) {
+        const uint8_t *p = p_data + (pos - p_low->base);
+        uint8_t cmd = p[0];
+        uint32_t offset = (uint32_t)pos;
+        int rc = 0;
+
+        if (cmd == 0x51 || cmd == 0xA1 || cmd == 0x5A || cmd == 0x5B || cmd == 0x5C) {
+            if (pos + 2 >= end) {
+                if (!is_final) break;
+                fprintf(stderr, "%s", (cmd == 0x51 || cmd == 0xA1) ? "Truncated YM2413 command.\n" :
+                                      (cmd == 0x5A) ? "Trunc YM3812\n" :
+                                      (cmd == 0x5B) ? "Trunc YM3526\n" : "Trunc Y8950\n");
+                p_low->is_done = true;
+                break;
+            }
+            uint8_t reg = p[1];
+            uint8_t val = p[2];
+            uint8_t type = (cmd == 0x51) ? classify_opll_write(reg, val, p_low->opll_keys)
+                         : (cmd == 0xA1) ? classify_opll_write(reg, val, p_low->opll2_keys)
+                                         : classify_opl_write(reg, val, p_low->opl_keys);
+            rc = event_stream_push(p_stream, type, cmd, reg, val, 3, offset);
+            pos += 3;
+        } else if (cmd == 0x52 || cmd == 0x54 || cmd == 0x55 || cmd == 0x56 || cmd == 0x57) {
+            if (pos + 2 >= end) {
+                if (!is_final) break;
+                fprintf(stderr, "Trunc OPN-like\n");
+                p_low->is_done = true;
+                break;
+            }
+            rc = event_stream_push(p_stream, OPL3_EVENT_SYSTEM, cmd, p[1], p[2], 3, offset);
+            pos += 3;
+        } else if (cmd >= 0x70 && cmd <= 0x7F) {
+            rc = event_stream_push(p_stream, OPL3_EVENT_WAIT, cmd, 0, 0, (uint32_t)((cmd & 0x0F) + 1), offset);
+            pos += 1;
+        } else if (cmd == 0x61) {
+            if (pos + 2 >= end) {
+                if (!is_final) break;
+                fprintf(stderr, "Trunc wait 0x61\n");
+                p_low->is_done = true;
+                break;
+            }
+            uint16_t ws = (uint16_t)(p[1] | (p[2] << 8));
+            rc = event_stream_push(p_stream, OPL3_EVENT_WAIT, cmd, 0, 0, ws, offset);
+            pos += 3;
+        } else if (cmd == 0x62 || cmd == 0x63) {
+            rc = event_stream_push(p_stream, OPL3_EVENT_WAIT, cmd, 0, 0, (cmd == 0x62) ? 735 : 882, offset);
+            pos += 1;
+        } else if (cmd == 0x66) {
+            rc = event_stream_push(p_stream, OPL3_EVENT_SYSTEM, cmd, 0, 0, 1, offset);
+            if (rc == 0) {
+                p_low->is_done = true;   /* End reached */
+                pos += 1;
+                break;
+            }
+        } else {
+            uint32_t len = vgm_cmd_length(p, (size_t)(end - pos));
+            if (!is_final && pos + (long)len > end) break;   // passthrough bytes are copied from the source later
+            rc = event_stream_push(p_stream, OPL3_EVENT_SYSTEM, cmd, 0, 0, len, offset);
+            pos += len;
+        }
+        if (rc != 0) return -1;
+    }
+    p_low->pos = pos;
+    if (is_final) p_low->is_done = true;
+    return 0;
+}
+
+int opl3_event_lower_vgm(OPL3EventStream *p_stream, struct OPL3Arena *p_arena,
+                         const uint8_t *p_data, long filesize, long data_start) {
+    OPL3EventLowerer low;
+    opl3_event_lower_begin(p_stream, &low, p_arena, data_start);
+    return opl3_event_lower_feed(p_stream, &low, p_data, filesize, true);
+}
@@ -2,6 +2,7 @@
 #define OPL3_EVENT_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "../vgm/vgm_helpers.h" // For FMChipType
 
 typedef enum {
@@ -37,9 +38,10 @@ typedef struct {
     OPL3Event *p_events;
     int count;
     int capacity;
+    const OPL3Allocator *p_alloc;   /* NULL = malloc */
 } OPL3EventList;
 
-void opl3_event_list_init(OPL3EventList *p_list);
+void opl3_event_list_init(OPL3EventList *p_list, const OPL3Allocator *p_alloc);
 void opl3_event_list_free(OPL3EventList *p_list);
 void opl3_event_list_add(OPL3EventList *p_list, const OPL3Event *p_event);
 
@@ -48,4 +50,122 @@ typedef struct {
     uint8_t prev_keyon; // Previous KeyOn bit (0 or 1)
 } OPL3KeyOnStatus;
 
+/*
+ * Command IR (struct-of-arrays)
+ *
+ * Front end: opl3_event_lower_vgm() が VGM コマンド列を1回だけ走査し、
+ * コマンド毎に1イベント (1:1、長さ・ウェイト値は解決済み) を arena 上の
+ * チャンクに格納する。Back end (eseopl3.c) は cmd/reg/val/arg を元のコマンド
+ * として各チップのハンドラへ渡す。コマンドの解析を 1 回で済ませ、同じ
+ * OPL3EventStream を複数の出力バリエーションで共有するための層であり、
+ * 音符単位の意味イベント (KeyOn/ピッチ/音色) への変換はしていない。
+ *
+ * type はコマンドの分類 (KEYON/KEYOFF/PITCH/VOICECHANGE/CONTROL/WAIT/SYSTEM)。
+ * 変換には使わず、統計 ([IR] 行) と解析用。
+ */
+#define OPL3_EVENT_CHUNK_SIZE 4096
+
+typedef struct OPL3EventChunk {
+    struct OPL3EventChunk *p_next;
+    uint32_t count;
+    uint8_t  type[OPL3_EVENT_CHUNK_SIZE];   /* OPL3EventType */
+    uint8_t  cmd[OPL3_EVENT_CHUNK_SIZE];    /* VGM command byte */
+    uint8_t  reg[OPL3_EVENT_CHUNK_SIZE];    /* register (chip writes) */
+    uint8_t  val[OPL3_EVENT_CHUNK_SIZE];    /* value (chip writes) */
+    uint32_t arg[OPL3_EVENT_CHUNK_SIZE];    /* wait samples / command length */
+    uint32_t offset[OPL3_EVENT_CHUNK_SIZE]; /* file offset of the command */
+} OPL3EventChunk;
+
+struct OPL3Arena;
+
+typedef struct {
+    OPL3EventChunk *p_head;
+    OPL3EventChunk *p_tail;
+    struct OPL3Arena *p_arena;
+    uint32_t count;
+    uint32_t type_count[OPL3_EVENT_SYSTEM + 1];
+    uint64_t total_samples;
+    const uint8_t *p_src;   /* source bytes of the last feed (from the lowerer's base) */
+    long src_size;
+} OPL3EventStream;
+
+/** One decoded event (view into a chunk). */
+typedef struct {
+    const OPL3EventChunk *p_chunk;
+    uint32_t index;
+    uint8_t  type;
+    uint8_t  cmd;
+    uint8_t  reg;
+    uint8_t  val;
+    uint32_t arg;
+    uint32_t offset;
+} OPL3EventCursor;
+
+/**
+ * Lower the VGM command stream starting at data_start into p_stream.
+ * Stops after 0x66 or at the first truncated command (reported on stderr).
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int  opl3_event_lower_vgm(OPL3EventStream *p_stream, struct OPL3Arena *p_arena,
+                          const uint8_t *p_data, long filesize, long data_start);
+
+/** Incremental front end state (input arriving in chunks). */
+typedef struct {
+    uint8_t opll_keys[9];
+    uint8_t opll2_keys[9];    // second YM2413 (0xA1)
+    uint8_t opl_keys[9];
+    long    pos;              // next command to lower (file offset)
+    long    base;             // file offset of p_data[0] (0 unless the caller dropped a lowered prefix)
+    bool    is_done;          // 0x66 lowered, or the input ended
+} OPL3EventLowerer;
+
+void opl3_event_lower_begin(OPL3EventStream *p_stream, OPL3EventLowerer *p_low,
+                            struct OPL3Arena *p_arena, long data_start);
+
+/**
+ * Lower every complete command up to the end of p_data, which holds size bytes of the
+ * input starting at file offset p_low->base (it may move between calls; event offsets
+ * stay file offsets). With is_final the input ends there:
+ * a truncated command is reported and ends the stream, as in opl3_event_lower_vgm().
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int  opl3_event_lower_feed(OPL3EventStream *p_stream, OPL3EventLowerer *p_low,
+                           const uint8_t *p_data, long size, bool is_final);
+
+static inline void opl3_event_cursor_init(OPL3EventCursor *p_cur, const OPL3EventStream *p_stream) {
+    p_cur->p_chunk = p_stream->p_head;
+    p_cur->index = 0;
+}
+
+/** Position the cursor so that the next opl3_event_next() returns event #index. */
+static inline void opl3_event_cursor_seek(OPL3EventCursor *p_cur, const OPL3EventStream *p_stream, uint32_t index) {
+    p_cur->p_chunk = p_stream->p_head;
+    while (p_cur->p_chunk && index >= p_cur->p_chunk->count) {
+        index -= p_cur->p_chunk->count;
+        p_cur->p_chunk = p_cur->p_chunk->p_next;
+    }
+    p_cur->index = index;
+}
+
+/**
+ * Advance to the next event; returns 0 at the end of the stream.
+ * The cursor stays on the tail chunk, so events lowered later are picked up.
+ */
+static inline int opl3_event_next(OPL3EventCursor *p_cur) {
+    while (p_cur->p_chunk && p_cur->index >= p_cur->p_chunk->count && p_cur->p_chunk->p_next) {
+        p_cur->p_chunk = p_cur->p_chunk->p_next;
+        p_cur->index = 0;
+    }
+    if (!p_cur->p_chunk || p_cur->index >= p_cur->p_chunk->count) return 0;
+    const OPL3EventChunk *c = p_cur->p_chunk;
+    uint32_t i = p_cur->index++;
+    p_cur->type = c->type[i];
+    p_cur->cmd = c->cmd[i];
+    p_cur->reg = c->reg[i];
+    p_cur->val = c->val[i];
+    p_cur->arg = c->arg[i];
+    p_cur->offset = c->offset[i];
+    return 1;
+}
+
 #endif // OPL3_EVENT_H
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef OPL3_HASH_H
+#define OPL3_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * FNV-1a: voice DB keys, override file fingerprints, voice bank source hash,
+ * checkpoint input/option fingerprints and the --cache key.
+ * h に前回の戻り値を渡せば複数の領域を続けてハッシュできる (最初は *_BASIS)。
+ */
+#define OPL3_FNV1A_BASIS    2166136261u
+#define OPL3_FNV1A_PRIME    16777619u
+#define OPL3_FNV1A64_BASIS  0xcbf29ce484222325ULL
+#define OPL3_FNV1A64_PRIME  0x100000001b3ULL
+
+static inline uint32_t opl3_fnv1a(uint32_t h, const void *p_data, size_t size) {
+    const uint8_t *p = (const uint8_t *)p_data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= OPL3_FNV1A_PRIME;
+    }
+    return h;
+}
+
+static inline uint64_t opl3_fnv1a64(uint64_t h, const void *p_data, size_t size) {
+    const uint8_t *p = (const uint8_t *)p_data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= OPL3_FNV1A64_PRIME;
+    }
+    return h;
+}
+
+#endif /* OPL3_HASH_H */
@@ -1,4 +1,35 @@
 #include "opl3_hooks.h"
 
-/* 何もしないデフォルト */
-OPL3Hooks g_opl3_hooks = {0};
\ No newline at end of file
+bool opl3_hooks_pre_write(const OPL3HookBinding *p_b, uint32_t sample, int port, uint8_t reg, uint8_t *p_val) {
+    if (!p_b->p_hooks->on_pre_write) return true;
+    return p_b->p_hooks->on_pre_write(p_b->p_user, sample, port, reg, p_val);
+}
+
+void opl3_hooks_post_write(OPL3HookBinding *p_b, const OPL3State *p_st, uint32_t sample,
+                           int port, uint8_t reg, uint8_t val, int bytes) {
+    const OPL3Hooks *p_h = p_b->p_hooks;
+    if (p_h->on_post_write) p_h->on_post_write(p_b->p_user, sample, port, reg, val, bytes);
+    if (reg < 0xB0 || reg > 0xB8) return;
+
+    // KEY edge against what was emitted before (the mirror may already hold this value)
+    int ch = reg - 0xB0;
+    uint32_t bit = 1u << (port * 9 + ch);
+    bool was_on = (p_b->key_mask & bit) != 0;
+    bool is_on = (val & 0x20) != 0;
+    if (was_on == is_on) return;
+    if (is_on) {
+        p_b->key_mask |= bit;
+        if (p_h->on_keyon) {
+            uint8_t a0 = opl3_reg_get(p_st, (port ? 0x100 : 0) + 0xA0 + ch);
+            uint16_t fnum = (uint16_t)(((val & 0x03) << 8) | a0);
+            p_h->on_keyon(p_b->p_user, sample, port, ch, fnum, (uint8_t)((val >> 2) & 0x07));
+        }
+    } else {
+        p_b->key_mask &= ~bit;
+        if (p_h->on_keyoff) p_h->on_keyoff(p_b->p_user, sample, port, ch);
+    }
+}
+
+void opl3_hooks_wait(const OPL3HookBinding *p_b, uint32_t sample, uint32_t samples) {
+    if (p_b->p_hooks->on_wait) p_b->p_hooks->on_wait(p_b->p_user, sample, samples);
+}
@@ -1,14 +1,69 @@
 #ifndef OPL3_HOOKS_H
 #define OPL3_HOOKS_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "opl3_state.h"
 
+/*
+ * Converter hooks.
+ *
+ * VGMContext ごとに登録するコールバック群。write_reg() / vgm_wait_*() が
+ * 出力の直前・直後に呼ぶので、metrics・trace・独自フィルタを
+ * duplicate_write_opl3 や write_reg をフォークせずに差し込める。
+ *
+ *  - 未登録なら各呼び出し点はポインタの NULL チェック1回だけ (分岐予測で偽)。
+ *  - -DDISABLE_OPL3_HOOKS でビルドすると呼び出し点ごと消える。
+ *
+ * sample は出力ストリーム上の現在位置 (VGMContext.timestamp.current_sample)。
+ * コールバックは変換スレッドから同期的に呼ばれる。
+ */
+
 typedef struct OPL3Hooks {
-    void (*on_pre_keyon)(int ch, OPL3VoiceParam *vp); /* KeyOn直前（VoiceParam確定後） */
-    void (*on_post_keyon)(int ch);                    /* KeyOnコマンド書き込み直後 */
-    void (*on_note_off)(int ch);                      /* KeyOffエッジ時 */
+    /**
+     * Before an OPL3 register write is emitted. *p_val may be rewritten;
+     * return false to drop the write from the output (the register mirror keeps
+     * the converter's value, so later conversion decisions are unaffected).
+     */
+    bool (*on_pre_write)(void *p_user, uint32_t sample, int port, uint8_t reg, uint8_t *p_val);
+    /** After a write was emitted; bytes = VGM bytes written (including the MSX-AUDIO mirror). */
+    void (*on_post_write)(void *p_user, uint32_t sample, int port, uint8_t reg, uint8_t val, int bytes);
+    /** KEY bit of Bn rose on channel port*9+ch (fnum from the register mirror, block as emitted). */
+    void (*on_keyon)(void *p_user, uint32_t sample, int port, int ch, uint16_t fnum, uint8_t block);
+    /** KEY bit of Bn fell. */
+    void (*on_keyoff)(void *p_user, uint32_t sample, int port, int ch);
+    /** A wait of `samples` was emitted starting at `sample`. */
+    void (*on_wait)(void *p_user, uint32_t sample, uint32_t samples);
 } OPL3Hooks;
 
-extern OPL3Hooks g_opl3_hooks;
+/** Per-context registration (VGMContext.hooks). Zero-initialized = no hooks. */
+typedef struct OPL3HookBinding {
+    const OPL3Hooks *p_hooks;
+    void            *p_user;
+    uint32_t         key_mask;   /* emitted KEY bits, bit = port*9+ch (edge detection) */
+} OPL3HookBinding;
+
+#ifndef DISABLE_OPL3_HOOKS
+#if defined(__GNUC__)
+#define OPL3_HOOKS_ATTACHED(b) __builtin_expect((b).p_hooks != NULL, 0)
+#else
+#define OPL3_HOOKS_ATTACHED(b) ((b).p_hooks != NULL)
+#endif
+#else
+#define OPL3_HOOKS_ATTACHED(b) 0
+#endif
+
+/** Register p_hooks (NULL = detach) with user data for one conversion context. */
+static inline void opl3_hooks_attach(OPL3HookBinding *p_b, const OPL3Hooks *p_hooks, void *p_user) {
+    p_b->p_hooks = p_hooks;
+    p_b->p_user = p_user;
+    p_b->key_mask = 0;
+}
+
+/* Dispatch helpers for the emit points; call only when OPL3_HOOKS_ATTACHED(). */
+bool opl3_hooks_pre_write(const OPL3HookBinding *p_b, uint32_t sample, int port, uint8_t reg, uint8_t *p_val);
+void opl3_hooks_post_write(OPL3HookBinding *p_b, const OPL3State *p_st, uint32_t sample,
+                           int port, uint8_t reg, uint8_t val, int bytes);
+void opl3_hooks_wait(const OPL3HookBinding *p_b, uint32_t sample, uint32_t samples);
 
-#endif /* OPL3_HOOKS_H */
\ No newline at end of file
+#endif /* OPL3_HOOKS_H */
@@ -0,0 +1,59 @@
+#ifndef OPL3_MEM_H
+#define OPL3_MEM_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Pluggable allocator.
+ *
+ * 変換 1 回分 (ジョブ) のメモリ確保はすべてこのインタフェースを通す。
+ * VGMBuffer / OPL3VoiceDB / OPL3EventList / OPL3Arena のブロックは確保時の
+ * アロケータを自分で持つので、違うアロケータのものが混ざっても正しく解放される。
+ * NULL は libc (malloc / realloc / free)。
+ *
+ * fn は lua_Alloc と同じ形の 1 関数: p_ptr NULL で確保、new_size 0 で解放、
+ * それ以外は伸縮。old_size は p_ptr を得たときのサイズ (バンプアロケータが
+ * 末尾の伸長と巻き戻しに使う)。
+ */
+typedef void *(*OPL3AllocFn)(void *p_user, void *p_ptr, size_t old_size, size_t new_size);
+
+typedef struct OPL3Allocator {
+    OPL3AllocFn fn;
+    void       *p_user;
+} OPL3Allocator;
+
+static inline void *opl3_mem_realloc(const OPL3Allocator *p_alloc, void *p_ptr, size_t old_size, size_t new_size) {
+    if (p_alloc) return p_alloc->fn(p_alloc->p_user, p_ptr, old_size, new_size);
+    if (new_size == 0) {
+        free(p_ptr);
+        return NULL;
+    }
+    return realloc(p_ptr, new_size);
+}
+
+static inline void *opl3_mem_alloc(const OPL3Allocator *p_alloc, size_t size) {
+    return opl3_mem_realloc(p_alloc, NULL, 0, size ? size : 1);
+}
+
+static inline void *opl3_mem_calloc(const OPL3Allocator *p_alloc, size_t size) {
+    if (!p_alloc) return calloc(1, size ? size : 1);
+    void *p = opl3_mem_alloc(p_alloc, size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+static inline void opl3_mem_free(const OPL3Allocator *p_alloc, void *p_ptr, size_t size) {
+    if (p_ptr) opl3_mem_realloc(p_alloc, p_ptr, size, 0);
+}
+
+/** strdup() through p_alloc; release with opl3_mem_free(p_alloc, s, strlen(s) + 1). */
+static inline char *opl3_mem_strdup(const OPL3Allocator *p_alloc, const char *p_str) {
+    size_t len = strlen(p_str) + 1;
+    char *p = (char *)opl3_mem_alloc(p_alloc, len);
+    if (p) memcpy(p, p_str, len);
+    return p;
+}
+
+#endif /* OPL3_MEM_H */
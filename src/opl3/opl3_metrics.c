@@ -1,29 +1,141 @@
 #include "opl3_metrics.h"
+#include <stdlib.h>
+#include <string.h>
 
-#ifdef ENABLE_OPL3_METRICS
-#include <stdio.h>
+static const char *const k_class_names[OPL3_METRICS_NUM_REG_CLASSES] = {
+    "global", "op20", "op40", "op60", "op80", "a0", "b0", "bd", "c0", "e0", "other"
+};
 
-static FILE *g_fp = NULL;
+static OPL3MetricsRegClass metrics_reg_class(uint8_t reg) {
+    if (reg >= 0x01 && reg <= 0x08) return OPL3_METRICS_REG_GLOBAL;
+    if (reg >= 0x20 && reg <= 0x35) return OPL3_METRICS_REG_OP20;
+    if (reg >= 0x40 && reg <= 0x55) return OPL3_METRICS_REG_OP40;
+    if (reg >= 0x60 && reg <= 0x75) return OPL3_METRICS_REG_OP60;
+    if (reg >= 0x80 && reg <= 0x95) return OPL3_METRICS_REG_OP80;
+    if (reg >= 0xA0 && reg <= 0xA8) return OPL3_METRICS_REG_A0;
+    if (reg >= 0xB0 && reg <= 0xB8) return OPL3_METRICS_REG_B0;
+    if (reg == 0xBD)                return OPL3_METRICS_REG_BD;
+    if (reg >= 0xC0 && reg <= 0xC8) return OPL3_METRICS_REG_C0;
+    if (reg >= 0xE0 && reg <= 0xF5) return OPL3_METRICS_REG_E0;
+    return OPL3_METRICS_REG_OTHER;
+}
+
+OPL3Metrics *opl3_metrics_open(uint32_t note_capacity, const OPL3Allocator *p_alloc) {
+    OPL3Metrics *p_m = (OPL3Metrics *)opl3_mem_calloc(p_alloc, sizeof(OPL3Metrics));
+    if (!p_m) return NULL;
+    p_m->p_alloc = p_alloc;
+    p_m->note_capacity = note_capacity ? note_capacity : OPL3_METRICS_DEFAULT_NOTES;
+    p_m->p_notes = (OPL3MetricsNote *)opl3_mem_alloc(p_alloc, (size_t)p_m->note_capacity * sizeof(OPL3MetricsNote));
+    if (!p_m->p_notes) {
+        opl3_mem_free(p_alloc, p_m, sizeof(OPL3Metrics));
+        return NULL;
+    }
+    for (int i = 0; i < OPL3_NUM_CHANNELS; ++i) p_m->ch[i].gate_min = UINT32_MAX;
+    return p_m;
+}
 
-void opl3_metrics_init(const char *path) {
-    g_fp = fopen(path ? path : "opl3_metrics.csv", "w");
-    if (g_fp) {
-        fprintf(g_fp, "time_samples,ch,event,fnum,block\n");
+void opl3_metrics_close(OPL3Metrics *p_m) {
+    if (!p_m) return;
+    const OPL3Allocator *p_alloc = p_m->p_alloc;
+    opl3_mem_free(p_alloc, p_m->p_notes, (size_t)p_m->note_capacity * sizeof(OPL3MetricsNote));
+    opl3_mem_free(p_alloc, p_m, sizeof(OPL3Metrics));
+}
+
+/** Close the sounding note of channel index c at sample. */
+static void metrics_note_end(OPL3Metrics *p_m, int c, uint32_t sample) {
+    OPL3MetricsNote *p_n = &p_m->open[c];
+    p_n->keyoff_sample = sample;
+    uint32_t gate = sample - p_n->keyon_sample;
+    OPL3MetricsChannel *p_ch = &p_m->ch[c];
+    p_ch->notes++;
+    p_ch->gate_total += gate;
+    if (gate < p_ch->gate_min) p_ch->gate_min = gate;
+    if (gate > p_ch->gate_max) p_ch->gate_max = gate;
+    if (p_m->note_count < p_m->note_capacity) {
+        p_m->p_notes[p_m->note_count++] = *p_n;
+    } else {
+        p_m->notes_dropped++;
     }
 }
 
-void opl3_metrics_close(void) {
-    if (g_fp) {
-        fclose(g_fp);
-        g_fp = NULL;
+void opl3_metrics_write(OPL3Metrics *p_m, const OPL3State *p_st, uint32_t sample,
+                        int port, uint8_t reg, uint8_t val, int bytes) {
+    OPL3MetricsRegClass cls = metrics_reg_class(reg);
+    p_m->writes[port ? 1 : 0][cls]++;
+    p_m->bytes += (uint64_t)bytes;
+    if (cls != OPL3_METRICS_REG_B0) return;
+
+    // KEY edge against what was emitted before (same rule as the converter hooks)
+    int ch = reg - 0xB0;
+    int c = (port ? 9 : 0) + ch;
+    uint32_t bit = 1u << c;
+    bool was_on = (p_m->key_mask & bit) != 0;
+    bool is_on = (val & 0x20) != 0;
+    if (was_on == is_on) return;
+    if (is_on) {
+        p_m->key_mask |= bit;
+        p_m->keyons++;
+        OPL3MetricsNote *p_n = &p_m->open[c];
+        uint8_t a0 = opl3_reg_get(p_st, (port ? 0x100 : 0) + 0xA0 + ch);
+        p_n->keyon_sample = sample;
+        p_n->fnum = (uint16_t)(((val & 0x03) << 8) | a0);
+        p_n->block = (uint8_t)((val >> 2) & 0x07);
+        p_n->ch = (uint8_t)c;
+    } else {
+        p_m->key_mask &= ~bit;
+        p_m->keyoffs++;
+        metrics_note_end(p_m, c, sample);
     }
 }
 
-/* 現状 time_samples を持っていないので 0。後でサンプルカウンタ導入可能 */
-void opl3_metrics_note_on(int ch, uint16_t fnum, uint8_t block) {
-    if (g_fp) fprintf(g_fp, "0,%d,ON,%u,%u\n", ch, fnum, block);
+static int metrics_note_order(const void *p_a, const void *p_b) {
+    const OPL3MetricsNote *a = (const OPL3MetricsNote *)p_a;
+    const OPL3MetricsNote *b = (const OPL3MetricsNote *)p_b;
+    if (a->keyon_sample != b->keyon_sample) return (a->keyon_sample < b->keyon_sample) ? -1 : 1;
+    return (int)a->ch - (int)b->ch;
+}
+
+int opl3_metrics_flush(OPL3Metrics *p_m, const char *p_path, uint32_t end_sample) {
+    for (int c = 0; c < OPL3_NUM_CHANNELS; ++c) {
+        if (p_m->key_mask & (1u << c)) metrics_note_end(p_m, c, end_sample);
+    }
+    p_m->key_mask = 0;
+    qsort(p_m->p_notes, p_m->note_count, sizeof(OPL3MetricsNote), metrics_note_order);
+
+    FILE *fp = fopen(p_path, "w");
+    if (!fp) return -1;
+    fprintf(fp, "# samples=%u bytes=%llu waits=%llu wait_samples=%llu keyons=%llu keyoffs=%llu dedup_hits=%llu notes_dropped=%llu\n",
+            (unsigned)end_sample, (unsigned long long)p_m->bytes, (unsigned long long)p_m->waits,
+            (unsigned long long)p_m->wait_samples, (unsigned long long)p_m->keyons, (unsigned long long)p_m->keyoffs,
+            (unsigned long long)p_m->dedup_hits, (unsigned long long)p_m->notes_dropped);
+    for (int port = 0; port < 2; ++port) {
+        fprintf(fp, "# writes port%d:", port);
+        for (int k = 0; k < OPL3_METRICS_NUM_REG_CLASSES; ++k) {
+            fprintf(fp, " %s=%llu", k_class_names[k], (unsigned long long)p_m->writes[port][k]);
+        }
+        fputc('\n', fp);
+    }
+    for (int c = 0; c < OPL3_NUM_CHANNELS; ++c) {
+        const OPL3MetricsChannel *p_ch = &p_m->ch[c];
+        if (!p_ch->notes) continue;
+        fprintf(fp, "# ch %d: notes=%u gate_min=%u gate_avg=%llu gate_max=%u\n", c, p_ch->notes, p_ch->gate_min,
+                (unsigned long long)(p_ch->gate_total / p_ch->notes), p_ch->gate_max);
+    }
+    fprintf(fp, "ch,keyon_sample,keyoff_sample,gate_samples,fnum,block\n");
+    for (uint32_t i = 0; i < p_m->note_count; ++i) {
+        const OPL3MetricsNote *p_n = &p_m->p_notes[i];
+        fprintf(fp, "%u,%u,%u,%u,%u,%u\n", p_n->ch, p_n->keyon_sample, p_n->keyoff_sample,
+                p_n->keyoff_sample - p_n->keyon_sample, p_n->fnum, p_n->block);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
 }
-void opl3_metrics_note_off(int ch) {
-    if (g_fp) fprintf(g_fp, "0,%d,OFF,,\n", ch);
+
+void opl3_metrics_print_summary(const OPL3Metrics *p_m, FILE *fp) {
+    uint64_t writes = 0;
+    for (int port = 0; port < 2; ++port) {
+        for (int k = 0; k < OPL3_METRICS_NUM_REG_CLASSES; ++k) writes += p_m->writes[port][k];
+    }
+    fprintf(fp, "[METRICS] writes=%llu bytes=%llu waits=%llu keyons=%llu dedup_hits=%llu notes=%u%s\n",
+            (unsigned long long)writes, (unsigned long long)p_m->bytes, (unsigned long long)p_m->waits, (unsigned long long)p_m->keyons,
+            (unsigned long long)p_m->dedup_hits, p_m->note_count, p_m->notes_dropped ? " (log full)" : "");
 }
-#endif
\ No newline at end of file
@@ -1,18 +1,119 @@
 #ifndef OPL3_METRICS_H
 #define OPL3_METRICS_H
 
+#include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include "opl3_state.h"
 
-#ifdef ENABLE_OPL3_METRICS
-void opl3_metrics_init(const char *path);
-void opl3_metrics_close(void);
-void opl3_metrics_note_on(int ch, uint16_t fnum, uint8_t block);
-void opl3_metrics_note_off(int ch);
+/*
+ * Per-conversion metrics.
+ *
+ * VGMContext.p_metrics が NULL (既定) なら各記録点はポインタの NULL チェック1回だけ。
+ * 開いている場合も記録はカウンタの加算と、open 時に確保した固定長ノートログへの
+ * 書き込みだけで、確保もファイル I/O もしない。ファイルへは opl3_metrics_flush() で
+ * 最後に1回だけ書く。そのため本番の変換でも有効にしたままにできる。
+ * -DDISABLE_OPL3_METRICS でビルドすると記録点ごと消える。
+ *
+ * sample は出力ストリーム上の位置 (VGMContext.timestamp.current_sample) で、
+ * ノートの時刻はスケジューラが実際に書き込みを出した時刻 (emit_time) になる。
+ */
+
+/** Register classes, counted per port. */
+typedef enum {
+    OPL3_METRICS_REG_GLOBAL = 0,    /* 01-08, 104/105 */
+    OPL3_METRICS_REG_OP20,          /* AM/VIB/EGT/KSR/MULT */
+    OPL3_METRICS_REG_OP40,          /* KSL/TL */
+    OPL3_METRICS_REG_OP60,          /* AR/DR */
+    OPL3_METRICS_REG_OP80,          /* SL/RR */
+    OPL3_METRICS_REG_A0,            /* FNUM low */
+    OPL3_METRICS_REG_B0,            /* KEY/BLOCK/FNUM high */
+    OPL3_METRICS_REG_BD,            /* rhythm */
+    OPL3_METRICS_REG_C0,            /* FB/CNT/panning */
+    OPL3_METRICS_REG_E0,            /* waveform */
+    OPL3_METRICS_REG_OTHER,
+    OPL3_METRICS_NUM_REG_CLASSES
+} OPL3MetricsRegClass;
+
+/** One finished note: KEY on to KEY off on channel port*9+ch. */
+typedef struct {
+    uint32_t keyon_sample;
+    uint32_t keyoff_sample;
+    uint16_t fnum;
+    uint8_t  block;
+    uint8_t  ch;
+} OPL3MetricsNote;
+
+typedef struct {
+    uint32_t notes;
+    uint32_t gate_min;
+    uint32_t gate_max;
+    uint64_t gate_total;
+} OPL3MetricsChannel;
+
+#define OPL3_METRICS_DEFAULT_NOTES 65536    /* note log entries reserved at open (12 bytes each) */
+
+typedef struct OPL3Metrics {
+    /* counters */
+    uint64_t writes[2][OPL3_METRICS_NUM_REG_CLASSES];
+    uint64_t bytes;                 /* VGM bytes emitted by register writes */
+    uint64_t waits;
+    uint64_t wait_samples;
+    uint64_t keyons;
+    uint64_t keyoffs;
+    uint64_t dedup_hits;            /* writes dropped because the chip already had the value */
+    OPL3MetricsChannel ch[OPL3_NUM_CHANNELS];
+    /* notes */
+    uint32_t        key_mask;       /* KEY bits as emitted, bit = port*9+ch */
+    OPL3MetricsNote open[OPL3_NUM_CHANNELS];
+    OPL3MetricsNote *p_notes;       /* preallocated log */
+    uint32_t        note_count;
+    uint32_t        note_capacity;
+    uint64_t        notes_dropped;  /* finished after the log was full (still in the counters) */
+    const OPL3Allocator *p_alloc;
+} OPL3Metrics;
+
+#ifndef DISABLE_OPL3_METRICS
+#if defined(__GNUC__)
+#define OPL3_METRICS_ON(p) __builtin_expect((p) != NULL, 0)
+#else
+#define OPL3_METRICS_ON(p) ((p) != NULL)
+#endif
 #else
-#define opl3_metrics_init(path)         ((void)0)
-#define opl3_metrics_close()            ((void)0)
-#define opl3_metrics_note_on(c,f,b)     ((void)0)
-#define opl3_metrics_note_off(c)        ((void)0)
+#define OPL3_METRICS_ON(p) 0
 #endif
 
-#endif /* OPL3_METRICS_H */
\ No newline at end of file
+/**
+ * Allocate the counters and a log of note_capacity notes (0 = OPL3_METRICS_DEFAULT_NOTES)
+ * from p_alloc (NULL = malloc). Returns NULL on failure.
+ */
+OPL3Metrics *opl3_metrics_open(uint32_t note_capacity, const OPL3Allocator *p_alloc);
+
+/** Free; NULL is accepted. */
+void opl3_metrics_close(OPL3Metrics *p_m);
+
+/** An emitted register write (after write_reg); p_st supplies FNUM low for key-ons. */
+void opl3_metrics_write(OPL3Metrics *p_m, const OPL3State *p_st, uint32_t sample,
+                        int port, uint8_t reg, uint8_t val, int bytes);
+
+/** An emitted wait of `samples`. */
+static inline void opl3_metrics_wait(OPL3Metrics *p_m, uint32_t samples) {
+    p_m->waits++;
+    p_m->wait_samples += samples;
+}
+
+/** A write the converter skipped because the register already held the value. */
+static inline void opl3_metrics_dedup(OPL3Metrics *p_m) {
+    p_m->dedup_hits++;
+}
+
+/**
+ * Write everything to p_path (counters as "# " lines, then one CSV row per note).
+ * Notes still sounding end at end_sample. Returns 0, or -1 if the file cannot be written.
+ */
+int opl3_metrics_flush(OPL3Metrics *p_m, const char *p_path, uint32_t end_sample);
+
+/** One-line summary for -verbose. */
+void opl3_metrics_print_summary(const OPL3Metrics *p_m, FILE *fp);
+
+#endif /* OPL3_METRICS_H */
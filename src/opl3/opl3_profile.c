@@ -0,0 +1,36 @@
+#include "opl3_profile.h"
+#include <string.h>
+
+void opl3_profile_init(OPL3Profile *p_prof) {
+    memset(p_prof, 0, sizeof(*p_prof));
+    p_prof->stage = OPL3_PROFILE_IDLE;
+    p_prof->mark_ns = opl3_now_ns();
+}
+
+static void *profile_alloc(void *p_user, void *p_ptr, size_t old_size, size_t new_size) {
+    OPL3Profile *p_prof = (OPL3Profile *)p_user;
+    void *p_new = opl3_mem_realloc(p_prof->p_parent, p_ptr, old_size, new_size);
+    if (new_size == 0) {
+        p_prof->frees++;
+        p_prof->live_bytes -= old_size;
+        return p_new;
+    }
+    if (!p_new) return NULL;
+    if (p_ptr) {
+        p_prof->reallocs++;
+    } else {
+        p_prof->allocs++;
+    }
+    if (new_size > old_size) p_prof->alloc_bytes += new_size - old_size;
+    p_prof->live_bytes += new_size;
+    p_prof->live_bytes -= old_size;
+    if (p_prof->live_bytes > p_prof->peak_bytes) p_prof->peak_bytes = p_prof->live_bytes;
+    return p_new;
+}
+
+const OPL3Allocator *opl3_profile_allocator(OPL3Profile *p_prof, const OPL3Allocator *p_parent) {
+    p_prof->p_parent = p_parent;
+    p_prof->counted.fn = profile_alloc;
+    p_prof->counted.p_user = p_prof;
+    return &p_prof->counted;
+}
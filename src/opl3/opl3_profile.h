@@ -0,0 +1,84 @@
+#ifndef OPL3_PROFILE_H
+#define OPL3_PROFILE_H
+
+#include <stdint.h>
+#include "opl3_clock.h"
+#include "opl3_mem.h"
+
+/*
+ * Per-conversion stage timer and allocation counter (--profile).
+ *
+ * 時間は排他的に数える: opl3_profile_enter() で今のステージまでの経過を
+ * そのステージに足してから切り替え、opl3_profile_leave() で元に戻す。
+ * YM2413 処理の中から呼ばれる duplicate_write_opl3 の時間は YM2413 側から
+ * 引かれるので、全ステージの合計が変換の実時間になる。
+ *
+ * VGMContext.p_profile が NULL (既定) なら記録点はポインタの NULL チェックだけ。
+ * 確保の回数とバイト数は opl3_profile_allocator() が返すアロケータを
+ * ジョブのアロケータの代わりに使って数える。
+ */
+
+typedef enum {
+    OPL3_PROFILE_IDLE = 0,          /* between API calls (not reported); the rest follow ESEOPL3_STAGE_* */
+    OPL3_PROFILE_PARSE,             /* header, IR lowering */
+    OPL3_PROFILE_CONVERT,           /* command dispatch, waits, passthrough, checkpoints */
+    OPL3_PROFILE_YM2413,            /* opll2opl3 handler and scheduler (minus the OPL3 writes) */
+    OPL3_PROFILE_OPL3_WRITE,        /* duplicate_write_opl3 */
+    OPL3_PROFILE_MERGE,             /* 2xYM2413 / --fm-mix merge */
+    OPL3_PROFILE_GD3,
+    OPL3_PROFILE_HEADER,
+    OPL3_PROFILE_NUM_STAGES
+} OPL3ProfileStage;
+
+typedef struct OPL3Profile {
+    uint64_t ns[OPL3_PROFILE_NUM_STAGES];
+    uint64_t calls[OPL3_PROFILE_NUM_STAGES];
+    OPL3ProfileStage stage;         /* the stage the clock runs for */
+    uint64_t mark_ns;               /* last switch */
+    uint64_t commands;              /* input commands converted */
+    /* allocations through opl3_profile_allocator() */
+    uint64_t allocs;
+    uint64_t reallocs;
+    uint64_t frees;
+    uint64_t alloc_bytes;           /* requested by allocations and growth */
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+    OPL3Allocator        counted;
+    const OPL3Allocator *p_parent;
+} OPL3Profile;
+
+#ifndef DISABLE_OPL3_PROFILE
+#if defined(__GNUC__)
+#define OPL3_PROFILE_ON(p) __builtin_expect((p) != NULL, 0)
+#else
+#define OPL3_PROFILE_ON(p) ((p) != NULL)
+#endif
+#else
+#define OPL3_PROFILE_ON(p) 0
+#endif
+
+/** Zero everything and start the clock in OPL3_PROFILE_IDLE. */
+void opl3_profile_init(OPL3Profile *p_prof);
+
+/** Switch to `stage`; returns the stage to hand back to opl3_profile_leave(). */
+static inline OPL3ProfileStage opl3_profile_enter(OPL3Profile *p_prof, OPL3ProfileStage stage) {
+    uint64_t now = opl3_now_ns();
+    OPL3ProfileStage prev = p_prof->stage;
+    p_prof->ns[prev] += now - p_prof->mark_ns;
+    p_prof->mark_ns = now;
+    p_prof->stage = stage;
+    p_prof->calls[stage]++;
+    return prev;
+}
+
+static inline void opl3_profile_leave(OPL3Profile *p_prof, OPL3ProfileStage prev) {
+    uint64_t now = opl3_now_ns();
+    p_prof->ns[p_prof->stage] += now - p_prof->mark_ns;
+    p_prof->mark_ns = now;
+    p_prof->stage = prev;
+}
+
+/** An allocator that counts into p_prof and forwards to p_parent (NULL = libc). */
+const OPL3Allocator *opl3_profile_allocator(OPL3Profile *p_prof, const OPL3Allocator *p_parent);
+
+#endif /* OPL3_PROFILE_H */
@@ -0,0 +1,19 @@
+#include "opl3_ring.h"
+#include <stdlib.h>
+
+int opl3_ring_init(OPL3Ring *p_ring, uint32_t capacity) {
+    uint32_t size = 2;
+    while (size < capacity && size < 0x80000000u) size <<= 1;
+    p_ring->p_slots = (OPL3RingWrite *)calloc(size, sizeof(OPL3RingWrite));
+    if (!p_ring->p_slots) return -1;
+    p_ring->mask = size - 1;
+    atomic_init(&p_ring->head, 0);
+    atomic_init(&p_ring->tail, 0);
+    return 0;
+}
+
+void opl3_ring_free(OPL3Ring *p_ring) {
+    free(p_ring->p_slots);
+    p_ring->p_slots = NULL;
+    p_ring->mask = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef OPL3_RING_H
+#define OPL3_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * Lock-free single-producer / single-consumer queue of OPL3 register writes.
+ *
+ * 変換スレッド (producer) が push し、再生スレッド (consumer) が pop する。
+ * スロットは opl3_ring_init() で一度だけ確保するので push/pop はメモリ確保も
+ * ロックもしない。head は producer だけ、tail は consumer だけが書き、
+ * release/acquire でスロットの中身を受け渡す。
+ */
+
+typedef struct {
+    uint32_t sample;        /* output timeline position (44.1 kHz) */
+    uint8_t  port;
+    uint8_t  reg;
+    uint8_t  val;
+    uint8_t  reserved;
+    uint64_t queued_ns;     /* opl3_now_ns() at push (queueing latency) */
+} OPL3RingWrite;
+
+#define OPL3_RING_CACHE_LINE 64
+
+typedef struct {
+    _Alignas(OPL3_RING_CACHE_LINE) _Atomic uint32_t head;   /* next slot to fill (producer) */
+    _Alignas(OPL3_RING_CACHE_LINE) _Atomic uint32_t tail;   /* next slot to read (consumer) */
+    _Alignas(OPL3_RING_CACHE_LINE) OPL3RingWrite *p_slots;
+    uint32_t mask;                                          /* capacity - 1 */
+} OPL3Ring;
+
+/** Allocate the slots; capacity is rounded up to a power of two. Returns 0, or -1 on OOM. */
+int  opl3_ring_init(OPL3Ring *p_ring, uint32_t capacity);
+void opl3_ring_free(OPL3Ring *p_ring);
+
+/** Producer: queue one write. Returns false when the ring is full (nothing queued). */
+static inline bool opl3_ring_push(OPL3Ring *p_ring, const OPL3RingWrite *p_w) {
+    uint32_t head = atomic_load_explicit(&p_ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&p_ring->tail, memory_order_acquire);
+    if (head - tail > p_ring->mask) return false;
+    p_ring->p_slots[head & p_ring->mask] = *p_w;
+    atomic_store_explicit(&p_ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+/** Consumer: take the oldest write. Returns false when the ring is empty. */
+static inline bool opl3_ring_pop(OPL3Ring *p_ring, OPL3RingWrite *p_w) {
+    uint32_t tail = atomic_load_explicit(&p_ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&p_ring->head, memory_order_acquire);
+    if (tail == head) return false;
+    *p_w = p_ring->p_slots[tail & p_ring->mask];
+    atomic_store_explicit(&p_ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/** Writes currently queued (exact only on the producer or consumer side). */
+static inline uint32_t opl3_ring_count(OPL3Ring *p_ring) {
+    return atomic_load_explicit(&p_ring->head, memory_order_acquire) -
+           atomic_load_explicit(&p_ring->tail, memory_order_acquire);
+}
+
+#endif /* OPL3_RING_H */
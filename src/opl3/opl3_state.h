@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "opl3_mem.h"
 
 #define OPL3_DB_INITIAL_SIZE 64
 #define OPL3_NUM_CHANNELS    18   // 9 (port0) + 9 (port1)
@@ -27,16 +28,73 @@ typedef struct OPL3VoiceParam {
     int     source_fmchip;
 } OPL3VoiceParam;
 
+/**
+ * Packed operator register image (one byte per OPL3 operator register).
+ * Bytes are stored exactly as written to 20h/40h/60h/80h/E0h + slot.
+ */
+typedef struct OPL3OpRegs {
+    uint8_t r20;   // AM/VIB/EGT/KSR/MULT
+    uint8_t r40;   // KSL/TL
+    uint8_t r60;   // AR/DR
+    uint8_t r80;   // SL/RR
+    uint8_t rE0;   // WS
+} OPL3OpRegs;
+
+/**
+ * Packed voice register image mirroring the OPL3 register layout.
+ * 4 operators x 5 bytes + C0h per 2-op pair = 24 bytes, no padding holes,
+ * so two images can be compared or hashed with memcmp()/word compares.
+ */
+typedef struct OPL3VoiceRegs {
+    OPL3OpRegs op[4];      // [0]=mod, [1]=car, [2-3]=future 4op
+    uint8_t    c0[2];      // CHD..CHA/FB/CNT per 2-op pair
+    uint8_t    is_4op;
+    uint8_t    reserved;   // keep sizeof == 24 (always 0)
+} OPL3VoiceRegs;
+
 typedef struct OPL3VoiceDB {
     int count;
     int capacity;
     OPL3VoiceParam *p_voices;
+    OPL3VoiceRegs  *p_keys;   // packed compare keys (TL/CNT masked), parallel to p_voices
+    const OPL3Allocator *p_alloc;   // NULL = malloc; set before the first insert
 } OPL3VoiceDB;
 
+/** A/B write order used when rewriting FNUM/KEYON (per conversion, see opl3_init) */
+typedef enum {
+    FREQSEQ_BAB = 0, // B(OFF) -> A -> B(POST)
+    FREQSEQ_AB  = 1  // A -> B(POST), for hardware experiment use
+} FreqSeqMode;
+
+/*
+ * Dense per-port OPL3 register file.
+ * 0x00..0xFF のうち実在するアドレス (0x00-08, 20-35, 40-55, 60-75, 80-95,
+ * A0-A8, B0-B8, BD, C0-C8, E0-F5) だけを詰めて保持する: 147 slots/port。
+ * 存在しないアドレスへの書き込みはミラーに残らない (読み出しは 0)。
+ */
+#define OPL3_REGFILE_SLOTS   147
+#define OPL3_REG_SLOT_NONE   (-1)
+
+/** Map a per-port register number to its dense slot (OPL3_REG_SLOT_NONE if it does not exist). */
+static inline int opl3_reg_slot(uint8_t reg) {
+    if (reg <= 0x08) return reg;                                  //   0..8
+    if (reg < 0x20) return OPL3_REG_SLOT_NONE;
+    if (reg < 0xA0) {                                             //   9..96 (20/40/60/80)
+        int lo = reg & 0x1F;
+        return (lo <= 0x15) ? 9 + ((reg >> 5) - 1) * 22 + lo : OPL3_REG_SLOT_NONE;
+    }
+    if (reg <= 0xA8) return 97 + (reg - 0xA0);                    //  97..105
+    if (reg >= 0xB0 && reg <= 0xB8) return 106 + (reg - 0xB0);    // 106..114
+    if (reg == 0xBD) return 115;                                  // 115
+    if (reg >= 0xC0 && reg <= 0xC8) return 116 + (reg - 0xC0);    // 116..124
+    if (reg >= 0xE0 && reg <= 0xF5) return 125 + (reg - 0xE0);    // 125..146
+    return OPL3_REG_SLOT_NONE;
+}
+
 /** Main OPL3 register/state mirror */
 typedef struct {
-    uint8_t  reg[0x200];
-    uint8_t  reg_stamp[0x200];
+    uint8_t  reg[2][OPL3_REGFILE_SLOTS];  // dense register file per port (use opl3_reg_get/set)
+    uint8_t  b0_stamp[2][9];              // B0-B8 value before the latest write (KeyOn edge detect)
     uint8_t     last_key[OPL3_NUM_CHANNELS];     // true=KeyOn, false=KeyOff
     uint32_t post_keyon_sample[OPL3_NUM_CHANNELS];
     uint32_t post_keyon_valid[OPL3_NUM_CHANNELS];
@@ -48,6 +106,23 @@ typedef struct {
     uint8_t staged_fnum_lsb[OPL3_NUM_CHANNELS];  // Staged A0 values per channel
     bool staged_fnum_valid[OPL3_NUM_CHANNELS];   // Whether staged A0 value is valid
     int pair_an_bn_enabled; // 1: Pearing enabled, 0: Pearing disabled
+    FreqSeqMode freqseq_mode;
 } OPL3State;
 
+/** Read the mirror; addr = port * 0x100 + reg. Non-existent registers read as 0. */
+static inline uint8_t opl3_reg_get(const OPL3State *p_st, int addr) {
+    int slot = opl3_reg_slot((uint8_t)addr);
+    return (slot == OPL3_REG_SLOT_NONE) ? 0 : p_st->reg[(addr >> 8) & 1][slot];
+}
+
+/** Update the mirror; addr = port * 0x100 + reg. Keeps b0_stamp for B0-B8. */
+static inline void opl3_reg_set(OPL3State *p_st, int addr, uint8_t val) {
+    int port = (addr >> 8) & 1;
+    uint8_t reg = (uint8_t)addr;
+    int slot = opl3_reg_slot(reg);
+    if (slot == OPL3_REG_SLOT_NONE) return;
+    if (reg >= 0xB0 && reg <= 0xB8) p_st->b0_stamp[port][reg - 0xB0] = p_st->reg[port][slot];
+    p_st->reg[port][slot] = val;
+}
+
 #endif /* ESEOPL3PATCHER_OPL3_STATE_H */
\ No newline at end of file
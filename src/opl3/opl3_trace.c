@@ -0,0 +1,221 @@
+#include "opl3_trace.h"
+#include <string.h>
+
+_Static_assert(sizeof(OPL3TraceRecord) == 16, "trace records are 16 bytes");
+
+#define TRACE_MAGIC   "OPL3TRC"
+#define TRACE_VERSION 1
+#define TRACE_FLAG_RING 0x01u
+
+/** File header; the records follow. */
+typedef struct {
+    char     magic[8];
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t flags;
+    uint64_t recorded;      /* records made during the conversion */
+    uint64_t dropped;       /* of those, not in the file (older than the ring) */
+} TraceFileHeader;
+
+static int trace_write_header(OPL3Trace *p_trace, uint64_t dropped) {
+    TraceFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    hdr.version = TRACE_VERSION;
+    hdr.record_size = (uint16_t)sizeof(OPL3TraceRecord);
+    hdr.flags = p_trace->is_stream ? 0 : TRACE_FLAG_RING;
+    hdr.recorded = p_trace->head;
+    hdr.dropped = dropped;
+    if (fseek(p_trace->fp, 0, SEEK_SET) != 0) return -1;
+    return fwrite(&hdr, sizeof(hdr), 1, p_trace->fp) == 1 ? 0 : -1;
+}
+
+OPL3Trace *opl3_trace_open(const char *p_path, uint32_t ring_records, bool is_stream, const OPL3Allocator *p_alloc) {
+    if (ring_records == 0) ring_records = OPL3_TRACE_STREAM_RECORDS;
+    if (ring_records > (1u << 30)) ring_records = 1u << 30;
+    uint32_t capacity = 1;
+    while (capacity < ring_records) capacity <<= 1;
+
+    OPL3Trace *p_trace = (OPL3Trace *)opl3_mem_calloc(p_alloc, sizeof(OPL3Trace));
+    if (!p_trace) return NULL;
+    p_trace->p_alloc = p_alloc;
+    p_trace->mask = capacity - 1;
+    p_trace->is_stream = is_stream;
+    p_trace->p_ring = (OPL3TraceRecord *)opl3_mem_alloc(p_alloc, (size_t)capacity * sizeof(OPL3TraceRecord));
+    p_trace->fp = p_trace->p_ring ? fopen(p_path, "wb") : NULL;
+    if (!p_trace->fp || trace_write_header(p_trace, 0) != 0) {
+        if (p_trace->fp) fclose(p_trace->fp);
+        opl3_mem_free(p_alloc, p_trace->p_ring, (size_t)capacity * sizeof(OPL3TraceRecord));
+        opl3_mem_free(p_alloc, p_trace, sizeof(OPL3Trace));
+        return NULL;
+    }
+    return p_trace;
+}
+
+void opl3_trace_spill(OPL3Trace *p_trace) {
+    // written is a multiple of the capacity, so the pending records start at index 0
+    size_t n = (size_t)(p_trace->head - p_trace->written);
+    if (fwrite(p_trace->p_ring, sizeof(OPL3TraceRecord), n, p_trace->fp) != n) p_trace->is_failed = true;
+    p_trace->written = p_trace->head;
+}
+
+int opl3_trace_close(OPL3Trace *p_trace) {
+    if (!p_trace) return 0;
+    uint64_t capacity = (uint64_t)p_trace->mask + 1;
+    uint64_t dropped = 0;
+    if (p_trace->is_stream) {
+        if (p_trace->head > p_trace->written) opl3_trace_spill(p_trace);
+    } else {
+        // Flight recorder: the newest records, oldest first
+        uint64_t n = (p_trace->head < capacity) ? p_trace->head : capacity;
+        uint64_t first = p_trace->head - n;
+        dropped = first;
+        size_t start = (size_t)(first & p_trace->mask);
+        size_t n1 = (size_t)((start + n > capacity) ? capacity - start : n);
+        if (fwrite(p_trace->p_ring + start, sizeof(OPL3TraceRecord), n1, p_trace->fp) != n1) p_trace->is_failed = true;
+        if (n1 < n && fwrite(p_trace->p_ring, sizeof(OPL3TraceRecord), (size_t)n - n1, p_trace->fp) != (size_t)n - n1) {
+            p_trace->is_failed = true;
+        }
+    }
+    if (trace_write_header(p_trace, dropped) != 0) p_trace->is_failed = true;
+    if (fclose(p_trace->fp) != 0) p_trace->is_failed = true;
+    int rc = p_trace->is_failed ? -1 : 0;
+    const OPL3Allocator *p_alloc = p_trace->p_alloc;
+    opl3_mem_free(p_alloc, p_trace->p_ring, (size_t)capacity * sizeof(OPL3TraceRecord));
+    opl3_mem_free(p_alloc, p_trace, sizeof(OPL3Trace));
+    return rc;
+}
+
+static const char *const k_sched_tags[OPL3_TRACE_NUM_TAGS][2] = {
+    { "FLUSH",  "Burst" },
+    { "HANDLE", "FNUM Low" },
+    { "HANDLE", "FNUM High/Key" },
+    { "HANDLE", "Instrument/Volume" },
+};
+
+static const char *const k_block_names[3] = { "port0/port1", "60h block", "80h block" };
+
+static void trace_render_seq(const OPL3TraceRecord *p_rec, FILE *fp) {
+    int port = (p_rec->y & OPL3_TRACE_SEQ_PORT1) ? 1 : 0;
+    int rhythm = (p_rec->y & OPL3_TRACE_SEQ_RHYTHM) ? 1 : 0;
+    const char *p_key = (p_rec->y & OPL3_TRACE_SEQ_KEYED) ? "KeyOn" : "KeyOff";
+    uint8_t a = p_rec->reg, b = p_rec->val;
+    switch (p_rec->x) {
+    case OPL3_TRACE_SEQ_A_ONLY:
+        fprintf(fp, "[SEQ%d] ch=%d %s A=%02X (rhythm=%d) port%d: A(%02X)\n", port, p_rec->ch, p_key, a, rhythm, port, a);
+        break;
+    case OPL3_TRACE_SEQ_KEYON:
+        fprintf(fp, "[SEQ%d] ch=%d KeyOff -> KeyOn A=%02X B=%02X (rhythm=%d) port%d: A(%02X)->B(%02X)\n",
+                port, p_rec->ch, a, b, rhythm, port, a, b);
+        break;
+    case OPL3_TRACE_SEQ_KEYOFF:
+        fprintf(fp, "[SEQ%d] ch=%d KeyOn -> KeyOff A=%02X B=%02X (rhythm=%d) port%d: B(%02X)->A(%02X)\n",
+                port, p_rec->ch, a, b, rhythm, port, b, a);
+        break;
+    default:
+        fprintf(fp, "[SEQ%d] ch=%d %s mode=%s A=%02X B=%02X (rhythm=%d) ",
+                port, p_rec->ch, p_key, (p_rec->x == OPL3_TRACE_SEQ_BAB) ? "BAB" : "AB", a, b, rhythm);
+        if (p_rec->x == OPL3_TRACE_SEQ_BAB) {
+            fprintf(fp, "port%d: B(%02X)->A(%02X)->B(%02X)\n", port, b, a, b);
+        } else if (p_rec->x == OPL3_TRACE_SEQ_AB) {
+            fprintf(fp, "port%d: A(%02X)->B(%02X)\n", port, a, b);
+        }
+        break;
+    }
+}
+
+static void trace_render_voice(const OPL3TraceRecord *p_rec, FILE *fp) {
+    int ch = p_rec->ch & 0x0F, op = p_rec->ch >> 4;
+    fprintf(fp, "[DEBUG][Apply Voice] Ch %d Reg0x%02X : ", ch, p_rec->reg);
+    switch (p_rec->x) {
+    case OPL3_TRACE_VOICE_20:
+        fprintf(fp, "Op %d AM: %s, Vibrato: %s, KSR: %s, EG Type: %d, Freq Multipler: %d\n", op,
+                (p_rec->val & 0x01) ? "On" : "Off", (p_rec->val & 0x02) ? "On" : "Off", (p_rec->val & 0x04) ? "On" : "Off",
+                p_rec->arg, p_rec->y);
+        break;
+    case OPL3_TRACE_VOICE_40:
+        fprintf(fp, "Op %d Key Scaling: %d, Total Level: 0x%02x\n", op, p_rec->val, p_rec->y);
+        break;
+    case OPL3_TRACE_VOICE_60:
+        fprintf(fp, "Op %d Attack Rate: %X, Decay Rate: %X\n", op, p_rec->val, p_rec->y);
+        break;
+    case OPL3_TRACE_VOICE_80:
+        fprintf(fp, "Op %d Sustain Level: %X, Release Rate: %X\n", op, p_rec->val, p_rec->y);
+        break;
+    default:
+        fprintf(fp, "Waveform Select: %X\n", p_rec->val);
+        break;
+    }
+}
+
+void opl3_trace_render(const OPL3TraceRecord *p_rec, FILE *fp) {
+    switch (p_rec->code) {
+    case OPL3_TRACE_MAIN_WAIT:
+        fprintf(fp, "\n[MAIN] call opll2opl3_command_handler: cmd=0x%02X type=%d reg=0x%02X val=0x%02X wait=%d\n",
+                p_rec->reg, p_rec->val, 0, 0, p_rec->arg);
+        break;
+    case OPL3_TRACE_HANDLER:
+        fprintf(fp, "\n[OPLL2OPL3][HANDLER][%s] virtual_time:%llu emit_time:%llu --- reg:0x%02x val:0x%02x Sample:%d\n",
+                p_rec->x ? "RegWrite" : "Wait", (unsigned long long)p_rec->time, (unsigned long long)p_rec->emit,
+                p_rec->reg, p_rec->val, p_rec->arg);
+        break;
+    case OPL3_TRACE_SCHED: {
+        int tag = (p_rec->x < OPL3_TRACE_NUM_TAGS) ? p_rec->x : 0;
+        uint16_t f = p_rec->arg;
+        fprintf(fp, "[OPLL2OPL3][%s][%s] virtual_time:%llu emit_time:%llu ch=%d TL(%d) Voice(%d) FnumL(%d) --- "
+                "Active %d Pending %d PendingOff %d PrevKey %d KeyNow %d\n",
+                k_sched_tags[tag][0], k_sched_tags[tag][1], (unsigned long long)p_rec->time, (unsigned long long)p_rec->emit,
+                p_rec->ch, !!(f & OPL3_TRACE_SCHED_TL), !!(f & OPL3_TRACE_SCHED_VOICE), !!(f & OPL3_TRACE_SCHED_FNUM_LOW),
+                !!(f & OPL3_TRACE_SCHED_ACTIVE), !!(f & OPL3_TRACE_SCHED_PENDING), !!(f & OPL3_TRACE_SCHED_PENDING_OFF),
+                !!(f & OPL3_TRACE_SCHED_PREV_KEY), !!(f & OPL3_TRACE_SCHED_KEY_NOW));
+        break;
+    }
+    case OPL3_TRACE_EMIT_WRITE:
+        fprintf(fp, "[EMIT][Reg Write] time=%u addr=%02X val=%02X emit_time=%u\n",
+                (unsigned)p_rec->time, p_rec->reg, p_rec->val, (unsigned)p_rec->emit);
+        break;
+    case OPL3_TRACE_EMIT_WAIT:
+        if (p_rec->x) {
+            fprintf(fp, "[EMIT][WAIT] emit_time advanced by %u -> %u\n", (unsigned)p_rec->arg, (unsigned)p_rec->emit);
+        } else {
+            fprintf(fp, "[EMIT][WAIT] emit_time was ignored by samples = %u\n", (unsigned)p_rec->arg);
+        }
+        break;
+    case OPL3_TRACE_OPL3_WRITE:
+        fprintf(fp, "[OPL3] Write reg=%02X val=%02X ch=%d (%s)\n", p_rec->reg, p_rec->val, p_rec->ch,
+                k_block_names[p_rec->x < 3 ? p_rec->x : 0]);
+        break;
+    case OPL3_TRACE_SEQ:
+        trace_render_seq(p_rec, fp);
+        break;
+    case OPL3_TRACE_VOICE:
+        trace_render_voice(p_rec, fp);
+        break;
+    default:
+        fprintf(fp, "[TRACE] unknown code %u at sample %u\n", p_rec->code, (unsigned)p_rec->time);
+        break;
+    }
+}
+
+int opl3_trace_decode(const char *p_path, FILE *fp_out) {
+    FILE *fp = fopen(p_path, "rb");
+    if (!fp) return -1;
+    TraceFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        hdr.version != TRACE_VERSION || hdr.record_size != sizeof(OPL3TraceRecord)) {
+        fclose(fp);
+        return -1;
+    }
+    if (hdr.dropped) {
+        fprintf(stderr, "[TRACE] ring trace: %llu older records of %llu were not kept\n",
+                (unsigned long long)hdr.dropped, (unsigned long long)hdr.recorded);
+    }
+    OPL3TraceRecord recs[256];
+    size_t n;
+    while ((n = fread(recs, sizeof(OPL3TraceRecord), 256, fp)) > 0) {
+        for (size_t i = 0; i < n; ++i) opl3_trace_render(&recs[i], fp_out);
+    }
+    int rc = ferror(fp) ? -1 : 0;
+    fclose(fp);
+    return rc;
+}
@@ -0,0 +1,174 @@
+#ifndef OPL3_TRACE_H
+#define OPL3_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "opl3_mem.h"
+
+/*
+ * Binary trace of the converter's debug events.
+ *
+ * -verbose のデバッグ出力 ([MAIN] / [OPLL2OPL3] / [EMIT] / [OPL3] / [SEQ0] / [SEQ1] /
+ * [DEBUG][Apply Voice]) は、すべて 16 バイト固定長のレコードを作ってから出す。
+ * VGMContext.p_trace が開いていればレコードをリングに積み (書式化も I/O もしない)、
+ * -verbose なら同じレコードを opl3_trace_render() で従来どおりの文字列にして stderr へ出す。
+ * トレースファイルは opl3_trace_decode() で -verbose と同じテキストに戻せる。
+ *
+ * ファイルに全部残すモードではリングが一杯になるたびに 1 回の fwrite で書き出す。
+ * リングモードでは直近の capacity 件だけを残し、close 時に書く (フライトレコーダ)。
+ *
+ * ビルド時のログレベル OPL3_LOG_LEVEL:
+ *   OPL3_LOG_TEXT  (既定) トレースと -verbose のテキスト
+ *   OPL3_LOG_TRACE  トレースのみ (テキスト化と stderr への出力はコードごと消える)
+ *   OPL3_LOG_NONE   どちらも消える
+ */
+
+#define OPL3_LOG_NONE  0
+#define OPL3_LOG_TRACE 1
+#define OPL3_LOG_TEXT  2
+#ifndef OPL3_LOG_LEVEL
+#define OPL3_LOG_LEVEL OPL3_LOG_TEXT
+#endif
+
+// Records buffered between two writes when every record goes to the file
+#define OPL3_TRACE_STREAM_RECORDS 4096
+
+/** Event codes (OPL3TraceRecord.code). */
+typedef enum {
+    OPL3_TRACE_MAIN_WAIT = 1,   /* reg = VGM command, val = command type, arg = wait */
+    OPL3_TRACE_HANDLER,         /* OPLL command in: reg, val, arg = wait, x = 1 for a register write */
+    OPL3_TRACE_SCHED,           /* scheduler channel state: x = OPL3TraceSchedTag, arg = OPL3_TRACE_SCHED_* flags */
+    OPL3_TRACE_EMIT_WRITE,      /* scheduled OPL3 write: reg, val */
+    OPL3_TRACE_EMIT_WAIT,       /* arg = samples, x = 1 if emit_time advanced */
+    OPL3_TRACE_OPL3_WRITE,      /* operator write: reg, val, x = OPL3TraceWriteBlock */
+    OPL3_TRACE_SEQ,             /* A/B sequence: reg = A, val = B, x = OPL3TraceSeqKind, y = OPL3_TRACE_SEQ_* flags */
+    OPL3_TRACE_VOICE,           /* applied voice: reg = register value, x = line (OPL3TraceVoiceLine), val/y/arg = fields */
+    OPL3_TRACE_NUM_CODES
+} OPL3TraceCode;
+
+typedef enum {
+    OPL3_TRACE_TAG_FLUSH_BURST = 0,
+    OPL3_TRACE_TAG_FNUM_LOW,
+    OPL3_TRACE_TAG_FNUM_HIGH_KEY,
+    OPL3_TRACE_TAG_INST_VOL,
+    OPL3_TRACE_NUM_TAGS
+} OPL3TraceSchedTag;
+
+/* OPL3_TRACE_SCHED flags */
+#define OPL3_TRACE_SCHED_TL         0x01
+#define OPL3_TRACE_SCHED_VOICE      0x02
+#define OPL3_TRACE_SCHED_FNUM_LOW   0x04
+#define OPL3_TRACE_SCHED_ACTIVE     0x08
+#define OPL3_TRACE_SCHED_PENDING    0x10
+#define OPL3_TRACE_SCHED_PENDING_OFF 0x20
+#define OPL3_TRACE_SCHED_PREV_KEY   0x40
+#define OPL3_TRACE_SCHED_KEY_NOW    0x80
+
+typedef enum {
+    OPL3_TRACE_BLOCK_40 = 0,    /* KSL/TL to port0 and port1 */
+    OPL3_TRACE_BLOCK_60,
+    OPL3_TRACE_BLOCK_80
+} OPL3TraceWriteBlock;
+
+typedef enum {
+    OPL3_TRACE_SEQ_A_ONLY = 0,  /* A while keyed on (aligned A0/B0) */
+    OPL3_TRACE_SEQ_KEYON,       /* KeyOff -> KeyOn: A then B */
+    OPL3_TRACE_SEQ_KEYOFF,      /* KeyOn -> KeyOff: B then A */
+    OPL3_TRACE_SEQ_BAB,         /* no key change, BAB mode */
+    OPL3_TRACE_SEQ_AB,          /* no key change, AB mode */
+    OPL3_TRACE_SEQ_B_ONLY       /* no key change, AB mode without A0/B0 alignment (port0) */
+} OPL3TraceSeqKind;
+
+/* OPL3_TRACE_SEQ flags */
+#define OPL3_TRACE_SEQ_PORT1    0x01
+#define OPL3_TRACE_SEQ_RHYTHM   0x02
+#define OPL3_TRACE_SEQ_KEYED    0x04    /* key bit before this write */
+
+typedef enum {
+    OPL3_TRACE_VOICE_20 = 0,    /* val = AM | VIB << 1 | KSR << 2 (set/clear), y = MULT, arg = EGT << 5 */
+    OPL3_TRACE_VOICE_40,        /* val = KSL, y = TL */
+    OPL3_TRACE_VOICE_60,        /* val = AR, y = DR */
+    OPL3_TRACE_VOICE_80,        /* val = SL, y = RR */
+    OPL3_TRACE_VOICE_E0         /* val = WS */
+} OPL3TraceVoiceLine;
+
+/** One event (16 bytes, written to the file as is: little-endian hosts). */
+typedef struct {
+    uint32_t time;      /* scheduler virtual_time, or the output sample outside the scheduler */
+    uint32_t emit;      /* scheduler emit_time */
+    uint16_t arg;
+    uint8_t  code;      /* OPL3TraceCode */
+    uint8_t  ch;        /* OPL3_TRACE_VOICE: ch | op << 4 */
+    uint8_t  reg;
+    uint8_t  val;
+    uint8_t  x;
+    uint8_t  y;
+} OPL3TraceRecord;
+
+typedef struct OPL3Trace {
+    OPL3TraceRecord *p_ring;
+    uint32_t         mask;          /* capacity - 1 (power of two) */
+    uint64_t         head;          /* records recorded */
+    uint64_t         written;       /* records already in the file (stream mode) */
+    bool             is_stream;     /* every record reaches the file; otherwise the last capacity are kept */
+    bool             is_failed;     /* a write failed: recording goes on, close reports it */
+    FILE            *fp;
+    const OPL3Allocator *p_alloc;
+} OPL3Trace;
+
+#ifndef DISABLE_OPL3_TRACE
+#if defined(__GNUC__)
+#define OPL3_TRACE_ON(p) __builtin_expect((p) != NULL, 0)
+#else
+#define OPL3_TRACE_ON(p) ((p) != NULL)
+#endif
+#else
+#define OPL3_TRACE_ON(p) 0
+#endif
+
+/** Worth building a record: a trace is open, or (text builds) -verbose wants the line. */
+#if OPL3_LOG_LEVEL >= OPL3_LOG_TEXT
+#define OPL3_TRACE_WANTED(p_trace, is_verbose) (OPL3_TRACE_ON(p_trace) || (is_verbose))
+#elif OPL3_LOG_LEVEL >= OPL3_LOG_TRACE
+#define OPL3_TRACE_WANTED(p_trace, is_verbose) OPL3_TRACE_ON(p_trace)
+#else
+#define OPL3_TRACE_WANTED(p_trace, is_verbose) 0
+#endif
+
+/**
+ * Create p_path and a ring of ring_records (rounded up to a power of two).
+ * is_stream: every record goes to the file (ring_records 0 = OPL3_TRACE_STREAM_RECORDS);
+ * otherwise only the last ring_records are written at close. NULL on failure.
+ */
+OPL3Trace *opl3_trace_open(const char *p_path, uint32_t ring_records, bool is_stream, const OPL3Allocator *p_alloc);
+
+/** Write what is left and the final header, then free. Returns 0, or -1 if the file is incomplete. */
+int  opl3_trace_close(OPL3Trace *p_trace);
+
+/** Stream mode: the ring is full, hand it to the file. */
+void opl3_trace_spill(OPL3Trace *p_trace);
+
+static inline void opl3_trace_push(OPL3Trace *p_trace, const OPL3TraceRecord *p_rec) {
+    p_trace->p_ring[p_trace->head & p_trace->mask] = *p_rec;
+    p_trace->head++;
+    if (p_trace->is_stream && p_trace->head - p_trace->written > p_trace->mask) opl3_trace_spill(p_trace);
+}
+
+/** The -verbose text of one record (the exact lines the converter used to print). */
+void opl3_trace_render(const OPL3TraceRecord *p_rec, FILE *fp);
+
+/** Record into p_trace (NULL = off) and, with -verbose, print the text on stderr. */
+static inline void opl3_trace_emit(OPL3Trace *p_trace, bool is_verbose, const OPL3TraceRecord *p_rec) {
+    if (OPL3_TRACE_ON(p_trace)) opl3_trace_push(p_trace, p_rec);
+#if OPL3_LOG_LEVEL >= OPL3_LOG_TEXT
+    if (is_verbose) opl3_trace_render(p_rec, stderr);
+#else
+    (void)is_verbose;
+#endif
+}
+
+/** Render a trace file as text. Returns 0, or -1 if it cannot be read or is not a trace. */
+int  opl3_trace_decode(const char *p_path, FILE *fp_out);
+
+#endif /* OPL3_TRACE_H */
@@ -1,60 +1,166 @@
 #include "opl3_voice.h"
 #include "opl3_convert.h"
+#include "opl3_hash.h"
 #include <string.h>
 #include <stdlib.h>
 
+/** Storage is allocated lazily on the first insert (most OPLL conversions never touch the DB). */
 void opl3_voice_db_init(OPL3VoiceDB *p_db) {
     p_db->count = 0;
-    p_db->capacity = OPL3_DB_INITIAL_SIZE;
-    p_db->p_voices = (OPL3VoiceParam*)calloc(p_db->capacity, sizeof(OPL3VoiceParam));
+    p_db->capacity = 0;
+    p_db->p_voices = NULL;
+    p_db->p_keys = NULL;
+    p_db->p_alloc = NULL;
 }
+/** The allocator is kept, so the DB can be refilled. */
 void opl3_voice_db_free(OPL3VoiceDB *p_db) {
-    if (p_db->p_voices) free(p_db->p_voices);
+    opl3_mem_free(p_db->p_alloc, p_db->p_voices, (size_t)p_db->capacity * sizeof(OPL3VoiceParam));
+    opl3_mem_free(p_db->p_alloc, p_db->p_keys, (size_t)p_db->capacity * sizeof(OPL3VoiceRegs));
     p_db->p_voices = NULL;
+    p_db->p_keys = NULL;
     p_db->count = 0;
     p_db->capacity = 0;
 }
 
+/** Register offset of the modulator slot for 2-op channel ch (0..8); carrier is +3. */
+static inline int opl3_mod_slot_offset(int ch) {
+    return (ch % 3) + (ch / 3) * 8;
+}
+
+void opl3_voice_pack(const OPL3VoiceParam *p_vp, OPL3VoiceRegs *p_out) {
+    memset(p_out, 0, sizeof(OPL3VoiceRegs));
+    int n_ops = p_vp->is_4op ? 4 : 2;
+    for (int op = 0; op < n_ops; ++op) {
+        const OPL3OpParam *s = &p_vp->op[op];
+        OPL3OpRegs *d = &p_out->op[op];
+        d->r20 = (uint8_t)(((s->am & 1) << 7) | ((s->vib & 1) << 6) | ((s->egt & 1) << 5) | ((s->ksr & 1) << 4) | (s->mult & 0x0F));
+        d->r40 = (uint8_t)(((s->ksl & 3) << 6) | (s->tl & 0x3F));
+        d->r60 = (uint8_t)(((s->ar & 0x0F) << 4) | (s->dr & 0x0F));
+        d->r80 = (uint8_t)(((s->sl & 0x0F) << 4) | (s->rr & 0x0F));
+        d->rE0 = (uint8_t)(s->ws & 0x07);
+    }
+    p_out->c0[0] = (uint8_t)(((p_vp->fb[0] & 0x07) << 1) | (p_vp->cnt[0] & 0x01));
+    if (p_vp->is_4op) {
+        p_out->c0[1] = (uint8_t)(((p_vp->fb[1] & 0x07) << 1) | (p_vp->cnt[1] & 0x01));
+    }
+    p_out->is_4op = p_vp->is_4op ? 1 : 0;
+}
+
+void opl3_voice_unpack(const OPL3VoiceRegs *p_regs, OPL3VoiceParam *p_out) {
+    memset(p_out, 0, sizeof(OPL3VoiceParam));
+    for (int op = 0; op < 4; ++op) {
+        const OPL3OpRegs *s = &p_regs->op[op];
+        OPL3OpParam *d = &p_out->op[op];
+        d->am   = opl3_op_am(s);
+        d->vib  = opl3_op_vib(s);
+        d->egt  = opl3_op_egt(s);
+        d->ksr  = opl3_op_ksr(s);
+        d->mult = opl3_op_mult(s);
+        d->ksl  = opl3_op_ksl(s);
+        d->tl   = opl3_op_tl(s);
+        d->ar   = opl3_op_ar(s);
+        d->dr   = opl3_op_dr(s);
+        d->sl   = opl3_op_sl(s);
+        d->rr   = opl3_op_rr(s);
+        d->ws   = opl3_op_ws(s);
+    }
+    for (int pair = 0; pair < 2; ++pair) {
+        p_out->fb[pair]  = opl3_voice_fb(p_regs, pair);
+        p_out->cnt[pair] = opl3_voice_cnt(p_regs, pair);
+    }
+    p_out->is_4op = p_regs->is_4op;
+}
+
+void opl3_voice_regs_from_state(const OPL3State *p_state, int ch, OPL3VoiceRegs *p_out) {
+    memset(p_out, 0, sizeof(OPL3VoiceRegs));
+    static const uint8_t bases[5] = {0x20, 0x40, 0x60, 0x80, 0xE0};
+    int slot[2] = { opl3_mod_slot_offset(ch), opl3_mod_slot_offset(ch) + 3 };
+    for (int op = 0; op < 2; ++op) {
+        uint8_t *d = &p_out->op[op].r20;
+        for (int i = 0; i < 5; ++i) d[i] = opl3_reg_get(p_state, bases[i] + slot[op]);
+    }
+    p_out->c0[0] = opl3_reg_get(p_state, 0xC0 + ch) & 0x0F;
+}
+
+void opl3_voice_regs_make_key(const OPL3VoiceRegs *p_regs, OPL3VoiceRegs *p_key) {
+    *p_key = *p_regs;
+    int n_ops = p_regs->is_4op ? 4 : 2;
+    for (int op = 0; op < 4; ++op) {
+        if (op >= n_ops) {
+            memset(&p_key->op[op], 0, sizeof(OPL3OpRegs));
+            continue;
+        }
+        p_key->op[op].r40 &= 0xC0;   // KSL only, TL excluded
+        p_key->op[op].rE0 &= 0x07;
+    }
+    p_key->c0[0] &= 0x0E;            // FB only, CNT excluded
+    p_key->c0[1] = p_regs->is_4op ? (uint8_t)(p_regs->c0[1] & 0x0E) : 0;
+    p_key->reserved = 0;
+}
+
+uint32_t opl3_voice_regs_hash(const OPL3VoiceRegs *p_regs) {
+    return opl3_fnv1a(OPL3_FNV1A_BASIS, p_regs, sizeof(OPL3VoiceRegs));
+}
+
+/**
+ * Same rule as opl3_voice_regs_make_key(), applied to the fields directly (nothing is packed per compare).
+ * The DB itself compares its stored keys; this is for callers holding two OPL3VoiceParam.
+ */
 int opl3_voice_param_cmp(const OPL3VoiceParam *a, const OPL3VoiceParam *b) {
     if (!a || !b) return 0;
+    if ((a->is_4op != 0) != (b->is_4op != 0)) return 0;
     int n_ops = a->is_4op ? 4 : 2;
     for (int op = 0; op < n_ops; ++op) {
-        if (a->op[op].am   != b->op[op].am)   return 0;
-        if (a->op[op].vib  != b->op[op].vib)  return 0;
-        if (a->op[op].egt  != b->op[op].egt)  return 0;
-        if (a->op[op].ksr  != b->op[op].ksr)  return 0;
-        if (a->op[op].mult != b->op[op].mult) return 0;
-        if (a->op[op].ksl  != b->op[op].ksl)  return 0;
-        if (a->op[op].ar   != b->op[op].ar)   return 0;
-        if (a->op[op].dr   != b->op[op].dr)   return 0;
-        if (a->op[op].sl   != b->op[op].sl)   return 0;
-        if (a->op[op].rr   != b->op[op].rr)   return 0;
-        if (a->op[op].ws   != b->op[op].ws)   return 0;
+        const OPL3OpParam *x = &a->op[op], *y = &b->op[op];
+        if (((x->am ^ y->am) | (x->vib ^ y->vib) | (x->egt ^ y->egt) | (x->ksr ^ y->ksr)) & 0x01) return 0;
+        if (((x->mult ^ y->mult) | (x->ar ^ y->ar) | (x->dr ^ y->dr) | (x->sl ^ y->sl) | (x->rr ^ y->rr)) & 0x0F) return 0;
+        if ((x->ksl ^ y->ksl) & 0x03) return 0;     // TL excluded
+        if ((x->ws ^ y->ws) & 0x07) return 0;
+    }
+    int n_pairs = a->is_4op ? 2 : 1;
+    for (int pair = 0; pair < n_pairs; ++pair) {
+        if ((a->fb[pair] ^ b->fb[pair]) & 0x07) return 0;     // CNT excluded
     }
-    if (a->is_4op != b->is_4op) return 0;
-    if (a->fb[0]  != b->fb[0])  return 0;
     return 1;
 }
 
+int opl3_voice_db_reserve(OPL3VoiceDB *p_db, int capacity) {
+    if (capacity <= p_db->capacity) return 0;
+    OPL3VoiceParam *p_voices = (OPL3VoiceParam*)opl3_mem_realloc(p_db->p_alloc, p_db->p_voices,
+        (size_t)p_db->capacity * sizeof(OPL3VoiceParam), (size_t)capacity * sizeof(OPL3VoiceParam));
+    if (!p_voices) return -1;
+    p_db->p_voices = p_voices;
+    OPL3VoiceRegs *p_keys = (OPL3VoiceRegs*)opl3_mem_realloc(p_db->p_alloc, p_db->p_keys,
+        (size_t)p_db->capacity * sizeof(OPL3VoiceRegs), (size_t)capacity * sizeof(OPL3VoiceRegs));
+    if (!p_keys) return -1;
+    p_db->p_keys = p_keys;
+    p_db->capacity = capacity;
+    return 0;
+}
+
 int opl3_voice_db_find_or_add(OPL3VoiceDB *p_db, OPL3VoiceParam *p_vp) {
+    OPL3VoiceRegs regs, key;
+    opl3_voice_pack(p_vp, &regs);
+    opl3_voice_regs_make_key(&regs, &key);
     for (int i = 0; i < p_db->count; ++i) {
-        if (opl3_voice_param_cmp(&p_db->p_voices[i], p_vp)) {
+        if (opl3_voice_regs_equal(&p_db->p_keys[i], &key)) {
             p_vp->voice_no = p_db->p_voices[i].voice_no;
             return p_db->p_voices[i].voice_no;
         }
     }
-    if (p_db->count >= p_db->capacity) {
-        p_db->capacity *= 2;
-        p_db->p_voices = (OPL3VoiceParam*)realloc(p_db->p_voices, p_db->capacity * sizeof(OPL3VoiceParam));
+    if (p_db->count >= p_db->capacity &&
+        opl3_voice_db_reserve(p_db, p_db->capacity ? p_db->capacity * 2 : OPL3_DB_INITIAL_SIZE) != 0) {
+        abort();
     }
     int new_voice_no = (p_db->count > 0) ? p_db->p_voices[p_db->count - 1].voice_no + 1 : 0;
     p_vp->voice_no = new_voice_no;
+    p_db->p_keys[p_db->count] = key;
     p_db->p_voices[p_db->count++] = *p_vp;
     return new_voice_no;
 }
 
 int is_4op_channel(const OPL3State *p_state, int ch) {
-    uint8_t reg_104 = p_state->reg[0x104];
+    uint8_t reg_104 = opl3_reg_get(p_state, 0x104);
     if (ch == 0 || ch == 3) return (reg_104 & 0x01) ? 1 : 0;
     if (ch == 1 || ch == 4) return (reg_104 & 0x02) ? 1 : 0;
     if (ch == 2 || ch == 5) return (reg_104 & 0x04) ? 1 : 0;
@@ -65,40 +171,16 @@ int get_opl3_channel_mode(const OPL3State *p_state, int ch) {
 }
 
 void extract_voice_param(const OPL3State *p_state, OPL3VoiceParam *p_out) {
-    memset(p_out, 0, sizeof(OPL3VoiceParam));
     int latest_keyon_ch = -1;
     for (int ch = 0; ch < 9; ++ch) { /* 2-OP 対象9chのみスキャン */
-        uint8_t reg_val = p_state->reg[0xB0 + ch];
+        uint8_t reg_val = opl3_reg_get(p_state, 0xB0 + ch);
         if (reg_val & 0x20) { latest_keyon_ch = ch; break; }
     }
     int ch = (latest_keyon_ch >= 0) ? latest_keyon_ch : 0;
 
-    static const int slot_table[9][2] = {
-        {0,3},{1,4},{2,5},{6,9},{7,10},{8,11},{12,15},{13,16},{14,17}
-    };
-    int slot_mod = slot_table[ch][0];
-    int slot_car = slot_table[ch][1];
-
-    /* Modulator */
-    uint8_t v;
-    OPL3OpParam *mod = &p_out->op[0];
-    v = p_state->reg[0x40 + slot_mod]; mod->tl  = v & 0x3F; mod->ksl = (v >> 6) & 0x03;
-    v = p_state->reg[0x20 + slot_mod]; mod->mult= v & 0x0F; mod->ksr = (v >> 4) & 1; mod->egt=(v>>5)&1; mod->vib=(v>>6)&1; mod->am=(v>>7)&1;
-    v = p_state->reg[0x60 + slot_mod]; mod->ar  = (v >> 4) & 0x0F; mod->dr = v & 0x0F;
-    v = p_state->reg[0x80 + slot_mod]; mod->sl  = (v >> 4) & 0x0F; mod->rr = v & 0x0F;
-    v = p_state->reg[0xE0 + slot_mod]; mod->ws  = v & 0x07;
-
-    /* Carrier */
-    OPL3OpParam *car = &p_out->op[1];
-    v = p_state->reg[0x40 + slot_car]; car->tl  = v & 0x3F; car->ksl = (v >> 6) & 0x03;
-    v = p_state->reg[0x20 + slot_car]; car->mult= v & 0x0F; car->ksr = (v >> 4) & 1; car->egt=(v>>5)&1; car->vib=(v>>6)&1; car->am=(v>>7)&1;
-    v = p_state->reg[0x60 + slot_car]; car->ar  = (v >> 4) & 0x0F; car->dr = v & 0x0F;
-    v = p_state->reg[0x80 + slot_car]; car->sl  = (v >> 4) & 0x0F; car->rr = v & 0x0F;
-    v = p_state->reg[0xE0 + slot_car]; car->ws  = v & 0x07;
-
-    v = p_state->reg[0xC0 + ch];
-    p_out->fb[0]  = (v >> 1) & 0x07;
-    p_out->cnt[0] = v & 0x01;
+    OPL3VoiceRegs regs;
+    opl3_voice_regs_from_state(p_state, ch, &regs);
+    opl3_voice_unpack(&regs, p_out);
     p_out->voice_no = ch;
     p_out->is_4op = 0;
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 #define ESEOPL3PATCHER_OPL3_VOICE_H
 
 #include "opl3_state.h"
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,11 +10,64 @@ extern "C" {
 
 void opl3_voice_db_init(OPL3VoiceDB *db);
 void opl3_voice_db_free(OPL3VoiceDB *db);
+int  opl3_voice_db_reserve(OPL3VoiceDB *db, int capacity); /* 0 / -1 (OOM); find_or_add は capacity まで確保しない */
 int  opl3_voice_db_find_or_add(OPL3VoiceDB *db, OPL3VoiceParam *vp); /* 非 const に統一 */
 int  opl3_voice_param_cmp(const OPL3VoiceParam *a, const OPL3VoiceParam *b);
 void extract_voice_param(const OPL3State *p_state, OPL3VoiceParam *out); /* const state */
 
+/* --- Packed register image (OPL3VoiceRegs) --- */
+
+/** Pack OPL3VoiceParam fields into register bytes (fields are masked to their bit widths). */
+void opl3_voice_pack(const OPL3VoiceParam *p_vp, OPL3VoiceRegs *p_out);
+
+/** Unpack register bytes into OPL3VoiceParam fields (voice_no/source_fmchip are left 0). */
+void opl3_voice_unpack(const OPL3VoiceRegs *p_regs, OPL3VoiceParam *p_out);
+
+/** Read the packed image of 2-op channel ch (0..8) directly from the register mirror. */
+void opl3_voice_regs_from_state(const OPL3State *p_state, int ch, OPL3VoiceRegs *p_out);
+
+/**
+ * Build the DB compare key: TL and CNT are masked out so that volume changes
+ * and connection do not create new voices (same rule as opl3_voice_param_cmp).
+ */
+void opl3_voice_regs_make_key(const OPL3VoiceRegs *p_regs, OPL3VoiceRegs *p_key);
+
+/** FNV-1a over the 24-byte image. */
+uint32_t opl3_voice_regs_hash(const OPL3VoiceRegs *p_regs);
+
+static inline int opl3_voice_regs_equal(const OPL3VoiceRegs *a, const OPL3VoiceRegs *b) {
+    return memcmp(a, b, sizeof(OPL3VoiceRegs)) == 0;
+}
+
+/* Field accessors (operator register byte -> field) */
+static inline uint8_t opl3_op_am  (const OPL3OpRegs *o) { return (o->r20 >> 7) & 0x01; }
+static inline uint8_t opl3_op_vib (const OPL3OpRegs *o) { return (o->r20 >> 6) & 0x01; }
+static inline uint8_t opl3_op_egt (const OPL3OpRegs *o) { return (o->r20 >> 5) & 0x01; }
+static inline uint8_t opl3_op_ksr (const OPL3OpRegs *o) { return (o->r20 >> 4) & 0x01; }
+static inline uint8_t opl3_op_mult(const OPL3OpRegs *o) { return  o->r20       & 0x0F; }
+static inline uint8_t opl3_op_ksl (const OPL3OpRegs *o) { return (o->r40 >> 6) & 0x03; }
+static inline uint8_t opl3_op_tl  (const OPL3OpRegs *o) { return  o->r40       & 0x3F; }
+static inline uint8_t opl3_op_ar  (const OPL3OpRegs *o) { return (o->r60 >> 4) & 0x0F; }
+static inline uint8_t opl3_op_dr  (const OPL3OpRegs *o) { return  o->r60       & 0x0F; }
+static inline uint8_t opl3_op_sl  (const OPL3OpRegs *o) { return (o->r80 >> 4) & 0x0F; }
+static inline uint8_t opl3_op_rr  (const OPL3OpRegs *o) { return  o->r80       & 0x0F; }
+static inline uint8_t opl3_op_ws  (const OPL3OpRegs *o) { return  o->rE0       & 0x07; }
+
+/* Field setters (replace one field, keep the rest of the byte) */
+static inline void opl3_op_set_tl  (OPL3OpRegs *o, uint8_t v) { o->r40 = (uint8_t)((o->r40 & 0xC0) | (v & 0x3F)); }
+static inline void opl3_op_set_ksl (OPL3OpRegs *o, uint8_t v) { o->r40 = (uint8_t)((o->r40 & 0x3F) | ((v & 0x03) << 6)); }
+static inline void opl3_op_set_ar  (OPL3OpRegs *o, uint8_t v) { o->r60 = (uint8_t)((o->r60 & 0x0F) | ((v & 0x0F) << 4)); }
+static inline void opl3_op_set_dr  (OPL3OpRegs *o, uint8_t v) { o->r60 = (uint8_t)((o->r60 & 0xF0) | (v & 0x0F)); }
+static inline void opl3_op_set_sl  (OPL3OpRegs *o, uint8_t v) { o->r80 = (uint8_t)((o->r80 & 0x0F) | ((v & 0x0F) << 4)); }
+static inline void opl3_op_set_rr  (OPL3OpRegs *o, uint8_t v) { o->r80 = (uint8_t)((o->r80 & 0xF0) | (v & 0x0F)); }
+static inline void opl3_op_set_mult(OPL3OpRegs *o, uint8_t v) { o->r20 = (uint8_t)((o->r20 & 0xF0) | (v & 0x0F)); }
+static inline void opl3_op_set_ws  (OPL3OpRegs *o, uint8_t v) { o->rE0 = (uint8_t)(v & 0x07); }
+
+/* Channel (C0h) accessors */
+static inline uint8_t opl3_voice_fb (const OPL3VoiceRegs *v, int pair) { return (v->c0[pair] >> 1) & 0x07; }
+static inline uint8_t opl3_voice_cnt(const OPL3VoiceRegs *v, int pair) { return  v->c0[pair]       & 0x01; }
+
 #ifdef __cplusplus
 }
 #endif
-#endif /* ESEOPL3PATCHER_OPL3_VOICE_H */
\ No newline at end of file
+#endif /* ESEOPL3PATCHER_OPL3_VOICE_H */
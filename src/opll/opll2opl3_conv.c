@@ -5,10 +5,16 @@
 #include "../vgm/vgm_header.h"
 #include "../vgm/vgm_helpers.h"
 #include "../opll/ym2413_voice_roms.h"
+#include "../opl3/opl3_voice.h"
+#include "../opl3/opl3_hash.h"
+#include "../opl3/opl3_metrics.h"
+#include "../opl3/opl3_profile.h"
+#include "../opl3/opl3_trace.h"
+#include "opll_voice_bank.h"
+#include "opll_override.h"
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>  // getenv
-#include <stdarg.h>
 #include "opll2opl3_conv.h"
 
 #define YM2413_REGS_SIZE 0x40
@@ -26,37 +32,40 @@
 
 static inline bool is_keyon_bit_set(uint8_t val) { return (val & 0x10) != 0; }
 
-static void opll_debug_log(const CommandOptions *opts, const char *fmt, ...) {
-    if (!opts || !opts->debug.verbose) return;
-    va_list args;
-    va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
-    va_end(args);
+/** Scheduler events: one trace record, printed as text with -verbose. */
+static inline void opll2opl3_trace(VGMContext *p_vgmctx, OPL3TraceCode code, int ch, uint8_t reg, uint8_t val,
+                                   uint16_t arg, uint8_t x, const CommandOptions *p_opts) {
+    if (!OPL3_TRACE_WANTED(p_vgmctx->p_trace, p_opts->debug.verbose)) return;
+    OPLL2OPL3_Scheduler *s = &(p_vgmctx->opll_state.sch);
+    OPL3TraceRecord rec = {0};
+    rec.time = (uint32_t)s->virtual_time;
+    rec.emit = (uint32_t)s->emit_time;
+    rec.code = (uint8_t)code;
+    rec.ch = (uint8_t)ch;
+    rec.reg = reg;
+    rec.val = val;
+    rec.arg = arg;
+    rec.x = x;
+    opl3_trace_emit(p_vgmctx->p_trace, p_opts->debug.verbose, &rec);
 }
 
-static inline void opll2opl3_debug_log(VGMContext *p_vgmctx, char *tag1,const char *tag2, int ch, const CommandOptions *p_opts) {
-    if (p_opts->debug.verbose) {
-        OPLL2OPL3_Scheduler      *s = &(p_vgmctx->opll_state.sch);
-        OPLL2OPL3_PendingChannel *p = &(p_vgmctx->opll_state.sch.ch[ch]);
-        fprintf(stderr,
-        "[OPLL2OPL3][%s][%s] virtual_time:%llu emit_time:%llu ch=%d TL(%d) Voice(%d) FnumL(%d) --- "
-        "Active %d Pending %d PendingOff %d PrevKey %d KeyNow %d\n",
-        tag1,tag2,
-        (unsigned long long)s->virtual_time,
-        (unsigned long long)s->emit_time,
-        ch,
-        p->has_tl, p->has_voice, p->has_fnum_low,
-        p->is_active, p->is_pending, p->is_pending_keyoff,
-        p->has_keybit_stamp, p->has_keybit
-        );
-    }
+static inline void opll2opl3_debug_log(VGMContext *p_vgmctx, OPL3TraceSchedTag tag, int ch, const CommandOptions *p_opts) {
+    if (!OPL3_TRACE_WANTED(p_vgmctx->p_trace, p_opts->debug.verbose)) return;
+    const OPLL2OPL3_PendingChannel *p = &(p_vgmctx->opll_state.sch.ch[ch]);
+    uint16_t flags = (p->has_tl ? OPL3_TRACE_SCHED_TL : 0) | (p->has_voice ? OPL3_TRACE_SCHED_VOICE : 0) |
+                     (p->has_fnum_low ? OPL3_TRACE_SCHED_FNUM_LOW : 0) | (p->is_active ? OPL3_TRACE_SCHED_ACTIVE : 0) |
+                     (p->is_pending ? OPL3_TRACE_SCHED_PENDING : 0) | (p->is_pending_keyoff ? OPL3_TRACE_SCHED_PENDING_OFF : 0) |
+                     (p->has_keybit_stamp ? OPL3_TRACE_SCHED_PREV_KEY : 0) | (p->has_keybit ? OPL3_TRACE_SCHED_KEY_NOW : 0);
+    opll2opl3_trace(p_vgmctx, OPL3_TRACE_SCHED, ch, 0, 0, flags, (uint8_t)tag, p_opts);
 }
 
 void opll2opl3_init_scheduler(VGMContext *p_vgmctx, const CommandOptions *p_opts) {
     OPLL2OPL3_Scheduler *s = &(p_vgmctx->opll_state.sch);
     memset(s, 0, sizeof(*s));
+    p_vgmctx->opll_state.p_voice_bank = NULL; // acquired lazily on first preset load
     s->virtual_time = 0;
     s->emit_time = 0;
+    s->seen_sample = p_vgmctx->timestamp.current_sample;
 
     for (int ch = 0; ch < OPLL_NUM_CHANNELS; ch++) {
         memset(&s->ch[ch], 0, sizeof(OPLL2OPL3_PendingChannel));
@@ -78,7 +87,8 @@ void opll2opl3_init_scheduler(VGMContext *p_vgmctx, const CommandOptions *p_opts
         // Key/edge state
         p->has_keybit_stamp = false;  // last observed register key bit (register state)
         p->has_keybit      = false;  // last seen register's key bit presence in current update
-        p->is_pending     = false ; // we delayed keyon because not all pieces arrived
+        p->is_pending     = false ; // writes held in the current coalescing burst
+        p->is_pending_keyon = false; // burst contains a KeyOn edge
         p->is_active      = false ; // we have emitted KeyOn for this channel in OPL output
         p->is_pending_keyoff = false; //  a KeyOff is pending to be flushed (used to ensure min gate)
         p->is_keyoff_forced  = false; // internal marker for forced (retrigger) off
@@ -93,6 +103,7 @@ void opll2opl3_init_scheduler(VGMContext *p_vgmctx, const CommandOptions *p_opts
 
     /* time stamp */
         p->keyon_time = 0;    // virtual time when KeyOn was first seen
+        p->pending_since = 0; // virtual time of the first held write
     }
 }
 
@@ -166,20 +177,21 @@ int  opll2opl3_emit_reg_write(VGMContext *p_vgmctx, uint8_t addr, uint8_t val, c
 {
     // Emit actual OPL3 write (handles dual port if needed)
     OPLL2OPL3_Scheduler *s = &(p_vgmctx->opll_state.sch);
-    uint8_t last_val =  s->last_emitted_reg_val[addr];
-    bool first_access = !s->accessed[addr];
+    int slot = opl3_reg_slot(addr);
+    bool first_access = (slot == OPL3_REG_SLOT_NONE) || !(s->emitted_bits[slot >> 5] & (1u << (slot & 31)));
+    uint8_t last_val = first_access ? 0 : s->last_emitted_reg_val[slot];
     int wrote_bytes = 0;
 
-    if (p_opts->debug.verbose) {
-        fprintf(stderr, "[EMIT][Reg Write] time=%u addr=%02X val=%02X emit_time=%u\n", (unsigned)s->virtual_time, addr, val, (unsigned)s->emit_time);
-    }
+    opll2opl3_trace(p_vgmctx, OPL3_TRACE_EMIT_WRITE, 0, addr, val, 0, 0, p_opts);
    if (first_access || val != last_val) {
         int bytes = duplicate_write_opl3(p_vgmctx, addr, val, p_opts);
         if (should_account_addtional_bytes_pre_loop(&(p_vgmctx->status))) wrote_bytes += bytes;
 
-        s->accessed[addr] = true;
+        if (slot != OPL3_REG_SLOT_NONE) s->emitted_bits[slot >> 5] |= 1u << (slot & 31);
+    } else if (OPL3_METRICS_ON(p_vgmctx->p_metrics)) {
+        opl3_metrics_dedup(p_vgmctx->p_metrics);
     }
-    s->last_emitted_reg_val[addr] = val;
+    if (slot != OPL3_REG_SLOT_NONE) s->last_emitted_reg_val[slot] = val;
 
     return wrote_bytes;
 }
@@ -187,9 +199,7 @@ int  opll2opl3_emit_reg_write(VGMContext *p_vgmctx, uint8_t addr, uint8_t val, c
 int emit_wait(VGMContext *p_vgmctx, uint16_t samples, OPLL2OPL3_Scheduler *s,const CommandOptions *p_opts) {
     int wrote_bytes = 0;
     if (samples == 0) {
-        if (p_opts->debug.verbose) {
-            fprintf(stderr,"[EMIT][WAIT] emit_time was ignored by samples = %u\n", samples);
-        }
+        opll2opl3_trace(p_vgmctx, OPL3_TRACE_EMIT_WAIT, 0, 0, 0, samples, 0, p_opts);
         return wrote_bytes;
     }
 
@@ -197,9 +207,7 @@ int emit_wait(VGMContext *p_vgmctx, uint16_t samples, OPLL2OPL3_Scheduler *s,con
     // Advance emitted timeline
     s->emit_time += samples;
 
-    if (p_opts->debug.verbose) {
-        fprintf(stderr,"[EMIT][WAIT] emit_time advanced by %u -> %u\n", samples, (unsigned)s->emit_time);
-    }
+    opll2opl3_trace(p_vgmctx, OPL3_TRACE_EMIT_WAIT, 0, 0, 0, samples, 1, p_opts);
     return wrote_bytes;
 }
 
@@ -814,20 +822,33 @@ static inline uint8_t opll2opl_tl(uint8_t tl) {
     return (tl & 0x0F) << 1;
 }
 
-/** Write to OPL3 register mirror and VGM output */
-static inline void write_opl3_reg(VGMContext *p_vgmctx, uint8_t addr, uint8_t data) {
-    forward_write(p_vgmctx, 0, addr, data);
-    p_vgmctx->opll_state.reg[addr] = data;
-}
-
 static inline int toTL(int vol, int off) {
     int t = (vol << 2) - off;
     return (t > 0) ? t : 0;
 }
 
 
+/**
+ * EXPERIMENT テーブルは呼び出し側のスクラッチ (18x8) に毎回生成する。
+ * 共有の可変テーブルを持たないので、複数スレッドから同時に呼んでも安全。
+ */
+static const unsigned char (*build_experiment_preset(
+    OPLL_PresetType preset, unsigned char (*p_scratch)[8]
+))[8]
+{
+    switch (preset) {
+        case OPLL_PresetType_YM2413:  convert_ymfm_2413_to_experiment(YMFM_YM2413_VOICES, p_scratch); break;
+        case OPLL_PresetType_VRC7:    convert_ymfm_vrc7_to_experiment(YMFM_VRC7_VOICES, p_scratch); break;
+        case OPLL_PresetType_YMF281B: convert_ymf281b_to_experiment(YMFM_YMF281B_VOICES, p_scratch); break;
+        case OPLL_PresetType_YM2423:  convert_ymfm_2423_to_experiment(YMFM_YM2423_VOICES, p_scratch); break;
+        default: return YMVOICE_YM2413_VOICES;
+    }
+    return (const unsigned char (*)[8])p_scratch;
+}
+
+/** p_scratch receives the EXPERIMENT table when that source is selected. */
 static const unsigned char (*select_opll_preset_table(
-    OPLL_PresetType preset, OPLL_PresetSource preset_source
+    OPLL_PresetType preset, OPLL_PresetSource preset_source, unsigned char (*p_scratch)[8]
 ))[8]
 {
     switch (preset) {
@@ -838,7 +859,7 @@ static const unsigned char (*select_opll_preset_table(
                 case OPLL_PresetSource_YMFM:
                     return YMFM_YM2413_VOICES;
                 case OPLL_PresetSource_EXPERIMENT:
-                    return EXPERIMENT_YM2413_PRESET;
+                    return build_experiment_preset(preset, p_scratch);
                 default:
                     return YMFM_YM2413_VOICES;
             }
@@ -849,7 +870,7 @@ static const unsigned char (*select_opll_preset_table(
                 case OPLL_PresetSource_YMFM:
                     return YMFM_VRC7_VOICES;
                 case OPLL_PresetSource_EXPERIMENT:
-                    return EXPERIMENT_VRC7_PRESET;
+                    return build_experiment_preset(preset, p_scratch);
                 default:
                     return YMFM_VRC7_VOICES;
             }
@@ -860,7 +881,7 @@ static const unsigned char (*select_opll_preset_table(
                 case OPLL_PresetSource_YMFM:
                     return YMFM_YMF281B_VOICES;
                 case OPLL_PresetSource_EXPERIMENT:
-                    return EXPERIMENT_YMF281B_PRESET;
+                    return build_experiment_preset(preset, p_scratch);
                 default:
                     return YMFM_YMF281B_VOICES;
             }
@@ -869,7 +890,7 @@ static const unsigned char (*select_opll_preset_table(
                 case OPLL_PresetSource_YMFM:
                     return YMFM_YM2423_VOICES;
                 case OPLL_PresetSource_EXPERIMENT:
-                    return EXPERIMENT_YM2423_PRESET;
+                    return build_experiment_preset(preset, p_scratch);
                 default:
                     return YMFM_YM2423_VOICES;
             }
@@ -880,56 +901,29 @@ static const unsigned char (*select_opll_preset_table(
 }
 
 
-void opll_load_voice(VGMContext *p_vgmctx, int inst, int ch, OPL3VoiceParam *p_vp, const CommandOptions *p_opts)
+/** Verbose dump of a converted OPLL patch. */
+static void opll_debug_dump_voice(int inst, const unsigned char *src, const OPL3VoiceParam *p_vp)
 {
-    if (!p_vp) return;
-    memset(p_vp, 0, sizeof(*p_vp));
-
-    uint8_t user_patch[8];
-    // Select the preset table
-    const unsigned char (*source_preset)[8] = select_opll_preset_table(p_opts->preset, p_opts->preset_source);
-    if (p_opts->preset_source == OPLL_PresetSource_EXPERIMENT) {
-        switch (p_opts->preset) {
-            case OPLL_PresetType_YM2413:
-                convert_ymfm_2413_to_experiment(YMFM_YM2413_VOICES, EXPERIMENT_YM2413_PRESET);
-                source_preset = EXPERIMENT_YM2413_PRESET;
-                break;
-            case OPLL_PresetType_VRC7:
-                convert_ymfm_vrc7_to_experiment(YMFM_VRC7_VOICES, EXPERIMENT_VRC7_PRESET);
-                source_preset = EXPERIMENT_VRC7_PRESET;
-                break;
-            case OPLL_PresetType_YMF281B:
-                convert_ymf281b_to_experiment(YMFM_YMF281B_VOICES, EXPERIMENT_YMF281B_PRESET);
-                source_preset = EXPERIMENT_YMF281B_PRESET;
-                break;
-            case OPLL_PresetType_YM2423:
-                convert_ymfm_2423_to_experiment(YMFM_YM2423_VOICES, EXPERIMENT_YM2423_PRESET);
-                source_preset = EXPERIMENT_YM2423_PRESET;
-                break;
-            default:
-                break;
-        }
-    }
-    // Select patch
-    const unsigned char *src = NULL;
-    if (inst == 0) {
-        // User patch (from registers)
-        for (int i = 0; i < 8; ++i)
-            user_patch[i] = p_vgmctx->opll_state.reg[i];
-        src = user_patch;
-    } else if (inst >= 1 && inst <= 19) {
-        src = source_preset[inst - 1]; // [1]..[19] are preset patches
-    } else if (source_preset >= 20) {
-        src = source_preset[19]; // Fallback: last preset
-    } else {
-        src = source_preset[0];  // Fallback: first preset
-    }
+    fprintf(stderr, "[YM2413->OPL3] inst=%d RAW: %02X %02X %02X %02X  %02X %02X %02X %02X\n",
+        inst, src[0],src[1],src[2],src[3],src[4],src[5],src[6],src[7]);
+    fprintf(stderr, "[YM2413->OPL3] MOD: AM=%u VIB=%u EGT=%u KSR=%u MULT=%u KSL=%u TL=%u AR=%u DR=%u SL=%u RR=%u WS=%u\n",
+        p_vp->op[0].am, p_vp->op[0].vib, p_vp->op[0].egt, p_vp->op[0].ksr, p_vp->op[0].mult,
+        p_vp->op[0].ksl, p_vp->op[0].tl, p_vp->op[0].ar, p_vp->op[0].dr, p_vp->op[0].sl, p_vp->op[0].rr, p_vp->op[0].ws
+    );
+    fprintf(stderr, "[YM2413->OPL3] CAR: AM=%u VIB=%u EGT=%u KSR=%u MULT=%u KSL=%u TL=%u AR=%u DR=%u SL=%u RR=%u WS=%u\n",
+        p_vp->op[1].am, p_vp->op[1].vib, p_vp->op[1].egt, p_vp->op[1].ksr, p_vp->op[1].mult,
+        p_vp->op[1].ksl, p_vp->op[1].tl, p_vp->op[1].ar, p_vp->op[1].dr, p_vp->op[1].sl, p_vp->op[1].rr, p_vp->op[1].ws
+    );
+    fprintf(stderr, "[YM2413->OPL3] FB=%u\n", p_vp->fb[0]);
+}
 
-    // Defensive: if src is NULL, abort
-    if (!src) {
-        fprintf(stderr, "[ERROR] src is NULL in opll_load_voice (inst=%d)\n", inst);
-        return;
-    }
+/**
+ * Convert one 8-byte OPLL patch into OPL3VoiceParam (pure; no state access).
+ * YMVOICE keeps the raw OPLL values, other sources go through the vgm-conv tables.
+ */
+static void opll_patch_to_opl3_voice(const unsigned char *src, OPLL_PresetSource preset_source, int inst, OPL3VoiceParam *p_vp)
+{
+    memset(p_vp, 0, sizeof(*p_vp));
 
     // --- Modulator ---
     uint8_t m_am   = (src[0] >> 7) & 1;
@@ -961,7 +955,7 @@ void opll_load_voice(VGMContext *p_vgmctx, int inst, int ch, OPL3VoiceParam *p_v
 
     uint8_t fb = src[3] & 0x07;
 
-    if (p_opts->preset_source != OPLL_PresetSource_YMVOICE) {
+    if (preset_source != OPLL_PresetSource_YMVOICE) {
         // Modulator
         p_vp->op[0].am   = m_am;
         p_vp->op[0].vib  = m_vib;
@@ -1030,19 +1024,115 @@ void opll_load_voice(VGMContext *p_vgmctx, int inst, int ch, OPL3VoiceParam *p_v
         p_vp->voice_no = inst;
         p_vp->source_fmchip = 0x01; // YM2413
     }
+}
+
+/** Fill the persistent voice bank (see opll_voice_bank.h). */
+void opll_voice_bank_build(OPLLVoiceBank *p_bank)
+{
+    unsigned char scratch[OPLL_VOICE_BANK_NUM_INST][8];
+    for (int t = 0; t < OPLL_VOICE_BANK_NUM_TYPES; ++t) {
+        for (int s = 0; s < OPLL_VOICE_BANK_NUM_SOURCES; ++s) {
+            const unsigned char (*table)[8] = select_opll_preset_table((OPLL_PresetType)t, (OPLL_PresetSource)s, scratch);
+            for (int i = 0; i < OPLL_VOICE_BANK_NUM_INST; ++i) {
+                OPLLVoiceBankEntry *p_e = &p_bank->entry[t][s][i];
+                OPL3VoiceParam vp;
+                memcpy(p_e->raw, table[i], 8);
+                opll_patch_to_opl3_voice(table[i], (OPLL_PresetSource)s, i + 1, &vp);
+                opl3_voice_pack(&vp, &p_e->regs);
+            }
+        }
+    }
+}
+
+/** FNV-1a over every input of opll_voice_bank_build (ROM tables + mapping tables). */
+uint32_t opll_voice_bank_source_hash(void)
+{
+    static const struct { const void *p; size_t n; } inputs[] = {
+        { YMVOICE_YM2413_VOICES,  sizeof(YMVOICE_YM2413_VOICES) },
+        { YMVOICE_VRC7_VOICES,    sizeof(YMVOICE_VRC7_VOICES) },
+        { YMVOICE_YMF281B_VOICES, sizeof(YMVOICE_YMF281B_VOICES) },
+        { YMFM_YM2413_VOICES,     sizeof(YMFM_YM2413_VOICES) },
+        { YMFM_VRC7_VOICES,       sizeof(YMFM_VRC7_VOICES) },
+        { YMFM_YMF281B_VOICES,    sizeof(YMFM_YMF281B_VOICES) },
+        { YMFM_YM2423_VOICES,     sizeof(YMFM_YM2423_VOICES) },
+        { opll2opl_ar,   sizeof(opll2opl_ar) },
+        { opll2opl_dr,   sizeof(opll2opl_dr) },
+        { opll2opl_rr,   sizeof(opll2opl_rr) },
+        { opll2opl_ksl,  sizeof(opll2opl_ksl) },
+        { opll2opl_mult, sizeof(opll2opl_mult) },
+    };
+    uint32_t h = OPL3_FNV1A_BASIS;
+    for (size_t k = 0; k < sizeof(inputs) / sizeof(inputs[0]); ++k) {
+        h = opl3_fnv1a(h, inputs[k].p, inputs[k].n);
+    }
+    return h;
+}
+
+static void opll_load_base_voice(VGMContext *p_vgmctx, int inst, OPL3VoiceParam *p_vp, const CommandOptions *p_opts)
+{
+    memset(p_vp, 0, sizeof(*p_vp));
+
+    // Preset voices come pre-derived from the persistent bank (no table conversion per process)
+    if (inst >= 1 && inst <= OPLL_VOICE_BANK_NUM_INST) {
+        if (!p_vgmctx->opll_state.p_voice_bank) {
+            p_vgmctx->opll_state.p_voice_bank = opll_voice_bank_open(p_opts->p_voice_bank_path, p_opts->debug.verbose);
+        }
+        const OPLLVoiceBankEntry *p_e = opll_voice_bank_lookup(
+            p_vgmctx->opll_state.p_voice_bank, p_opts->preset, p_opts->preset_source, inst);
+        if (p_e) {
+            opl3_voice_unpack(&p_e->regs, p_vp);
+            p_vp->voice_no = inst;
+            p_vp->source_fmchip = 0x01; // YM2413
+            if (p_opts->debug.verbose) {
+                opll_debug_dump_voice(inst, p_e->raw, p_vp);
+            }
+            return;
+        }
+    }
+
+
+    uint8_t user_patch[8];
+    unsigned char preset_scratch[OPLL_VOICE_BANK_NUM_INST][8];
+    const unsigned char *src = NULL;
+    if (inst == 0) {
+        // User patch (from registers)
+        for (int i = 0; i < 8; ++i)
+            user_patch[i] = p_vgmctx->opll_state.reg[i];
+        src = user_patch;
+    } else {
+        // Bank unavailable or inst out of range: derive from the ROM table directly
+        const unsigned char (*source_preset)[8] = select_opll_preset_table(p_opts->preset, p_opts->preset_source, preset_scratch);
+        if (inst >= 1 && inst <= OPLL_VOICE_BANK_NUM_INST) {
+            src = source_preset[inst - 1]; // [1]..[18] are preset patches
+        } else if (inst > OPLL_VOICE_BANK_NUM_INST) {
+            src = source_preset[OPLL_VOICE_BANK_NUM_INST - 1]; // Fallback: last preset
+        } else {
+            src = source_preset[0];  // Fallback: first preset
+        }
+    }
+
+    // Defensive: if src is NULL, abort
+    if (!src) {
+        fprintf(stderr, "[ERROR] src is NULL in opll_load_voice (inst=%d)\n", inst);
+        return;
+    }
+
+    opll_patch_to_opl3_voice(src, p_opts->preset_source, inst, p_vp);
 
     if (p_opts && p_opts->debug.verbose) {
-        fprintf(stderr, "[YM2413->OPL3] inst=%d RAW: %02X %02X %02X %02X  %02X %02X %02X %02X\n",
-            inst, src[0],src[1],src[2],src[3],src[4],src[5],src[6],src[7]);
-        fprintf(stderr, "[YM2413->OPL3] MOD: AM=%u VIB=%u EGT=%u KSR=%u MULT=%u KSL=%u TL=%u AR=%u DR=%u SL=%u RR=%u WS=%u\n",
-            p_vp->op[0].am, p_vp->op[0].vib, p_vp->op[0].egt, p_vp->op[0].ksr, p_vp->op[0].mult,
-            p_vp->op[0].ksl, p_vp->op[0].tl, p_vp->op[0].ar, p_vp->op[0].dr, p_vp->op[0].sl, p_vp->op[0].rr, p_vp->op[0].ws
-        );
-        fprintf(stderr, "[YM2413->OPL3] CAR: AM=%u VIB=%u EGT=%u KSR=%u MULT=%u KSL=%u TL=%u AR=%u DR=%u SL=%u RR=%u WS=%u\n",
-            p_vp->op[1].am, p_vp->op[1].vib, p_vp->op[1].egt, p_vp->op[1].ksr, p_vp->op[1].mult,
-            p_vp->op[1].ksl, p_vp->op[1].tl, p_vp->op[1].ar, p_vp->op[1].dr, p_vp->op[1].sl, p_vp->op[1].rr, p_vp->op[1].ws
-        );
-        fprintf(stderr, "[YM2413->OPL3] FB=%u\n", p_vp->fb[0]);
+        opll_debug_dump_voice(inst, src, p_vp);
+    }
+}
+
+void opll_load_voice(VGMContext *p_vgmctx, int inst, int ch, OPL3VoiceParam *p_vp, const CommandOptions *p_opts)
+{
+    if (!p_vp) return;
+    opll_load_base_voice(p_vgmctx, inst, p_vp, p_opts);
+
+    // --override: one table lookup per voice load
+    if (p_opts->p_overrides) {
+        const OPLLOverrideEntry *p_e = opll_override_lookup(p_opts->p_overrides, inst, ch);
+        if (p_e) opll_override_apply_params(p_e, p_vp);
     }
 }
 
@@ -1053,55 +1143,76 @@ int opll2opl3_apply_voice(VGMContext *p_vgmctx, int ch, int mod_volume, int car_
 {
     if (!p_vp || ch < 0 || ch >= 9) return 0;
     int wrote_bytes = 0;
-    int slot_mod = opl3_opreg_addr(0, ch, 0);
-    int slot_car = opl3_opreg_addr(0, ch, 1);
-    uint8_t tl = p_vgmctx->opll_state.reg[0x30 + ch] & 0xF;
-
-    // AM/VIB/EGT/KSR/MULT
-    uint8_t opl3_2n_mod = (uint8_t)((p_vp->op[0].am << 7) | (p_vp->op[0].vib << 6) | (p_vp->op[0].egt << 5) | (p_vp->op[0].ksr << 4) | (p_vp->op[0].mult & 0x0F));
-    uint8_t opl3_2n_car = (uint8_t)((p_vp->op[1].am << 7) | (p_vp->op[1].vib << 6) | (p_vp->op[1].egt << 5) | (p_vp->op[1].ksr << 4) | (p_vp->op[1].mult & 0x0F));
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x20 + slot_mod, opl3_2n_mod, p_opts);
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x20 + slot_car, opl3_2n_car, p_opts);
-
-    // KSL/TL 
-    uint8_t opl3_4n_mod = (uint8_t)((opll2opl_ksl[(p_vp->op[0].ksl & 0x03)] << 6) | ((mod_volume >= 0) ? mod_volume : (p_vp->op[0].tl & 0x3F)));
-    uint8_t opl3_4n_car = (uint8_t)((opll2opl_ksl[(p_vp->op[1].ksl & 0x03)] << 6) | ((car_volume >= 0) ? car_volume : (p_vp->op[1].tl & 0x3F)));
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x40 + slot_mod, opl3_4n_mod, p_opts);
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x40 + slot_car, opl3_4n_car, p_opts);
-
-    // AR/DR
-    uint8_t opl3_6n_mod = (uint8_t)((p_vp->op[0].ar << 4) | (p_vp->op[0].dr & 0x0F));
-    uint8_t opl3_6n_car = (uint8_t)((p_vp->op[1].ar << 4) | (p_vp->op[1].dr & 0x0F));
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x60 + slot_mod, opl3_6n_mod, p_opts);
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x60 + slot_car, opl3_6n_car, p_opts);
-
-    // SL/RR
-    uint8_t opl3_8n_mod = (uint8_t)((p_vp->op[0].sl << 4) | ((!p_vp->op[0].egt) ? (p_vp->op[0].rr & 0x0F) : 0));
-    uint8_t opl3_8n_car = (uint8_t)((p_vp->op[1].sl << 4) | ((p_vp->op[1].egt || key) ? (p_vp->op[1].rr & 0x0F) : 6));
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x80 + slot_mod, opl3_8n_mod, p_opts);
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x80 + slot_car, opl3_8n_car, p_opts);
-
-    // FB/CNT
-    uint8_t c0_val = (uint8_t)(0xC0 | ((p_vp->fb[0] & 0x07) << 1) | (p_vp->cnt[0] & 0x01));
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xC0 + ch, c0_val, p_opts);
-
-    // WS
-    uint8_t opl3_en_mod = (uint8_t)((p_vp->op[0].ws)? 1 : 0);
-    uint8_t opl3_en_car = (uint8_t)((p_vp->op[1].ws)? 1 : 0);
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xE0 + slot_mod, opl3_en_mod, p_opts);
-    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xE0 + slot_car, opl3_en_car, p_opts);
-
-    if (p_opts->debug.verbose ) {
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Op 0 AM: %s, Vibrato: %s, KSR: %s, EG Type: %d, Freq Multipler: %d\n",ch,opl3_2n_mod,(p_vp->op[0].am) ? "On":"Off",(p_vp->op[0].vib << 6) ? "On":"Off",(p_vp->op[0].ksr << 4) ? "On":"Off",(p_vp->op[0].egt << 5),(p_vp->op[0].mult & 0x0F));
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Op 1 AM: %s, Vibrato: %s, KSR: %s, EG Type: %d, Freq Multipler: %d\n",ch,opl3_2n_car,(p_vp->op[1].am) ? "On":"Off",(p_vp->op[1].vib << 6) ? "On":"Off",(p_vp->op[1].ksr << 4) ? "On":"Off",(p_vp->op[1].egt << 5),(p_vp->op[1].mult & 0x0F));
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Op 0 Key Scaling: %d, Total Level: 0x%02x\n",ch,opl3_4n_mod,(p_vp->op[0].ksl & 0x03), (p_vp->op[0].tl & 0x3F));
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Op 1 Key Scaling: %d, Total Level: 0x%02x\n",ch,opl3_4n_car,(p_vp->op[1].ksl & 0x03), (p_vp->op[1].tl & 0x3F));
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Op 0 Attack Rate: %X, Decay Rate: %X\n",ch,opl3_6n_mod,p_vp->op[0].ar,p_vp->op[0].dr);
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Op 1 Attack Rate: %X, Decay Rate: %X\n",ch,opl3_6n_car,p_vp->op[1].ar,p_vp->op[1].dr);
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Op 0 Sustain Level: %X, Release Rate: %X\n",ch,opl3_8n_mod,p_vp->op[0].sl,p_vp->op[0].rr);
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Op 1 Sustain Level: %X, Release Rate: %X\n",ch,opl3_8n_car,p_vp->op[1].sl,p_vp->op[1].rr);
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Waveform Select: %X\n",ch,opl3_en_mod,(p_vp->op[0].ws & 0x07));
-        fprintf(stderr,"[DEBUG][Apply Voice] Ch %d Reg0x%02X : Waveform Select: %X\n",ch,opl3_en_car,(p_vp->op[0].ws & 0x07));
+    int slot[2] = { opl3_opreg_addr(0, ch, 0), opl3_opreg_addr(0, ch, 1) };
+    int vol[2] = { mod_volume, car_volume };
+
+    // Pack once into the register image, then apply the YM2413-specific tweaks in place
+    OPL3VoiceRegs regs;
+    opl3_voice_pack(p_vp, &regs);
+    for (int op = 0; op < 2; ++op) {
+        OPL3OpRegs *o = &regs.op[op];
+        // KSL/TL: OPLL KSL order differs, volume overrides TL when given
+        opl3_op_set_ksl(o, opll2opl_ksl[p_vp->op[op].ksl & 0x03]);
+        if (vol[op] >= 0) opl3_op_set_tl(o, (uint8_t)vol[op]);
+        // WS: only half-sine is meaningful on OPLL
+        opl3_op_set_ws(o, p_vp->op[op].ws ? 1 : 0);
+    }
+    // SL/RR: modulator RR only for percussive EG, carrier uses RR=6 while released & sustained
+    opl3_op_set_rr(&regs.op[0], (!p_vp->op[0].egt) ? p_vp->op[0].rr : 0);
+    opl3_op_set_rr(&regs.op[1], (p_vp->op[1].egt || key) ? p_vp->op[1].rr : 6);
+    regs.c0[0] |= 0xC0;
+    if (p_opts->p_overrides) {
+        const OPLLOverrideEntry *p_e = opll_override_lookup(p_opts->p_overrides, p_vp->voice_no, ch);
+        if (p_e) opll_override_apply_regs(p_e, &regs);
+    }
+
+    // Emit in the fixed order 20/40/60/80 (mod, car), C0, E0 (mod, car)
+    static const uint8_t op_bases[4] = { 0x20, 0x40, 0x60, 0x80 };
+    for (int i = 0; i < 4; ++i) {
+        for (int op = 0; op < 2; ++op) {
+            const uint8_t *img = &regs.op[op].r20;
+            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, op_bases[i] + slot[op], img[i], p_opts);
+        }
+    }
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xC0 + ch, regs.c0[0], p_opts);
+    for (int op = 0; op < 2; ++op) {
+        wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xE0 + slot[op], regs.op[op].rE0, p_opts);
+    }
+
+    if (OPL3_TRACE_WANTED(p_vgmctx->p_trace, p_opts->debug.verbose)) {
+        // [DEBUG][Apply Voice]: register value and the source voice fields, per operator
+        static const uint8_t lines[5] = { OPL3_TRACE_VOICE_20, OPL3_TRACE_VOICE_40, OPL3_TRACE_VOICE_60,
+                                          OPL3_TRACE_VOICE_80, OPL3_TRACE_VOICE_E0 };
+        for (int i = 0; i < 5; ++i) {
+            for (int op = 0; op < 2; ++op) {
+                const OPL3OperatorParam *p_op = &p_vp->op[op];
+                uint8_t a = 0, b = 0;
+                uint16_t arg = 0;
+                switch (lines[i]) {
+                case OPL3_TRACE_VOICE_20:
+                    a = (p_op->am ? 0x01 : 0) | (p_op->vib ? 0x02 : 0) | (p_op->ksr ? 0x04 : 0);
+                    b = p_op->mult & 0x0F;
+                    arg = (uint16_t)(p_op->egt << 5);
+                    break;
+                case OPL3_TRACE_VOICE_40: a = p_op->ksl & 0x03; b = p_op->tl & 0x3F; break;
+                case OPL3_TRACE_VOICE_60: a = p_op->ar; b = p_op->dr; break;
+                case OPL3_TRACE_VOICE_80: a = p_op->sl; b = p_op->rr; break;
+                default:                  a = p_vp->op[0].ws & 0x07; break;   // both lines show the modulator WS
+                }
+                const uint8_t *img = &regs.op[op].r20;
+                OPL3TraceRecord rec = {0};
+                rec.time = (uint32_t)p_vgmctx->opll_state.sch.virtual_time;
+                rec.emit = (uint32_t)p_vgmctx->opll_state.sch.emit_time;
+                rec.code = OPL3_TRACE_VOICE;
+                rec.ch = (uint8_t)(ch | (op << 4));
+                rec.reg = (lines[i] == OPL3_TRACE_VOICE_E0) ? regs.op[op].rE0 : img[i];
+                rec.val = a;
+                rec.y = b;
+                rec.arg = arg;
+                rec.x = lines[i];
+                opl3_trace_emit(p_vgmctx->p_trace, p_opts->debug.verbose, &rec);
+            }
+        }
     }
     return wrote_bytes;
 }
@@ -1112,7 +1223,6 @@ int opll2opl3_apply_voice(VGMContext *p_vgmctx, int ch, int mod_volume, int car_
  */
 int opll2opl3_update_voice(VGMContext *p_vgmctx, int ch, const CommandOptions *p_opts)
 {
-    OPLL2OPL3_Scheduler *p_s = &(p_vgmctx->opll_state.sch);
     uint8_t *regs = p_vgmctx->opll_state.reg;
     bool rflag = (p_vgmctx->opll_state.is_rhythm_mode != 0);
     uint8_t d = regs[0x30 + ch];
@@ -1121,7 +1231,6 @@ int opll2opl3_update_voice(VGMContext *p_vgmctx, int ch, const CommandOptions *p
     bool key = (regs[0x20 + ch] & 0x10) ? true : false;
     int wrote_bytes = 0;
     
-    OPLL2OPL3_PendingChannel *p = &p_s->ch[ch];
     OPL3VoiceParam vp;
 
     if (rflag && ch >= 6) {
@@ -1170,13 +1279,360 @@ int opll2opl3_update_voice(VGMContext *p_vgmctx, int ch, const CommandOptions *p
     return wrote_bytes;
 }
 
+/**
+ * Key timing scheduler (opt-in: every limit is 0 by default; needs key-on coalescing)
+ *
+ * KeyOn/KeyOff を含む A0/B0 書き込みは emit_time 上の期限付きイベントとして扱う。
+ *   - KeyOff は直前の KeyOn から min_gate_samples 経過するまで遅延
+ *   - KeyOn は直前の KeyOff から min_off_on_wait_samples、音色書き換え時は
+ *     さらに pre_keyon_wait_samples 経過するまで遅延
+ * 遅延したイベントはチャンネル毎の FIFO (key_q) に積み、先頭期限をキーにした
+ * min-heap (key_heap) で管理する。既存の wait をイベント期限で分割して出力する
+ * ため、出力の総サンプル数は変わらない (追加の wait は発生しない)。
+ */
+static inline sample_t opll2opl3_key_head_due(const OPLL2OPL3_Scheduler *p_s, int ch)
+{
+    const OPLL2OPL3_PendingChannel *p = &p_s->ch[ch];
+    return p->key_q[p->key_q_head].due;
+}
+
+static void opll2opl3_key_heap_push(OPLL2OPL3_Scheduler *p_s, int ch)
+{
+    int i = p_s->key_heap_size++;
+    sample_t due = opll2opl3_key_head_due(p_s, ch);
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (opll2opl3_key_head_due(p_s, p_s->key_heap[parent]) <= due) break;
+        p_s->key_heap[i] = p_s->key_heap[parent];
+        i = parent;
+    }
+    p_s->key_heap[i] = (uint8_t)ch;
+}
+
+/** Remove the heap entry at index i (root for the normal pop). */
+static void opll2opl3_key_heap_remove_at(OPLL2OPL3_Scheduler *p_s, int i)
+{
+    uint8_t last = p_s->key_heap[--p_s->key_heap_size];
+    if (i == p_s->key_heap_size) return;
+    sample_t due = opll2opl3_key_head_due(p_s, last);
+    // sift up (only needed for non-root removal), then sift down
+    while (i > 0 && opll2opl3_key_head_due(p_s, p_s->key_heap[(i - 1) / 2]) > due) {
+        p_s->key_heap[i] = p_s->key_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= p_s->key_heap_size) break;
+        if (child + 1 < p_s->key_heap_size &&
+            opll2opl3_key_head_due(p_s, p_s->key_heap[child + 1]) < opll2opl3_key_head_due(p_s, p_s->key_heap[child])) {
+            ++child;
+        }
+        if (opll2opl3_key_head_due(p_s, p_s->key_heap[child]) >= due) break;
+        p_s->key_heap[i] = p_s->key_heap[child];
+        i = child;
+    }
+    p_s->key_heap[i] = last;
+}
+
+static int opll2opl3_emit_key_event(VGMContext *p_vgmctx, int ch, const OPLL2OPL3_KeyEvent *p_ev, const CommandOptions *p_opts)
+{
+    int wrote_bytes = 0;
+    if (p_ev->has_a0) {
+        wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xA0 + ch, p_ev->a0, p_opts);
+    }
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xB0 + ch, p_ev->b0, p_opts);
+    return wrote_bytes;
+}
+
+/**
+ * Emit queued events of ch that are due at or before limit.
+ * The channel must not be in the heap; it is re-inserted when events remain.
+ */
+static int opll2opl3_key_release(VGMContext *p_vgmctx, int ch, sample_t limit, const CommandOptions *p_opts)
+{
+    OPLL2OPL3_Scheduler *p_s = &(p_vgmctx->opll_state.sch);
+    OPLL2OPL3_PendingChannel *p = &p_s->ch[ch];
+    int wrote_bytes = 0;
+
+    while (p->key_q_count > 0 && p->key_q[p->key_q_head].due <= limit) {
+        wrote_bytes += opll2opl3_emit_key_event(p_vgmctx, ch, &p->key_q[p->key_q_head], p_opts);
+        p->key_q_head = (uint8_t)((p->key_q_head + 1) & (OPLL_KEY_QUEUE_DEPTH - 1));
+        p->key_q_count--;
+    }
+    if (p->key_q_count > 0) opll2opl3_key_heap_push(p_s, ch);
+    return wrote_bytes;
+}
+
+/** Emit every queued event (loop point / end of data): timing constraints are dropped. */
+static int opll2opl3_key_drain(VGMContext *p_vgmctx, const CommandOptions *p_opts)
+{
+    OPLL2OPL3_Scheduler *p_s = &(p_vgmctx->opll_state.sch);
+    int wrote_bytes = 0;
+    while (p_s->key_heap_size > 0) {
+        int ch = p_s->key_heap[0];
+        opll2opl3_key_heap_remove_at(p_s, 0);
+        wrote_bytes += opll2opl3_key_release(p_vgmctx, ch, (sample_t)-1, p_opts);
+    }
+    return wrote_bytes;
+}
+
+/**
+ * Place an A0/B0 write on the emit timeline. Emitted immediately when no
+ * constraint applies, otherwise queued behind earlier events of the channel.
+ */
+static int opll2opl3_schedule_key(VGMContext *p_vgmctx, int ch, bool has_a0, uint8_t a0, uint8_t b0,
+                                  bool is_voice_changed, const CommandOptions *p_opts)
+{
+    OPLL2OPL3_Scheduler *p_s = &(p_vgmctx->opll_state.sch);
+    OPLL2OPL3_PendingChannel *p = &p_s->ch[ch];
+    sample_t now = p_s->emit_time;
+    sample_t due = now;
+    bool key = (b0 & 0x20) != 0;
+    int wrote_bytes = 0;
+
+    if (p->key_q_count > 0) {
+        int tail = (p->key_q_head + p->key_q_count - 1) & (OPLL_KEY_QUEUE_DEPTH - 1);
+        if (p->key_q[tail].due > due) due = p->key_q[tail].due;
+    }
+    if (key && !p->sched_key) {
+        if (p->has_sched_off && p->sched_off_time + p_opts->min_off_on_wait_samples > due) {
+            due = p->sched_off_time + p_opts->min_off_on_wait_samples;
+        }
+        if (is_voice_changed && now + p_opts->pre_keyon_wait_samples > due) {
+            due = now + p_opts->pre_keyon_wait_samples;
+        }
+    } else if (!key && p->sched_key) {
+        if (p->sched_on_time + p_opts->min_gate_samples > due) {
+            due = p->sched_on_time + p_opts->min_gate_samples;
+        }
+    }
+
+    if (key != p->sched_key) {
+        if (key) {
+            p->sched_on_time = due;
+        } else {
+            p->sched_off_time = due;
+            p->has_sched_off = true;
+        }
+        p->sched_key = key;
+    }
+
+    OPLL2OPL3_KeyEvent ev = { due, a0, b0, has_a0 };
+    if (due <= now && p->key_q_count == 0) {
+        return opll2opl3_emit_key_event(p_vgmctx, ch, &ev, p_opts);
+    }
+
+    if (p->key_q_count == OPLL_KEY_QUEUE_DEPTH) {
+        // Queue overflow: give up the constraints for this channel
+        for (int i = 0; i < p_s->key_heap_size; ++i) {
+            if (p_s->key_heap[i] == ch) {
+                opll2opl3_key_heap_remove_at(p_s, i);
+                break;
+            }
+        }
+        wrote_bytes += opll2opl3_key_release(p_vgmctx, ch, (sample_t)-1, p_opts);
+        ev.due = now;
+        return wrote_bytes + opll2opl3_emit_key_event(p_vgmctx, ch, &ev, p_opts);
+    }
+
+    int slot = (p->key_q_head + p->key_q_count) & (OPLL_KEY_QUEUE_DEPTH - 1);
+    p->key_q[slot] = ev;
+    if (p->key_q_count++ == 0) opll2opl3_key_heap_push(p_s, ch);
+
+    if (p_opts->debug.verbose) {
+        fprintf(stderr, "[SCHED] ch=%d B0=%02X deferred %llu -> %llu\n",
+            ch, b0, (unsigned long long)now, (unsigned long long)due);
+    }
+    return wrote_bytes;
+}
+
+/** Emit a wait of any length as 16-bit emit_wait() steps. */
+static int opll2opl3_emit_wait_span(VGMContext *p_vgmctx, sample_t span, OPLL2OPL3_Scheduler *p_s, const CommandOptions *p_opts)
+{
+    int wrote_bytes = 0;
+    while (span > 0) {
+        uint16_t step = (span > 0xFFFF) ? 0xFFFF : (uint16_t)span;
+        wrote_bytes += emit_wait(p_vgmctx, step, p_s, p_opts);
+        span -= step;
+    }
+    return wrote_bytes;
+}
+
+/**
+ * Advance the emit timeline by wait_samples, splitting the wait at the due
+ * times of queued key events (total wait is unchanged).
+ */
+static int opll2opl3_wait_with_events(VGMContext *p_vgmctx, uint32_t wait_samples, const CommandOptions *p_opts)
+{
+    OPLL2OPL3_Scheduler *p_s = &(p_vgmctx->opll_state.sch);
+    sample_t target = p_s->emit_time + wait_samples;
+    int wrote_bytes = 0;
+
+    while (p_s->key_heap_size > 0) {
+        int ch = p_s->key_heap[0];
+        sample_t due = opll2opl3_key_head_due(p_s, ch);
+        if (due > target) break;
+        if (due > p_s->emit_time) {
+            wrote_bytes += opll2opl3_emit_wait_span(p_vgmctx, due - p_s->emit_time, p_s, p_opts);
+        }
+        opll2opl3_key_heap_remove_at(p_s, 0);
+        wrote_bytes += opll2opl3_key_release(p_vgmctx, ch, p_s->emit_time, p_opts);
+    }
+    if (target > p_s->emit_time) {
+        wrote_bytes += opll2opl3_emit_wait_span(p_vgmctx, target - p_s->emit_time, p_s, p_opts);
+    }
+    return wrote_bytes;
+}
+
+/**
+ * Key-on coalescing (--keyon-coalesce, off by default)
+ *
+ * 1n/2n/3n の部分書き込みはチャンネル単位で保留し、1ノート分が揃った時点
+ * (または保留ウィンドウ満了時) に A0/B0/音色を一括で正しい順序で出力する。
+ *   - KeyOn エッジを含むバーストは FNUM LSB (1n) の到着を待つ
+ *   - 1n のみのバーストは 2n (Block/FNUM MSB) を待つ
+ *   - それ以外 (3n のみ、KeyOff 等) は同一タイムスタンプ内でまとめるだけ
+ * 保留は cmd_opts.keyon_coalesce_samples (上限 OPLL_MAX_PENDING_SAMPLES) を超えない。
+ */
+static void opll2opl3_mark_pending(OPLL2OPL3_Scheduler *p_s, int ch)
+{
+    OPLL2OPL3_PendingChannel *p = &p_s->ch[ch];
+    if (!p->is_pending) {
+        p->is_pending = true;
+        p->pending_since = p_s->virtual_time;
+    }
+}
+
+static bool opll2opl3_pending_complete(const OPLL2OPL3_PendingChannel *p)
+{
+    if (p->is_pending_keyon) return p->has_fnum_low;        // KeyOn waits for FNUM LSB
+    if (p->has_fnum_low && !p->has_fnum_high) return false; // LSB alone waits for Block/MSB
+    return true;
+}
+
+static inline uint32_t opll2opl3_coalesce_window(const CommandOptions *p_opts)
+{
+    uint32_t w = p_opts->keyon_coalesce_samples;
+    return (w > OPLL_MAX_PENDING_SAMPLES) ? OPLL_MAX_PENDING_SAMPLES : w;
+}
+
+/** Zero-clear the 2-op voice registers of ch (vgm-conv compatible mode). */
+static int opll2opl3_zero_clear_voice(VGMContext *p_vgmctx, int ch, const CommandOptions *p_opts)
+{
+    int wrote_bytes = 0;
+    int mod_slot = opl3_opreg_addr(0, ch, 0);
+    int car_slot = opl3_opreg_addr(0, ch, 1);
+
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x20 + mod_slot, 0x00, p_opts); // AM/VIB/EGT/KSR/MULT
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x20 + car_slot, 0x00, p_opts);
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x40 + mod_slot, 0x00, p_opts); // KSL/TL
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x40 + car_slot, 0x00, p_opts);
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x60 + mod_slot, 0x00, p_opts); // AR/DR
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x60 + car_slot, 0x00, p_opts);
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x80 + mod_slot, 0x00, p_opts); // SL/RR
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x80 + car_slot, 0x00, p_opts);
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xE0 + mod_slot, 0x00, p_opts); // WS
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xE0 + car_slot, 0x00, p_opts);
+    wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xC0 + ch, 0xF0, p_opts);       // Feedback/Algo（FM）
+    return wrote_bytes;
+}
+
+/**
+ * Emit one consolidated burst for ch:
+ * [forced KeyOff] -> [zero clear] -> voice -> A0 (FNUM LSB) -> B0 (Key/Block/FNUM MSB)
+ */
+static int opll2opl3_flush_channel(VGMContext *p_vgmctx, int ch, const CommandOptions *p_opts)
+{
+    OPLL2OPL3_Scheduler *p_s = &(p_vgmctx->opll_state.sch);
+    OPLL2OPL3_PendingChannel *p = &p_s->ch[ch];
+    const uint8_t *regs = p_vgmctx->opll_state.reg;
+    int wrote_bytes = 0;
+
+    if (!p->is_pending) return 0;
+    opll2opl3_debug_log(p_vgmctx, OPL3_TRACE_TAG_FLUSH_BURST, ch, p_opts);
+
+    uint8_t reg_bn = (uint8_t)(((regs[0x20 + ch] & 0x1F) << 1) | ((regs[0x10 + ch] & 0x80) >> 7));
+    uint8_t reg_an = (uint8_t)((regs[0x10 + ch] & 0x7F) << 1);
+    bool voice_dirty = p->has_voice || p->has_tl || p->has_fnum_high;
+    bool freq_dirty  = p->has_fnum_low || p->has_fnum_high;
+
+    if (p->is_keyoff_forced) {
+        // KeyOff -> KeyOn inside one burst: keep the retrigger edge
+        wrote_bytes += opll2opl3_schedule_key(p_vgmctx, ch, false, 0, (uint8_t)(reg_bn & ~0x20), false, p_opts);
+    }
+    if (voice_dirty) {
+        if (p_opts->is_voice_zero_clear) {
+            wrote_bytes += opll2opl3_zero_clear_voice(p_vgmctx, ch, p_opts);
+        }
+        wrote_bytes += opll2opl3_update_voice(p_vgmctx, ch, p_opts);
+    }
+    if (freq_dirty) {
+        wrote_bytes += opll2opl3_schedule_key(p_vgmctx, ch, true, reg_an, reg_bn, p->has_voice, p_opts);
+    }
+
+    p->is_active = (reg_bn & 0x20) != 0;
+    if (p->is_pending_keyon) p->keyon_time = p->sched_on_time;
+    p->last_emit_time = p_s->emit_time;
+    p->is_pending = false;
+    p->is_pending_keyon = false;
+    p->is_pending_keyoff = false;
+    p->is_keyoff_forced = false;
+    p->has_fnum_low = false;
+    p->has_fnum_high = false;
+    p->has_tl = false;
+    p->has_voice = false;
+    return wrote_bytes;
+}
+
+/** Flush every held channel burst (deferred key events stay queued). */
+static int opll2opl3_flush_bursts(VGMContext *p_vgmctx, const CommandOptions *p_opts)
+{
+    int wrote_bytes = 0;
+    for (int ch = 0; ch < OPLL_NUM_CHANNELS; ++ch) {
+        wrote_bytes += opll2opl3_flush_channel(p_vgmctx, ch, p_opts);
+    }
+    return wrote_bytes;
+}
+
+/** Flush held bursts and deferred key events (loop point, end of data). */
+int opll2opl3_flush_all(VGMContext *p_vgmctx, const CommandOptions *p_opts)
+{
+    OPL3ProfileStage prev_stage = OPL3_PROFILE_IDLE;
+    if (OPL3_PROFILE_ON(p_vgmctx->p_profile)) prev_stage = opl3_profile_enter(p_vgmctx->p_profile, OPL3_PROFILE_YM2413);
+    int wrote_bytes = opll2opl3_flush_bursts(p_vgmctx, p_opts);
+    wrote_bytes += opll2opl3_key_drain(p_vgmctx, p_opts);
+    if (OPL3_PROFILE_ON(p_vgmctx->p_profile)) opl3_profile_leave(p_vgmctx->p_profile, prev_stage);
+    return wrote_bytes;
+}
+
+/**
+ * Called before time advances by wait_samples (virtual_time already advanced):
+ * flush complete bursts and those whose hold would exceed the coalescing window.
+ */
+static int opll2opl3_flush_due(VGMContext *p_vgmctx, const CommandOptions *p_opts)
+{
+    OPLL2OPL3_Scheduler *p_s = &(p_vgmctx->opll_state.sch);
+    uint32_t window = opll2opl3_coalesce_window(p_opts);
+    int wrote_bytes = 0;
+    for (int ch = 0; ch < OPLL_NUM_CHANNELS; ++ch) {
+        OPLL2OPL3_PendingChannel *p = &p_s->ch[ch];
+        if (!p->is_pending) continue;
+        if (opll2opl3_pending_complete(p) || (p_s->virtual_time - p->pending_since) > window) {
+            wrote_bytes += opll2opl3_flush_channel(p_vgmctx, ch, p_opts);
+        }
+    }
+    return wrote_bytes;
+}
+
 int opll2opl3_handle_opll_command (VGMContext *p_vgmctx, uint8_t reg, uint8_t val, const CommandOptions *p_opts) 
 {
     int wrote_bytes = 0;
     if (reg == 0x0e) {
-        OPLL2OPL3_Scheduler *p_s = &(p_vgmctx->opll_state.sch);
         int lfoDepth = OPLL_LFO_DEPTH; 
 
+        // Keep ordering: held channel bursts go out before the rhythm switch
+        wrote_bytes += opll2opl3_flush_bursts(p_vgmctx, p_opts);
+
         bool prev_rhythm_mode = p_vgmctx->opll_state.is_rhythm_mode;
         bool now_rhythm_mode  = (val & 0x20) != 0;
 
@@ -1235,50 +1691,28 @@ int opll2opl3_handle_opll_command (VGMContext *p_vgmctx, uint8_t reg, uint8_t va
         wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xbd, (lfoDepth << 6) | (val & 0x3f), p_opts);
         return wrote_bytes;
     }
-        /* --- FNUM Low (0x10..0x18) --- */
+    /* --- FNUM Low (0x10..0x18) --- */
     if (reg >= 0x10 && reg <= 0x18) {
         int ch = reg & 0x0F;
         OPLL2OPL3_PendingChannel *p = &(p_vgmctx->opll_state.sch.ch[ch]);
         p->fnum_comb = (uint16_t)((p->fnum_comb & 0x300) | val);
-        p->has_fnum_low = true;
+        p->fnum_low = val;
         p->last_reg_10 = val;
 
-        opll2opl3_debug_log(p_vgmctx, "HANDLE", "FNUM Low",ch, p_opts);
-        bool keybit   = (val & 0x80) != 0;
-        if (p_opts && p_opts->debug.verbose) {
-            fprintf(stderr,
-                "[DEBUG] OPLL→OPL3 Before conversion: block=%u, fnum=0x%03X (dec %u) src_clock=%.1f dst_clock=%.1f\n",
-                p->block, p->fnum_comb & 0x3FF, p->fnum_comb & 0x3FF,
-                p_vgmctx->source_fm_clock, p_vgmctx->target_fm_clock);
+        opll2opl3_debug_log(p_vgmctx, OPL3_TRACE_TAG_FNUM_LOW, ch, p_opts);
+        if (!p_opts->is_keyon_coalesce) {
+            // Direct: B0 first (FNUM bit 8 is there), then A0 with the new LSB
+            uint8_t reg_bn = (uint8_t)(((p_vgmctx->opll_state.reg[0x20 + ch] & 0x1F) << 1) | ((val & 0x80) >> 7));
+            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xB0 + ch, reg_bn, p_opts);
+            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xA0 + ch, (uint8_t)((val & 0x7F) << 1), p_opts);
+            return wrote_bytes;
         }
-
-        uint16_t dst_fnum = (uint16_t)(p->fnum_comb & 0x3FF);
-        uint8_t dst_block = p->block & 0x07;
-            (void)convert_fnum_block_from_opll_to_opl3(
-                p_vgmctx->source_fm_clock,
-                p_vgmctx->target_fm_clock,
-                p->block,
-                p->fnum_comb,
-            &dst_fnum,
-            &dst_block);
-        if (p_opts && p_opts->debug.verbose) {
-            fprintf(stderr,
-                "[DEBUG] OPLL→OPL3 After conversion: dst_block=%u, dst_fnum=0x%03X (dec %u)\n",
-                dst_block, dst_fnum, dst_fnum);
-        }
-
-        if (p_opts && p_opts->debug.verbose) {
-            fprintf(stderr, "[DEBUG][0x10] ch=%d val=0x%02X (should be FNUM-LSB)\n", ch, val);
-        }
-        uint8_t reg_bn = ((p_vgmctx->opll_state.reg[0x20 + ch]  & 0x1F) << 1) | ((val & 0x80) >> 7) ;
-        uint8_t reg_an = (val & 0x7f) << 1;
-
+        p->has_fnum_low = true;
+        opll2opl3_mark_pending(&p_vgmctx->opll_state.sch, ch);
         if (p_opts && p_opts->debug.verbose) {
-            fprintf(stderr,
-                "[DEBUG] reg_bn:0x%02x reg_an:0x%02x\n",reg_bn,reg_an);
+            fprintf(stderr, "[DEBUG][0x10] ch=%d val=0x%02X block=%u fnum=0x%03X (held)\n",
+                ch, val, p->block, p->fnum_comb & 0x3FF);
         }
-        wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xB0 + ch, reg_bn, p_opts);
-        wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xA0 + ch, reg_an, p_opts);
         return wrote_bytes;
     }
 
@@ -1292,109 +1726,129 @@ int opll2opl3_handle_opll_command (VGMContext *p_vgmctx, uint8_t reg, uint8_t va
         bool keybit   = (val & 0x10) != 0;
         bool prev_key = p->key_state;
 
+        if (!p_opts->is_keyon_coalesce) {
+            // Direct: voice, then B0 (Key/Block/FNUM MSB) and A0, as the OPLL applies 2n at once
+            p->fnum_high = fhi;
+            p->fnum_comb = (uint16_t)((fhi << 8) | (p->last_reg_10 & 0xFF));
+            p->block = block;
+            p->last_reg_20 = val;
+            p->key_state = keybit;
+            if (p_opts->is_voice_zero_clear) {
+                wrote_bytes += opll2opl3_zero_clear_voice(p_vgmctx, ch, p_opts);
+            }
+            wrote_bytes += opll2opl3_update_voice(p_vgmctx, ch, p_opts);
+            uint8_t reg_bn = (uint8_t)(((val & 0x1F) << 1) | ((p_vgmctx->opll_state.reg[0x10 + ch] & 0x80) >> 7));
+            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xB0 + ch, reg_bn, p_opts);
+            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xA0 + ch, (uint8_t)((p->last_reg_10 & 0x7F) << 1), p_opts);
+            opll2opl3_debug_log(p_vgmctx, OPL3_TRACE_TAG_FNUM_HIGH_KEY, ch, p_opts);
+            return wrote_bytes;
+        }
+
+        if (keybit && !prev_key) {
+            // KeyOn edge: a KeyOff already held in this burst becomes a retrigger
+            if (p->is_pending_keyoff) {
+                p->is_keyoff_forced = true;
+                p->is_pending_keyoff = false;
+            }
+            p->is_pending_keyon = true;
+        } else if (!keybit && prev_key) {
+            // KeyOff edge while the KeyOn is still held: emit the note first (short pulse)
+            if (p->is_pending_keyon) {
+                uint8_t cur = p_vgmctx->opll_state.reg[reg];
+                p_vgmctx->opll_state.reg[reg] = p->last_reg_20;
+                wrote_bytes += opll2opl3_flush_channel(p_vgmctx, ch, p_opts);
+                p_vgmctx->opll_state.reg[reg] = cur;
+            }
+            p->is_pending_keyoff = true;
+        }
+
         // FNUM/Block/Key update
         p->fnum_high = fhi;
         p->fnum_comb = (uint16_t)((fhi << 8) | (p->last_reg_10 & 0xFF));
         p->block = block;
         p->last_reg_20 = val;
-
-        if (p_opts->is_voice_zero_clear) {
-            // 0x20～0x28書き込み時は毎回ゼロクリア＋voice apply（vgm-conv互換）
-            int mod_slot = opl3_opreg_addr(0, ch, 0);
-            int car_slot = opl3_opreg_addr(0, ch, 1);
-
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x20 + mod_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x20 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x40 + mod_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x40 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x60 + mod_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x60 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x80 + mod_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x80 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xE0 + mod_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xE0 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xC0 + ch, 0xF0, p_opts);
-        }
-
-        wrote_bytes += opll2opl3_update_voice(p_vgmctx, ch, p_opts);
-
-        // KeyOn/KeyOff含むA0/B0レジスタ書き込み（OPLL的なNoteOn/Off反映）
-        uint8_t reg_bn = ((val  & 0x1F) << 1) | ((p_vgmctx->opll_state.reg[0x10 + ch] & 0x80) >> 7);
-        uint8_t reg_an = (p->last_reg_10 & 0x7f) << 1;
-        wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xB0 + ch, reg_bn, p_opts);
-        wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xA0 + ch, reg_an, p_opts);
         p->key_state = keybit;
         p->has_fnum_high = true;
+        opll2opl3_mark_pending(&p_vgmctx->opll_state.sch, ch);
+
+        opll2opl3_debug_log(p_vgmctx, OPL3_TRACE_TAG_FNUM_HIGH_KEY, ch, p_opts);
         return wrote_bytes;
     }
 
     /* --- Instrument/Volume (0x30..0x38) --- */
-    // Instrument/Volume (0x30..0x38)
     if (reg >= 0x30 && reg <= 0x38) {
         int ch = reg & 0x0F;
         OPLL2OPL3_PendingChannel *p = &(p_vgmctx->opll_state.sch.ch[ch]);
-        uint16_t dst_fnum = (uint16_t)(p->fnum_comb & 0x3FF);
-        uint8_t dst_block = p->block & 0x07;
 
+        bool is_voice_changed = ((p->last_reg_30 ^ val) & 0xF0) != 0;
         p->last_reg_30 = val;
         p->voice_id = (val >> 4) & 0x0F;
         p->tl = val & 0x0F;
 
-        if (p_opts->is_voice_zero_clear) {
-            // --- ここからゼロクリア追加 ---
-            // operator slot計算(2op)
-            int mod_slot = opl3_opreg_addr(0, ch, 0);
-            int car_slot = opl3_opreg_addr(0, ch, 1);
-
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x20 + mod_slot, 0x00, p_opts); // AM/VIB/EGT/KSR/MULT
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x20 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x40 + mod_slot, 0x00, p_opts); // KSL/TL
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x40 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x60 + mod_slot, 0x00, p_opts); // AR/DR
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x60 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x80 + mod_slot, 0x00, p_opts); // SL/RR
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0x80 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xE0 + mod_slot, 0x00, p_opts); // WS
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xE0 + car_slot, 0x00, p_opts);
-            wrote_bytes += opll2opl3_emit_reg_write(p_vgmctx, 0xC0 + ch, 0xF0, p_opts); // Feedback/Algo（FM）
+        opll2opl3_debug_log(p_vgmctx, OPL3_TRACE_TAG_INST_VOL, ch, p_opts);
+        if (!p_opts->is_keyon_coalesce) {
+            // Direct: reapply the voice with the new instrument/volume
+            if (p_opts->is_voice_zero_clear) {
+                wrote_bytes += opll2opl3_zero_clear_voice(p_vgmctx, ch, p_opts);
+            }
+            return wrote_bytes + opll2opl3_update_voice(p_vgmctx, ch, p_opts);
         }
+        if (is_voice_changed) p->has_voice = true;
+        p->has_tl = true;
+        opll2opl3_mark_pending(&p_vgmctx->opll_state.sch, ch);
+        return wrote_bytes;
+    }
+    return wrote_bytes;
+}
 
-        opll2opl3_debug_log(p_vgmctx, "HANDLE", "Instrument/Volume", ch, p_opts);
-        wrote_bytes += opll2opl3_update_voice(p_vgmctx, ch, p_opts);
+/**
+ * Time that reached the output without a scheduler wait (the stream clock moved past
+ * seen_sample): move emit_time along and release the bursts and key events that fell
+ * due in that span, so deadlines never wait for the next scheduled wait.
+ */
+static int opll2opl3_catch_up(VGMContext *p_vgmctx, const CommandOptions *p_opts)
+{
+    OPLL2OPL3_Scheduler *p_s = &(p_vgmctx->opll_state.sch);
+    sample_t now = p_vgmctx->timestamp.current_sample;
+    int wrote_bytes = 0;
 
-        return wrote_bytes;
+    if (now > p_s->seen_sample) {
+        p_s->emit_time += now - p_s->seen_sample;
+        wrote_bytes += opll2opl3_flush_due(p_vgmctx, p_opts);
+        while (p_s->key_heap_size > 0) {
+            int ch = p_s->key_heap[0];
+            if (opll2opl3_key_head_due(p_s, ch) > p_s->emit_time) break;
+            opll2opl3_key_heap_remove_at(p_s, 0);
+            wrote_bytes += opll2opl3_key_release(p_vgmctx, ch, p_s->emit_time, p_opts);
+        }
     }
+    p_s->seen_sample = now;
     return wrote_bytes;
 }
 
 int opll2opl3_schedule_wait(VGMContext *p_vgmctx, uint32_t wait_samples, const CommandOptions *p_opts, OPLL2OPL3_Scheduler *s)
 {
     int wrote_bytes = 0;
-    wrote_bytes += emit_wait(p_vgmctx, wait_samples, s, p_opts);
+    wrote_bytes += opll2opl3_flush_due(p_vgmctx, p_opts);
+    wrote_bytes += opll2opl3_wait_with_events(p_vgmctx, wait_samples, p_opts);
     return wrote_bytes;
 }
 
 /**
  * Main register write entrypoint for OPLL emulation.
  */
-int opll2opl3_command_handler (VGMContext *p_vgmctx, uint8_t reg, uint8_t val, uint16_t wait_samples, const CommandOptions *p_opts)
+static int opll2opl3_handle_command(VGMContext *p_vgmctx, uint8_t reg, uint8_t val, uint16_t wait_samples, const CommandOptions *p_opts)
  {
     int wrote_bytes = 0;
     // Update timestamp
     p_vgmctx->opll_state.sch.virtual_time = p_vgmctx->timestamp.current_sample;
     
-    if (p_opts->debug.verbose) {
-        fprintf(stderr,
-        "\n[OPLL2OPL3][HANDLER][%s] virtual_time:%llu emit_time:%llu --- reg:0x%02x val:0x%02x Sample:%d\n",
-        (p_vgmctx->cmd_type == VGMCommandType_RegWrite) ? "RegWrite" : "Wait",
-        (unsigned long long)p_vgmctx->opll_state.sch.virtual_time,
-        (unsigned long long)p_vgmctx->opll_state.sch.emit_time,reg,val,wait_samples
-        );
-    }
+    opll2opl3_trace(p_vgmctx, OPL3_TRACE_HANDLER, 0, reg, val, wait_samples,
+                    p_vgmctx->cmd_type == VGMCommandType_RegWrite, p_opts);
+    wrote_bytes += opll2opl3_catch_up(p_vgmctx, p_opts);
 
     if (p_vgmctx->cmd_type == VGMCommandType_RegWrite) {
-        p_vgmctx->opll_state.reg_stamp[reg] = p_vgmctx->opll_state.reg[reg];
-        p_vgmctx->opll_state.reg[reg] = val;
+        if (reg < YM2413_REGS_SIZE) p_vgmctx->opll_state.reg[reg] = val;
         //handle_opll_write(p_vgmctx, reg, val, p_opts, &g_scheduler );
         wrote_bytes += opll2opl3_handle_opll_command(p_vgmctx, reg, val, p_opts);
     } else if (p_vgmctx->cmd_type == VGMCommandType_Wait) {
@@ -1404,7 +1858,19 @@ int opll2opl3_command_handler (VGMContext *p_vgmctx, uint8_t reg, uint8_t val, u
     } else {
         // Should not be occured here
     }
+    p_vgmctx->opll_state.sch.seen_sample = p_vgmctx->timestamp.current_sample;
 
     return wrote_bytes;
 }
 
+int opll2opl3_command_handler(VGMContext *p_vgmctx, uint8_t reg, uint8_t val, uint16_t wait_samples, const CommandOptions *p_opts)
+{
+    if (OPL3_PROFILE_ON(p_vgmctx->p_profile)) {
+        OPL3ProfileStage prev_stage = opl3_profile_enter(p_vgmctx->p_profile, OPL3_PROFILE_YM2413);
+        int wrote_bytes = opll2opl3_handle_command(p_vgmctx, reg, val, wait_samples, p_opts);
+        opl3_profile_leave(p_vgmctx->p_profile, prev_stage);
+        return wrote_bytes;
+    }
+    return opll2opl3_handle_command(p_vgmctx, reg, val, wait_samples, p_opts);
+}
+
@@ -8,5 +8,6 @@
 
 void opll2opl3_init_scheduler  (VGMContext *p_vgmctx, const CommandOptions *p_opts);
 int  opll2opl3_command_handler (VGMContext *p_vgmctx, uint8_t reg, uint8_t val, uint16_t wait_samples, const CommandOptions *p_opts);
+int  opll2opl3_flush_all       (VGMContext *p_vgmctx, const CommandOptions *p_opts);
 
 #endif /* ESEOPL3PATCHER_OPLL2OPL3_CONV_H */
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include <string.h>
+#include "opll_bridge.h"
+#include "opll2opl3_conv.h"
+#include "opll_voice_bank.h"
+#include "../opl3/opl3_clock.h"
+#include "../opl3/opl3_convert.h"
+#include "../opl3/opl3_voice.h"
+#include "../opl3/opl3_hooks.h"
+#include "../vgm/vgm_header.h"
+
+/** Output of the converter: straight into the ring instead of the VGM buffer. */
+static bool bridge_on_pre_write(void *p_user, uint32_t sample, int port, uint8_t reg, uint8_t *p_val) {
+    OPLLBridge *p_br = (OPLLBridge *)p_user;
+    OPL3RingWrite w = {sample, (uint8_t)port, reg, *p_val, 0, opl3_now_ns()};
+    if (opl3_ring_push(p_br->p_ring, &w)) {
+        p_br->stats.opl3_writes++;
+    } else {
+        p_br->stats.overflows++;
+    }
+    return false;
+}
+
+static const OPL3Hooks k_bridge_hooks = {
+    .on_pre_write = bridge_on_pre_write,
+};
+
+static void bridge_record_latency(OPLLBridgeLatency *p_lat, uint64_t ns) {
+    uint32_t v = (ns > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)ns;
+    p_lat->popped++;
+    p_lat->total_ns += ns;
+    if (v > p_lat->max_ns) p_lat->max_ns = v;
+    p_lat->hist[31 - __builtin_clz(v | 1)]++;
+}
+
+/** Advance the converter to input sample `sample` (splits waits to the handler's 16-bit range). */
+static void bridge_wait_until(OPLLBridge *p_br, uint32_t sample) {
+    VGMContext *p_ctx = &p_br->ctx;
+    if (sample < p_br->in_sample) {
+        p_br->stats.late++;
+        return;
+    }
+    uint32_t remain = sample - p_br->in_sample;
+    p_ctx->cmd_type = VGMCommandType_Wait;
+    while (remain > 0) {
+        uint16_t step = (remain > 0xFFFF) ? 0xFFFF : (uint16_t)remain;
+        opll2opl3_command_handler(p_ctx, 0, 0, step, &p_ctx->cmd_opts);
+        remain -= step;
+    }
+    p_br->in_sample = sample;
+}
+
+int opll_bridge_init(OPLLBridge *p_br, const CommandOptions *p_opts, double opll_clock, OPL3Ring *p_ring) {
+    memset(p_br, 0, sizeof(*p_br));
+    VGMContext *p_ctx = &p_br->ctx;
+    p_br->p_ring = p_ring;
+
+    vgm_buffer_init(&p_ctx->buffer);
+    vgm_buffer_reserve(&p_ctx->buffer, OPLL_BRIDGE_BUFFER_BYTES);
+    p_ctx->timestamp.sample_rate = 44100.0;
+    p_ctx->cmd_type = VGMCommandType_Unkown;
+    p_ctx->cmd_opts = *p_opts;
+    p_ctx->cmd_opts.is_keep_source_vgm = false;   // nothing but OPL3 writes reach the player
+    p_ctx->source_fmchip = FMCHIP_YM2413;
+    p_ctx->source_fm_clock = (opll_clock > 0) ? opll_clock : (double)get_vgm_default_chip_clock(FMCHIP_YM2413);
+    p_ctx->target_fmchip = p_ctx->cmd_opts.is_moon ? FMCHIP_YMF278B : FMCHIP_YMF262;
+    p_ctx->target_fm_clock = OPL3_CLOCK;
+    p_ctx->p_metrics = NULL;
+    opl3_hooks_attach(&p_ctx->hooks, &k_bridge_hooks, p_br);
+
+    opl3_init(p_ctx, FMCHIP_YM2413, &p_ctx->cmd_opts);
+    p_ctx->opl3_state.opl3_mode_initialized = true;
+    opll2opl3_init_scheduler(p_ctx, &p_ctx->cmd_opts);
+
+    // Everything the write path would otherwise allocate on first use
+    p_ctx->opll_state.p_voice_bank = opll_voice_bank_open(p_ctx->cmd_opts.p_voice_bank_path, p_ctx->cmd_opts.debug.verbose);
+    if (opl3_voice_db_reserve(&p_ctx->opl3_state.voice_db, OPLL_BRIDGE_MAX_VOICES) != 0) {
+        opll_bridge_free(p_br);
+        return -1;
+    }
+    p_ctx->buffer.size = 0;
+    return 0;
+}
+
+void opll_bridge_write(OPLLBridge *p_br, uint32_t sample, uint8_t reg, uint8_t val) {
+    VGMContext *p_ctx = &p_br->ctx;
+
+    bridge_wait_until(p_br, sample);
+    p_ctx->cmd_type = VGMCommandType_RegWrite;
+    opll2opl3_command_handler(p_ctx, reg, val, 0, &p_ctx->cmd_opts);
+    p_ctx->buffer.size = 0;   // only waits land here; the writes went to the ring
+
+    p_br->stats.writes++;
+}
+
+void opll_bridge_advance(OPLLBridge *p_br, uint32_t sample) {
+    bridge_wait_until(p_br, sample);
+    p_br->ctx.buffer.size = 0;
+}
+
+void opll_bridge_finish(OPLLBridge *p_br) {
+    if (p_br->is_finished) return;
+    p_br->ctx.cmd_type = VGMCommandType_End;
+    opll2opl3_flush_all(&p_br->ctx, &p_br->ctx.cmd_opts);
+    p_br->ctx.buffer.size = 0;
+    p_br->is_finished = true;
+}
+
+bool opll_bridge_pop(OPLLBridge *p_br, OPL3RingWrite *p_w, uint64_t now_ns) {
+    if (!opl3_ring_pop(p_br->p_ring, p_w)) return false;
+    bridge_record_latency(&p_br->latency, (now_ns > p_w->queued_ns) ? now_ns - p_w->queued_ns : 0);
+    return true;
+}
+
+void opll_bridge_free(OPLLBridge *p_br) {
+    opll_voice_bank_close(p_br->ctx.opll_state.p_voice_bank);
+    p_br->ctx.opll_state.p_voice_bank = NULL;
+    opl3_voice_db_free(&p_br->ctx.opl3_state.voice_db);
+    vgm_buffer_free(&p_br->ctx.buffer);
+}
@@ -0,0 +1,77 @@
+#ifndef OPLL_BRIDGE_H
+#define OPLL_BRIDGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../vgm/vgm_helpers.h"
+#include "../opl3/opl3_ring.h"
+
+/*
+ * Real-time YM2413 -> OPL3 register bridge.
+ *
+ * タイムスタンプ付きの YM2413 書き込みを1つずつ受け取り、オフライン変換と
+ * 同じ opll2opl3 の処理 (opll2opl3_command_handler) を通して、出てきた
+ * OPL3 書き込みを SPSC リングへ積む。再生スレッドはリングから取り出して
+ * 実チップ / エミュレータへ書く。
+ *
+ *  - 出力は VGMContext の hooks (on_pre_write) で横取りし、VGM バッファには積まない。
+ *    wait だけはバッファに入るので 1 回ごとに巻き戻す (容量は init で確保済み)。
+ *  - 音色バンク・voice DB・バッファは init で確保するので、書き込み経路は
+ *    OPLL_BRIDGE_MAX_VOICES 種類の音色までメモリ確保をしない。
+ *  - OPL3 書き込みごとにリング内の待ち時間 (push -> pop) を計測する。
+ *    push 時刻はスロットに入れ、統計は pop する consumer 側が持つ。
+ *
+ * 保持中のバースト (--keyon-coalesce) は時間が進むまで出てこないので、
+ * producer は入力が途切れている間も opll_bridge_advance() を周期的に呼んで
+ * 現在時刻まで進める (CLI は 1 ms ごと)。
+ */
+
+#define OPLL_BRIDGE_MAX_VOICES    1024      /* voice DB entries reserved up front */
+#define OPLL_BRIDGE_BUFFER_BYTES  4096      /* scratch for the wait commands of one call */
+#define OPLL_BRIDGE_HIST_BUCKETS  32        /* latency histogram, bucket k = [2^k, 2^(k+1)) ns */
+
+typedef struct {
+    uint64_t writes;            /* YM2413 writes handled */
+    uint64_t opl3_writes;       /* OPL3 writes queued */
+    uint64_t overflows;         /* OPL3 writes dropped on a full ring */
+    uint64_t late;              /* input timestamps behind the stream position */
+} OPLLBridgeStats;
+
+/** Consumer side: time each OPL3 write spent in the ring (push -> pop). */
+typedef struct {
+    uint64_t popped;
+    uint64_t total_ns;
+    uint32_t max_ns;
+    uint32_t hist[OPLL_BRIDGE_HIST_BUCKETS];
+} OPLLBridgeLatency;
+
+typedef struct {
+    VGMContext       ctx;
+    OPL3Ring        *p_ring;
+    uint32_t         in_sample;     /* input timeline position */
+    bool             is_finished;
+    OPLLBridgeStats  stats;         /* producer only */
+    _Alignas(OPL3_RING_CACHE_LINE) OPLLBridgeLatency latency;   /* consumer only */
+} OPLLBridge;
+
+/**
+ * Set up the converter (opl3_init, scheduler, voice bank) and queue the OPL3 init writes.
+ * opll_clock 0 = the standard 3.579545 MHz. Returns 0, or -1 on allocation failure.
+ */
+int  opll_bridge_init(OPLLBridge *p_br, const CommandOptions *p_opts, double opll_clock, OPL3Ring *p_ring);
+
+/** One YM2413 write at input sample `sample` (timestamps must not go backwards). */
+void opll_bridge_write(OPLLBridge *p_br, uint32_t sample, uint8_t reg, uint8_t val);
+
+/** Time passes without a write: emit what is due up to `sample` (call it periodically while the input is quiet). */
+void opll_bridge_advance(OPLLBridge *p_br, uint32_t sample);
+
+/** End of the input stream: flush everything still held. */
+void opll_bridge_finish(OPLLBridge *p_br);
+
+/** Consumer: take the oldest OPL3 write and record how long it was queued (now_ns: opl3_now_ns()). */
+bool opll_bridge_pop(OPLLBridge *p_br, OPL3RingWrite *p_w, uint64_t now_ns);
+
+void opll_bridge_free(OPLLBridge *p_br);
+
+#endif /* OPLL_BRIDGE_H */
@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "opll_override.h"
+#include "../opl3/opl3_voice.h"
+#include "../opl3/opl3_hash.h"
+
+#define OVR_LINE_MAX 256
+
+static const char *const k_field_names[OPLL_OVR_NUM_FIELDS] = {
+    "am", "vib", "egt", "ksr", "mult", "ksl", "tl", "ar", "dr", "sl", "rr", "ws"
+};
+static const uint8_t k_field_max[OPLL_OVR_NUM_FIELDS] = {
+    1, 1, 1, 1, 15, 3, 63, 15, 15, 15, 15, 7
+};
+static const char *const k_env_names[OPLL_ENV_NUM] = { "ar", "dr", "sl", "rr" };
+
+/* Raw sections as written in the file: [default], [inst 0..18], [ch 0..8] */
+enum { OVR_SEC_DEFAULT = 0, OVR_SEC_INST = 1, OVR_SEC_CH = OVR_SEC_INST + OPLL_OVERRIDE_NUM_INST,
+       OVR_SEC_COUNT = OVR_SEC_CH + OPLL_OVERRIDE_NUM_CH };
+
+/* Line of each raw section's env clamps (0 = not in the file), for the empty-range check */
+typedef struct {
+    int min_line[2][OPLL_ENV_NUM];
+    int max_line[2][OPLL_ENV_NUM];
+} OvrClampLines;
+
+static void entry_init(OPLLOverrideEntry *p_e) {
+    memset(p_e, 0, sizeof(*p_e));
+    memset(p_e->env_max, 15, sizeof(p_e->env_max));
+    p_e->fb = -1;
+    p_e->cnt = -1;
+}
+
+/** Layer p_src over p_dst: fields/fb/cnt/detune replace, tl_offset adds, clamps intersect. */
+static void entry_merge(OPLLOverrideEntry *p_dst, const OPLLOverrideEntry *p_src) {
+    for (int op = 0; op < 2; ++op) {
+        for (int f = 0; f < OPLL_OVR_NUM_FIELDS; ++f) {
+            if (p_src->set_mask[op] & (1u << f)) p_dst->value[op][f] = p_src->value[op][f];
+        }
+        p_dst->set_mask[op] |= p_src->set_mask[op];
+        int tl = p_dst->tl_offset[op] + p_src->tl_offset[op];
+        p_dst->tl_offset[op] = (int8_t)((tl < -63) ? -63 : (tl > 63) ? 63 : tl);
+        for (int e = 0; e < OPLL_ENV_NUM; ++e) {
+            if (p_src->env_min[op][e] > p_dst->env_min[op][e]) p_dst->env_min[op][e] = p_src->env_min[op][e];
+            if (p_src->env_max[op][e] < p_dst->env_max[op][e]) p_dst->env_max[op][e] = p_src->env_max[op][e];
+        }
+    }
+    if (p_src->fb >= 0) p_dst->fb = p_src->fb;
+    if (p_src->cnt >= 0) p_dst->cnt = p_src->cnt;
+    if (p_src->has_detune) {
+        p_dst->has_detune = true;
+        p_dst->detune = p_src->detune;
+    }
+}
+
+static bool entry_is_identity(const OPLLOverrideEntry *p_e) {
+    OPLLOverrideEntry id;
+    entry_init(&id);
+    return memcmp(p_e, &id, sizeof(id)) == 0;
+}
+
+static char *ovr_trim(char *p) {
+    while (isspace((unsigned char)*p)) ++p;
+    char *p_end = p + strlen(p);
+    while (p_end > p && isspace((unsigned char)p_end[-1])) *--p_end = '\0';
+    return p;
+}
+
+/** Parse an integer in [lo, hi]. Returns 0 on success. */
+static int ovr_parse_int(const char *p, long lo, long hi, long *p_out) {
+    char *p_end;
+    long v = strtol(p, &p_end, 0);
+    if (p_end == p || *ovr_trim(p_end) != '\0' || v < lo || v > hi) return -1;
+    *p_out = v;
+    return 0;
+}
+
+static int ovr_parse_section(const char *p_name, int *p_sec) {
+    long n;
+    if (strcmp(p_name, "default") == 0) {
+        *p_sec = OVR_SEC_DEFAULT;
+        return 0;
+    }
+    if (strncmp(p_name, "inst", 4) == 0 && ovr_parse_int(p_name + 4, 0, OPLL_OVERRIDE_NUM_INST - 1, &n) == 0) {
+        *p_sec = OVR_SEC_INST + (int)n;
+        return 0;
+    }
+    if (strncmp(p_name, "ch", 2) == 0 && ovr_parse_int(p_name + 2, 0, OPLL_OVERRIDE_NUM_CH - 1, &n) == 0) {
+        *p_sec = OVR_SEC_CH + (int)n;
+        return 0;
+    }
+    return -1;
+}
+
+/** Apply "key = value" to a raw section entry. Returns 0, or -1 with *pp_err set. */
+static int ovr_parse_key(OPLLOverrideEntry *p_e, OvrClampLines *p_lines, int line_no,
+                         const char *p_key, const char *p_val, const char **pp_err) {
+    long n;
+    if (strcmp(p_key, "fb") == 0 || strcmp(p_key, "cnt") == 0) {
+        bool is_fb = (p_key[0] == 'f');
+        if (ovr_parse_int(p_val, 0, is_fb ? 7 : 1, &n) != 0) { *pp_err = "value out of range"; return -1; }
+        if (is_fb) p_e->fb = (int8_t)n;
+        else       p_e->cnt = (int8_t)n;
+        return 0;
+    }
+    if (strcmp(p_key, "detune") == 0) {
+        char *p_end;
+        double d = strtod(p_val, &p_end);
+        if (p_end == p_val || *ovr_trim(p_end) != '\0') { *pp_err = "detune must be a number"; return -1; }
+        p_e->has_detune = true;
+        p_e->detune = d;
+        return 0;
+    }
+
+    int op;
+    if (strncmp(p_key, "mod.", 4) == 0)      op = 0;
+    else if (strncmp(p_key, "car.", 4) == 0) op = 1;
+    else { *pp_err = "unknown key (expected mod.*, car.*, fb, cnt or detune)"; return -1; }
+    const char *p_field = p_key + 4;
+
+    if (strcmp(p_field, "tl_offset") == 0) {
+        if (ovr_parse_int(p_val, -63, 63, &n) != 0) { *pp_err = "tl_offset must be -63..63"; return -1; }
+        p_e->tl_offset[op] = (int8_t)n;
+        return 0;
+    }
+    for (int e = 0; e < OPLL_ENV_NUM; ++e) {
+        size_t len = strlen(k_env_names[e]);
+        if (strncmp(p_field, k_env_names[e], len) != 0 || p_field[len] != '_') continue;
+        const char *p_which = p_field + len + 1;
+        bool is_min = (strcmp(p_which, "min") == 0);
+        if (!is_min && strcmp(p_which, "max") != 0) break;
+        if (ovr_parse_int(p_val, 0, 15, &n) != 0) { *pp_err = "clamp must be 0..15"; return -1; }
+        if (is_min) {
+            p_e->env_min[op][e] = (uint8_t)n;
+            p_lines->min_line[op][e] = line_no;
+        } else {
+            p_e->env_max[op][e] = (uint8_t)n;
+            p_lines->max_line[op][e] = line_no;
+        }
+        return 0;
+    }
+    for (int f = 0; f < OPLL_OVR_NUM_FIELDS; ++f) {
+        if (strcmp(p_field, k_field_names[f]) != 0) continue;
+        if (ovr_parse_int(p_val, 0, k_field_max[f], &n) != 0) { *pp_err = "operator value out of range"; return -1; }
+        p_e->value[op][f] = (uint8_t)n;
+        p_e->set_mask[op] |= (uint16_t)(1u << f);
+        return 0;
+    }
+    *pp_err = "unknown operator field";
+    return -1;
+}
+
+/** Sections a and b are layered into one table entry: the same one, [default] with any, or an [inst N] with a [ch M]. */
+static bool ovr_sections_meet(int a, int b) {
+    if (a == b || a == OVR_SEC_DEFAULT || b == OVR_SEC_DEFAULT) return true;
+    bool is_inst_a = (a < OVR_SEC_CH), is_inst_b = (b < OVR_SEC_CH);
+    return is_inst_a != is_inst_b;
+}
+
+/**
+ * Clamps intersect when sections are layered, so a *_min above a *_max that meets it would
+ * leave an empty range. Report each such pair at the later of its two lines. Returns the count.
+ */
+static int ovr_check_clamps(const char *p_path, const OPLLOverrideEntry *p_raw, const OvrClampLines *p_lines) {
+    int errors = 0;
+    for (int op = 0; op < 2; ++op) {
+        for (int e = 0; e < OPLL_ENV_NUM; ++e) {
+            for (int a = 0; a < OVR_SEC_COUNT; ++a) {
+                int min_line = p_lines[a].min_line[op][e];
+                if (!min_line) continue;
+                for (int b = 0; b < OVR_SEC_COUNT; ++b) {
+                    int max_line = p_lines[b].max_line[op][e];
+                    if (!max_line || !ovr_sections_meet(a, b)) continue;
+                    uint8_t lo = p_raw[a].env_min[op][e], hi = p_raw[b].env_max[op][e];
+                    if (lo <= hi) continue;
+                    const char *p_op = op ? "car" : "mod";
+                    fprintf(stderr, "[OVERRIDE] %s:%d: %s.%s_min = %u is above %s.%s_max = %u (line %d): empty clamp range\n",
+                            p_path, (min_line > max_line) ? min_line : max_line, p_op, k_env_names[e], (unsigned)lo,
+                            p_op, k_env_names[e], (unsigned)hi, (min_line > max_line) ? max_line : min_line);
+                    ++errors;
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+OPLLOverrideTable *opll_override_load(const char *p_path) {
+    FILE *fp = fopen(p_path, "r");
+    if (!fp) {
+        fprintf(stderr, "[OVERRIDE] cannot open %s\n", p_path);
+        return NULL;
+    }
+
+    OPLLOverrideEntry raw[OVR_SEC_COUNT];
+    OvrClampLines clamp_lines[OVR_SEC_COUNT];
+    for (int i = 0; i < OVR_SEC_COUNT; ++i) entry_init(&raw[i]);
+    memset(clamp_lines, 0, sizeof(clamp_lines));
+
+    char line[OVR_LINE_MAX];
+    int line_no = 0;
+    int sec = -1;
+    int is_error = 0;
+    uint32_t hash = OPL3_FNV1A_BASIS;
+    while (fgets(line, sizeof(line), fp)) {
+        ++line_no;
+        hash = opl3_fnv1a(hash, line, strlen(line));
+        char *p_comment = strpbrk(line, "#;");
+        if (p_comment) *p_comment = '\0';
+        char *p = ovr_trim(line);
+        if (*p == '\0') continue;
+
+        const char *p_err = NULL;
+        if (*p == '[') {
+            char *p_close = strchr(p, ']');
+            if (!p_close || *ovr_trim(p_close + 1) != '\0') {
+                p_err = "malformed section header";
+            } else {
+                *p_close = '\0';
+                if (ovr_parse_section(ovr_trim(p + 1), &sec) != 0) p_err = "unknown section (default, inst 0-18, ch 0-8)";
+            }
+        } else {
+            char *p_eq = strchr(p, '=');
+            if (!p_eq) {
+                p_err = "expected key = value";
+            } else if (sec < 0) {
+                p_err = "key outside of a section";
+            } else {
+                *p_eq = '\0';
+                ovr_parse_key(&raw[sec], &clamp_lines[sec], line_no, ovr_trim(p), ovr_trim(p_eq + 1), &p_err);
+            }
+        }
+        if (p_err) {
+            fprintf(stderr, "[OVERRIDE] %s:%d: %s\n", p_path, line_no, p_err);
+            is_error = 1;
+        }
+    }
+    fclose(fp);
+    if (!is_error && ovr_check_clamps(p_path, raw, clamp_lines) > 0) is_error = 1;
+    if (is_error) return NULL;
+
+    OPLLOverrideTable *p_tbl = (OPLLOverrideTable *)calloc(1, sizeof(OPLLOverrideTable));
+    if (!p_tbl) return NULL;
+    for (int inst = 0; inst <= OPLL_OVERRIDE_NUM_INST; ++inst) {
+        for (int ch = 0; ch < OPLL_OVERRIDE_NUM_CH; ++ch) {
+            OPLLOverrideEntry *p_e = &p_tbl->entry[inst][ch];
+            entry_init(p_e);
+            entry_merge(p_e, &raw[OVR_SEC_DEFAULT]);
+            if (inst < OPLL_OVERRIDE_NUM_INST) entry_merge(p_e, &raw[OVR_SEC_INST + inst]);
+            entry_merge(p_e, &raw[OVR_SEC_CH + ch]);
+            p_e->is_active = !entry_is_identity(p_e);
+        }
+    }
+    p_tbl->hash = hash ? hash : 1;
+    return p_tbl;
+}
+
+void opll_override_free(OPLLOverrideTable *p_tbl) {
+    free(p_tbl);
+}
+
+void opll_override_apply_params(const OPLLOverrideEntry *p_e, OPL3VoiceParam *p_vp) {
+    for (int op = 0; op < 2; ++op) {
+        uint16_t mask = p_e->set_mask[op];
+        if (!mask) continue;
+        OPL3OpParam *o = &p_vp->op[op];
+        uint8_t *const p_fields[OPLL_OVR_NUM_FIELDS] = {
+            &o->am, &o->vib, &o->egt, &o->ksr, &o->mult, &o->ksl,
+            &o->tl, &o->ar, &o->dr, &o->sl, &o->rr, &o->ws
+        };
+        for (int f = 0; f < OPLL_OVR_NUM_FIELDS; ++f) {
+            if (mask & (1u << f)) *p_fields[f] = p_e->value[op][f];
+        }
+    }
+    if (p_e->fb >= 0) p_vp->fb[0] = (uint8_t)p_e->fb;
+    if (p_e->cnt >= 0) p_vp->cnt[0] = (uint8_t)p_e->cnt;
+}
+
+static inline uint8_t ovr_clamp(uint8_t v, uint8_t lo, uint8_t hi) {
+    if (v < lo) v = lo;
+    if (v > hi) v = hi;
+    return v;
+}
+
+void opll_override_apply_regs(const OPLLOverrideEntry *p_e, OPL3VoiceRegs *p_regs) {
+    for (int op = 0; op < 2; ++op) {
+        OPL3OpRegs *o = &p_regs->op[op];
+        if (p_e->tl_offset[op]) {
+            int tl = (int)opl3_op_tl(o) + p_e->tl_offset[op];
+            opl3_op_set_tl(o, (uint8_t)((tl < 0) ? 0 : (tl > 63) ? 63 : tl));
+        }
+        const uint8_t *lo = p_e->env_min[op], *hi = p_e->env_max[op];
+        opl3_op_set_ar(o, ovr_clamp(opl3_op_ar(o), lo[OPLL_ENV_AR], hi[OPLL_ENV_AR]));
+        opl3_op_set_dr(o, ovr_clamp(opl3_op_dr(o), lo[OPLL_ENV_DR], hi[OPLL_ENV_DR]));
+        opl3_op_set_sl(o, ovr_clamp(opl3_op_sl(o), lo[OPLL_ENV_SL], hi[OPLL_ENV_SL]));
+        opl3_op_set_rr(o, ovr_clamp(opl3_op_rr(o), lo[OPLL_ENV_RR], hi[OPLL_ENV_RR]));
+    }
+}
+
+double opll_override_detune(const OPLLOverrideTable *p_tbl, const VGMContext *p_ctx, int ch, double detune) {
+    int inst = OPLL_OVERRIDE_NO_INST;
+    if (p_ctx->source_fmchip == FMCHIP_YM2413 && ch < OPLL_OVERRIDE_NUM_CH) {
+        if (p_ctx->opll_state.is_rhythm_mode && ch >= 6) inst = 10 + ch;   // 16 BD, 17 SD/TOM, 18 HH/CYM
+        else inst = (p_ctx->opll_state.reg[0x30 + ch] >> 4) & 0x0F;
+    }
+    const OPLLOverrideEntry *p_e = opll_override_lookup(p_tbl, inst, ch);
+    return (p_e && p_e->has_detune) ? p_e->detune : detune;
+}
@@ -0,0 +1,81 @@
+#ifndef OPLL_OVERRIDE_H
+#define OPLL_OVERRIDE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../opl3/opl3_state.h"
+#include "../vgm/vgm_helpers.h"
+
+/*
+ * Per-song voice overrides (--override <file>).
+ *
+ * INI 形式のファイルを読み込み時に [音色][ch] のフラットな表へ展開しておき、
+ * opll_load_voice / opll2opl3_apply_voice は表を1回引くだけで済ませる
+ * (override 無しなら NULL チェックのみ)。
+ *
+ *   [default]        全音色・全 ch
+ *   [inst N]         N = 0 (user patch), 1-15, 16 BD, 17 SD/TOM, 18 HH/CYM
+ *   [ch N]           N = 0-8
+ *   mod.ar = 15      operator field: am vib egt ksr mult ksl tl ar dr sl rr ws
+ *   car.tl_offset = -4   added to the final TL (after volume)
+ *   car.rr_min = 4   envelope clamps on the final registers: ar/dr/sl/rr _min/_max
+ *   fb = 5 / cnt = 1
+ *   detune = 0.5     port1 chorus detune (%), replaces the global value
+ *
+ * 優先順位は [default] < [inst] < [ch]。オペレータ/fb/cnt/detune は後勝ち、
+ * tl_offset は加算、clamp は範囲の共通部分。
+ */
+
+#define OPLL_OVERRIDE_NUM_INST  19                       /* 0 = user patch, 1-15 melodic, 16-18 rhythm */
+#define OPLL_OVERRIDE_NO_INST   OPLL_OVERRIDE_NUM_INST   /* row used for non-YM2413 sources */
+#define OPLL_OVERRIDE_NUM_CH    9
+
+enum {
+    OPLL_OVR_AM = 0, OPLL_OVR_VIB, OPLL_OVR_EGT, OPLL_OVR_KSR, OPLL_OVR_MULT, OPLL_OVR_KSL,
+    OPLL_OVR_TL, OPLL_OVR_AR, OPLL_OVR_DR, OPLL_OVR_SL, OPLL_OVR_RR, OPLL_OVR_WS,
+    OPLL_OVR_NUM_FIELDS
+};
+
+enum { OPLL_ENV_AR = 0, OPLL_ENV_DR, OPLL_ENV_SL, OPLL_ENV_RR, OPLL_ENV_NUM };
+
+typedef struct {
+    uint16_t set_mask[2];                     /* replaced operator fields (bit = OPLL_OVR_*) */
+    uint8_t  value[2][OPLL_OVR_NUM_FIELDS];
+    int8_t   tl_offset[2];
+    uint8_t  env_min[2][OPLL_ENV_NUM];        /* AR/DR/SL/RR clamp, 0..15 */
+    uint8_t  env_max[2][OPLL_ENV_NUM];
+    int8_t   fb;                              /* -1 = keep */
+    int8_t   cnt;                             /* -1 = keep */
+    bool     has_detune;
+    bool     is_active;                       /* anything to apply for this [inst][ch] */
+    double   detune;
+} OPLLOverrideEntry;
+
+typedef struct OPLLOverrideTable {
+    OPLLOverrideEntry entry[OPLL_OVERRIDE_NUM_INST + 1][OPLL_OVERRIDE_NUM_CH];   /* resolved */
+    uint32_t hash;                            /* content hash (checkpoint option key) */
+} OPLLOverrideTable;
+
+/**
+ * Parse p_path and compile it. Returns NULL (after printing file:line) on error.
+ * The table is immutable afterwards; free with opll_override_free().
+ */
+OPLLOverrideTable *opll_override_load(const char *p_path);
+void opll_override_free(OPLLOverrideTable *p_tbl);
+
+static inline const OPLLOverrideEntry *opll_override_lookup(const OPLLOverrideTable *p_tbl, int inst, int ch) {
+    if ((unsigned)inst > OPLL_OVERRIDE_NO_INST || (unsigned)ch >= OPLL_OVERRIDE_NUM_CH) return NULL;
+    const OPLLOverrideEntry *p_e = &p_tbl->entry[inst][ch];
+    return p_e->is_active ? p_e : NULL;
+}
+
+/** Field replacements and FB/CNT on the voice parameters (opll_load_voice). */
+void opll_override_apply_params(const OPLLOverrideEntry *p_e, OPL3VoiceParam *p_vp);
+
+/** TL offsets and envelope clamps on the final register image (opll2opl3_apply_voice). */
+void opll_override_apply_regs(const OPLLOverrideEntry *p_e, OPL3VoiceRegs *p_regs);
+
+/** Chorus detune for OPL3 channel ch of p_ctx (instrument resolved for YM2413 sources). */
+double opll_override_detune(const OPLLOverrideTable *p_tbl, const VGMContext *p_ctx, int ch, double detune);
+
+#endif /* OPLL_OVERRIDE_H */
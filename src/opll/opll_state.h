@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "../opl3/opl3_state.h"   /* OPL3_REGFILE_SLOTS */
 
 typedef uint64_t sample_t; // sample 単位の時間
 
@@ -10,9 +11,15 @@ typedef uint64_t sample_t; // sample 単位の時間
 #define OPLL_SAMPLE_RATE            44100
 #define OPLL_MIN_GATE_MS            2        // 最短ゲート補償 (ms)
 #define OPLL_MIN_GATE_SAMPLES       ((OPLL_SAMPLE_RATE * OPLL_MIN_GATE_MS) / 1000) // ≒88@44.1kHz
+#define OPLL_PRE_KEYON_WAIT_SAMPLES 16       // 音色書き換え→KeyOn 間の安定待ち
+#define OPLL_MIN_OFF_TO_ON_WAIT_SAMPLES 16   // KeyOff→KeyOn (retrigger) 最小間隔
 #define OPLL_MAX_PENDING_MS         50       // 保留上限 (ms)
 #define OPLL_MAX_PENDING_SAMPLES    ((OPLL_SAMPLE_RATE * OPLL_MAX_PENDING_MS) / 1000) // ≒2205@44.1kHz
+#ifndef OPLL_KEYON_COALESCE_SAMPLES
+#define OPLL_KEYON_COALESCE_SAMPLES 32       // KeyOn 合流ウィンドウ既定値 (≒0.7ms, 上限 OPLL_MAX_PENDING_SAMPLES)
+#endif
 #define OPLL_NUM_CHANNELS 9
+#define OPLL_KEY_QUEUE_DEPTH 8               // per-channel deferred A0/B0 events (power of 2)
 #define YM2413_REGS_SIZE 0x40
 #define OPLL_LFO_DEPTH 3
 
@@ -27,6 +34,14 @@ typedef struct {
     OPLL_ChannelType type;   // melodic / rhythm / invalid
 } OPLL_ChannelInfo;
 
+/* Deferred A0/B0 write on the emit timeline (min gate / retrigger gap) */
+typedef struct {
+    sample_t due;      // emit_time at which the write is released
+    uint8_t  a0;       // FNUM LSB (valid when has_a0)
+    uint8_t  b0;       // Key/Block/FNUM MSB
+    bool     has_a0;
+} OPLL2OPL3_KeyEvent;
+
 typedef struct {
     /* register-arrival flags */
     bool has_fnum_low;   // 1n (0x10..0x18)
@@ -37,7 +52,8 @@ typedef struct {
     // Key/edge state
     bool has_keybit_stamp;    // last observed register key bit (register state)
     bool has_keybit;         // whether key bit was seen (1)
-    bool is_pending;        // we delayed keyon because not all pieces arrived
+    bool is_pending;        // writes held in the current coalescing burst
+    bool is_pending_keyon;  // burst contains a KeyOn edge (waits for FNUM LSB)
     bool is_pending_keyoff; // KeyOff waiting to be applied (handled in flush)
     bool is_active;         // currently logically KeyOn (after flush active=true)
     bool is_keyoff_forced;  // internal marker for forced (retrigger) off
@@ -63,24 +79,38 @@ typedef struct {
     // Timing
     sample_t keyon_time;  // when key-on was detected (used for gate length)
     sample_t last_emit_time; 
+    sample_t pending_since;  // virtual_time of the first held write in the burst
+
+    // Emit-timeline key state (includes queued events)
+    OPLL2OPL3_KeyEvent key_q[OPLL_KEY_QUEUE_DEPTH];
+    uint8_t  key_q_head;
+    uint8_t  key_q_count;
+    bool     sched_key;       // key bit of the last emitted/queued B0
+    bool     has_sched_off;   // a KeyOff has been placed on the timeline
+    sample_t sched_on_time;   // emit_time of the last KeyOn (emitted or due)
+    sample_t sched_off_time;  // emit_time of the last KeyOff (emitted or due)
 } OPLL2OPL3_PendingChannel;
 
 typedef struct {
     sample_t    virtual_time; // 入力（解析）側の進行時間（samples）
     sample_t    emit_time;    // 出力済みVGMの進行時間（samples）
-    bool        accessed[0x200];
-    uint8_t     last_emitted_reg_val[0x200];
+    sample_t    seen_sample;  // timestamp.current_sample when the handler last returned
+    uint32_t    emitted_bits[(OPL3_REGFILE_SLOTS + 31) / 32]; // port0 slot written at least once
+    uint8_t     last_emitted_reg_val[OPL3_REGFILE_SLOTS];     // dense port0 slot (opl3_reg_slot)
     OPLL2OPL3_PendingChannel ch[OPLL_NUM_CHANNELS];
+    uint8_t     key_heap[OPLL_NUM_CHANNELS]; // min-heap of channels by key_q head due
+    uint8_t     key_heap_size;
 } OPLL2OPL3_Scheduler;
 
+struct OPLLVoiceBank;
+
 typedef struct {
-    uint8_t  reg[0x200];
-    uint8_t  reg_stamp[0x200];
-    uint8_t  patches[19][8];
+    uint8_t  reg[YM2413_REGS_SIZE];   // YM2413 register mirror (0x00-0x3F only)
     bool     is_rhythm_mode;
     bool     is_initialized;
     uint8_t  lfo_depth;  // Staged A0 values per channel
     OPLL2OPL3_Scheduler sch;
+    const struct OPLLVoiceBank *p_voice_bank; // preset bank owned by this context (opll_voice_bank_open/close)
 } OPLLState;
 
 #endif /* OPLL_STATE_H */
\ No newline at end of file
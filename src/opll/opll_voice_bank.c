@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "opll_voice_bank.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define bank_getpid() _getpid()
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#define bank_getpid() getpid()
+#endif
+
+#define BANK_PATH_MAX 1024
+
+/*
+ * Banks are mmap'ed (POSIX: the file, or anonymous memory for a built bank) or heap (Windows),
+ * so opll_voice_bank_close() needs no record of where a bank came from.
+ * 構築後は不変。コンテキストごとに所有するのでプロセス共有の状態は持たない。
+ */
+static OPLLVoiceBank *bank_alloc(void) {
+#ifdef _WIN32
+    return (OPLLVoiceBank *)calloc(1, sizeof(OPLLVoiceBank));
+#else
+    void *p = mmap(NULL, sizeof(OPLLVoiceBank), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (p == MAP_FAILED) ? NULL : (OPLLVoiceBank *)p;
+#endif
+}
+
+static int bank_header_valid(const OPLLVoiceBank *p_bank, uint32_t source_hash) {
+    const OPLLVoiceBankHeader *h = &p_bank->hdr;
+    return h->magic       == OPLL_VOICE_BANK_MAGIC &&
+           h->version     == OPLL_VOICE_BANK_VERSION &&
+           h->entry_size  == sizeof(OPLLVoiceBankEntry) &&
+           h->num_types   == OPLL_VOICE_BANK_NUM_TYPES &&
+           h->num_sources == OPLL_VOICE_BANK_NUM_SOURCES &&
+           h->num_inst    == OPLL_VOICE_BANK_NUM_INST &&
+           h->source_hash == source_hash;
+}
+
+/** Map an existing cache file. Returns NULL if missing or stale. */
+static const OPLLVoiceBank *bank_map_file(const char *p_path, uint32_t source_hash) {
+#ifdef _WIN32
+    FILE *fp = fopen(p_path, "rb");
+    if (!fp) return NULL;
+    OPLLVoiceBank *p_bank = (OPLLVoiceBank *)malloc(sizeof(OPLLVoiceBank));
+    if (p_bank && fread(p_bank, 1, sizeof(OPLLVoiceBank), fp) == sizeof(OPLLVoiceBank)
+        && fgetc(fp) == EOF && bank_header_valid(p_bank, source_hash)) {
+        fclose(fp);
+        return p_bank;
+    }
+    fclose(fp);
+    free(p_bank);
+    return NULL;
+#else
+    int fd = open(p_path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != (off_t)sizeof(OPLLVoiceBank)) {
+        close(fd);
+        return NULL;
+    }
+    void *p_map = mmap(NULL, sizeof(OPLLVoiceBank), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p_map == MAP_FAILED) return NULL;
+    if (!bank_header_valid((const OPLLVoiceBank *)p_map, source_hash)) {
+        munmap(p_map, sizeof(OPLLVoiceBank));
+        return NULL;
+    }
+    return (const OPLLVoiceBank *)p_map;
+#endif
+}
+
+/** Write via temp file + rename so concurrent writers never see a partial bank. */
+static void bank_store_file(const char *p_path, const OPLLVoiceBank *p_bank) {
+    char tmp[BANK_PATH_MAX + 64];
+    // pid + bank address: unique across processes and across contexts of one process
+    int len = snprintf(tmp, sizeof(tmp), "%s.tmp.%d.%p", p_path, (int)bank_getpid(), (const void *)p_bank);
+    if (len < 0 || (size_t)len >= sizeof(tmp)) return;
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return;
+    size_t n = fwrite(p_bank, 1, sizeof(OPLLVoiceBank), fp);
+    if (fclose(fp) != 0 || n != sizeof(OPLLVoiceBank) || rename(tmp, p_path) != 0) {
+        remove(tmp);
+    }
+}
+
+const OPLLVoiceBank *opll_voice_bank_open(const char *p_path, int verbose) {
+    uint32_t source_hash = opll_voice_bank_source_hash();
+    if (p_path) {
+        const OPLLVoiceBank *p_mapped = bank_map_file(p_path, source_hash);
+        if (p_mapped) {
+            if (verbose) fprintf(stderr, "[VOICEBANK] mapped %s\n", p_path);
+            return p_mapped;
+        }
+    }
+
+    OPLLVoiceBank *p_bank = bank_alloc();
+    if (!p_bank) return NULL;
+    p_bank->hdr.magic       = OPLL_VOICE_BANK_MAGIC;
+    p_bank->hdr.version     = OPLL_VOICE_BANK_VERSION;
+    p_bank->hdr.entry_size  = sizeof(OPLLVoiceBankEntry);
+    p_bank->hdr.num_types   = OPLL_VOICE_BANK_NUM_TYPES;
+    p_bank->hdr.num_sources = OPLL_VOICE_BANK_NUM_SOURCES;
+    p_bank->hdr.num_inst    = OPLL_VOICE_BANK_NUM_INST;
+    p_bank->hdr.source_hash = source_hash;
+    opll_voice_bank_build(p_bank);
+
+    if (p_path) {
+        bank_store_file(p_path, p_bank);
+        if (verbose) fprintf(stderr, "[VOICEBANK] generated %s\n", p_path);
+    }
+    return p_bank;
+}
+
+void opll_voice_bank_close(const OPLLVoiceBank *p_bank) {
+    if (!p_bank) return;
+#ifdef _WIN32
+    free((void *)p_bank);
+#else
+    munmap((void *)p_bank, sizeof(OPLLVoiceBank));
+#endif
+}
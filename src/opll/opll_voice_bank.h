@@ -0,0 +1,78 @@
+#ifndef ESEOPL3PATCHER_OPLL_VOICE_BANK_H
+#define ESEOPL3PATCHER_OPLL_VOICE_BANK_H
+
+#include <stdint.h>
+#include "../opl3/opl3_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Persistent OPLL voice bank
+ *
+ * preset (YM2413/VRC7/YMF281B/YM2423) x source (YMVOICE/YMFM/EXPERIMENT) x
+ * inst (1..18) の OPL3 レジスタイメージを1ファイルにまとめたもの。
+ * 変換コンテキストごとに1つ持ち (OPLLState.p_voice_bank)、既定ではメモリ上に構築する。
+ * --voice-bank <file> を指定すると初回にそのファイルへ保存し、以降は mmap して参照するだけなので
+ * プロセス起動ごとの ROM テーブル変換 (EXPERIMENT 変換含む) が不要になる。
+ *
+ * Bump OPLL_VOICE_BANK_VERSION whenever the conversion rules in
+ * opll2opl3_conv.c change; ROM table edits are detected by source_hash.
+ */
+#define OPLL_VOICE_BANK_MAGIC        0x42564F45u  /* "EOVB" little endian */
+#define OPLL_VOICE_BANK_VERSION      1
+#define OPLL_VOICE_BANK_NUM_TYPES    4   /* OPLL_PresetType   */
+#define OPLL_VOICE_BANK_NUM_SOURCES  3   /* OPLL_PresetSource */
+#define OPLL_VOICE_BANK_NUM_INST     18  /* 15 melodic + 3 rhythm */
+
+/** One derived voice: original 8-byte OPLL patch + converted OPL3 image (32 bytes). */
+typedef struct OPLLVoiceBankEntry {
+    uint8_t       raw[8];
+    OPL3VoiceRegs regs;
+} OPLLVoiceBankEntry;
+
+typedef struct OPLLVoiceBankHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t num_types;
+    uint32_t num_sources;
+    uint32_t num_inst;
+    uint32_t source_hash;   /* FNV-1a over ROM tables + mapping tables */
+    uint32_t reserved;
+} OPLLVoiceBankHeader;
+
+typedef struct OPLLVoiceBank {
+    OPLLVoiceBankHeader hdr;
+    OPLLVoiceBankEntry  entry[OPLL_VOICE_BANK_NUM_TYPES][OPLL_VOICE_BANK_NUM_SOURCES][OPLL_VOICE_BANK_NUM_INST];
+} OPLLVoiceBank;
+
+/**
+ * Open a read-only voice bank for one converter context.
+ * p_path == NULL builds it in memory; otherwise p_path is mapped, or built and stored there
+ * (temp file + rename) when missing or stale. Contexts on other threads may share p_path.
+ * Returns NULL only on allocation failure; callers fall back to direct conversion.
+ */
+const OPLLVoiceBank *opll_voice_bank_open(const char *p_path, int verbose);
+
+/** Unmap/free a bank from opll_voice_bank_open() (NULL is ignored). */
+void opll_voice_bank_close(const OPLLVoiceBank *p_bank);
+
+/** Look up one entry; inst is 1-based. Returns NULL when out of range. */
+static inline const OPLLVoiceBankEntry *opll_voice_bank_lookup(const OPLLVoiceBank *p_bank, int preset, int source, int inst) {
+    if (!p_bank) return NULL;
+    if (preset < 0 || preset >= OPLL_VOICE_BANK_NUM_TYPES) return NULL;
+    if (source < 0 || source >= OPLL_VOICE_BANK_NUM_SOURCES) return NULL;
+    if (inst < 1 || inst > OPLL_VOICE_BANK_NUM_INST) return NULL;
+    return &p_bank->entry[preset][source][inst - 1];
+}
+
+/* Implemented in opll2opl3_conv.c (owns the ROM tables and conversion rules) */
+void     opll_voice_bank_build(OPLLVoiceBank *p_bank);
+uint32_t opll_voice_bank_source_hash(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ESEOPL3PATCHER_OPLL_VOICE_BANK_H */
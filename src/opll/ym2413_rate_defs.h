@@ -0,0 +1,24 @@
+#ifndef YM2413_RATE_DEFS_H
+#define YM2413_RATE_DEFS_H
+
+/*
+ * YM2413 -> OPL3 補正用の元データ。
+ * ym2413_patch_convert.c と tools/gen_ym2413_tables.c の両方から include し、
+ * ビルド時に生成される ym2413_rate_tables.h (整数 LUT) の入力になる。
+ * ここを変更すると make 時に LUT も再生成される。
+ */
+
+static const unsigned char ym2413_fnum_to_atten[16] = {0,24,32,37,40,43,45,47,48,50,51,52,53,54,55,56};
+static const float ym2413_rate_to_attack_time[16] = {2826.24f,2260.99f,1888.43f,1577.74f,1318.52f,1102.96f,921.98f,770.38f,644.21f,539.54f,452.28f,379.99f,319.84f,269.51f,227.15f,191.20f};
+static const float ym2413_rate_to_decay_time[16]  = {2260.99f,1888.43f,1577.74f,1318.52f,1102.96f,921.98f,770.38f,644.21f,539.54f,452.28f,379.99f,319.84f,269.51f,227.15f,191.20f,160.08f};
+
+/* MULT 実効値 x2 */
+static const int ym2413_mult_x2[16] = {1,2,4,6,8,10,12,14,16,18,20,20,24,24,30,30};
+
+/* KSL attenuation base for (block, fnum upper 4 bits); shifted by KSL at use site */
+static inline int ym2413_ksl_atten(int block, int fnum4) {
+    int atten = ym2413_fnum_to_atten[fnum4 & 0xF] - 8 * ((block & 7) ^ 7);
+    return (atten < 0) ? 0 : atten;
+}
+
+#endif /* YM2413_RATE_DEFS_H */
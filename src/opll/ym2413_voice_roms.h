@@ -305,8 +305,4 @@ static const unsigned char YMFM_YM2423_VOICES[18][8] =
 	{ 0x05, 0x01, 0x00, 0x00, 0xF8, 0xAA, 0x59, 0x55 }  // 18. rhythm 3 (Copy from YMFM_YM2413_VOICES)
 };
 
-static unsigned char EXPERIMENT_YM2413_PRESET[18][8] = {0};
-static unsigned char EXPERIMENT_VRC7_PRESET[18][8] = {0};
-static unsigned char EXPERIMENT_YMF281B_PRESET[18][8] = {0};
-static unsigned char EXPERIMENT_YM2423_PRESET[18][8] = {0};
 #endif // YM2413_VOICE_ROM_H
\ No newline at end of file
@@ -22,11 +22,18 @@ static void write_le_uint32(unsigned char *ptr, uint32_t val) {
 }
 
 /**
- * Decode a UTF-16LE string to a newly allocated UTF-8 string.
+ * Decode a UTF-16LE string to a newly allocated UTF-8 string (exactly strlen + 1 bytes).
  */
-static char *utf16le_to_utf8(const uint8_t *utf16, size_t bytes) {
-    // Worst case: each UTF-16 code unit becomes 3 UTF-8 bytes + null terminator
-    char *utf8 = (char*)malloc(bytes * 2 + 1);
+static char *utf16le_to_utf8(const uint8_t *utf16, size_t bytes, const OPL3Allocator *p_alloc) {
+    // Size pass first, so the string can be released as strlen + 1 bytes (gd3_fields_free)
+    size_t len = 0;
+    for (size_t in = 0; in + 1 < bytes; in += 2) {
+        uint16_t w = utf16[in] | (utf16[in+1] << 8);
+        if (w == 0) break;
+        len += (w < 0x80) ? 1 : (w < 0x800) ? 2 : 3;
+    }
+    char *utf8 = (char*)opl3_mem_alloc(p_alloc, len + 1);
+    if (!utf8) return NULL;
     size_t out = 0;
     for (size_t in = 0; in + 1 < bytes; in += 2) {
         uint16_t w = utf16[in] | (utf16[in+1] << 8);
@@ -83,13 +90,48 @@ static size_t utf8_to_utf16le(const char *utf8, uint8_t *out) {
     return bytes;
 }
 
+/**
+ * Decode a GD3 chunk ("Gd3 " tag first) of avail bytes into UTF-8 fields.
+ * Each field is allocated from p_alloc and must be released with gd3_fields_free().
+ */
+int extract_gd3_chunk(const unsigned char *gd3_data, long avail,
+                      char *gd3_fields[GD3_FIELDS],
+                      uint32_t *out_ver, uint32_t *out_len,
+                      const OPL3Allocator *p_alloc) {
+    if (avail < 12)
+        return 1;
+    if (memcmp(gd3_data, "Gd3 ", 4) != 0)
+        return 1;
+
+    *out_ver = read_le_uint32(gd3_data + 4);
+    *out_len = read_le_uint32(gd3_data + 8);
+
+    const uint8_t *gd3_ptr = gd3_data + 12;
+    const uint8_t *gd3_end = gd3_ptr + ((*out_len < (uint32_t)(avail - 12)) ? *out_len : (uint32_t)(avail - 12));
+    for (int i = 0; i < GD3_FIELDS; ++i) {
+        // Find UTF-16LE null-terminated string
+        const uint8_t *str_start = gd3_ptr;
+        while (gd3_ptr + 1 < gd3_end && (gd3_ptr[0] != 0 || gd3_ptr[1] != 0))
+            gd3_ptr += 2;
+        // Decode to UTF-8
+        gd3_fields[i] = utf16le_to_utf8(str_start, gd3_ptr - str_start, p_alloc);
+        if (!gd3_fields[i]) {
+            gd3_fields_free(gd3_fields, i, p_alloc);
+            return 1;
+        }
+        gd3_ptr += 2; // skip null terminator
+    }
+    return 0;
+}
+
 /**
  * Extracts GD3 fields from input VGM data, outputs UTF-8 strings for each field.
- * Each field is dynamically allocated and must be freed by the caller.
+ * Each field is allocated from p_alloc and must be released with gd3_fields_free().
  */
 int extract_gd3_fields(const unsigned char *vgm_data, long filesize,
                        char *gd3_fields[GD3_FIELDS],
-                       uint32_t *out_ver, uint32_t *out_len) {
+                       uint32_t *out_ver, uint32_t *out_len,
+                       const OPL3Allocator *p_alloc) {
     // Find GD3 offset in VGM header (0x14)
     if (filesize < 0x18)
         return 1;
@@ -99,54 +141,44 @@ int extract_gd3_fields(const unsigned char *vgm_data, long filesize,
     long gd3_absolute = 0x14 + gd3_offset;
     if (gd3_absolute + 12 > filesize)
         return 1;
-    if (memcmp(vgm_data + gd3_absolute, "Gd3 ", 4) != 0)
-        return 1;
-
-    *out_ver = read_le_uint32(vgm_data + gd3_absolute + 4);
-    *out_len = read_le_uint32(vgm_data + gd3_absolute + 8);
+    return extract_gd3_chunk(vgm_data + gd3_absolute, filesize - gd3_absolute, gd3_fields, out_ver, out_len, p_alloc);
+}
 
-    const uint8_t *gd3_ptr = vgm_data + gd3_absolute + 12;
-    const uint8_t *gd3_end = gd3_ptr + *out_len;
-    for (int i = 0; i < GD3_FIELDS; ++i) {
-        // Find UTF-16LE null-terminated string
-        const uint8_t *str_start = gd3_ptr;
-        while (gd3_ptr + 1 < gd3_end && (gd3_ptr[0] != 0 || gd3_ptr[1] != 0))
-            gd3_ptr += 2;
-        // Decode to UTF-8
-        gd3_fields[i] = utf16le_to_utf8(str_start, gd3_ptr - str_start);
-        gd3_ptr += 2; // skip null terminator
+/**
+ * Release the first count fields returned by extract_gd3_fields().
+ */
+void gd3_fields_free(char *gd3_fields[GD3_FIELDS], int count, const OPL3Allocator *p_alloc) {
+    for (int i = 0; i < count; ++i) {
+        if (gd3_fields[i]) opl3_mem_free(p_alloc, gd3_fields[i], strlen(gd3_fields[i]) + 1);
+        gd3_fields[i] = NULL;
     }
-    return 0;
 }
 
 /**
  * Build a new GD3 chunk from fields, creator, and notes.
- * The result is appended to p_gd3_buf.
+ * The result is appended to p_gd3_buf; temporaries come from its allocator.
  */
 void build_new_gd3_chunk(VGMBuffer *p_gd3_buf,
                          char *gd3_fields[GD3_FIELDS],
                          uint32_t orig_ver,
                          const char *append_creator,
                          const char *append_notes) {
+    const OPL3Allocator *p_alloc = p_gd3_buf->p_alloc;
     // Compose new fields, append creator and notes as needed
     char *new_fields[GD3_FIELDS];
     for (int i = 0; i < GD3_FIELDS; ++i) {
-        if (i == 9 && append_creator) {
-            // Append creator to Creator field
-            size_t len1 = strlen(gd3_fields[i]);
-            size_t len2 = strlen(append_creator);
-            new_fields[i] = (char*)malloc(len1 + len2 + 2);
-            strcpy(new_fields[i], gd3_fields[i]);
-            strcat(new_fields[i], append_creator);
-        } else if (i == 10 && append_notes) {
-            // Append notes to Notes field
+        const char *append = (i == 9) ? append_creator : (i == 10) ? append_notes : NULL;
+        if (append) {
+            // Append creator to Creator field / notes to Notes field
             size_t len1 = strlen(gd3_fields[i]);
-            size_t len2 = strlen(append_notes);
-            new_fields[i] = (char*)malloc(len1 + len2 + 2);
-            strcpy(new_fields[i], gd3_fields[i]);
-            strcat(new_fields[i], append_notes);
+            size_t len2 = strlen(append);
+            new_fields[i] = (char*)opl3_mem_alloc(p_alloc, len1 + len2 + 1);
+            if (!new_fields[i]) abort();
+            memcpy(new_fields[i], gd3_fields[i], len1);
+            memcpy(new_fields[i] + len1, append, len2 + 1);
         } else {
-            new_fields[i] = strdup(gd3_fields[i]);
+            new_fields[i] = opl3_mem_strdup(p_alloc, gd3_fields[i]);
+            if (!new_fields[i]) abort();
         }
     }
 
@@ -166,14 +198,10 @@ void build_new_gd3_chunk(VGMBuffer *p_gd3_buf,
     write_le_uint32(header + 8, (uint32_t)total_utf16);
     vgm_buffer_append(p_gd3_buf, header, 12);
 
-    // GD3 fields (UTF-16LE, null-terminated)
+    // GD3 fields (UTF-16LE, null-terminated), encoded in place at the end of the buffer
+    vgm_buffer_reserve(p_gd3_buf, p_gd3_buf->size + total_utf16);
     for (int i = 0; i < GD3_FIELDS; ++i) {
-        // Two passes: first with NULL to get length, then actual write
-        size_t len = utf8_to_utf16le(new_fields[i], NULL);
-        uint8_t *tmp = (uint8_t*)malloc(len);
-        utf8_to_utf16le(new_fields[i], tmp);
-        vgm_buffer_append(p_gd3_buf, tmp, len);
-        free(tmp);
-        free(new_fields[i]);
+        p_gd3_buf->size += utf8_to_utf16le(new_fields[i], p_gd3_buf->data + p_gd3_buf->size);
     }
+    gd3_fields_free(new_fields, GD3_FIELDS, p_alloc);
 }
\ No newline at end of file
@@ -8,15 +8,29 @@
 
 /**
  * Extracts GD3 fields from input VGM data, outputs UTF-8 strings for each field.
- * Each field is dynamically allocated and must be freed by the caller.
+ * Each field is allocated from p_alloc (NULL = malloc) and must be released with gd3_fields_free().
  */
 int extract_gd3_fields(const unsigned char *p_vgm_data, long filesize,
                        char *p_gd3_fields[GD3_FIELDS],
-                       uint32_t *p_out_ver, uint32_t *p_out_len);
+                       uint32_t *p_out_ver, uint32_t *p_out_len,
+                       const OPL3Allocator *p_alloc);
+
+/**
+ * Same, for a GD3 chunk that is not at its header offset (p_gd3_data points at "Gd3 ").
+ */
+int extract_gd3_chunk(const unsigned char *p_gd3_data, long avail,
+                      char *p_gd3_fields[GD3_FIELDS],
+                      uint32_t *p_out_ver, uint32_t *p_out_len,
+                      const OPL3Allocator *p_alloc);
+
+/**
+ * Release the first count fields (each strlen + 1 bytes from p_alloc) and NULL them.
+ */
+void gd3_fields_free(char *p_gd3_fields[GD3_FIELDS], int count, const OPL3Allocator *p_alloc);
 
 /**
  * Build a new GD3 chunk from fields, creator, and notes.
- * The result is appended to p_gd3_buf.
+ * The result is appended to p_gd3_buf; temporaries come from its allocator.
  */
 void build_new_gd3_chunk(VGMBuffer *p_gd3_buf,
                          char *p_gd3_fields[GD3_FIELDS],
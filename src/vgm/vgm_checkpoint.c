@@ -0,0 +1,182 @@
+#include "vgm_checkpoint.h"
+#include <stdlib.h>
+#include <string.h>
+#include "../opl3/opl3_voice.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define ckpt_truncate(fp, size) _chsize_s(_fileno(fp), (size))
+#else
+#include <unistd.h>
+#define ckpt_truncate(fp, size) ftruncate(fileno(fp), (off_t)(size))
+#endif
+
+static void ckpt_header_make(VGMCheckpointFileHeader *p_hdr, uint32_t input_hash, uint32_t opts_hash) {
+    memset(p_hdr, 0, sizeof(*p_hdr));
+    p_hdr->magic = VGM_CKPT_MAGIC;
+    p_hdr->version = VGM_CKPT_VERSION;
+    p_hdr->ctx_size = (uint32_t)sizeof(VGMContext);
+    p_hdr->input_hash = input_hash;
+    p_hdr->opts_hash = opts_hash;
+}
+
+int vgm_checkpoint_open(VGMCheckpointWriter *p_w, const char *p_path, uint64_t interval,
+                        uint32_t input_hash, uint32_t opts_hash, long resume_end) {
+    memset(p_w, 0, sizeof(*p_w));
+    p_w->interval = interval;
+    p_w->next_at = interval;
+
+    if (resume_end > 0) {
+        p_w->fp = fopen(p_path, "r+b");
+        if (p_w->fp && (ckpt_truncate(p_w->fp, resume_end) != 0 || fseek(p_w->fp, resume_end, SEEK_SET) != 0)) {
+            fclose(p_w->fp);
+            p_w->fp = NULL;
+        }
+        return p_w->fp ? 0 : -1;
+    }
+
+    p_w->fp = fopen(p_path, "wb");
+    if (!p_w->fp) return -1;
+    VGMCheckpointFileHeader hdr;
+    ckpt_header_make(&hdr, input_hash, opts_hash);
+    if (fwrite(&hdr, sizeof(hdr), 1, p_w->fp) != 1) {
+        fclose(p_w->fp);
+        p_w->fp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int vgm_checkpoint_write(VGMCheckpointWriter *p_w, VGMCheckpointRecord *p_rec, const VGMContext *p_ctx) {
+    if (!p_w->fp) return -1;
+    const OPL3VoiceDB *p_db = &p_ctx->opl3_state.voice_db;
+
+    p_rec->magic = VGM_CKPT_RECORD_MAGIC;
+    p_rec->out_delta = (uint32_t)(p_ctx->buffer.size - p_w->out_done);
+    p_rec->voice_count = (uint32_t)p_db->count;
+    p_rec->ctx = *p_ctx;
+    // Scrub process-local pointers
+    p_rec->ctx.buffer.data = NULL;
+    p_rec->ctx.buffer.p_alloc = NULL;
+    p_rec->ctx.gd3.data = NULL;
+    p_rec->ctx.opl3_state.voice_db.p_voices = NULL;
+    p_rec->ctx.opl3_state.voice_db.p_keys = NULL;
+    p_rec->ctx.opl3_state.voice_db.p_alloc = NULL;
+    p_rec->ctx.opll_state.p_voice_bank = NULL;
+    p_rec->ctx.p_metrics = NULL;
+    p_rec->ctx.p_profile = NULL;
+    p_rec->ctx.p_trace = NULL;
+    p_rec->ctx.cmd_opts.p_overrides = NULL;
+    memset(&p_rec->ctx.hooks, 0, sizeof(p_rec->ctx.hooks));
+
+    int ok = fwrite(p_rec, sizeof(*p_rec), 1, p_w->fp) == 1;
+    if (ok && p_rec->out_delta) {
+        ok = fwrite(p_ctx->buffer.data + p_w->out_done, 1, p_rec->out_delta, p_w->fp) == p_rec->out_delta;
+    }
+    // Voice DB is append-only: only the entries added since the previous record
+    int new_voices = p_db->count - p_w->voices_done;
+    if (ok && new_voices > 0) {
+        ok = fwrite(&p_db->p_voices[p_w->voices_done], sizeof(OPL3VoiceParam), (size_t)new_voices, p_w->fp) ==
+             (size_t)new_voices;
+    }
+    // A record only counts once it is on disk (a killed run keeps the previous one)
+    if (!ok || fflush(p_w->fp) != 0) {
+        fprintf(stderr, "[CKPT] write failed, checkpoints disabled\n");
+        fclose(p_w->fp);
+        p_w->fp = NULL;
+        return -1;
+    }
+    p_w->out_done = p_ctx->buffer.size;
+    p_w->voices_done = p_db->count;
+    p_w->next_at = p_rec->src_sample + p_w->interval;
+    p_w->count++;
+    return 0;
+}
+
+void vgm_checkpoint_close(VGMCheckpointWriter *p_w) {
+    if (p_w->fp) fclose(p_w->fp);
+    p_w->fp = NULL;
+}
+
+int vgm_checkpoint_load(const char *p_path, uint32_t input_hash, uint32_t opts_hash, uint64_t max_sample,
+                        VGMCheckpointRecord *p_rec, VGMBuffer *p_prefix, OPL3VoiceDB *p_db, long *p_end) {
+    FILE *fp = fopen(p_path, "rb");
+    if (!fp) return -1;
+
+    VGMCheckpointFileHeader hdr, want;
+    ckpt_header_make(&want, input_hash, opts_hash);
+    if (fread(&hdr, sizeof(hdr), 1, fp) == 1 && opts_hash == 0) want.opts_hash = hdr.opts_hash;
+    if (memcmp(&hdr, &want, sizeof(hdr)) != 0) {
+        fclose(fp);
+        return -1;
+    }
+
+    VGMCheckpointRecord *p_cur = (VGMCheckpointRecord *)malloc(sizeof(VGMCheckpointRecord));
+    uint8_t *p_delta = NULL;
+    OPL3VoiceParam *p_voices = NULL;
+    uint32_t voice_count = 0;   // DB size after the last accepted record
+    OPL3VoiceDB db;
+    opl3_voice_db_init(&db);
+    int found = 0;
+    if (p_prefix) vgm_buffer_init(p_prefix);
+
+    while (p_cur && fread(p_cur, sizeof(*p_cur), 1, fp) == 1) {
+        if (p_cur->magic != VGM_CKPT_RECORD_MAGIC || p_cur->src_sample > max_sample) break;
+        if (p_cur->voice_count < voice_count) break;
+
+        uint8_t *p_new = (uint8_t *)realloc(p_delta, p_cur->out_delta ? p_cur->out_delta : 1);
+        if (!p_new) break;
+        p_delta = p_new;
+        if (p_cur->out_delta && fread(p_delta, 1, p_cur->out_delta, fp) != p_cur->out_delta) break;
+
+        // Voices added since the previous record
+        uint32_t new_voices = p_cur->voice_count - voice_count;
+        OPL3VoiceParam *p_vnew = (OPL3VoiceParam *)realloc(p_voices, (new_voices ? new_voices : 1) * sizeof(OPL3VoiceParam));
+        if (!p_vnew) break;
+        p_voices = p_vnew;
+        if (new_voices && fread(p_voices, sizeof(OPL3VoiceParam), new_voices, fp) != new_voices) break;
+
+        // Record complete: accept it
+        if (p_prefix) vgm_buffer_append(p_prefix, p_delta, p_cur->out_delta);
+        for (uint32_t i = 0; p_db && i < new_voices; ++i) opl3_voice_db_find_or_add(&db, &p_voices[i]);
+        voice_count = p_cur->voice_count;
+        *p_rec = *p_cur;
+        if (p_end) *p_end = ftell(fp);
+        found = 1;
+    }
+
+    if (found && p_db) {
+        opl3_voice_db_free(p_db);
+        *p_db = db;
+    } else {
+        opl3_voice_db_free(&db);
+    }
+    free(p_voices);
+    free(p_delta);
+    free(p_cur);
+    fclose(fp);
+    return found ? 0 : -1;
+}
+
+void vgm_checkpoint_restore_ctx(VGMContext *p_ctx, const VGMCheckpointRecord *p_rec) {
+    VGMBuffer buffer = p_ctx->buffer;
+    VGMGD3Tag gd3 = p_ctx->gd3;
+    OPL3VoiceDB db = p_ctx->opl3_state.voice_db;
+    const struct OPLLVoiceBank *p_bank = p_ctx->opll_state.p_voice_bank;
+    struct OPL3Metrics *p_metrics = p_ctx->p_metrics;
+    struct OPL3Profile *p_profile = p_ctx->p_profile;
+    struct OPL3Trace *p_trace = p_ctx->p_trace;
+    const struct OPLLOverrideTable *p_overrides = p_ctx->cmd_opts.p_overrides;
+    OPL3HookBinding hooks = p_ctx->hooks;
+
+    *p_ctx = p_rec->ctx;
+    p_ctx->buffer = buffer;
+    p_ctx->gd3 = gd3;
+    p_ctx->opl3_state.voice_db = db;
+    p_ctx->opll_state.p_voice_bank = p_bank;
+    p_ctx->p_metrics = p_metrics;
+    p_ctx->p_profile = p_profile;
+    p_ctx->p_trace = p_trace;
+    p_ctx->cmd_opts.p_overrides = p_overrides;
+    p_ctx->hooks = hooks;
+}
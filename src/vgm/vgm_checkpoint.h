@@ -0,0 +1,96 @@
+#ifndef VGM_CHECKPOINT_H
+#define VGM_CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "vgm_helpers.h"
+#include "vgm_seek.h"
+
+/*
+ * Conversion checkpoints (sidecar file, append-only)
+ *
+ * 変換中に一定サンプル間隔で VGMContext 全体 (レジスタミラー, OPLL
+ * スケジューラ, 音色 DB) とソース側レジスタイメージを直列化して追記する。
+ *
+ * File layout:
+ *   VGMCheckpointFileHeader
+ *   { VGMCheckpointRecord, out_delta bytes, new voices x OPL3VoiceParam } ...
+ *
+ * 各レコードは直前のレコード以降に出力されたバイト列 (out_delta) と、直前のレコード
+ * 以降に音色 DB へ追加された音色 (DB は追記のみ) だけを持つので、サイドカーは出力に
+ * 比例して伸びる。途中で kill されても最後の完全なレコードまでの出力と DB を復元して再開できる。
+ * 末尾の不完全なレコードは読み込み時に無視する。
+ *
+ * The sidecar is tied to one build (sizeof(VGMContext)), one input file and
+ * one option set (hashes); mismatching sidecars are rejected.
+ */
+#define VGM_CKPT_MAGIC        0x54504B43u  /* "CKPT" little endian */
+#define VGM_CKPT_RECORD_MAGIC 0x44524B43u  /* "CKRD" */
+#define VGM_CKPT_VERSION      3   /* 2: 0xA1 source image added, 3: voice DB stored as deltas */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ctx_size;      /* sizeof(VGMContext): layout guard */
+    uint32_t input_hash;    /* FNV-1a of the input VGM */
+    uint32_t opts_hash;     /* FNV-1a of CommandOptions */
+    uint32_t reserved;
+} VGMCheckpointFileHeader;
+
+/** Main-loop state captured before event `event_index` is processed. */
+typedef struct {
+    uint32_t magic;
+    uint32_t event_index;           /* events consumed from the IR */
+    uint32_t src_offset;            /* file offset of that event */
+    uint32_t out_delta;             /* output bytes appended since the previous record */
+    uint64_t src_sample;            /* source timeline position */
+    int64_t  pre_loop_output_bytes;
+    int64_t  loop_start_in_buffer;
+    uint32_t voice_count;           /* OPL3 voice DB size; entries past the previous record's follow out_delta */
+    uint32_t reserved;
+    VGMContext        ctx;          /* pointers are scrubbed */
+    VGMChipClockFlags chip_flags;   /* autodetect state */
+    VGMSeekImage      image[VGM_SEEK_NUM_CHIPS];  /* source register images */
+} VGMCheckpointRecord;
+
+typedef struct {
+    FILE    *fp;
+    uint64_t interval;      /* samples between checkpoints */
+    uint64_t next_at;       /* source sample of the next checkpoint */
+    size_t   out_done;      /* output bytes already stored */
+    int      voices_done;   /* voice DB entries already stored */
+    uint32_t count;         /* records written by this run */
+} VGMCheckpointWriter;
+
+/**
+ * Open the sidecar for writing. If p_resume_end > 0 the file is kept up to that
+ * byte (end of the record resumed from) and appended to; otherwise it is recreated.
+ * Returns 0 on success.
+ */
+int  vgm_checkpoint_open(VGMCheckpointWriter *p_w, const char *p_path, uint64_t interval,
+                         uint32_t input_hash, uint32_t opts_hash, long resume_end);
+
+/** True when a checkpoint is due at src_sample. */
+static inline int vgm_checkpoint_due(const VGMCheckpointWriter *p_w, uint64_t src_sample) {
+    return p_w->fp && src_sample >= p_w->next_at;
+}
+
+/** Append one record (p_rec->ctx is copied and scrubbed here). Returns 0 on success. */
+int  vgm_checkpoint_write(VGMCheckpointWriter *p_w, VGMCheckpointRecord *p_rec, const VGMContext *p_ctx);
+
+void vgm_checkpoint_close(VGMCheckpointWriter *p_w);
+
+/**
+ * Load the last valid record with src_sample <= max_sample.
+ * opts_hash 0 accepts any option set (source register images are option independent).
+ * p_prefix (optional) receives the output bytes up to that record,
+ * p_db (optional) receives the voice DB (replayed from the per-record deltas). *p_end is the file offset after the record.
+ * Returns 0 when a record was found, -1 otherwise (missing, stale or empty sidecar).
+ */
+int  vgm_checkpoint_load(const char *p_path, uint32_t input_hash, uint32_t opts_hash, uint64_t max_sample,
+                         VGMCheckpointRecord *p_rec, VGMBuffer *p_prefix, OPL3VoiceDB *p_db, long *p_end);
+
+/** Restore p_rec->ctx into p_ctx, keeping p_ctx's live pointers (buffer, voice bank, metrics, DB). */
+void vgm_checkpoint_restore_ctx(VGMContext *p_ctx, const VGMCheckpointRecord *p_rec);
+
+#endif // VGM_CHECKPOINT_H
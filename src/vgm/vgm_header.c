@@ -81,7 +81,6 @@ void build_vgm_header(
     uint32_t orig_header_size = VGM_HEADER_SIZE;
     if (p_orig_vgm_header) {
         orig_data_offset = read_le32(p_orig_vgm_header + 0x34);
-        printf("orig_data_offset:%d(0x%x)\n",orig_data_offset,orig_data_offset);
         if (orig_data_offset== 0 ) {
             orig_data_offset = 0xC;
         }
@@ -139,6 +138,28 @@ bool should_account_addtional_bytes_pre_loop(const VGMStatus *p_vstatus) {
         return (p_vstatus && p_vstatus->is_adding_port1_bytes);
 }
 
+/**
+ * Mark the output as non-looping (loop offset/samples = 0).
+ */
+void clear_vgm_loop(uint8_t *p_header) {
+    write_le32(p_header + 0x1C, 0);
+    write_le32(p_header + 0x20, 0);
+}
+
+/**
+ * Announce a second chip (VGM dual-chip, clock bit 30) for the clock at clock_offset.
+ * A zero clock is left alone (the chip is absent).
+ */
+void set_vgm_dual_chip(uint8_t *p_header, uint32_t clock_offset) {
+    uint32_t clock = (uint32_t)p_header[clock_offset] |
+                     ((uint32_t)p_header[clock_offset + 1] << 8) |
+                     ((uint32_t)p_header[clock_offset + 2] << 16) |
+                     ((uint32_t)p_header[clock_offset + 3] << 24);
+    if (clock != 0) {
+        write_le32(p_header + clock_offset, clock | VGM_CLOCK_DUAL_BIT);
+    }
+}
+
 /**
  * Set the YM2413 clock value in the VGM header.
  */
@@ -391,28 +412,32 @@ void vgm_header_postprocess(
         fprintf(stderr, "[VGM HEADER] Total Write Count YM2413:%d YM3812:%d YM3526:%d Y8950:%d \n",  p_ctx->status.stats.ym2413_write_count,p_ctx->status.stats.ym3812_write_count,p_ctx->status.stats.ym3526_write_count,p_ctx->status.stats.y8950_write_count);
 
     if (p_cmd_opts->strip_unused_chip_clocks == false) {
-        //if(p_cmd_opts->debug.verbose) 
+        if (p_cmd_opts->debug.verbose)
             fprintf(stderr, "[VGM HEADER] strip_unused_chip_clocks == %d: Skip setting unused clocks to zero on OPL-series chips.\n", p_cmd_opts->strip_unused_chip_clocks );
     } else {
         // YM2413
         if (p_ctx->status.stats.ym2413_write_count == 0) {
-            //if(p_cmd_opts->debug.verbose) 
-                fprintf(stderr, "[VGM HEADER] Set YM2413 clock to zero in VGM Header since this chip is not used.\n" ); set_ym2413_clock(p_header_buf, 0);
+            if (p_cmd_opts->debug.verbose)
+                fprintf(stderr, "[VGM HEADER] Set YM2413 clock to zero in VGM Header since this chip is not used.\n" );
+            set_ym2413_clock(p_header_buf, 0);
         }
         // YM3812
         if (p_ctx->status.stats.ym3812_write_count == 0) {
-            //if(p_cmd_opts->debug.verbose) 
-                fprintf(stderr, "[VGM HEADER] Set YM3812 clock to zero in VGM Header since this chip is not used.\n" ); set_ym3812_clock(p_header_buf, 0);
+            if (p_cmd_opts->debug.verbose)
+                fprintf(stderr, "[VGM HEADER] Set YM3812 clock to zero in VGM Header since this chip is not used.\n" );
+            set_ym3812_clock(p_header_buf, 0);
         }
         // YM3526
         if (p_ctx->status.stats.ym3526_write_count == 0) {
-            //if(p_cmd_opts->debug.verbose) 
-                fprintf(stderr, "[VGM HEADER] Set YM3526 clock to zero in VGM Header since this chip is not used.\n" ); set_ym3526_clock(p_header_buf, 0);
+            if (p_cmd_opts->debug.verbose)
+                fprintf(stderr, "[VGM HEADER] Set YM3526 clock to zero in VGM Header since this chip is not used.\n" );
+            set_ym3526_clock(p_header_buf, 0);
         }
         // Y8950
         if (p_ctx->status.stats.y8950_write_count == 0) {
-            //if(p_cmd_opts->debug.verbose) 
-                fprintf(stderr, "[VGM HEADER] Set Y8950 clock to zero in VGM Header since this chip is not used.\n" ); set_y8950_clock(p_header_buf, 0);
+            if (p_cmd_opts->debug.verbose)
+                fprintf(stderr, "[VGM HEADER] Set Y8950 clock to zero in VGM Header since this chip is not used.\n" );
+            set_y8950_clock(p_header_buf, 0);
         }
     }
 
@@ -420,22 +445,26 @@ void vgm_header_postprocess(
     if (!p_cmd_opts->is_keep_source_vgm) {
         // YM2413
         if (p_ctx->source_fmchip == FMCHIP_YM2413) {
-            fprintf(stderr, "[VGM HEADER] Set YM2413 clock to zero in VGM Header, as this is the source chip\n" );
+            if (p_cmd_opts->debug.verbose)
+                fprintf(stderr, "[VGM HEADER] Set YM2413 clock to zero in VGM Header, as this is the source chip\n" );
             set_ym2413_clock(p_header_buf, 0);
         }
         // YM3812
         if (p_ctx->source_fmchip == FMCHIP_YM3812) {
-            fprintf(stderr, "[VGM HEADER] Set YM3812 clock to zero in VGM Header, as this is the source chip\n" );
+            if (p_cmd_opts->debug.verbose)
+                fprintf(stderr, "[VGM HEADER] Set YM3812 clock to zero in VGM Header, as this is the source chip\n" );
             set_ym3812_clock(p_header_buf, 0);
         }
         // YM3526
         if (p_ctx->source_fmchip == FMCHIP_YM3526) {
-            fprintf(stderr, "[VGM HEADER] Set YM3526 clock to zero in VGM Header, as this is the source chip\n" );
+            if (p_cmd_opts->debug.verbose)
+                fprintf(stderr, "[VGM HEADER] Set YM3526 clock to zero in VGM Header, as this is the source chip\n" );
             set_ym3526_clock(p_header_buf, 0);
         }
         // Y8950
         if (p_ctx->source_fmchip == FMCHIP_Y8950) {
-            fprintf(stderr, "[VGM HEADER] Set Y8950 clock to zero in VGM Header, as this is the source chip\n" );
+            if (p_cmd_opts->debug.verbose)
+                fprintf(stderr, "[VGM HEADER] Set Y8950 clock to zero in VGM Header, as this is the source chip\n" );
             set_y8950_clock(p_header_buf, 0);
         }
     }
@@ -42,6 +42,19 @@ bool should_account_addtional_bytes_pre_loop(const VGMStatus *p_vstatus);
  */
 void set_ym2413_clock(uint8_t *p_header, uint32_t value);
 
+/**
+ * Clears the loop (offset and sample count) in the VGM header
+ * @param p_header Pointer to the VGM header
+ */
+void clear_vgm_loop(uint8_t *p_header);
+
+/**
+ * Sets the dual-chip bit (bit 30) of the clock at clock_offset (e.g. 0x5C for YMF262)
+ * @param p_header Pointer to the VGM header
+ * @param clock_offset Header offset of the chip clock
+ */
+void set_vgm_dual_chip(uint8_t *p_header, uint32_t clock_offset);
+
 /**
  * Sets the YM3812 clock value in the VGM header
  * @param p_header Pointer to the VGM header
@@ -1,4 +1,5 @@
 #include "vgm_helpers.h"
+#include "../opl3/opl3_metrics.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -14,34 +15,57 @@ void vgm_buffer_init(VGMBuffer *p_buf) {
     p_buf->data = NULL;
     p_buf->size = 0;
     p_buf->capacity = 0;
+    p_buf->p_alloc = NULL;
 }
 
 /**
  * Append arbitrary bytes to a dynamic VGMBuffer.
  */
 void vgm_buffer_append(VGMBuffer *p_buf, const void *p_data, size_t len) {
+    if (vgm_buffer_try_append(p_buf, p_data, len) != 0) abort();
+}
+
+/**
+ * Append arbitrary bytes; returns -1 (p_buf unchanged) when the buffer cannot grow.
+ */
+int vgm_buffer_try_append(VGMBuffer *p_buf, const void *p_data, size_t len) {
     if (p_buf->size + len > p_buf->capacity) {
         size_t new_capacity = (p_buf->capacity ? p_buf->capacity * 2 : 256);
         while (new_capacity < p_buf->size + len) new_capacity *= 2;
-        uint8_t *new_data = realloc(p_buf->data, new_capacity);
+        uint8_t *new_data = opl3_mem_realloc(p_buf->p_alloc, p_buf->data, p_buf->capacity, new_capacity);
         if (!new_data) {
             // メモリ確保失敗
             fprintf(stderr, "vgm_buffer_append: realloc failed (request %zu bytes)\n", new_capacity);
-            abort();
+            return -1;
         }
         p_buf->data = new_data;
         p_buf->capacity = new_capacity;
     }
     memcpy(p_buf->data + p_buf->size, p_data, len);
     p_buf->size += len;
+    return 0;
+}
+
+/**
+ * Grow the capacity to at least capacity bytes (size is unchanged).
+ */
+void vgm_buffer_reserve(VGMBuffer *p_buf, size_t capacity) {
+    if (capacity <= p_buf->capacity) return;
+    uint8_t *new_data = opl3_mem_realloc(p_buf->p_alloc, p_buf->data, p_buf->capacity, capacity);
+    if (!new_data) {
+        fprintf(stderr, "vgm_buffer_reserve: realloc failed (request %zu bytes)\n", capacity);
+        abort();
+    }
+    p_buf->data = new_data;
+    p_buf->capacity = capacity;
 }
 
 /**
- * Release memory allocated for a VGMBuffer.
+ * Release memory allocated for a VGMBuffer. The allocator is kept, so the buffer can be refilled.
  */
 void vgm_buffer_free(VGMBuffer *p_buf) {
     if (p_buf && p_buf->data) {
-        free(p_buf->data);
+        opl3_mem_free(p_buf->p_alloc, p_buf->data, p_buf->capacity);
         p_buf->data = NULL;
     }
     p_buf->size = 0;
@@ -82,6 +106,43 @@ int forward_ppaadd(VGMContext *p_vgmctx, int port, uint8_t reg, uint8_t val) {
 }
 
 
+/** Passthrough commands of other chips (copied verbatim) */
+static const VGMFixedCmdLen kKnownFixedCmds[] = {
+    {0xA0, 3}, // AY8910
+    {0xD2, 4}, // K051649
+    // Add others if necessary
+};
+
+const VGMFixedCmdLen* vgm_find_fixed_cmd(uint8_t code) {
+    for (size_t i = 0; i < sizeof(kKnownFixedCmds)/sizeof(kKnownFixedCmds[0]); ++i) {
+        if (kKnownFixedCmds[i].code == code) return &kKnownFixedCmds[i];
+    }
+    return NULL;
+}
+
+uint32_t vgm_cmd_length(const uint8_t *p, size_t avail) {
+    uint8_t cmd = p[0];
+    if (cmd >= 0x30 && cmd <= 0x3F) return 2;
+    if (cmd >= 0x40 && cmd <= 0x4E) return 3;
+    if (cmd == 0x4F || cmd == 0x50) return 2;
+    if (cmd >= 0x51 && cmd <= 0x5F) return 3;
+    if (cmd == 0x61) return 3;
+    if (cmd == 0x67) {
+        if (avail < 7) return 7;
+        uint32_t size = (uint32_t)p[3] | ((uint32_t)p[4] << 8) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 24);
+        return 7 + (size & 0x7FFFFFFF);
+    }
+    if (cmd == 0x68) return 12;
+    if (cmd == 0x90 || cmd == 0x91 || cmd == 0x95) return 5;
+    if (cmd == 0x92) return 6;
+    if (cmd == 0x93) return 11;
+    if (cmd == 0x94) return 2;
+    if (cmd >= 0xA0 && cmd <= 0xBF) return 3;
+    if (cmd >= 0xC0 && cmd <= 0xDF) return 4;
+    if (cmd >= 0xE0) return 5;
+    return 1;
+}
+
 /**
  * Write a short wait command (0x70-0x7F) and update status.
  */
@@ -93,6 +154,10 @@ int vgm_wait_short(VGMContext *p_vgmctx, uint8_t cmd) {
     add_bytes = vgm_append_byte(&(p_vgmctx->buffer), cmd);
     if (p_vgmctx) {
         p_vgmctx->timestamp.last_sample = p_vgmctx->timestamp.current_sample;
+        if (OPL3_HOOKS_ATTACHED(p_vgmctx->hooks)) {
+            opl3_hooks_wait(&p_vgmctx->hooks, p_vgmctx->timestamp.current_sample, (uint32_t)(cmd & 0x0F) + 1);
+        }
+        if (OPL3_METRICS_ON(p_vgmctx->p_metrics)) opl3_metrics_wait(p_vgmctx->p_metrics, (uint32_t)(cmd & 0x0F) + 1);
         p_vgmctx->timestamp.current_sample += (cmd & 0x0F) + 1;
         p_vgmctx->status.total_samples += (cmd & 0x0F) + 1;
     }
@@ -114,6 +179,10 @@ int vgm_wait_samples(VGMContext *p_vgmctx, uint16_t samples) {
     add_bytes = 3;
     if (p_vgmctx) {
         p_vgmctx->timestamp.last_sample = p_vgmctx->timestamp.current_sample;
+        if (OPL3_HOOKS_ATTACHED(p_vgmctx->hooks)) {
+            opl3_hooks_wait(&p_vgmctx->hooks, p_vgmctx->timestamp.current_sample, samples);
+        }
+        if (OPL3_METRICS_ON(p_vgmctx->p_metrics)) opl3_metrics_wait(p_vgmctx->p_metrics, samples);
         p_vgmctx->timestamp.current_sample += samples;
         p_vgmctx->status.total_samples += samples;
     } 
@@ -128,6 +197,10 @@ int vgm_wait_60hz(VGMContext *p_vgmctx) {
     add_bytes = vgm_append_byte(&(p_vgmctx->buffer), 0x62);
     if (p_vgmctx) {
         p_vgmctx->timestamp.last_sample = p_vgmctx->timestamp.current_sample;
+        if (OPL3_HOOKS_ATTACHED(p_vgmctx->hooks)) {
+            opl3_hooks_wait(&p_vgmctx->hooks, p_vgmctx->timestamp.current_sample, 735);
+        }
+        if (OPL3_METRICS_ON(p_vgmctx->p_metrics)) opl3_metrics_wait(p_vgmctx->p_metrics, 735);
         p_vgmctx->timestamp.current_sample += 735;
         p_vgmctx->status.total_samples += 735;
     }
@@ -142,6 +215,10 @@ int vgm_wait_50hz(VGMContext *p_vgmctx) {
     add_bytes = vgm_append_byte(&(p_vgmctx->buffer), 0x63);
     if (p_vgmctx) {
         p_vgmctx->timestamp.last_sample = p_vgmctx->timestamp.current_sample;
+        if (OPL3_HOOKS_ATTACHED(p_vgmctx->hooks)) {
+            opl3_hooks_wait(&p_vgmctx->hooks, p_vgmctx->timestamp.current_sample, 882);
+        }
+        if (OPL3_METRICS_ON(p_vgmctx->p_metrics)) opl3_metrics_wait(p_vgmctx->p_metrics, 882);
         p_vgmctx->timestamp.current_sample += 882;
         p_vgmctx->status.total_samples += 882;
     }
@@ -162,6 +239,10 @@ bool vgm_parse_chip_clocks(const uint8_t *vgm_data, long filesize, VGMChipClockF
     out_flags->ym3526_clock  = read_le_uint32(vgm_data + 0x54);
     out_flags->y8950_clock   = read_le_uint32(vgm_data + 0x58);
 
+    // VGM dual-chip convention: bit 30 of the clock announces a second chip
+    out_flags->has_2nd_ym2413 = (out_flags->ym2413_clock & VGM_CLOCK_DUAL_BIT) != 0;
+    out_flags->ym2413_clock  &= ~VGM_CLOCK_DUAL_BIT;
+
     // Set bool flags if clock is nonzero
     out_flags->has_ym2413   = (out_flags->ym2413_clock  != 0);
     out_flags->has_ym3812   = (out_flags->ym3812_clock  != 0);
@@ -179,8 +260,11 @@ int write_reg(VGMContext *p_vpmctx, int port, uint8_t reg, uint8_t value) {
     int reg_addr = reg + (port ? 0x100 : 0x000);
     int add_bytes = 0;
 
-    p_vpmctx->opl3_state.reg_stamp[reg_addr] = p_vpmctx->opl3_state.reg[reg_addr];
-    p_vpmctx->opl3_state.reg[reg_addr] = value;
+    opl3_reg_set(&p_vpmctx->opl3_state, reg_addr, value);
+    if (OPL3_HOOKS_ATTACHED(p_vpmctx->hooks) &&
+        !opl3_hooks_pre_write(&p_vpmctx->hooks, p_vpmctx->timestamp.current_sample, port, reg, &value)) {
+        return 0;
+    }
 
     p_vpmctx->target_cmd = get_vgm_chip_cmd(p_vpmctx->target_fmchip);
     // Write to VGM stream
@@ -203,6 +287,14 @@ int write_reg(VGMContext *p_vpmctx, int port, uint8_t reg, uint8_t value) {
         p_vpmctx->target_cmd = get_vgm_chip_cmd(FMCHIP_Y8950);
         add_bytes += forward_aadd(p_vpmctx, port, reg, value);
     }
+    if (OPL3_HOOKS_ATTACHED(p_vpmctx->hooks)) {
+        opl3_hooks_post_write(&p_vpmctx->hooks, &p_vpmctx->opl3_state, p_vpmctx->timestamp.current_sample,
+                              port, reg, value, add_bytes);
+    }
+    if (OPL3_METRICS_ON(p_vpmctx->p_metrics)) {
+        opl3_metrics_write(p_vpmctx->p_metrics, &p_vpmctx->opl3_state, p_vpmctx->timestamp.current_sample,
+                           port, reg, value, add_bytes);
+    }
     return add_bytes;
 }
 
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stddef.h> // for size_t
 #include "../opl3/opl3_state.h"
+#include "../opl3/opl3_hooks.h"
 #include "../opll/opll_state.h"
 
 #ifdef __cplusplus
@@ -76,6 +77,13 @@ typedef enum {
     OPLL_ConvertMethod_COMMANDBUFFER,
 } OPLL_ConvertMethod;
 
+/** Where the second YM2413 (VGM dual-chip, 0xA1) is placed in the output */
+typedef enum {
+    OPLL_DualRoute_NONE = 0,     /* single chip: port1 carries the detuned chorus */
+    OPLL_DualRoute_PORT1,        /* chip 2 -> OPL3 port1 channels (chorus off) */
+    OPLL_DualRoute_SECOND_OPL3,  /* chip 2 -> second OPL3 (0xAE/0xAF, clock bit 30) */
+} OPLL_DualRoute;
+
 /** Global debug / diagnostic options */
 typedef struct {
     bool strip_non_opl;       /* Remove AY8910/K051649 etc. from output */
@@ -87,6 +95,8 @@ typedef struct {
     bool verbose;
 } DebugOpts;
 
+struct OPLLOverrideTable;   /* opll/opll_override.h */
+
 typedef struct {
     double detune;
     int    opl3_keyon_wait;
@@ -101,6 +111,8 @@ typedef struct {
     uint16_t min_gate_samples;          // OPLL_MIN_GATE_SAMPLES 相当
     uint16_t pre_keyon_wait_samples;    // OPLL_PRE_KEYON_WAIT_SAMPLES 相当
     uint16_t min_off_on_wait_samples;   // OPLL_MIN_OFF_TO_ON_WAIT_SAMPLES 相当
+    uint16_t keyon_coalesce_samples;    // OPLL_KEYON_COALESCE_SAMPLES 相当 (部分書き込みの保留上限)
+    bool is_keyon_coalesce;             // false: 1n/2n/3n を到着順にそのまま変換 (既定)
     // 追加: ヘッダ整形
     bool strip_unused_chip_clocks;      // 未使用チップのクロックを0化
     uint32_t override_opl3_clock;       // 0 以外なら OPL3 clock を上書き
@@ -115,6 +127,9 @@ typedef struct {
     OPLL_PresetType preset;
     OPLL_PresetSource preset_source;
     OPLL_ConvertMethod opll_convert_method;
+    OPLL_DualRoute dual_route;
+    const struct OPLLOverrideTable *p_overrides;   /* --override (NULL = none) */
+    const char *p_voice_bank_path;      /* --voice-bank (NULL = build the bank in memory) */
     DebugOpts debug;
 } CommandOptions;
 #endif /* ESEOPL3PATCHER_FMCHIPTYPE_DEFINED */
@@ -126,6 +141,7 @@ typedef struct {
     uint8_t *data;     /**< Pointer to the buffer data */
     size_t size;       /**< Current valid byte count */
     size_t capacity;   /**< Allocated capacity in bytes */
+    const OPL3Allocator *p_alloc;   /**< Storage allocator (NULL = malloc); set before the first append */
 } VGMBuffer;
 
 /**
@@ -199,6 +215,11 @@ typedef struct {
  *   - header: VGM header information (raw and parsed).
  *   - gd3: GD3 tag data (raw and/or parsed).
  *   - source_fmchip: The source FM chip type for conversion.
+ *
+ * Threading: all mutable conversion state lives here. Independent conversions may
+ * run on separate threads as long as each owns its own VGMContext (voice bank
+ * included); the only process-wide data are const ROM/LUT tables. Hooks are
+ * registered per context.
  */
 typedef struct {
     VGMBuffer      buffer;              /**< Data buffer for the VGM stream */
@@ -216,8 +237,15 @@ typedef struct {
     OPLLState       opll_state;
     uint8_t         ym2413_user_patch[8]; // YM2413ユーザーパッチ用（0x00〜0x07）
     CommandOptions  cmd_opts;
+    struct OPL3Metrics *p_metrics;   /**< Optional metrics sink (NULL = disabled, nothing allocated) */
+    struct OPL3Profile *p_profile;   /**< Optional stage timer (--profile; NULL = disabled) */
+    struct OPL3Trace   *p_trace;     /**< Optional binary debug trace (--trace; NULL = disabled) */
+    OPL3HookBinding hooks;           /**< Converter hooks (opl3_hooks_attach; zero = none) */
 } VGMContext;
 
+/** Clock bit 30: a second chip of the same type is present (VGM dual-chip) */
+#define VGM_CLOCK_DUAL_BIT 0x40000000u
+
 /**
  * FM chip clocks and flags structure for VGM header analysis.
  * This allows checking which chips are present and flagging them.
@@ -236,6 +264,7 @@ typedef struct {
     bool has_y8950;
     bool has_sn76489;
     bool has_ay8910;
+    bool has_2nd_ym2413;   // bit 30 of the YM2413 clock (0xA1 commands)
 
     // Mark which chips are selected for conversion
     bool convert_ym2413;
@@ -259,6 +288,16 @@ void vgm_buffer_init(VGMBuffer *p_buf);
  */
 void vgm_buffer_append(VGMBuffer *p_buf, const void *p_data, size_t len);
 
+/**
+ * Same, but an allocation failure leaves p_buf unchanged and returns -1 (0 on success).
+ */
+int vgm_buffer_try_append(VGMBuffer *p_buf, const void *p_data, size_t len);
+
+/**
+ * Grow the capacity to at least capacity bytes (size is unchanged).
+ */
+void vgm_buffer_reserve(VGMBuffer *p_buf, size_t capacity);
+
 /**
  * Release memory allocated for a VGMBuffer.
  */
@@ -305,6 +344,21 @@ int vgm_wait_50hz(VGMContext *p_vgmctx);
  */
 bool vgm_parse_chip_clocks(const uint8_t *vgm_data, long filesize, VGMChipClockFlags *out_flags);
 
+/** Fixed command lengths for multi-byte VGM commands (for safe copying) */
+typedef struct {
+    uint8_t code;
+    uint8_t length; // code + params total length
+} VGMFixedCmdLen;
+
+/** Find passthrough command specification by code (NULL if unknown). */
+const VGMFixedCmdLen* vgm_find_fixed_cmd(uint8_t code);
+
+/**
+ * Length of the VGM command at p (VGM 1.71 command table; 0x67 includes its data).
+ * A 0x67 header that is not complete in avail bytes reports 7, so the caller waits for it.
+ */
+uint32_t vgm_cmd_length(const uint8_t *p, size_t avail);
+
 int write_reg(VGMContext *p_vpmctx, int port, uint8_t reg, uint8_t value);
 
 /**
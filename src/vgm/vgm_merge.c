@@ -0,0 +1,218 @@
+#include "vgm_merge.h"
+#include <string.h>
+#include <stdbool.h>
+
+typedef struct {
+    const VGMBuffer *p_buf;
+    size_t   pos;
+    long     loop;        // loop byte position (-1 = none)
+    uint64_t time;        // timeline position at pos
+    bool     loop_seen;
+    uint64_t loop_time;   // timeline position of the loop point
+    bool     has_end;     // 0x66 reached
+} MergeCursor;
+
+/** Length of the VGM command at p, cut to what is left of the buffer. */
+static uint32_t merge_cmd_length(const uint8_t *p, size_t remain) {
+    uint32_t len = vgm_cmd_length(p, remain);
+    return (len > remain) ? (uint32_t)remain : len;
+}
+
+/** Wait length in samples of the command at p (0 = not a wait). 0x8n is not timed, as in the converter. */
+static uint32_t merge_wait_samples(const uint8_t *p, uint32_t len) {
+    uint8_t cmd = p[0];
+    if (cmd >= 0x70 && cmd <= 0x7F) return (uint32_t)(cmd & 0x0F) + 1;
+    if (cmd == 0x61 && len == 3) return (uint32_t)p[1] | ((uint32_t)p[2] << 8);
+    if (cmd == 0x62) return 735;
+    if (cmd == 0x63) return 882;
+    return 0;
+}
+
+static void cursor_mark_loop(MergeCursor *c) {
+    if (c->loop >= 0 && !c->loop_seen && (long)c->pos >= c->loop) {
+        c->loop_seen = true;
+        c->loop_time = c->time;
+    }
+}
+
+/** Consume waits; returns 1 with pos at the next command to copy, 0 at the end of the stream. */
+static int cursor_peek(MergeCursor *c) {
+    const VGMBuffer *p_buf = c->p_buf;
+    while (c->pos < p_buf->size) {
+        cursor_mark_loop(c);
+        const uint8_t *p = p_buf->data + c->pos;
+        if (p[0] == 0x66) {
+            c->has_end = true;
+            c->pos = p_buf->size;
+            break;
+        }
+        uint32_t len = merge_cmd_length(p, p_buf->size - c->pos);
+        uint32_t wait = merge_wait_samples(p, len);
+        if (!wait && p[0] != 0x61) return 1;
+        c->time += wait;
+        c->pos += len;
+    }
+    cursor_mark_loop(c);
+    return 0;
+}
+
+static bool cursor_is_post_loop(const MergeCursor *c) {
+    return c->loop >= 0 && (long)c->pos >= c->loop;
+}
+
+static void merge_emit_wait(VGMBuffer *p_out, uint64_t samples) {
+    while (samples > 0) {
+        if (samples <= 16) {
+            vgm_append_byte(p_out, (uint8_t)(0x70 + samples - 1));
+            return;
+        }
+        if (samples == 735 || samples == 882) {
+            vgm_append_byte(p_out, (samples == 735) ? 0x62 : 0x63);
+            return;
+        }
+        uint16_t n = (samples > 0xFFFF) ? 0xFFFF : (uint16_t)samples;
+        uint8_t bytes[3] = {0x61, (uint8_t)(n & 0xFF), (uint8_t)(n >> 8)};
+        vgm_buffer_append(p_out, bytes, 3);
+        samples -= n;
+    }
+}
+
+static bool is_opl3_channel_reg(uint8_t reg) {
+    return (reg >= 0x20 && reg <= 0x35) || (reg >= 0x40 && reg <= 0x55) ||
+           (reg >= 0x60 && reg <= 0x75) || (reg >= 0x80 && reg <= 0x95) ||
+           (reg >= 0xA0 && reg <= 0xA8) || (reg >= 0xB0 && reg <= 0xB8) ||
+           (reg >= 0xC0 && reg <= 0xC8) || (reg >= 0xE0 && reg <= 0xF5);
+}
+
+/**
+ * Re-address one command of the sub stream. Returns 0 if it must be dropped.
+ * PORT1: port0 channel registers move to port1; chip-global writes stay with the main chip.
+ * SECOND_OPL3: 0x5n -> 0xAn and OPL4 port | 0x80 (VGM dual-chip convention).
+ */
+static int merge_remap_sub(uint8_t *p, uint32_t len, OPLL_DualRoute route) {
+    uint8_t cmd = p[0];
+    if (route == OPLL_DualRoute_SECOND_OPL3) {
+        if ((cmd == 0x5E || cmd == 0x5F || cmd == 0x5C) && len == 3) p[0] = (uint8_t)(cmd + 0x50);
+        else if (cmd == 0xD0 && len == 4) p[1] |= 0x80;
+        return 1;
+    }
+    if (cmd == 0x5E && len == 3) {
+        if (!is_opl3_channel_reg(p[1])) return 0;
+        p[0] = 0x5F;
+        return 1;
+    }
+    if (cmd == 0xD0 && len == 4) {
+        if (p[1] != 0 || !is_opl3_channel_reg(p[2])) return 0;
+        p[1] = 1;
+        return 1;
+    }
+    if (cmd == 0x5F || cmd == 0x5C) return 0;   // port1 / MSX-AUDIO mirror belong to the main chip
+    return 1;                                   // e.g. kept source 0xA1 commands
+}
+
+int vgm_merge_streams(VGMBuffer *p_out, const VGMMergeInput *p_inputs, int count,
+                      VGMMergeSink sink, void *p_user,
+                      long *p_out_loop, uint32_t *p_total_samples) {
+    if (count < 1 || count > VGM_MERGE_MAX_INPUTS) return -1;
+
+    MergeCursor cur[VGM_MERGE_MAX_INPUTS];
+    memset(cur, 0, sizeof(cur));
+    bool loop_pending = false;
+    for (int i = 0; i < count; ++i) {
+        cur[i].p_buf = p_inputs[i].p_buf;
+        cur[i].loop = p_inputs[i].loop;
+        if (cur[i].loop >= 0) loop_pending = true;
+    }
+
+    uint64_t out_time = 0;
+    *p_out_loop = -1;
+
+    for (;;) {
+        // Order: pre-loop before post-loop, then time, earlier input first on ties
+        int pick = -1;
+        for (int i = 0; i < count; ++i) {
+            if (!cursor_peek(&cur[i])) continue;
+            if (pick < 0) { pick = i; continue; }
+            bool post_i = cursor_is_post_loop(&cur[i]);
+            bool post_p = cursor_is_post_loop(&cur[pick]);
+            if (post_i != post_p) {
+                if (!post_i) pick = i;
+            } else if (cur[i].time < cur[pick].time) {
+                pick = i;
+            }
+        }
+        if (pick < 0) break;
+        MergeCursor *c = &cur[pick];
+
+        if (loop_pending && cursor_is_post_loop(c)) {
+            uint64_t loop_time = c->loop_time;
+            for (int i = 0; i < count; ++i) {
+                if (cur[i].loop_seen) { loop_time = cur[i].loop_time; break; }
+            }
+            if (loop_time > out_time) {
+                merge_emit_wait(p_out, loop_time - out_time);
+                out_time = loop_time;
+            }
+            *p_out_loop = (long)p_out->size;
+            loop_pending = false;
+        }
+        if (c->time > out_time) {
+            merge_emit_wait(p_out, c->time - out_time);
+            out_time = c->time;
+        }
+
+        const uint8_t *p = c->p_buf->data + c->pos;
+        uint32_t len = merge_cmd_length(p, c->p_buf->size - c->pos);
+        if (sink) sink(p_user, pick, p, len, p_out);
+        else vgm_buffer_append(p_out, p, len);
+        c->pos += len;
+    }
+
+    // Loop point with nothing after it (or only waits)
+    uint64_t end_time = 0;
+    bool has_end = false;
+    for (int i = 0; i < count; ++i) {
+        if (loop_pending && cur[i].loop_seen) {
+            if (cur[i].loop_time > out_time) {
+                merge_emit_wait(p_out, cur[i].loop_time - out_time);
+                out_time = cur[i].loop_time;
+            }
+            *p_out_loop = (long)p_out->size;
+            loop_pending = false;
+        }
+        if (cur[i].time > end_time) end_time = cur[i].time;
+        has_end |= cur[i].has_end;
+    }
+    if (end_time > out_time) {
+        merge_emit_wait(p_out, end_time - out_time);
+        out_time = end_time;
+    }
+    if (has_end) vgm_append_byte(p_out, 0x66);
+
+    *p_total_samples = (uint32_t)out_time;
+    return 0;
+}
+
+/** Sink for 2xYM2413: input 0 verbatim, input 1 re-addressed by route. */
+static void merge_dual_sink(void *p_user, int source, const uint8_t *p_cmd, uint32_t len, VGMBuffer *p_out) {
+    OPLL_DualRoute route = *(const OPLL_DualRoute *)p_user;
+    if (source == 0 || len > 4) {
+        vgm_buffer_append(p_out, p_cmd, len);
+        return;
+    }
+    uint8_t cmd_bytes[4];
+    memcpy(cmd_bytes, p_cmd, len);
+    if (merge_remap_sub(cmd_bytes, len, route)) vgm_buffer_append(p_out, cmd_bytes, len);
+}
+
+int vgm_merge_dual_streams(VGMBuffer *p_out,
+                           const VGMBuffer *p_main, long main_loop,
+                           const VGMBuffer *p_sub, long sub_loop,
+                           OPLL_DualRoute route,
+                           long *p_out_loop, uint32_t *p_total_samples) {
+    VGMMergeInput inputs[2] = {
+        { p_main, main_loop },
+        { p_sub,  sub_loop  },
+    };
+    return vgm_merge_streams(p_out, inputs, 2, merge_dual_sink, &route, p_out_loop, p_total_samples);
+}
@@ -0,0 +1,47 @@
+#ifndef VGM_MERGE_H
+#define VGM_MERGE_H
+
+#include <stdint.h>
+#include "vgm_helpers.h"
+
+/*
+ * Multi-stream merge (2xYM2413 / multi-chip mixing).
+ *
+ * 追加のソースチップ (0xA1 の2個目の YM2413、YM3812/Y8950 等) は別の
+ * VGMContext で同じ wait 列を受けながら変換し、最後にここで1本の
+ * ストリームへ時刻順に合流させる。書き込みは (ループ前後, 時刻, 入力順)
+ * の順に並べ、wait は合流後のタイムラインで書き直す。
+ * 各コマンドは sink に渡され、sink が出力へ何を書くかを決める
+ * (そのままコピー / port 付け替え / チャンネル割り当て)。
+ */
+#define VGM_MERGE_MAX_INPUTS 8
+
+typedef struct {
+    const VGMBuffer *p_buf;
+    long             loop;     /* byte position of the loop point (-1 = no loop) */
+} VGMMergeInput;
+
+/** Receives every non-wait command of input `source` in merged order. */
+typedef void (*VGMMergeSink)(void *p_user, int source, const uint8_t *p_cmd, uint32_t len, VGMBuffer *p_out);
+
+/**
+ * Merge `count` streams into p_out through sink (NULL = copy verbatim).
+ * Returns 0 (buffer growth aborts on OOM, as everywhere else), -1 if count is out of range.
+ * *p_out_loop receives the loop position in p_out (-1 = none),
+ * *p_total_samples the length of the merged timeline.
+ */
+int vgm_merge_streams(VGMBuffer *p_out, const VGMMergeInput *p_inputs, int count,
+                      VGMMergeSink sink, void *p_user,
+                      long *p_out_loop, uint32_t *p_total_samples);
+
+/**
+ * 2xYM2413: merge p_main and p_sub, re-addressing the sub stream's OPL3 writes
+ * to port1 (0x5F) or to the second OPL3 (0xAE/0xAF) according to route.
+ */
+int vgm_merge_dual_streams(VGMBuffer *p_out,
+                           const VGMBuffer *p_main, long main_loop,
+                           const VGMBuffer *p_sub, long sub_loop,
+                           OPLL_DualRoute route,
+                           long *p_out_loop, uint32_t *p_total_samples);
+
+#endif /* VGM_MERGE_H */
@@ -0,0 +1,208 @@
+#include "vgm_seek.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define SEEK_SAMPLE_RATE 44100
+
+typedef struct {
+    uint8_t lo;
+    uint8_t hi;
+} SeekRegSpan;
+
+/* Snapshot order: voice/frequency first, key registers last so notes start fully set up. */
+static const SeekRegSpan k_opll_order[] = {
+    {0x00, 0x07}, {0x10, 0x18}, {0x30, 0x38}, {0x0E, 0x0E}, {0x20, 0x28}
+};
+static const SeekRegSpan k_opl_order[] = {
+    {0x01, 0x01}, {0x08, 0x08}, {0x20, 0x35}, {0x40, 0x55}, {0x60, 0x75}, {0x80, 0x95},
+    {0xE0, 0xF5}, {0xC0, 0xC8}, {0xA0, 0xA8}, {0xB0, 0xB8}, {0xBD, 0xBD}
+};
+
+static const uint8_t k_chip_cmd[VGM_SEEK_NUM_CHIPS] = { 0x51, 0x5A, 0x5B, 0x5C, 0xA1 };
+
+static int seek_chip_index(uint8_t cmd) {
+    for (int i = 0; i < VGM_SEEK_NUM_CHIPS; ++i) {
+        if (k_chip_cmd[i] == cmd) return i;
+    }
+    return -1;
+}
+
+int vgm_parse_time_spec(const char *p_str, uint64_t *p_samples) {
+    if (!p_str || !*p_str) return -1;
+    char *p_end = NULL;
+    const char *p_colon = strchr(p_str, ':');
+    if (p_colon) {
+        unsigned long min = strtoul(p_str, &p_end, 10);
+        if (p_end != p_colon) return -1;
+        double sec = strtod(p_colon + 1, &p_end);
+        if (*p_end != '\0' || sec < 0.0) return -1;
+        *p_samples = (uint64_t)((min * 60.0 + sec) * SEEK_SAMPLE_RATE + 0.5);
+        return 0;
+    }
+    double v = strtod(p_str, &p_end);
+    if (p_end == p_str || v < 0.0) return -1;
+    if (*p_end == 's' && p_end[1] == '\0') {
+        *p_samples = (uint64_t)(v * SEEK_SAMPLE_RATE + 0.5);
+        return 0;
+    }
+    if (*p_end != '\0') return -1;
+    // A bare number counts samples: "1.5" is a missing "s", not sample 1
+    unsigned long long samples = strtoull(p_str, &p_end, 10);
+    if (*p_end != '\0') return -1;
+    *p_samples = (uint64_t)samples;
+    return 0;
+}
+
+void vgm_seek_init(VGMSeekRange *p_range, uint64_t start, uint64_t end) {
+    memset(p_range, 0, sizeof(*p_range));
+    p_range->start = start;
+    p_range->end = end;
+    p_range->is_active = (start > 0 || end > 0);
+    p_range->phase = (start > 0) ? VGM_SEEK_FORWARD : VGM_SEEK_PLAY;
+}
+
+void vgm_seek_capture(VGMSeekImage *p_images, const OPL3EventCursor *p_cur) {
+    int chip = seek_chip_index(p_cur->cmd);
+    if (chip < 0) return;   // other chips are not reconstructed
+    VGMSeekImage *p_img = &p_images[chip];
+    p_img->reg[p_cur->reg] = p_cur->val;
+    p_img->written[p_cur->reg >> 5] |= 1u << (p_cur->reg & 31);
+}
+
+void vgm_seek_resume_at(VGMSeekRange *p_range, uint64_t pos, const VGMSeekImage *p_images, uint32_t event_index) {
+    if (p_range->phase != VGM_SEEK_FORWARD || pos > p_range->start) return;
+    p_range->pos = pos;
+    p_range->replay = event_index;
+    memcpy(p_range->image, p_images, sizeof(p_range->image));
+}
+
+/**
+ * Before start: commands that only set up state pass through (0x67 data blocks, 0x68 PCM RAM
+ * writes, DAC stream setup, other chips' registers, ...). Dropped are the ones that start sound
+ * on their own timeline: 0x8n (YM2612 DAC write + wait) and 0x93 / 0x95 (DAC stream start).
+ */
+static bool seek_is_state_cmd(const OPL3EventCursor *p_cur) {
+    uint8_t cmd = p_cur->cmd;
+    if (p_cur->type == OPL3_EVENT_WAIT || cmd == 0x66 || seek_chip_index(cmd) >= 0) return false;
+    if (cmd >= 0x80 && cmd <= 0x8F) return false;
+    return cmd != 0x93 && cmd != 0x95;
+}
+
+/** Produce the next snapshot write; returns 0 when the snapshot is complete. */
+static int seek_snapshot_next(VGMSeekRange *p_range, OPL3EventCursor *p_cur) {
+    for (; p_range->snap_chip < VGM_SEEK_NUM_CHIPS; ++p_range->snap_chip, p_range->snap_idx = 0) {
+        const VGMSeekImage *p_img = &p_range->image[p_range->snap_chip];
+        bool is_opll = (k_chip_cmd[p_range->snap_chip] == 0x51 || k_chip_cmd[p_range->snap_chip] == 0xA1);
+        const SeekRegSpan *p_order = is_opll ? k_opll_order : k_opl_order;
+        int n_spans = is_opll
+            ? (int)(sizeof(k_opll_order) / sizeof(k_opll_order[0]))
+            : (int)(sizeof(k_opl_order) / sizeof(k_opl_order[0]));
+
+        // snap_idx walks the flattened span list
+        int idx = 0;
+        for (int s = 0; s < n_spans; ++s) {
+            for (int r = p_order[s].lo; r <= p_order[s].hi; ++r, ++idx) {
+                if (idx < p_range->snap_idx) continue;
+                p_range->snap_idx = idx + 1;
+                if (!(p_img->written[r >> 5] & (1u << (r & 31)))) continue;
+                p_cur->type = OPL3_EVENT_CONTROL;
+                p_cur->cmd = k_chip_cmd[p_range->snap_chip];
+                p_cur->reg = (uint8_t)r;
+                p_cur->val = p_img->reg[r];
+                p_cur->arg = 3;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/** Turn p_cur into a wait of `samples`, trimmed to end; advances pos. */
+static void seek_deliver_wait(VGMSeekRange *p_range, OPL3EventCursor *p_cur, uint32_t samples) {
+    if (p_range->end && p_range->pos + samples > p_range->end) {
+        samples = (uint32_t)(p_range->end - p_range->pos);
+    }
+    if (samples != p_cur->arg || p_cur->type != OPL3_EVENT_WAIT) {
+        p_cur->type = OPL3_EVENT_WAIT;
+        p_cur->cmd = 0x61;
+        p_cur->reg = 0;
+        p_cur->val = 0;
+        p_cur->arg = samples;
+    }
+    p_range->pos += samples;
+}
+
+static void seek_deliver_end(VGMSeekRange *p_range, OPL3EventCursor *p_cur) {
+    p_cur->type = OPL3_EVENT_SYSTEM;
+    p_cur->cmd = 0x66;
+    p_cur->reg = 0;
+    p_cur->val = 0;
+    p_cur->arg = 1;
+    p_range->phase = VGM_SEEK_FINISHED;
+}
+
+int vgm_seek_next(VGMSeekRange *p_range, OPL3EventCursor *p_cur) {
+    if (!p_range->is_active) return opl3_event_next(p_cur);
+
+    for (;;) {
+        switch (p_range->phase) {
+        case VGM_SEEK_FORWARD:
+            if (p_range->pos >= p_range->start) {
+                p_range->phase = VGM_SEEK_SNAPSHOT;
+                continue;
+            }
+            if (!opl3_event_next(p_cur)) return 0;
+            if (p_range->replay) {
+                // Up to the checkpoint: the image and pos are already known
+                p_range->replay--;
+                if (seek_is_state_cmd(p_cur)) return 1;
+                continue;
+            }
+            if (p_cur->type == OPL3_EVENT_WAIT) {
+                if (p_range->pos + p_cur->arg <= p_range->start) {
+                    p_range->pos += p_cur->arg;
+                } else {
+                    p_range->carry = (uint32_t)(p_range->pos + p_cur->arg - p_range->start);
+                    p_range->pos = p_range->start;
+                }
+                continue;
+            }
+            if (p_cur->cmd == 0x66) {
+                p_range->phase = VGM_SEEK_FINISHED;  // data ended before start
+                return 1;
+            }
+            if (seek_is_state_cmd(p_cur)) return 1;
+            vgm_seek_capture(p_range->image, p_cur);
+            continue;
+
+        case VGM_SEEK_SNAPSHOT:
+            if (seek_snapshot_next(p_range, p_cur)) return 1;
+            p_range->phase = VGM_SEEK_PLAY;
+            if (p_range->carry) {
+                uint32_t carry = p_range->carry;
+                p_range->carry = 0;
+                p_cur->type = OPL3_EVENT_NONE;
+                seek_deliver_wait(p_range, p_cur, carry);
+                return 1;
+            }
+            continue;
+
+        case VGM_SEEK_PLAY:
+            if (p_range->end && p_range->pos >= p_range->end) {
+                seek_deliver_end(p_range, p_cur);
+                return 1;
+            }
+            if (!opl3_event_next(p_cur)) return 0;
+            if (p_cur->type == OPL3_EVENT_WAIT) {
+                seek_deliver_wait(p_range, p_cur, p_cur->arg);
+            } else if (p_cur->cmd == 0x66) {
+                p_range->phase = VGM_SEEK_FINISHED;
+            }
+            return 1;
+
+        case VGM_SEEK_FINISHED:
+        default:
+            return 0;
+        }
+    }
+}
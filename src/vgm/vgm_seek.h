@@ -0,0 +1,71 @@
+#ifndef VGM_SEEK_H
+#define VGM_SEEK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../opl3/opl3_event.h"
+
+/*
+ * Time-range conversion (--start / --end)
+ *
+ * start より前のソースチップ書き込みは出力せず、レジスタイメージへ
+ * 取り込むだけ (state-only fast-forward)。start 到達時に書き込み済み
+ * レジスタだけを正規順で合成イベントとして流し (最小スナップショット)、
+ * 以降は通常変換。end で wait を切り詰めて合成 0x66 を返す。
+ * start より前の wait は捨てるが、状態を作るだけのコマンド (0x67 データブロック、
+ * PCM RAM 書き込み、DAC ストリーム設定、他チップのレジスタ) はそのまま流す。
+ *
+ * vgm_seek_next() は opl3_event_next() の置き換えで、back end の
+ * コマンド処理はそのまま使える。範囲指定が無ければ素通し。
+ */
+#define VGM_SEEK_NUM_CHIPS 5   /* 0x51 YM2413, 0x5A YM3812, 0x5B YM3526, 0x5C Y8950, 0xA1 2nd YM2413 */
+
+typedef enum {
+    VGM_SEEK_PLAY = 0,      // normal conversion (also: range inactive)
+    VGM_SEEK_FORWARD,       // before start: capture writes only
+    VGM_SEEK_SNAPSHOT,      // emitting the register snapshot at start
+    VGM_SEEK_FINISHED       // end reached (synthetic or real 0x66 delivered)
+} VGMSeekPhase;
+
+typedef struct {
+    uint8_t  reg[0x100];
+    uint32_t written[0x100 / 32];   // registers touched before start
+} VGMSeekImage;
+
+typedef struct {
+    bool         is_active;
+    VGMSeekPhase phase;
+    uint64_t     start;       // first sample to output (source timeline)
+    uint64_t     end;         // last sample (exclusive); 0 = until end of data
+    uint64_t     pos;         // source timeline position
+    uint32_t     carry;       // part of the wait that straddled start
+    uint32_t     replay;      // events before a checkpoint still to scan for state commands
+    int          snap_chip;   // snapshot cursor
+    int          snap_idx;
+    VGMSeekImage image[VGM_SEEK_NUM_CHIPS];
+} VGMSeekRange;
+
+/**
+ * Parse a time spec: "<samples>", "<seconds>s" or "<min>:<sec>" (44.1kHz).
+ * Samples are a whole number. Returns 0 on success, -1 on malformed input.
+ */
+int  vgm_parse_time_spec(const char *p_str, uint64_t *p_samples);
+
+/** start = end = 0 leaves the range inactive (vgm_seek_next == opl3_event_next). */
+void vgm_seek_init(VGMSeekRange *p_range, uint64_t start, uint64_t end);
+
+/** Record a source chip write into its register image (ignored for non-OPL chips). */
+void vgm_seek_capture(VGMSeekImage *p_images, const OPL3EventCursor *p_cur);
+
+/**
+ * Continue fast-forwarding from a known position (checkpoint #event_index) instead of the top.
+ * The cursor stays at the top: the first event_index events are only scanned for the state
+ * commands that pass through, then capture continues from pos and p_images.
+ * pos must not be past start.
+ */
+void vgm_seek_resume_at(VGMSeekRange *p_range, uint64_t pos, const VGMSeekImage *p_images, uint32_t event_index);
+
+/** Next event inside the range (snapshot and trimmed waits are synthesized). */
+int  vgm_seek_next(VGMSeekRange *p_range, OPL3EventCursor *p_cur);
+
+#endif // VGM_SEEK_H
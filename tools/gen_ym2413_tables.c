@@ -0,0 +1,141 @@
+/*
+ * gen_ym2413_tables.c
+ *
+ * Build-time generator for ym2413_rate_tables.h.
+ * correct_opl3_voice_param() の最近傍探索 (float の時間テーブル / KSL dB / MULT)
+ * をここで事前計算し、実行時は整数 LUT を引くだけにする。
+ *
+ * Usage: gen_ym2413_tables <output.h>   (invoked from the Makefile)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
+#include "../src/opll/ym2413_rate_defs.h"
+
+/* Nearest rate by envelope time (same tie rule as the old runtime search: first wins) */
+static int best_rate(float target_ms, const float *p_tbl) {
+    int best = 0;
+    float min_diff = 1e9f;
+    for (int i = 0; i < 16; ++i) {
+        float diff = fabsf(p_tbl[i] - target_ms);
+        if (diff < min_diff) { min_diff = diff; best = i; }
+    }
+    return best;
+}
+
+static int ksl_db_from_atten(int ksl, int atten) {
+    return (ksl == 0) ? 0 : (atten << ksl);
+}
+
+static int best_ksl_for_db(int db, int atten_dst) {
+    int best = 0, min_diff = 1000000000;
+    for (int ksl = 0; ksl < 4; ++ksl) {
+        int diff = abs(db - ksl_db_from_atten(ksl, atten_dst));
+        if (diff < min_diff) { min_diff = diff; best = ksl; }
+    }
+    return best;
+}
+
+static int best_mult(int mult_opll) {
+    int v = ym2413_mult_x2[mult_opll & 0xF];
+    int best = 0, min_diff = 1000000000;
+    for (int m = 0; m < 16; ++m) {
+        int diff = abs(v - ym2413_mult_x2[m]);
+        if (diff < min_diff) { min_diff = diff; best = m; }
+    }
+    return best;
+}
+
+static void emit_row(FILE *fp, const char *p_indent, const int *p_vals, int n) {
+    fprintf(fp, "%s", p_indent);
+    for (int i = 0; i < n; ++i) fprintf(fp, "%s%2d", i ? "," : "", p_vals[i]);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <output.h>\n", argv[0]);
+        return 2;
+    }
+
+    /* Collapse (block, fnum4) into distinct attenuation bands */
+    int band_atten[128];
+    int num_bands = 0;
+    int band_of[8][16];
+    for (int b = 0; b < 8; ++b) {
+        for (int f = 0; f < 16; ++f) {
+            int a = ym2413_ksl_atten(b, f);
+            int k = 0;
+            while (k < num_bands && band_atten[k] != a) ++k;
+            if (k == num_bands) band_atten[num_bands++] = a;
+            band_of[b][f] = k;
+        }
+    }
+
+    FILE *fp = fopen(argv[1], "w");
+    if (!fp) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fprintf(fp, "/* Generated by tools/gen_ym2413_tables.c from src/opll/ym2413_rate_defs.h. Do not edit. */\n");
+    fprintf(fp, "#ifndef YM2413_RATE_TABLES_H\n#define YM2413_RATE_TABLES_H\n\n#include <stdint.h>\n\n");
+
+    int row[128];
+
+    fprintf(fp, "/* OPLL AR/DR -> nearest OPL3 AR/DR by envelope time */\n");
+    for (int i = 0; i < 16; ++i) row[i] = best_rate(ym2413_rate_to_attack_time[i], ym2413_rate_to_attack_time);
+    fprintf(fp, "static const uint8_t ym2413_ar_remap[16] = {");
+    emit_row(fp, "", row, 16);
+    fprintf(fp, "};\n");
+    for (int i = 0; i < 16; ++i) row[i] = best_rate(ym2413_rate_to_decay_time[i], ym2413_rate_to_decay_time);
+    fprintf(fp, "static const uint8_t ym2413_dr_remap[16] = {");
+    emit_row(fp, "", row, 16);
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "/* OPLL MULT -> nearest OPL3 MULT by effective ratio */\n");
+    for (int i = 0; i < 16; ++i) row[i] = best_mult(i);
+    fprintf(fp, "static const uint8_t ym2413_mult_remap[16] = {");
+    emit_row(fp, "", row, 16);
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "/* TL 0-15 -> 0-63 scale (6-bit field) */\n");
+    for (int i = 0; i < 64; ++i) row[i] = (uint8_t)((i * 63 + 7) / 15);
+    fprintf(fp, "static const uint8_t ym2413_tl_remap[64] = {\n");
+    for (int i = 0; i < 64; i += 16) {
+        emit_row(fp, "    ", &row[i], 16);
+        fprintf(fp, "%s\n", (i + 16 < 64) ? "," : "");
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "/* (block, fnum>>6) -> KSL attenuation band */\n");
+    fprintf(fp, "#define YM2413_KSL_NUM_BANDS %d\n", num_bands);
+    fprintf(fp, "static const uint8_t ym2413_ksl_band[8][16] = {\n");
+    for (int b = 0; b < 8; ++b) {
+        fprintf(fp, "    {");
+        emit_row(fp, "", band_of[b], 16);
+        fprintf(fp, "}%s\n", (b < 7) ? "," : "");
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "/* [KSL][OPLL band][OPL3 band] -> OPL3 KSL with the closest dB attenuation */\n");
+    fprintf(fp, "static const uint8_t ym2413_ksl_remap[4][YM2413_KSL_NUM_BANDS][YM2413_KSL_NUM_BANDS] = {\n");
+    for (int ksl = 0; ksl < 4; ++ksl) {
+        fprintf(fp, "    {\n");
+        for (int s = 0; s < num_bands; ++s) {
+            int db = ksl_db_from_atten(ksl, band_atten[s]);
+            for (int d = 0; d < num_bands; ++d) row[d] = best_ksl_for_db(db, band_atten[d]);
+            fprintf(fp, "        {");
+            emit_row(fp, "", row, num_bands);
+            fprintf(fp, "}%s\n", (s < num_bands - 1) ? "," : "");
+        }
+        fprintf(fp, "    }%s\n", (ksl < 3) ? "," : "");
+    }
+    fprintf(fp, "};\n\n#endif /* YM2413_RATE_TABLES_H */\n");
+
+    if (fclose(fp) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    return 0;
+}